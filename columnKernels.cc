@@ -0,0 +1,402 @@
+/// @file columnKernels.cc
+/// @author luliang@ict.ac.cn
+/// @copybrief Copyright 2013 ICT, CAS. All rights reserved.
+/// @version 0.1
+/// @date 2026-10-19
+
+#include "columnKernels.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <pthread.h>
+#include <unistd.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define COLUMN_KERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+typedef void (*AggregateKernel)(const double *values, int count,
+		ColumnAggregate *aggregate);
+
+static void initAggregate(ColumnAggregate *aggregate) {
+	aggregate->count_ = 0;
+	aggregate->sum_ = 0;
+	aggregate->min_ = HUGE_VAL;
+	aggregate->max_ = -HUGE_VAL;
+	aggregate->mean_ = 0;
+}
+
+static void mergeAggregate(ColumnAggregate *to, const ColumnAggregate &from) {
+	to->count_ += from.count_;
+	to->sum_ += from.sum_;
+	if (from.min_ < to->min_)
+		to->min_ = from.min_;
+	if (from.max_ > to->max_)
+		to->max_ = from.max_;
+}
+
+static void finishAggregate(ColumnAggregate *aggregate) {
+	if (aggregate->count_ > 0) {
+		aggregate->mean_ = aggregate->sum_ / aggregate->count_;
+	} else {
+		aggregate->min_ = aggregate->max_ = 0;
+		aggregate->mean_ = 0;
+	}
+}
+
+// adds values to aggregate.
+static void aggregateScalar(const double *values, int count,
+		ColumnAggregate *aggregate) {
+	int n = 0;
+	double sum = 0, min = aggregate->min_, max = aggregate->max_;
+	for (int i = 0; i < count; ++i) {
+		double value = values[i];
+		if (value != value)
+			continue;
+		++n;
+		sum += value;
+		if (value < min)
+			min = value;
+		if (value > max)
+			max = value;
+	}
+	aggregate->count_ += n;
+	aggregate->sum_ += sum;
+	aggregate->min_ = min;
+	aggregate->max_ = max;
+}
+
+#ifdef COLUMN_KERNELS_X86
+static void aggregateSse2(const double *values, int count,
+		ColumnAggregate *aggregate) {
+	const __m128d one = _mm_set1_pd(1.0);
+	const __m128d inf = _mm_set1_pd(HUGE_VAL);
+	const __m128d neginf = _mm_set1_pd(-HUGE_VAL);
+	__m128d sum = _mm_setzero_pd(), n = _mm_setzero_pd();
+	__m128d min = inf, max = neginf;
+	int i = 0;
+	for (; i + 2 <= count; i += 2) {
+		__m128d value = _mm_loadu_pd(values + i);
+		__m128d valid = _mm_cmpord_pd(value, value);
+		sum = _mm_add_pd(sum, _mm_and_pd(valid, value));
+		n = _mm_add_pd(n, _mm_and_pd(valid, one));
+		min = _mm_min_pd(min,
+				_mm_or_pd(_mm_and_pd(valid, value), _mm_andnot_pd(valid, inf)));
+		max = _mm_max_pd(max,
+				_mm_or_pd(_mm_and_pd(valid, value),
+						_mm_andnot_pd(valid, neginf)));
+	}
+	double lanes[4][2];
+	_mm_storeu_pd(lanes[0], sum);
+	_mm_storeu_pd(lanes[1], n);
+	_mm_storeu_pd(lanes[2], min);
+	_mm_storeu_pd(lanes[3], max);
+	ColumnAggregate partial;
+	partial.count_ = (int) (lanes[1][0] + lanes[1][1]);
+	partial.sum_ = lanes[0][0] + lanes[0][1];
+	partial.min_ = lanes[2][0] < lanes[2][1] ? lanes[2][0] : lanes[2][1];
+	partial.max_ = lanes[3][0] > lanes[3][1] ? lanes[3][0] : lanes[3][1];
+	mergeAggregate(aggregate, partial);
+	aggregateScalar(values + i, count - i, aggregate);
+}
+
+__attribute__((target("avx2")))
+static void aggregateAvx2(const double *values, int count,
+		ColumnAggregate *aggregate) {
+	const __m256d one = _mm256_set1_pd(1.0);
+	const __m256d inf = _mm256_set1_pd(HUGE_VAL);
+	const __m256d neginf = _mm256_set1_pd(-HUGE_VAL);
+	// two sets of accumulators hide the add latency.
+	__m256d sum0 = _mm256_setzero_pd(), sum1 = _mm256_setzero_pd();
+	__m256d n0 = _mm256_setzero_pd(), n1 = _mm256_setzero_pd();
+	__m256d min0 = inf, min1 = inf, max0 = neginf, max1 = neginf;
+	int i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256d a = _mm256_loadu_pd(values + i);
+		__m256d b = _mm256_loadu_pd(values + i + 4);
+		__m256d va = _mm256_cmp_pd(a, a, _CMP_ORD_Q);
+		__m256d vb = _mm256_cmp_pd(b, b, _CMP_ORD_Q);
+		sum0 = _mm256_add_pd(sum0, _mm256_and_pd(va, a));
+		sum1 = _mm256_add_pd(sum1, _mm256_and_pd(vb, b));
+		n0 = _mm256_add_pd(n0, _mm256_and_pd(va, one));
+		n1 = _mm256_add_pd(n1, _mm256_and_pd(vb, one));
+		min0 = _mm256_min_pd(min0, _mm256_blendv_pd(inf, a, va));
+		min1 = _mm256_min_pd(min1, _mm256_blendv_pd(inf, b, vb));
+		max0 = _mm256_max_pd(max0, _mm256_blendv_pd(neginf, a, va));
+		max1 = _mm256_max_pd(max1, _mm256_blendv_pd(neginf, b, vb));
+	}
+	double lanes[4][4];
+	_mm256_storeu_pd(lanes[0], _mm256_add_pd(sum0, sum1));
+	_mm256_storeu_pd(lanes[1], _mm256_add_pd(n0, n1));
+	_mm256_storeu_pd(lanes[2], _mm256_min_pd(min0, min1));
+	_mm256_storeu_pd(lanes[3], _mm256_max_pd(max0, max1));
+	ColumnAggregate partial;
+	initAggregate(&partial);
+	double n = 0;
+	for (int lane = 0; lane < 4; ++lane) {
+		partial.sum_ += lanes[0][lane];
+		n += lanes[1][lane];
+		if (lanes[2][lane] < partial.min_)
+			partial.min_ = lanes[2][lane];
+		if (lanes[3][lane] > partial.max_)
+			partial.max_ = lanes[3][lane];
+	}
+	partial.count_ = (int) n;
+	mergeAggregate(aggregate, partial);
+	aggregateScalar(values + i, count - i, aggregate);
+}
+#endif
+
+static AggregateKernel aggregateKernel = NULL;
+static const char *kernelName = NULL;
+static pthread_once_t kernelOnce = PTHREAD_ONCE_INIT;
+
+static void selectAggregateKernel() {
+#ifdef COLUMN_KERNELS_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		kernelName = "avx2";
+		aggregateKernel = aggregateAvx2;
+	} else if (__builtin_cpu_supports("sse2")) {
+		kernelName = "sse2";
+		aggregateKernel = aggregateSse2;
+	}
+#endif
+	if (aggregateKernel == NULL) {
+		kernelName = "scalar";
+		aggregateKernel = aggregateScalar;
+	}
+}
+
+static AggregateKernel getAggregateKernel() {
+	// the column workers may ask first from several threads at once.
+	pthread_once(&kernelOnce, selectAggregateKernel);
+	return aggregateKernel;
+}
+
+const char *getColumnKernelName() {
+	getAggregateKernel();
+	return kernelName;
+}
+
+typedef enum {
+	TASK_AGGREGATE, TASK_HISTOGRAM, TASK_GROUPS
+} ColumnTaskKind;
+
+typedef struct {
+	ColumnTaskKind kind_;
+	const double *values_;
+	const int *groups_;
+	int start_, end_;
+	// histogram
+	double min_, max_, scale_;
+	int bincount_;
+	int *counts_;
+	// aggregate and groups
+	int groupcount_;
+	ColumnAggregate *aggregates_;
+} ColumnTask;
+
+// adds the values of the task range to the aggregates of their groups. The
+// values are first gathered into one contiguous run per group, a counting
+// sort, and every run then goes through the aggregate kernel; one value at a
+// time is left for when the runs find no memory.
+static void aggregateGroupRange(const ColumnTask *task) {
+	int count = task->end_ - task->start_;
+	int groupcount = task->groupcount_;
+	const double *values = task->values_ + task->start_;
+	const int *groups = task->groups_ + task->start_;
+	int *starts = (int *) calloc(groupcount + 1, sizeof(int));
+	int *cursors = (int *) malloc(sizeof(int) * (groupcount + 1));
+	double *runs = (double *) malloc(sizeof(double) * (count + 1));
+	if (starts && cursors && runs) {
+		for (int i = 0; i < count; ++i) {
+			int group = groups[i];
+			if (values[i] == values[i] && group >= 0 && group < groupcount)
+				++starts[group + 1];
+		}
+		for (int i = 0; i < groupcount; ++i)
+			starts[i + 1] += starts[i];
+		memcpy(cursors, starts, sizeof(int) * groupcount);
+		for (int i = 0; i < count; ++i) {
+			int group = groups[i];
+			if (values[i] == values[i] && group >= 0 && group < groupcount)
+				runs[cursors[group]++] = values[i];
+		}
+		AggregateKernel kernel = getAggregateKernel();
+		for (int i = 0; i < groupcount; ++i)
+			kernel(runs + starts[i], starts[i + 1] - starts[i],
+					task->aggregates_ + i);
+	} else {
+		for (int i = 0; i < count; ++i) {
+			double value = values[i];
+			int group = groups[i];
+			if (value != value || group < 0 || group >= groupcount)
+				continue;
+			ColumnAggregate *aggregate = task->aggregates_ + group;
+			++aggregate->count_;
+			aggregate->sum_ += value;
+			if (value < aggregate->min_)
+				aggregate->min_ = value;
+			if (value > aggregate->max_)
+				aggregate->max_ = value;
+		}
+	}
+	if (starts)
+		free(starts);
+	if (cursors)
+		free(cursors);
+	if (runs)
+		free(runs);
+}
+
+static void *runColumnTask(void *arg) {
+	ColumnTask *task = (ColumnTask *) arg;
+	const double *values = task->values_;
+	switch (task->kind_) {
+	case TASK_AGGREGATE:
+		getAggregateKernel()(values + task->start_, task->end_ - task->start_,
+				task->aggregates_);
+		break;
+	case TASK_HISTOGRAM:
+		for (int i = task->start_; i < task->end_; ++i) {
+			double value = values[i];
+			if (!(value >= task->min_ && value <= task->max_))
+				continue;
+			int bin = (int) ((value - task->min_) * task->scale_);
+			if (bin >= task->bincount_)
+				bin = task->bincount_ - 1;
+			++task->counts_[bin];
+		}
+		break;
+	case TASK_GROUPS:
+		aggregateGroupRange(task);
+		break;
+	}
+	return NULL;
+}
+
+// splits task over threads, each with outputs of its own, and merges them
+// into the outputs of task.
+static void runColumnTasks(const ColumnTask &task, int count) {
+	long threadcount = 1;
+	if (count > COLUMN_PARALLEL_COUNT) {
+		threadcount = sysconf(_SC_NPROCESSORS_ONLN);
+		if (threadcount < 1)
+			threadcount = 1;
+		if (threadcount > count / (COLUMN_PARALLEL_COUNT / 4))
+			threadcount = count / (COLUMN_PARALLEL_COUNT / 4);
+	}
+	int outputs = task.kind_ == TASK_HISTOGRAM ? task.bincount_ :
+			task.kind_ == TASK_GROUPS ? task.groupcount_ : 1;
+	ColumnTask *tasks = NULL;
+	pthread_t *threads = NULL;
+	void *buffers = NULL;
+	if (threadcount > 1) {
+		tasks = (ColumnTask *) malloc(sizeof(ColumnTask) * threadcount);
+		threads = (pthread_t *) malloc(sizeof(pthread_t) * threadcount);
+		buffers = calloc(threadcount * outputs,
+				task.kind_ == TASK_HISTOGRAM ?
+						sizeof(int) : sizeof(ColumnAggregate));
+	}
+	if (tasks == NULL || threads == NULL || buffers == NULL) {
+		if (tasks)
+			free(tasks);
+		if (threads)
+			free(threads);
+		if (buffers)
+			free(buffers);
+		ColumnTask single = task;
+		single.start_ = 0;
+		single.end_ = count;
+		runColumnTask(&single);
+		return;
+	}
+
+	int started = 0;
+	for (int i = 0; i < threadcount; ++i) {
+		tasks[i] = task;
+		tasks[i].start_ = (int) ((long long) count * i / threadcount);
+		tasks[i].end_ = (int) ((long long) count * (i + 1) / threadcount);
+		if (task.kind_ == TASK_HISTOGRAM) {
+			tasks[i].counts_ = (int *) buffers + i * outputs;
+		} else {
+			tasks[i].aggregates_ = (ColumnAggregate *) buffers + i * outputs;
+			for (int j = 0; j < outputs; ++j)
+				initAggregate(tasks[i].aggregates_ + j);
+		}
+		// the rest run on this thread if a thread does not start.
+		if (i == started
+				&& pthread_create(&threads[i], NULL, runColumnTask, &tasks[i])
+						== 0)
+			++started;
+	}
+	for (int i = started; i < threadcount; ++i)
+		runColumnTask(&tasks[i]);
+	for (int i = 0; i < started; ++i)
+		pthread_join(threads[i], NULL);
+
+	for (int i = 0; i < threadcount; ++i) {
+		for (int j = 0; j < outputs; ++j) {
+			if (task.kind_ == TASK_HISTOGRAM)
+				task.counts_[j] += tasks[i].counts_[j];
+			else
+				mergeAggregate(task.aggregates_ + j, tasks[i].aggregates_[j]);
+		}
+	}
+	free(tasks);
+	free(threads);
+	free(buffers);
+}
+
+void aggregateColumn(const double *values, int count,
+		ColumnAggregate *aggregate) {
+	initAggregate(aggregate);
+	ColumnTask task;
+	memset(&task, 0, sizeof(task));
+	task.kind_ = TASK_AGGREGATE;
+	task.values_ = values;
+	task.groupcount_ = 1;
+	task.aggregates_ = aggregate;
+	runColumnTasks(task, count);
+	finishAggregate(aggregate);
+}
+
+void histogramColumn(const double *values, int count, double min, double max,
+		int bincount, int *counts) {
+	if (bincount <= 0)
+		return;
+	memset(counts, 0, sizeof(int) * bincount);
+	if (!(max >= min))
+		return;
+	ColumnTask task;
+	memset(&task, 0, sizeof(task));
+	task.kind_ = TASK_HISTOGRAM;
+	task.values_ = values;
+	task.min_ = min;
+	task.max_ = max;
+	task.scale_ = max > min ? bincount / (max - min) : 0;
+	task.bincount_ = bincount;
+	task.counts_ = counts;
+	runColumnTasks(task, count);
+}
+
+void aggregateGroups(const double *values, const int *groups, int count,
+		int groupcount, ColumnAggregate *aggregates) {
+	for (int i = 0; i < groupcount; ++i)
+		initAggregate(aggregates + i);
+	ColumnTask task;
+	memset(&task, 0, sizeof(task));
+	task.kind_ = TASK_GROUPS;
+	task.values_ = values;
+	task.groups_ = groups;
+	task.groupcount_ = groupcount;
+	task.aggregates_ = aggregates;
+	runColumnTasks(task, count);
+	for (int i = 0; i < groupcount; ++i)
+		finishAggregate(aggregates + i);
+}
@@ -0,0 +1,41 @@
+/// @file columnKernels.h
+/// @author luliang@ict.ac.cn
+/// @copybrief Copyright 2013 ICT, CAS. All rights reserved.
+/// @version 0.1
+/// @date 2026-10-19
+
+#ifndef COLUMNKERNELS_H_
+#define COLUMNKERNELS_H_
+
+typedef struct {
+	int count_;
+	double sum_;
+	double min_;
+	double max_;
+	double mean_;
+} ColumnAggregate;
+
+// Aggregates of contiguous double columns. The kernels use AVX2 or SSE2 when
+// the cpu has them, found out once at run time, and a scalar loop elsewhere.
+// Columns longer than COLUMN_PARALLEL_COUNT are split over one thread per
+// cpu. NaN values are skipped.
+static const int COLUMN_PARALLEL_COUNT = 1 << 18;
+
+void aggregateColumn(const double *values, int count,
+		ColumnAggregate *aggregate);
+
+// counts of bincount equal bins over [min, max]; values outside are not
+// counted, max falls in the last bin. counts is zeroed first.
+void histogramColumn(const double *values, int count, double min, double max,
+		int bincount, int *counts);
+
+// aggregates of values by group: groups[i] in [0, groupcount) is the group
+// of values[i]. The values are sorted into a run per group, which the
+// aggregate kernel then sums.
+void aggregateGroups(const double *values, const int *groups, int count,
+		int groupcount, ColumnAggregate *aggregates);
+
+// name of the kernels in use: "avx2", "sse2" or "scalar".
+const char *getColumnKernelName();
+
+#endif /* COLUMNKERNELS_H_ */
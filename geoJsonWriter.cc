@@ -0,0 +1,654 @@
+/// @file geoJsonWriter.cc
+/// @author luliang@ict.ac.cn
+/// @copybrief Copyright 2013 ICT, CAS. All rights reserved.
+/// @version 0.1
+/// @date 2026-10-19
+
+#include "geoJsonWriter.h"
+#include "wkbReader.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// powers of ten exactly representable as doubles.
+static const double POW10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8,
+		1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19,
+		1e20, 1e21, 1e22 };
+static const int MAX_FIXED_DIGITS = 17;
+static const double MAX_EXACT_INTEGER = 9007199254740992.0; // 2^53
+
+static const char *GEOMETRY_NAMES[] = { "", "Point", "LineString", "Polygon",
+		"MultiPoint", "MultiLineString", "MultiPolygon", "GeometryCollection" };
+
+static char *writeDigits(unsigned long long value, char *text) {
+	char digits[24];
+	int count = 0;
+	do {
+		digits[count++] = (char) ('0' + value % 10);
+		value /= 10;
+	} while (value > 0);
+	while (count > 0)
+		*text++ = digits[--count];
+	return text;
+}
+
+// mantissa / 10^digits, without trailing zeros.
+static char *writeFixed(unsigned long long mantissa, int digits, char *text) {
+	unsigned long long scale = 1;
+	for (int i = 0; i < digits; ++i)
+		scale *= 10;
+	text = writeDigits(mantissa / scale, text);
+	unsigned long long fraction = mantissa % scale;
+	if (fraction == 0)
+		return text;
+	while (fraction % 10 == 0) {
+		fraction /= 10;
+		--digits;
+	}
+	*text++ = '.';
+	char *end = text + digits;
+	for (char *p = end; p > text; fraction /= 10)
+		*--p = (char) ('0' + fraction % 10);
+	return end;
+}
+
+int formatDouble(double value, int precision, char *text) {
+	char *p = text;
+	if (value != value || value - value != 0) {
+		memcpy(text, "null", 4);
+		return 4;
+	}
+	if (value == 0) {
+		*p = '0';
+		return 1;
+	}
+	if (value < 0) {
+		*p++ = '-';
+		value = -value;
+	}
+
+	if (precision >= 0) {
+		if (precision > MAX_FIXED_DIGITS)
+			precision = MAX_FIXED_DIGITS;
+		double scaled = floor(value * POW10[precision] + 0.5);
+		if (scaled == 0) {
+			*text = '0';
+			return 1;
+		}
+		if (scaled < MAX_EXACT_INTEGER)
+			return writeFixed((unsigned long long) scaled, precision, p) - text;
+		// past 2^53 the fixed digits are no more exact than the shortest
+		// text, which fits where hundreds of fixed digits would not.
+	}
+
+	// fast path: the fewest decimals whose rounded mantissa reads back as
+	// value. mantissa and power of ten are exact doubles, so the division
+	// rounds just like strtod() of the text does.
+	for (int digits = 0; digits <= MAX_FIXED_DIGITS; ++digits) {
+		double scaled = value * POW10[digits];
+		if (scaled >= MAX_EXACT_INTEGER)
+			break;
+		double mantissa = floor(scaled + 0.5);
+		if (mantissa / POW10[digits] == value)
+			return writeFixed((unsigned long long) mantissa, digits, p) - text;
+	}
+	// very large or very small values, 24 chars at most.
+	int length = 0;
+	for (int digits = 15; digits <= 17; ++digits) {
+		length = snprintf(p, 31, "%.*g", digits, value);
+		if (strtod(p, NULL) == value)
+			break;
+	}
+	if (length > 30)
+		length = 30;
+	return (p - text) + length;
+}
+
+GeoJsonWriter::GeoJsonWriter(GeoJsonSink sink, void *context, int precision,
+		int chunksize) :
+		sink_(sink), context_(context), precision_(precision), chunk_(NULL), chunksize_(
+				chunksize < 64 ? 64 : chunksize), length_(0), written_(0), failed_(
+				false), titles_(NULL), fieldcount_(0) {
+	chunk_ = (char *) malloc(chunksize_);
+	if (chunk_ == NULL) {
+		fprintf(stderr, "Fail to alloc memory for geojson chunk.\n");
+		failed_ = true;
+	}
+}
+
+GeoJsonWriter::~GeoJsonWriter() {
+	if (chunk_)
+		free(chunk_);
+	if (titles_)
+		free(titles_);
+}
+
+long long GeoJsonWriter::getWritten() const {
+	return written_;
+}
+
+bool GeoJsonWriter::flush() {
+	if (failed_)
+		return false;
+	if (length_ > 0) {
+		if (sink_ == NULL || !sink_(chunk_, length_, context_))
+			failed_ = true;
+		written_ += length_;
+		length_ = 0;
+	}
+	return !failed_;
+}
+
+void GeoJsonWriter::put(char c) {
+	if (length_ == chunksize_ && !flush())
+		return;
+	chunk_[length_++] = c;
+}
+
+void GeoJsonWriter::put(const char *str, int length) {
+	while (length > 0) {
+		if (length_ == chunksize_ && !flush())
+			return;
+		int size = chunksize_ - length_;
+		if (size > length)
+			size = length;
+		memcpy(chunk_ + length_, str, size);
+		length_ += size;
+		str += size;
+		length -= size;
+	}
+}
+
+void GeoJsonWriter::putText(const char *str) {
+	put(str, strlen(str));
+}
+
+void GeoJsonWriter::putString(const char *str, int length) {
+	static const char HEX[] = "0123456789abcdef";
+	put('"');
+	int start = 0;
+	for (int i = 0; i < length; ++i) {
+		unsigned char c = (unsigned char) str[i];
+		if (c >= 0x20 && c != '"' && c != '\\')
+			continue;
+		put(str + start, i - start);
+		start = i + 1;
+		switch (c) {
+		case '"':
+			put("\\\"", 2);
+			break;
+		case '\\':
+			put("\\\\", 2);
+			break;
+		case '\n':
+			put("\\n", 2);
+			break;
+		case '\r':
+			put("\\r", 2);
+			break;
+		case '\t':
+			put("\\t", 2);
+			break;
+		default: {
+			char escape[6] = { '\\', 'u', '0', '0', HEX[c >> 4], HEX[c & 15] };
+			put(escape, 6);
+			break;
+		}
+		}
+	}
+	put(str + start, length - start);
+	put('"');
+}
+
+void GeoJsonWriter::putNumber(double value, int precision) {
+	char text[32];
+	put(text, formatDouble(value, precision, text));
+}
+
+void GeoJsonWriter::putInteger(long long value) {
+	char text[24];
+	char *p = text;
+	unsigned long long magnitude = (unsigned long long) value;
+	if (value < 0) {
+		*p++ = '-';
+		magnitude = 0 - magnitude;
+	}
+	put(text, writeDigits(magnitude, p) - text);
+}
+
+void GeoJsonWriter::putDate(const FieldDateType & date) {
+	char text[64];
+	int length;
+	if (date.hour_ == 0 && date.min_ == 0 && date.sec_ == 0)
+		length = snprintf(text, sizeof(text), "\"%04d-%02d-%02d\"", date.year_,
+				date.mon_, date.day_);
+	else
+		length = snprintf(text, sizeof(text),
+				"\"%04d-%02d-%02dT%02d:%02d:%02d\"", date.year_, date.mon_,
+				date.day_, date.hour_, date.min_, date.sec_);
+	put(text, length);
+}
+
+void GeoJsonWriter::putBase64(const char *bytes, int length) {
+	static const char BASE64[] =
+			"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	put('"');
+	const unsigned char *in = (const unsigned char *) bytes;
+	for (int i = 0; i < length; i += 3) {
+		unsigned int group = in[i] << 16;
+		if (i + 1 < length)
+			group |= in[i + 1] << 8;
+		if (i + 2 < length)
+			group |= in[i + 2];
+		char out[4] = { BASE64[group >> 18], BASE64[(group >> 12) & 63],
+				i + 1 < length ? BASE64[(group >> 6) & 63] : '=',
+				i + 2 < length ? BASE64[group & 63] : '=' };
+		put(out, 4);
+	}
+	put('"');
+}
+
+void GeoJsonWriter::putPoints(WkbReader & reader, unsigned int count) {
+	put('[');
+	for (unsigned int i = 0; i < count && !reader.failed(); ++i) {
+		double x, y;
+		reader.readPoint(&x, &y);
+		if (i > 0)
+			put(',');
+		put('[');
+		putNumber(x, precision_);
+		put(',');
+		putNumber(y, precision_);
+		put(']');
+	}
+	put(']');
+}
+
+// coordinates of a geometry of type 1 to 6, whose header is read.
+void GeoJsonWriter::putCoordinates(WkbReader & reader, int type) {
+	switch (type) {
+	case 1: {
+		double x, y;
+		reader.readPoint(&x, &y);
+		put('[');
+		putNumber(x, precision_);
+		put(',');
+		putNumber(y, precision_);
+		put(']');
+		break;
+	}
+	case 2:
+		putPoints(reader, reader.readCount());
+		break;
+	case 3: {
+		unsigned int rings = reader.readCount();
+		put('[');
+		for (unsigned int i = 0; i < rings && !reader.failed(); ++i) {
+			if (i > 0)
+				put(',');
+			putPoints(reader, reader.readCount());
+		}
+		put(']');
+		break;
+	}
+	default: {
+		unsigned int parts = reader.readCount();
+		put('[');
+		for (unsigned int i = 0; i < parts && !reader.failed(); ++i) {
+			if (i > 0)
+				put(',');
+			int parttype = reader.readHeader();
+			if (parttype < 0)
+				break;
+			putCoordinates(reader, parttype);
+		}
+		put(']');
+		break;
+	}
+	}
+}
+
+void GeoJsonWriter::putGeometry(WkbReader & reader, int type) {
+	putText("{\"type\":\"");
+	putText(GEOMETRY_NAMES[type]);
+	if (type != 7) {
+		putText("\",\"coordinates\":");
+		putCoordinates(reader, type);
+		put('}');
+		return;
+	}
+	putText("\",\"geometries\":[");
+	unsigned int parts = reader.readCount();
+	for (unsigned int i = 0; i < parts && !reader.failed(); ++i) {
+		int parttype = reader.readHeader();
+		if (parttype < 0)
+			break;
+		if (i > 0)
+			put(',');
+		putGeometry(reader, parttype);
+	}
+	putText("]}");
+}
+
+// opens a feature, up to the start of its properties.
+void GeoJsonWriter::beginFeature(const char *wkb, int wkbsize) {
+	putText("{\"type\":\"Feature\",\"geometry\":");
+	WkbReader reader(wkb, wkbsize);
+	int type = wkb && wkbsize > 0 ? reader.readHeader() : -1;
+	if (type < 0)
+		putText("null");
+	else
+		putGeometry(reader, type);
+	putText(",\"properties\":{");
+}
+
+void GeoJsonWriter::putTitle(int index) {
+	if (index > 0)
+		put(',');
+	const char *title = index < fieldcount_ ? titles_[index] : "";
+	putString(title, strlen(title));
+	put(':');
+}
+
+void GeoJsonWriter::putCell(const RecordSection & section, char fieldtype,
+		const char *value) {
+	switch (fieldtype) {
+	case FTInteger:
+		putInteger(readCellInteger(section, value));
+		break;
+	case FTInteger64:
+		putInteger(readCellInteger64(section, value));
+		break;
+	case FTReal: {
+		double dvalue = 0;
+		memcpy(&dvalue, value, sizeof(dvalue));
+		putNumber(dvalue, -1);
+		break;
+	}
+	case FTString:
+	case FTBinary: {
+		const char *str = NULL;
+		int length = readCellBytes(value, &str);
+		if (fieldtype == FTBinary)
+			putBase64(str, length);
+		else
+			putString(str, length > 0 && str[length - 1] == '\0' ?
+					length - 1 : length);
+		break;
+	}
+	case FTDate:
+	case FTTime:
+	case FTDateTime: {
+		long long packed = 0;
+		memcpy(&packed, value, sizeof(packed));
+		FieldDateType date;
+		unpackDate(packed, &date);
+		putDate(date);
+		break;
+	}
+	case FTIntegerList:
+	case FTInteger64List:
+	case FTRealList:
+	case FTStringList: {
+		const char *values = NULL;
+		int count = readCellList(value, &values);
+		put('[');
+		for (int i = 0; i < count; ++i) {
+			if (i > 0)
+				put(',');
+			if (fieldtype == FTStringList) {
+				const char *str = NULL;
+				int length = readCellBytes(values, &str);
+				values = str + length;
+				putString(str, length > 0 && str[length - 1] == '\0' ?
+						length - 1 : length);
+			} else if (fieldtype == FTIntegerList) {
+				int ivalue = 0;
+				memcpy(&ivalue, values + i * sizeof(int), sizeof(ivalue));
+				putInteger(ivalue);
+			} else if (fieldtype == FTInteger64List) {
+				long long lvalue = 0;
+				memcpy(&lvalue, values + i * sizeof(long long),
+						sizeof(lvalue));
+				putInteger(lvalue);
+			} else {
+				double dvalue = 0;
+				memcpy(&dvalue, values + i * sizeof(double), sizeof(dvalue));
+				putNumber(dvalue, -1);
+			}
+		}
+		put(']');
+		break;
+	}
+	default:
+		putText("null");
+		break;
+	}
+}
+
+void GeoJsonWriter::putField(const LayerRecordField & field) {
+	switch (field.fieldtype_) {
+	case FTInteger:
+		putInteger(field.field_.ivalue_);
+		break;
+	case FTInteger64:
+		putInteger(field.field_.lvalue_);
+		break;
+	case FTReal:
+		putNumber(field.field_.dvalue_, -1);
+		break;
+	case FTString: {
+		const FieldStringType & str = field.field_.svalue_;
+		int length = str.strlength_;
+		if (length > 0 && str.str_[length - 1] == '\0')
+			--length;
+		putString(str.str_, length);
+		break;
+	}
+	case FTBinary:
+		putBase64(field.field_.bvalue_.bytes_, field.field_.bvalue_.byteslength_);
+		break;
+	case FTDate:
+	case FTTime:
+	case FTDateTime:
+		putDate(field.field_.tvalue_);
+		break;
+	case FTIntegerList:
+	case FTInteger64List:
+	case FTRealList:
+	case FTStringList: {
+		const FieldListType & list = field.field_.listvalue_;
+		put('[');
+		for (int i = 0; i < list.count_; ++i) {
+			if (i > 0)
+				put(',');
+			if (field.fieldtype_ == FTIntegerList) {
+				putInteger(((const int *) list.values_)[i]);
+			} else if (field.fieldtype_ == FTInteger64List) {
+				putInteger(((const long long *) list.values_)[i]);
+			} else if (field.fieldtype_ == FTRealList) {
+				putNumber(((const double *) list.values_)[i], -1);
+			} else {
+				const FieldStringType & str =
+						((const FieldStringType *) list.values_)[i];
+				int length = str.strlength_;
+				if (length > 0 && str.str_[length - 1] == '\0')
+					--length;
+				putString(str.str_, length);
+			}
+		}
+		put(']');
+		break;
+	}
+	default:
+		putText("null");
+		break;
+	}
+}
+
+bool GeoJsonWriter::writeLayer(const char *bytes, int size) {
+	if (bytes == NULL) {
+		fprintf(stderr, "Empty layer bytes.\n");
+		return false;
+	}
+	// every length is checked against the rest of the value before use.
+	if (!checkLayerHead(bytes, size, true))
+		return false;
+	int offset = LAYER_HEAD_SIZE;
+	int sectionlength = 0;
+	// metadata
+	memcpy(&sectionlength, bytes + offset, sizeof(sectionlength));
+	offset += sizeof(sectionlength);
+	if (sectionlength < 0
+			|| sectionlength > size - offset - (int) (2 * sizeof(int))) {
+		fprintf(stderr, "Bad layer bytes.\n");
+		return false;
+	}
+	offset += sectionlength;
+
+	// attribute definition: the titles are used in place.
+	memcpy(&sectionlength, bytes + offset, sizeof(sectionlength));
+	offset += sizeof(sectionlength);
+	int attrdefend = offset + sectionlength;
+	if (sectionlength < (int) sizeof(int)
+			|| sectionlength > size - offset - (int) (2 * sizeof(int))) {
+		fprintf(stderr, "Bad layer bytes.\n");
+		return false;
+	}
+	memcpy(&fieldcount_, bytes + offset, sizeof(fieldcount_));
+	offset += sizeof(fieldcount_);
+	// a field takes its title length, a title of one char at least, its
+	// width, precision and type.
+	int fieldsize = 3 * sizeof(int) + 2 * sizeof(char);
+	if (fieldcount_ < 0 || fieldcount_ > (attrdefend - offset) / fieldsize) {
+		fprintf(stderr, "Bad layer field count.\n");
+		fieldcount_ = 0;
+		return false;
+	}
+	if (titles_)
+		free(titles_);
+	titles_ = (const char **) malloc(sizeof(char *) * (fieldcount_ + 1));
+	if (titles_ == NULL) {
+		fprintf(stderr, "Fail to alloc memory for field titles.\n");
+		fieldcount_ = 0;
+		return false;
+	}
+	for (int i = 0; i < fieldcount_; ++i) {
+		int titlelength = 0;
+		memcpy(&titlelength, bytes + offset, sizeof(titlelength));
+		offset += sizeof(titlelength);
+		if (titlelength <= 0
+				|| titlelength > attrdefend - offset
+						- (int) (2 * sizeof(int) + sizeof(char))
+				|| bytes[offset + titlelength - 1] != '\0') {
+			fprintf(stderr, "Bad layer field title.\n");
+			fieldcount_ = 0;
+			return false;
+		}
+		titles_[i] = bytes + offset;
+		offset += titlelength + 2 * sizeof(int) + sizeof(char);
+	}
+	offset = attrdefend;
+
+	// features and records are walked side by side, from their offsets.
+	int featurelength = 0;
+	memcpy(&featurelength, bytes + offset, sizeof(featurelength));
+	offset += sizeof(featurelength);
+	int featurecount = 0;
+	memcpy(&featurecount, bytes + offset, sizeof(featurecount));
+	offset += sizeof(featurecount);
+	if (featurelength < (int) sizeof(int) || featurelength > size - offset) {
+		fprintf(stderr, "Bad layer feature length.\n");
+		return false;
+	}
+	const char *entries = bytes + offset;
+	RecordSection records;
+	if (!readRecordSection(entries + featurelength,
+			size - offset - featurelength, &records))
+		return false;
+	if (records.recordcount_ != featurecount) {
+		fprintf(stderr, "Features and records do not match.\n");
+		return false;
+	}
+	// the entries end sizeof(int) before the records.
+	int *featureoffsets = scanFeatureOffsets(entries, featurecount,
+			featurelength - sizeof(int));
+	int *rowoffsets =
+			featureoffsets && records.types_ == NULL ?
+					scanRecordOffsets(records.cells_, featurecount,
+							records.fieldcount_, records.length_) :
+					NULL;
+	if (featureoffsets == NULL
+			|| (records.types_ == NULL && rowoffsets == NULL)) {
+		if (featureoffsets)
+			free(featureoffsets);
+		return false;
+	}
+
+	putText("{\"type\":\"FeatureCollection\",\"features\":[");
+	for (int i = 0; i < featurecount && !failed_; ++i) {
+		const char *entry = entries + featureoffsets[i];
+		int wkbsize = 0;
+		memcpy(&wkbsize, entry + sizeof(int), sizeof(wkbsize));
+
+		if (i > 0)
+			put(',');
+		beginFeature(entry + 2 * sizeof(int), wkbsize);
+		const char *bitmap = records.cells_
+				+ (rowoffsets ? rowoffsets[i] : i * records.stride_);
+		const char *cell = bitmap + getRowBitmapSize(records.fieldcount_);
+		for (int j = 0; j < records.fieldcount_; ++j) {
+			putTitle(j);
+			char fieldtype = 0;
+			const char *value = NULL;
+			cell += readCell(records, bitmap, cell, j, &fieldtype, &value);
+			putCell(records, fieldtype, value);
+		}
+		putText("}}");
+	}
+	putText("]}\n");
+	free(featureoffsets);
+	if (rowoffsets)
+		free(rowoffsets);
+	return flush();
+}
+
+bool GeoJsonWriter::writeLayer(const LayerAttrDef & attrdef,
+		const LayerAllFeatures & features, const LayerAllRecords & records) {
+	fieldcount_ = attrdef.getFieldCount();
+	if (titles_)
+		free(titles_);
+	titles_ = (const char **) malloc(sizeof(char *) * (fieldcount_ + 1));
+	if (titles_ == NULL) {
+		fprintf(stderr, "Fail to alloc memory for field titles.\n");
+		return false;
+	}
+	for (int i = 0; i < fieldcount_; ++i)
+		titles_[i] = attrdef.getField(i)->sztitle_;
+
+	int featurecount = features.getFeatureCount();
+	int recordcount = records.getRecordCount();
+	int recordfieldcount = recordcount > 0 ? records.getFieldCount() : 0;
+	if (recordfieldcount > fieldcount_)
+		recordfieldcount = fieldcount_;
+
+	putText("{\"type\":\"FeatureCollection\",\"features\":[");
+	for (int i = 0; i < featurecount && !failed_; ++i) {
+		const LayerFeature *feature = features.getFeature(i);
+		if (i > 0)
+			put(',');
+		beginFeature(feature->wkbbytes_, feature->wkbsize_);
+		if (i < recordcount) {
+			const LayerRecordField *record = records.getRecord(i);
+			for (int j = 0; j < recordfieldcount; ++j) {
+				putTitle(j);
+				putField(record[j]);
+			}
+		}
+		putText("}}");
+	}
+	putText("]}\n");
+	return flush();
+}
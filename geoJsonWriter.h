@@ -0,0 +1,85 @@
+/// @file geoJsonWriter.h
+/// @author luliang@ict.ac.cn
+/// @copybrief Copyright 2013 ICT, CAS. All rights reserved.
+/// @version 0.1
+/// @date 2026-10-19
+
+#ifndef GEOJSONWRITER_H_
+#define GEOJSONWRITER_H_
+
+#include "layerAttrDef.h"
+#include "layerAllFeatures.h"
+#include "layerAllRecords.h"
+#include "layerDecoder.h"
+
+class WkbReader;
+
+// receives the output chunk by chunk, false stops the writer.
+typedef bool (*GeoJsonSink)(const char *bytes, int length, void *context);
+
+// writes value into text, which needs 32 bytes, and returns the length,
+// 31 at most.
+// precision: digits after the decimal point, -1 for the shortest text that
+// reads back as the same double. nan and infinity are written as null.
+int formatDouble(double value, int precision, char *text);
+
+// Streams a layer as a GeoJSON FeatureCollection straight from its
+// serialized bytes or its Layer* objects, through one chunk of output
+// buffer: memory use does not grow with the layer.
+class GeoJsonWriter {
+public:
+	// precision: digits after the decimal point of coordinates, -1 for the
+	// shortest round trip text. attribute reals are always written exactly.
+	GeoJsonWriter(GeoJsonSink sink, void *context, int precision = -1,
+			int chunksize = 65536);
+	~GeoJsonWriter();
+
+	// bytes: a layer value as stored by SpatialClient::putLayer, of size
+	// bytes. false, with the reason on stderr, if its sections overrun it.
+	bool writeLayer(const char *bytes, int size);
+	bool writeLayer(const LayerAttrDef & attrdef,
+			const LayerAllFeatures & features, const LayerAllRecords & records);
+
+	// total bytes passed to the sink.
+	long long getWritten() const;
+
+private:
+	GeoJsonWriter(const GeoJsonWriter &);
+	void operator=(const GeoJsonWriter &);
+
+	bool flush();
+	void put(char c);
+	void put(const char *str, int length);
+	void putText(const char *str);
+	void putString(const char *str, int length);
+	void putNumber(double value, int precision);
+	void putInteger(long long value);
+	void putDate(const FieldDateType & date);
+	void putBase64(const char *bytes, int length);
+
+	void beginFeature(const char *wkb, int wkbsize);
+	void putGeometry(WkbReader & reader, int type);
+	void putCoordinates(WkbReader & reader, int type);
+	void putPoints(WkbReader & reader, unsigned int count);
+	void putTitle(int index);
+	// the value of one cell of serialized records.
+	void putCell(const RecordSection & section, char fieldtype,
+			const char *value);
+	void putField(const LayerRecordField & field);
+
+	GeoJsonSink sink_;
+	void *context_;
+	int precision_;
+
+	char *chunk_;
+	int chunksize_;
+	int length_;
+	long long written_;
+	bool failed_;
+
+	// field titles of the layer being written.
+	const char **titles_;
+	int fieldcount_;
+};
+
+#endif /* GEOJSONWRITER_H_ */
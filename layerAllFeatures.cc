@@ -5,109 +5,142 @@
 /// @date 2013-06-25
 
 #include "layerAllFeatures.h"
+#include "layerDecoder.h"
+#include "layerEncoder.h"
 
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
 
+#include <algorithm>
+
 #include <ogrsf_frmts.h>
 
 LayerAllFeatures::LayerAllFeatures() :
 		featurelength_(0), featurecount_(0), features_(NULL), buffer_(NULL), bufferflag_(
-				UNINITIALIZED) {
+				UNINITIALIZED), payload_(NULL), callerarena_(NULL) {
+}
+
+LayerAllFeatures::LayerAllFeatures(LayerArena *arena) :
+		featurelength_(0), featurecount_(0), features_(NULL), buffer_(NULL), bufferflag_(
+				UNINITIALIZED), payload_(NULL), callerarena_(arena) {
 }
 
 LayerAllFeatures::LayerAllFeatures(const LayerAllFeatures & allfeatures) :
 		featurelength_(0), featurecount_(0), features_(NULL), buffer_(NULL), bufferflag_(
-				UNINITIALIZED) {
+				UNINITIALIZED), payload_(NULL), callerarena_(NULL) {
 	setAllFeatures(allfeatures);
 }
 
-LayerAllFeatures::LayerAllFeatures(OGRLayer *layer) :
+LayerAllFeatures::LayerAllFeatures(OGRLayer *layer, LayerArena *arena) :
 		featurelength_(0), featurecount_(0), features_(NULL), buffer_(NULL), bufferflag_(
-				UNINITIALIZED) {
+				UNINITIALIZED), payload_(NULL), callerarena_(arena) {
 	setAllFeatures(layer);
 }
 
-LayerAllFeatures::LayerAllFeatures(const char * bytes) :
+LayerAllFeatures::LayerAllFeatures(const char * bytes, LayerArena *arena) :
 		featurelength_(0), featurecount_(0), features_(NULL), buffer_(NULL), bufferflag_(
-				UNINITIALIZED) {
+				UNINITIALIZED), payload_(NULL), callerarena_(arena) {
 	setAllFeatures(bytes);
 }
 
 LayerAllFeatures::~LayerAllFeatures() {
-	for (int i = 0; i < featurecount_; ++i) {
-		if (features_[i].wkbbytes_)
-			free(features_[i].wkbbytes_);
-	}
-	if (features_)
-		free(features_);
+	// the features go with the payload, once no copy shares it.
+	if (payload_)
+		payload_->release();
 	if (buffer_)
 		free(buffer_);
 }
 
+bool LayerAllFeatures::resetFeatures(int count) {
+	// a shared payload is left to the copies.
+	if (payload_ && payload_->isShared()) {
+		payload_->release();
+		payload_ = NULL;
+	}
+	if (payload_ == NULL)
+		payload_ = LayerPayload::create();
+	else
+		payload_->getArena()->reset();
+	features_ = NULL;
+	if (count < 0) {
+		fprintf(stderr, "Invalid feature count %d.\n", count);
+		return false;
+	}
+	if (payload_)
+		features_ = (LayerFeature *) payload_->resizeItems(count,
+				sizeof(LayerFeature));
+	return features_ != NULL;
+}
+
+LayerArena *LayerAllFeatures::getArena() {
+	// a caller's arena is reset by the caller.
+	return callerarena_ ? callerarena_ : payload_->getArena();
+}
+
+typedef struct {
+	char *entries_;
+	const int *offsets_;
+	LayerFeature *features_;
+} FeatureDecoding;
+
+static bool decodeFeatures(int begin, int end, void *context) {
+	FeatureDecoding *decoding = (FeatureDecoding *) context;
+	for (int i = begin; i < end; ++i) {
+		char *entry = decoding->entries_ + decoding->offsets_[i];
+		LayerFeature *feature = decoding->features_ + i;
+		memcpy(&feature->geometrytype_, entry,
+				sizeof(feature->geometrytype_));
+		memcpy(&feature->wkbsize_, entry + sizeof(feature->geometrytype_),
+				sizeof(feature->wkbsize_));
+		feature->wkbbytes_ = entry + sizeof(feature->geometrytype_)
+				+ sizeof(feature->wkbsize_);
+	}
+	return true;
+}
+
+int LayerAllFeatures::decodeEntries(const char *entries, int length) {
+	// one copy of all entries in the arena, which the wkb point into; the
+	// entries are then decoded over ranges.
+	char *payload = getArena()->copy(entries, length);
+	int *offsets = payload ?
+			scanFeatureOffsets(payload, featurecount_, length) : NULL;
+	if (offsets == NULL) {
+		featurecount_ = 0;
+		return -1;
+	}
+	FeatureDecoding decoding = { payload, offsets, features_ };
+	runDecodeTasks(featurecount_, decodeFeatures, &decoding);
+	int decoded = offsets[featurecount_];
+	free(offsets);
+	return decoded;
+}
+
 void LayerAllFeatures::setAllFeatures(OGRLayer *layer) {
 	if (layer == NULL)
 		return;
+	// the wkb of all features is exported once, on all cpus.
+	LayerEncoder encoder(layer, false, false);
+	if (!encoder.encode())
+		return;
+	setAllFeatures(encoder);
+}
+
+void LayerAllFeatures::setAllFeatures(const LayerEncoder & encoder) {
 	featurelength_ = 0;
 	// featurelength_
 	featurelength_ += sizeof(featurelength_);
+	featurelength_ += encoder.getFeatureLength();
 	// featurecount_
-	for (int i = 0; i < featurecount_; ++i) {
-		if (features_[i].wkbbytes_)
-			free(features_[i].wkbbytes_);
-	}
-
-	layer->ResetReading();
-	for (OGRFeature *feature = layer->GetNextFeature(); feature != NULL;
-			feature = layer->GetNextFeature()) {
-		OGRGeometry *geometry = feature->GetGeometryRef();
-		if (geometry) {
-			// int geometrytype = (int)geometry->getGeometryType();
-			featurelength_ += sizeof(int);
-			int wkbsize = geometry->WkbSize();
-			featurelength_ += sizeof(wkbsize) + wkbsize;
-
-			++featurecount_;
-		}
-		OGRFeature::DestroyFeature(feature);
-	}
+	featurecount_ = encoder.getFeatureCount();
+	featurelength_ += sizeof(featurecount_);
 
-	if (features_ == NULL) {
-		features_ = (LayerFeature *) malloc(
-				sizeof(LayerFeature) * featurecount_);
-	} else {
-		features_ = (LayerFeature *) realloc(features_,
-				sizeof(LayerFeature) * featurecount_);
-	}
-	if (features_ == NULL) {
-		fprintf(stderr, "Fail to alloc memory for features.\n");
+	if (!resetFeatures(featurecount_)) {
+		featurecount_ = 0;
 		return;
 	}
 
-	layer->ResetReading();
-	int ifeature = 0;
-	for (OGRFeature *feature = layer->GetNextFeature(); feature != NULL;
-			feature = layer->GetNextFeature()) {
-		OGRGeometry *geometry = feature->GetGeometryRef();
-		if (geometry) {
-			features_[ifeature].geometrytype_ =
-					(int) geometry->getGeometryType();
-			features_[ifeature].wkbsize_ = geometry->WkbSize();
-
-			features_[ifeature].wkbbytes_ = (char *) malloc(
-					features_[ifeature].wkbsize_);
-			if (features_[ifeature].wkbbytes_ == NULL) {
-				fprintf(stderr, "Fail to alloc memory for feature wkbbytes.\n");
-				return;
-			}
-			geometry->exportToWkb((OGRwkbByteOrder) wkbNDR,
-					(unsigned char *) (features_[ifeature].wkbbytes_));
-
-			++ifeature;
-		}
-		OGRFeature::DestroyFeature(feature);
-	}
+	decodeEntries(encoder.getFeatures(), encoder.getFeatureLength());
 
 	// set buffer flag.
 	if (bufferflag_ == LATEST)
@@ -124,47 +157,18 @@ void LayerAllFeatures::setAllFeatures(const char * bytes) {
 	offset += sizeof(featurelength_);
 
 	// featurecount_
-	for (int i = 0; i < featurecount_; ++i) {
-		if (features_[i].wkbbytes_)
-			free(features_[i].wkbbytes_);
-	}
 	memcpy(&featurecount_, bytes + offset, sizeof(featurecount_));
 	offset += sizeof(featurecount_);
 
-	if (features_ == NULL) {
-		features_ = (LayerFeature *) malloc(
-				sizeof(LayerFeature) * featurecount_);
-	} else {
-		features_ = (LayerFeature *) realloc(features_,
-				sizeof(LayerFeature) * featurecount_);
-	}
-	if (features_ == NULL) {
-		fprintf(stderr, "Fail to alloc memory for features.\n");
+	if (!resetFeatures(featurecount_)) {
+		featurecount_ = 0;
 		return;
 	}
 
-	for (int ifeature = 0; ifeature < featurecount_; ++ifeature) {
-		// geometrytype_
-		memcpy(&features_[ifeature].geometrytype_, bytes + offset,
-				sizeof(features_[ifeature].geometrytype_));
-		offset += sizeof(features_[ifeature].geometrytype_);
-
-		// wkbsize_
-		memcpy(&features_[ifeature].wkbsize_, bytes + offset,
-				sizeof(features_[ifeature].wkbsize_));
-		offset += sizeof(features_[ifeature].wkbsize_);
-
-		// wkbbytes_
-		features_[ifeature].wkbbytes_ = (char *) malloc(
-				features_[ifeature].wkbsize_);
-		if (features_[ifeature].wkbbytes_ == NULL) {
-			fprintf(stderr, "Fail to alloc memory for feature wkbbytes.\n");
-			return;
-		}
-		memcpy(features_[ifeature].wkbbytes_, bytes + offset,
-				features_[ifeature].wkbsize_);
-		offset += features_[ifeature].wkbsize_;
-	}
+	int decoded = decodeEntries(bytes + offset, featurelength_ - offset);
+	if (decoded < 0)
+		return;
+	offset += decoded;
 
 	assert(offset == featurelength_);
 	// alloc memory for buffer_
@@ -185,30 +189,53 @@ void LayerAllFeatures::setAllFeatures(const char * bytes) {
 }
 
 void LayerAllFeatures::setAllFeatures(const LayerAllFeatures & allfeatures) {
+	if (&allfeatures == this)
+		return;
+	// features on a caller's arena may not outlive it, so they are copied.
+	if (allfeatures.callerarena_ || allfeatures.payload_ == NULL) {
+		copyFeatures(allfeatures, NULL);
+		return;
+	}
+	LayerPayload *payload = allfeatures.payload_->retain();
+	if (payload_)
+		payload_->release();
+	payload_ = payload;
+	features_ = allfeatures.features_;
+	featurelength_ = allfeatures.featurelength_;
+	featurecount_ = allfeatures.featurecount_;
+
+	// set buffer flag.
+	if (bufferflag_ == LATEST)
+		bufferflag_ = STALE;
+}
+
+void LayerAllFeatures::copyFeatures(const LayerAllFeatures & allfeatures,
+		const int *order) {
 	// featurelength_
 	featurelength_ = allfeatures.getFeatureLength();
 
 	// featurecount_
-	for (int i = 0; i < featurecount_; ++i) {
-		if (features_[i].wkbbytes_)
-			free(features_[i].wkbbytes_);
-	}
 	featurecount_ = allfeatures.getFeatureCount();
 
-	if (features_ == NULL) {
-		features_ = (LayerFeature *) malloc(
-				sizeof(LayerFeature) * featurecount_);
-	} else {
-		features_ = (LayerFeature *) realloc(features_,
-				sizeof(LayerFeature) * featurecount_);
+	if (!resetFeatures(featurecount_)) {
+		featurecount_ = 0;
+		return;
 	}
-	if (features_ == NULL) {
-		fprintf(stderr, "Fail to alloc memory for features.\n");
+
+	// the wkb of all features, from one arena allocation.
+	int payloadlength = 0;
+	for (int ifeature = 0; ifeature < featurecount_; ++ifeature)
+		payloadlength += allfeatures.getFeature(
+				order ? order[ifeature] : ifeature)->wkbsize_;
+	char *payload = getArena()->allocate(payloadlength);
+	if (payload == NULL) {
+		featurecount_ = 0;
 		return;
 	}
 
 	for (int ifeature = 0; ifeature < featurecount_; ++ifeature) {
-		const LayerFeature *feature = allfeatures.getFeature(ifeature);
+		const LayerFeature *feature = allfeatures.getFeature(
+				order ? order[ifeature] : ifeature);
 
 		// geometrytype_
 		features_[ifeature].geometrytype_ = feature->geometrytype_;
@@ -216,20 +243,42 @@ void LayerAllFeatures::setAllFeatures(const LayerAllFeatures & allfeatures) {
 		features_[ifeature].wkbsize_ = feature->wkbsize_;
 
 		// wkbbytes_
-		features_[ifeature].wkbbytes_ = (char *) malloc(
-				features_[ifeature].wkbsize_);
-		if (features_[ifeature].wkbbytes_ == NULL) {
-			fprintf(stderr, "Fail to alloc memory for feature wkbbytes.\n");
-			return;
-		}
-		memcpy(features_[ifeature].wkbbytes_, feature->wkbbytes_,
-				features_[ifeature].wkbsize_);
+		features_[ifeature].wkbbytes_ = NULL;
+		if (feature->wkbbytes_ == NULL)
+			continue;
+		features_[ifeature].wkbbytes_ = payload;
+		memcpy(payload, feature->wkbbytes_, feature->wkbsize_);
+		payload += feature->wkbsize_;
 	}
 	// set buffer flag.
 	if (bufferflag_ == LATEST)
 		bufferflag_ = STALE;
 }
 
+void LayerAllFeatures::swap(LayerAllFeatures & allfeatures) {
+	std::swap(featurelength_, allfeatures.featurelength_);
+	std::swap(featurecount_, allfeatures.featurecount_);
+	std::swap(features_, allfeatures.features_);
+	std::swap(buffer_, allfeatures.buffer_);
+	std::swap(bufferflag_, allfeatures.bufferflag_);
+	std::swap(payload_, allfeatures.payload_);
+	std::swap(callerarena_, allfeatures.callerarena_);
+}
+
+#if __cplusplus >= 201103L
+LayerAllFeatures::LayerAllFeatures(LayerAllFeatures && allfeatures) :
+		featurelength_(0), featurecount_(0), features_(NULL), buffer_(NULL), bufferflag_(
+				UNINITIALIZED), payload_(NULL), callerarena_(NULL) {
+	swap(allfeatures);
+}
+
+LayerAllFeatures & LayerAllFeatures::operator=(LayerAllFeatures && allfeatures) {
+	LayerAllFeatures moved(static_cast<LayerAllFeatures &&>(allfeatures));
+	swap(moved);
+	return *this;
+}
+#endif
+
 const char *LayerAllFeatures::getBytes() {
 	// alloc memory or return the buffered result.
 	if (bufferflag_ == UNINITIALIZED) {
@@ -288,3 +337,74 @@ const LayerFeature *LayerAllFeatures::getFeature(int index) const {
 		return NULL;
 	return &features_[index];
 }
+
+#if __cplusplus >= 201103L
+LayerSpan<const LayerFeature> LayerAllFeatures::getFeatureSpan() const {
+	return LayerSpan<const LayerFeature>(features_, featurecount_);
+}
+
+LayerSpan<const char> LayerAllFeatures::getWkbSpan(int index) const {
+	const LayerFeature *feature = getFeature(index);
+	if (feature == NULL)
+		return LayerSpan<const char>();
+	return LayerSpan<const char>(feature->wkbbytes_, feature->wkbsize_);
+}
+#endif
+
+int *LayerAllFeatures::getSpatialOrder(SpatialCurveType curve) const {
+	double *xs = (double *) malloc(sizeof(double) * (featurecount_ + 1));
+	double *ys = (double *) malloc(sizeof(double) * (featurecount_ + 1));
+	if (xs == NULL || ys == NULL) {
+		fprintf(stderr, "Fail to alloc memory for feature centers.\n");
+		if (xs)
+			free(xs);
+		if (ys)
+			free(ys);
+		return NULL;
+	}
+
+	for (int i = 0; i < featurecount_; ++i) {
+		xs[i] = ys[i] = 0;
+		OGRGeometry *geometry = NULL;
+		OGRGeometryFactory::createFromWkb(
+				(unsigned char *) features_[i].wkbbytes_, NULL, &geometry,
+				features_[i].wkbsize_);
+		if (geometry) {
+			OGREnvelope envelope;
+			geometry->getEnvelope(&envelope);
+			xs[i] = (envelope.MinX + envelope.MaxX) / 2;
+			ys[i] = (envelope.MinY + envelope.MaxY) / 2;
+			OGRGeometryFactory::destroyGeometry(geometry);
+		}
+	}
+
+	int *order = spatialOrder(xs, ys, featurecount_, curve);
+	free(xs);
+	free(ys);
+	return order;
+}
+
+void LayerAllFeatures::reorder(const int *order) {
+	if (order == NULL || featurecount_ == 0)
+		return;
+	if (payload_->isShared()) {
+		// the copies keep their order, this object gets its own features.
+		LayerAllFeatures source(*this);
+		copyFeatures(source, order);
+		return;
+	}
+	LayerFeature *features = (LayerFeature *) malloc(
+			sizeof(LayerFeature) * featurecount_);
+	if (features == NULL) {
+		fprintf(stderr, "Fail to alloc memory for features.\n");
+		return;
+	}
+	for (int i = 0; i < featurecount_; ++i)
+		features[i] = features_[order[i]];
+	memcpy(features_, features, sizeof(LayerFeature) * featurecount_);
+	free(features);
+
+	// set buffer flag.
+	if (bufferflag_ == LATEST)
+		bufferflag_ = STALE;
+}
@@ -7,7 +7,12 @@
 #ifndef LAYERALLFEATURES_H_
 #define LAYERALLFEATURES_H_
 
+#include "layerArena.h"
+#include "layerSpan.h"
+#include "spatialCurve.h"
+
 class OGRLayer;
+class LayerEncoder;
 
 typedef struct {
 	int geometrytype_;
@@ -15,12 +20,16 @@ typedef struct {
 	char *wkbbytes_;
 } LayerFeature;
 
+// wkb is drawn from an arena: the object's own, or one given by the
+// caller, which must outlive the object. Copies of an object on its own
+// arena share its features, in O(1), until one of them changes them.
 class LayerAllFeatures {
 public:
 	LayerAllFeatures();
+	explicit LayerAllFeatures(LayerArena *arena);
 	LayerAllFeatures(const LayerAllFeatures & allfeatures);
-	LayerAllFeatures(OGRLayer *layer);
-	LayerAllFeatures(const char * bytes);
+	LayerAllFeatures(OGRLayer *layer, LayerArena *arena = 0);
+	LayerAllFeatures(const char * bytes, LayerArena *arena = 0);
 	~LayerAllFeatures();
 
 	const char *getBytes();
@@ -33,6 +42,25 @@ public:
 	void setAllFeatures(OGRLayer *layer);
 	void setAllFeatures(const char * bytes);
 	void setAllFeatures(const LayerAllFeatures & allfeatures);
+	// the features of an encoded layer.
+	void setAllFeatures(const LayerEncoder & encoder);
+
+	// exchanges the contents of two objects in O(1), without allocating.
+	void swap(LayerAllFeatures & allfeatures);
+#if __cplusplus >= 201103L
+	// moves leave the source empty, as if default constructed.
+	LayerAllFeatures(LayerAllFeatures && allfeatures);
+	LayerAllFeatures & operator=(LayerAllFeatures && allfeatures);
+	LayerSpan<const LayerFeature> getFeatureSpan() const;
+	// the wkb of a feature, empty for an index out of range.
+	LayerSpan<const char> getWkbSpan(int index) const;
+#endif
+
+	// order of the features along the curve through their envelope centers,
+	// free() by caller. reorder() puts feature order[i] at position i; apply
+	// the same order to the LayerAllRecords of the layer to keep them in step.
+	int *getSpatialOrder(SpatialCurveType curve) const;
+	void reorder(const int *order);
 
 private:
 	typedef enum {
@@ -41,6 +69,12 @@ private:
 
 	void operator=(const LayerAllFeatures &);
 
+	bool resetFeatures(int count);
+	LayerArena *getArena();
+	// a copy of feature order[i] at position i, all in order if order is NULL.
+	void copyFeatures(const LayerAllFeatures & allfeatures, const int *order);
+	int decodeEntries(const char *entries, int length);
+
 	int featurelength_;
 	int featurecount_;
 
@@ -48,6 +82,10 @@ private:
 
 	char *buffer_;
 	BufferFlagType bufferflag_;
+
+	// the fields and their arena, shared by copies.
+	LayerPayload *payload_;
+	LayerArena *callerarena_;
 };
 
 #endif /* LAYERALLFEATURES_H_ */
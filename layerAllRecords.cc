@@ -5,239 +5,255 @@
 /// @date 2013-06-25
 
 #include "layerAllRecords.h"
+#include "layerDecoder.h"
+#include "layerEncoder.h"
+#include "recordFilter.h"
 
 #include <stdio.h>
 #include <string.h>
+#include <math.h>
+#include <limits.h>
 #include <assert.h>
 
+#include <algorithm>
+
 #include <ogrsf_frmts.h>
 
+// the place value of the year in a packed date, above 34 bits of the rest.
+static const long long DATE_YEAR_UNIT = 1LL << 34;
+
+long long packDate(const FieldDateType & date) {
+	long long packed = date.year_ * DATE_YEAR_UNIT;
+	packed += (long long) (date.mon_ & 0xf) << 30;
+	packed += (long long) (date.day_ & 0x1f) << 25;
+	packed += (long long) (date.hour_ & 0x1f) << 20;
+	packed += (date.min_ & 0x3f) << 14;
+	packed += (date.sec_ & 0x3f) << 8;
+	packed += date.tag_ & 0xff;
+	return packed;
+}
+
+void unpackDate(long long packed, FieldDateType *date) {
+	long long rest = packed & (DATE_YEAR_UNIT - 1);
+	date->year_ = (int) ((packed - rest) / DATE_YEAR_UNIT);
+	date->mon_ = (int) (rest >> 30) & 0xf;
+	date->day_ = (int) (rest >> 25) & 0x1f;
+	date->hour_ = (int) (rest >> 20) & 0x1f;
+	date->min_ = (int) (rest >> 14) & 0x3f;
+	date->sec_ = (int) (rest >> 8) & 0x3f;
+	date->tag_ = (int) rest & 0xff;
+}
+
+long long getDateKey(long long packed) {
+	return (packed - (packed & 0xff)) / 256;
+}
+
+bool isListType(char fieldtype) {
+	return getListValueSize(fieldtype) > 0;
+}
+
+int getListValueSize(char fieldtype) {
+	switch (fieldtype) {
+	case FTIntegerList:
+		return sizeof(int);
+	case FTInteger64List:
+		return sizeof(long long);
+	case FTRealList:
+		return sizeof(double);
+	case FTStringList:
+		return sizeof(FieldStringType);
+	default:
+		return -1;
+	}
+}
+
+// size of the cell of a list, without its type.
+static int getListCellLength(const LayerRecordField & field) {
+	const FieldListType &list = field.field_.listvalue_;
+	int length = getVarintSize(list.count_);
+	if (field.fieldtype_ != FTStringList)
+		return length + list.count_ * getListValueSize(field.fieldtype_);
+	const FieldStringType *strs = (const FieldStringType *) list.values_;
+	for (int i = 0; i < list.count_; ++i)
+		length += getVarintSize(strs[i].strlength_) + strs[i].strlength_;
+	return length;
+}
+
+// one run per field for the list values of the given records, all from
+// one arena allocation: runs[j] is where the values of field j start, 8
+// aligned. false, with the reason on stderr, on failure.
+static bool allocateListRuns(LayerArena *arena,
+		const LayerAllRecords & records, const int *rows, int rowcount,
+		char **runs) {
+	int fieldcount = records.getFieldCount();
+	long long *offsets = (long long *) malloc(
+			sizeof(long long) * (fieldcount + 1));
+	if (offsets == NULL) {
+		fprintf(stderr, "Fail to alloc memory for list runs.\n");
+		return false;
+	}
+	offsets[0] = 0;
+	for (int j = 0; j < fieldcount; ++j) {
+		long long runlength = 0;
+		for (int i = 0; i < rowcount; ++i) {
+			const LayerRecordField *field = records.getRecordField(
+					rows ? rows[i] : i, j);
+			if (isListType(field->fieldtype_))
+				runlength += (long long) field->field_.listvalue_.count_
+						* getListValueSize(field->fieldtype_);
+		}
+		offsets[j + 1] = offsets[j] + ((runlength + 7) & ~7LL);
+	}
+	long long total = offsets[fieldcount];
+	char *block = NULL;
+	if (total > LAYER_MAX_LENGTH)
+		fprintf(stderr, "List values pass %lld bytes.\n", LAYER_MAX_LENGTH);
+	else if (total > 0)
+		block = arena->allocate((int) total);
+	for (int j = 0; j < fieldcount; ++j)
+		runs[j] = block ? block + offsets[j] : NULL;
+	free(offsets);
+	return total == 0 || block != NULL;
+}
+
 LayerAllRecords::LayerAllRecords() :
-		recordlength_(0), recordcount_(0), fieldcount_(0), fields_(NULL), buffer_(
-				NULL), bufferflag_(UNINITIALIZED) {
+		recordlength_(0), recordcount_(0), fieldcount_(0), fields_(NULL), columns_(
+				NULL), buffer_(NULL), bufferflag_(UNINITIALIZED), payload_(
+				NULL), callerarena_(NULL) {
+}
+
+LayerAllRecords::LayerAllRecords(LayerArena *arena) :
+		recordlength_(0), recordcount_(0), fieldcount_(0), fields_(NULL), columns_(
+				NULL), buffer_(NULL), bufferflag_(UNINITIALIZED), payload_(
+				NULL), callerarena_(arena) {
 }
 
 LayerAllRecords::LayerAllRecords(const LayerAllRecords & allrecords) :
-		recordlength_(0), recordcount_(0), fieldcount_(0), fields_(NULL), buffer_(
-				NULL), bufferflag_(UNINITIALIZED) {
+		recordlength_(0), recordcount_(0), fieldcount_(0), fields_(NULL), columns_(
+				NULL), buffer_(NULL), bufferflag_(UNINITIALIZED), payload_(
+				NULL), callerarena_(NULL) {
 	setAllRecords(allrecords);
 }
-LayerAllRecords::LayerAllRecords(OGRLayer *layer) :
-		recordlength_(0), recordcount_(0), fieldcount_(0), fields_(NULL), buffer_(
-				NULL), bufferflag_(UNINITIALIZED) {
+LayerAllRecords::LayerAllRecords(OGRLayer *layer, LayerArena *arena) :
+		recordlength_(0), recordcount_(0), fieldcount_(0), fields_(NULL), columns_(
+				NULL), buffer_(NULL), bufferflag_(UNINITIALIZED), payload_(
+				NULL), callerarena_(arena) {
 	setAllRecords(layer);
 }
 
-LayerAllRecords::LayerAllRecords(const char * bytes) :
-		recordlength_(0), recordcount_(0), fieldcount_(0), fields_(NULL), buffer_(
-				NULL), bufferflag_(UNINITIALIZED) {
+LayerAllRecords::LayerAllRecords(const char * bytes, LayerArena *arena) :
+		recordlength_(0), recordcount_(0), fieldcount_(0), fields_(NULL), columns_(
+				NULL), buffer_(NULL), bufferflag_(UNINITIALIZED), payload_(
+				NULL), callerarena_(arena) {
 	setAllRecords(bytes);
 }
 
 LayerAllRecords::~LayerAllRecords() {
-	for (int i = 0; i < recordcount_; ++i) {
-		for (int j = 0; j < fieldcount_; ++j) {
-			int index = i * fieldcount_ + j;
-			switch (fields_[index].fieldtype_) {
-			case FTInteger:
-				break;
-			case FTReal:
-				break;
-			case FTString:
-				if (fields_[index].field_.svalue_.str_)
-					free(fields_[index].field_.svalue_.str_);
-				break;
-			case FTBinary:
-				if (fields_[index].field_.bvalue_.bytes_)
-					free(fields_[index].field_.bvalue_.bytes_);
-				break;
-			case FTDate:
-				break;
-			default:
-				break;
-			}
-		}
-	}
-
-	if (fields_)
-		free(fields_);
+	// the fields go with the payload, once no copy shares it.
+	if (payload_)
+		payload_->release();
 	if (buffer_)
 		free(buffer_);
 }
 
+bool LayerAllRecords::resetFields(int recordcount, int fieldcount) {
+	// a shared payload is left to the copies.
+	if (payload_ && payload_->isShared()) {
+		payload_->release();
+		payload_ = NULL;
+	}
+	if (payload_ == NULL)
+		payload_ = LayerPayload::create();
+	else
+		payload_->getArena()->reset();
+	fields_ = NULL;
+	columns_ = NULL;
+	// the cells are indexed by int, row by row.
+	if (recordcount < 0 || fieldcount < 0
+			|| (fieldcount > 0 && recordcount > INT_MAX / fieldcount)) {
+		fprintf(stderr, "Too many record fields: %d records of %d fields.\n",
+				recordcount, fieldcount);
+		return false;
+	}
+	if (payload_)
+		fields_ = (LayerRecordField *) payload_->resizeItems(
+				(size_t) recordcount * fieldcount, sizeof(LayerRecordField));
+	return fields_ != NULL;
+}
+
+LayerArena *LayerAllRecords::getArena() {
+	// a caller's arena is reset by the caller.
+	return callerarena_ ? callerarena_ : payload_->getArena();
+}
+
 void LayerAllRecords::setAllRecords(OGRLayer *layer) {
 	if (layer == NULL)
 		return;
+	// the cells are encoded on all cpus, then decoded like serialized ones.
+	LayerEncoder encoder(layer, true, false);
+	if (!encoder.encode())
+		return;
+	setAllRecords(encoder);
+}
+
+// size as tagged rows of the fields of fixed-stride rows, which have no
+// strings, binaries nor lists.
+static int getTaggedLength(const LayerRecordField *fields, int recordcount,
+		int fieldcount) {
+	int length = recordcount * getRowBitmapSize(fieldcount);
+	for (int i = 0; i < recordcount * fieldcount; ++i) {
+		if (fields[i].fieldtype_ == FTNull)
+			continue;
+		length += sizeof(char);
+		switch (fields[i].fieldtype_) {
+		case FTInteger:
+			length += getVarintSize(zigzagEncode(fields[i].field_.ivalue_));
+			break;
+		case FTReal:
+			length += sizeof(double);
+			break;
+		case FTInteger64:
+			length += writeVarint64(NULL,
+					zigzagEncode64(fields[i].field_.lvalue_));
+			break;
+		case FTDate:
+		case FTTime:
+		case FTDateTime:
+			length += sizeof(long long);
+			break;
+		default:
+			break;
+		}
+	}
+	return length;
+}
+
+void LayerAllRecords::setAllRecords(const LayerEncoder & encoder) {
 	recordlength_ = 0;
 	// recordlength_
 	recordlength_ += sizeof(recordlength_);
-	// clear
-	for (int i = 0; i < recordcount_; ++i) {
-		for (int j = 0; j < fieldcount_; ++j) {
-			int index = i * fieldcount_ + j;
-			switch (fields_[index].fieldtype_) {
-			case FTInteger:
-				break;
-			case FTReal:
-				break;
-			case FTString: {
-				char *str = fields_[index].field_.svalue_.str_;
-				if (str)
-					free(str);
-			}
-				break;
-			case FTBinary: {
-				char *bytes = fields_[index].field_.bvalue_.bytes_;
-				if (bytes)
-					free(bytes);
-			}
-				break;
-			case FTDate:
-				break;
-			default:
-				break;
-			}
-		}
-	}
 	// recordcount_
-	recordcount_ = 0;
+	recordcount_ = encoder.getFeatureCount();
 	recordlength_ += sizeof(recordcount_);
 	// fieldcount_
-	fieldcount_ = layer->GetLayerDefn()->GetFieldCount();
+	fieldcount_ = encoder.getFieldCount();
 	recordlength_ += sizeof(fieldcount_);
+	recordlength_ += encoder.getRecordLength();
+	const char *types = NULL;
+	if (encoder.getRecordStride() > 0)
+		types = encoder.getFieldTypes();
 
-	layer->ResetReading();
-	for (OGRFeature *feature = layer->GetNextFeature(); feature != NULL;
-			feature = layer->GetNextFeature()) {
-		OGRGeometry *geometry = feature->GetGeometryRef();
-		if (geometry) {
-			++recordcount_;
-
-			for (int ifield = 0; ifield < fieldcount_; ++ifield) {
-				OGRFieldDefn* poField = layer->GetLayerDefn()->GetFieldDefn(
-						ifield);
-				char fieldtype = (char) poField->GetType();
-				recordlength_ += sizeof(fieldtype);
-				switch (fieldtype) {
-				case FTInteger:
-					recordlength_ += sizeof(int);
-					break;
-				case FTReal:
-					recordlength_ += sizeof(double);
-					break;
-				case FTString: {
-					const char *pstr = feature->GetFieldAsString(ifield);
-					int strlength = strlen(pstr) + 1;
-					recordlength_ += sizeof(strlength) + strlength;
-					break;
-				}
-
-				case FTBinary: {
-					int blobsize;
-					feature->GetFieldAsBinary(ifield, &blobsize);
-					int byteslength = blobsize;
-					recordlength_ += sizeof(byteslength) + byteslength;
-					break;
-				}
-
-				case FTDate:
-					recordlength_ += 7 * sizeof(int);
-					break;
-				default:
-					break;
-				}
-			}
-		}
-		OGRFeature::DestroyFeature(feature);
-	}
-
-	if (fields_ == NULL) {
-		fields_ = (LayerRecordField *) malloc(
-				sizeof(LayerRecordField) * recordcount_ * fieldcount_);
-	} else {
-		fields_ = (LayerRecordField *) realloc(fields_,
-				sizeof(LayerRecordField) * recordcount_ * fieldcount_);
-	}
-	if (fields_ == NULL) {
-		fprintf(stderr, "Fail to alloc memory for record fields.\n");
+	if (!resetFields(recordcount_, fieldcount_)) {
+		recordcount_ = 0;
 		return;
 	}
 
-	layer->ResetReading();
-	int ifeature = 0;
-	for (OGRFeature *feature = layer->GetNextFeature(); feature != NULL;
-			feature = layer->GetNextFeature()) {
-		OGRGeometry *geometry = feature->GetGeometryRef();
-		if (geometry) {
-
-			for (int ifield = 0; ifield < fieldcount_; ++ifield) {
-				OGRFieldDefn* poField = layer->GetLayerDefn()->GetFieldDefn(
-						ifield);
-				int index = ifeature * fieldcount_ + ifield;
-				char fieldtype = (char) poField->GetType();
-				fields_[index].fieldtype_ = fieldtype;
-
-				switch (fieldtype) {
-				case FTInteger:
-					fields_[index].field_.ivalue_ = feature->GetFieldAsInteger(
-							ifield);
-					break;
-				case FTReal:
-					fields_[index].field_.dvalue_ = feature->GetFieldAsDouble(
-							ifield);
-					break;
-				case FTString: {
-					const char *pstr = feature->GetFieldAsString(ifield);
-					int strlength = strlen(pstr) + 1;
-					fields_[index].field_.svalue_.strlength_ = strlength;
-					fields_[index].field_.svalue_.str_ = (char *) malloc(
-							strlength);
-					if (fields_[index].field_.svalue_.str_ == NULL) {
-						fprintf(
-								stderr,
-								"Fail to alloc memory for record field string.\n");
-						return;
-					}
-					memcpy(fields_[index].field_.svalue_.str_, pstr, strlength);
-					break;
-				}
-				case FTBinary: {
-					int blobsize;
-					unsigned char * bvalue = feature->GetFieldAsBinary(ifield,
-							&blobsize);
-					fields_[index].field_.bvalue_.byteslength_ = blobsize;
-					fields_[index].field_.bvalue_.bytes_ = (char *) malloc(
-							blobsize);
-					if (fields_[index].field_.bvalue_.bytes_ == NULL) {
-						fprintf(
-								stderr,
-								"Fail to alloc memory for record field bytes array.\n");
-						return;
-					}
-					memcpy(fields_[index].field_.bvalue_.bytes_, bvalue,
-							blobsize);
-					break;
-				}
-				case FTDate:
-					int year, mon, day, hour, min, sec, tag;
-					feature->GetFieldAsDateTime(ifield, &year, &mon, &day,
-							&hour, &min, &sec, &tag);
-					fields_[index].field_.tvalue_.year_ = year;
-					fields_[index].field_.tvalue_.mon_ = mon;
-					fields_[index].field_.tvalue_.day_ = day;
-					fields_[index].field_.tvalue_.hour_ = hour;
-					fields_[index].field_.tvalue_.min_ = min;
-					fields_[index].field_.tvalue_.sec_ = sec;
-					fields_[index].field_.tvalue_.tag_ = tag;
-					break;
-				default:
-					break;
-				}
-			}
-			++ifeature;
-		}
-		OGRFeature::DestroyFeature(feature);
-	}
+	decodeCells(types, encoder.getRecords(), encoder.getRecordLength());
+	buildColumns();
+	// fixed-stride rows are kept as tagged cells.
+	if (types)
+		recordlength_ = 3 * sizeof(int)
+				+ getTaggedLength(fields_, recordcount_, fieldcount_);
 
 	// set buffer flag.
 	if (bufferflag_ == LATEST)
@@ -245,153 +261,209 @@ void LayerAllRecords::setAllRecords(OGRLayer *layer) {
 
 }
 
-void LayerAllRecords::setAllRecords(const char * bytes) {
-	if (bytes == NULL)
-		return;
-
-	int offset = 0;
-	// recordlength_
-	memcpy(&recordlength_, bytes + offset, sizeof(recordlength_));
-	offset += sizeof(recordlength_);
+typedef struct {
+	RecordSection section_;
+	char *cells_;
+	const int *offsets_;
+	LayerRecordField *fields_;
+} RecordDecoding;
 
-	// clear
-	for (int i = 0; i < recordcount_; ++i) {
-		for (int j = 0; j < fieldcount_; ++j) {
-			int index = i * fieldcount_ + j;
-			switch (fields_[index].fieldtype_) {
+static bool decodeRecords(int begin, int end, void *context) {
+	RecordDecoding *decoding = (RecordDecoding *) context;
+	int fieldcount = decoding->section_.fieldcount_;
+	int stride = decoding->section_.stride_;
+	int bitmapsize = getRowBitmapSize(fieldcount);
+	for (int i = begin; i < end; ++i) {
+		int offset = stride > 0 ? i * stride : decoding->offsets_[i];
+		const char *bitmap = decoding->cells_ + offset;
+		offset += bitmapsize;
+		for (int j = 0; j < fieldcount; ++j) {
+			LayerRecordField *field = decoding->fields_ + i * fieldcount + j;
+			const char *value = NULL;
+			offset += readCell(decoding->section_, bitmap,
+					decoding->cells_ + offset, j, &field->fieldtype_, &value);
+			// strings and binaries point into the copy of the cells.
+			char *cell = decoding->cells_ + (value - decoding->cells_);
+			switch (field->fieldtype_) {
 			case FTInteger:
+				field->field_.ivalue_ = readCellInteger(decoding->section_,
+						cell);
+				break;
+			case FTInteger64:
+				field->field_.lvalue_ = readCellInteger64(decoding->section_,
+						cell);
 				break;
 			case FTReal:
+				memcpy(&field->field_.dvalue_, cell,
+						sizeof(field->field_.dvalue_));
 				break;
 			case FTString: {
-				char *str = fields_[index].field_.svalue_.str_;
-				if (str)
-					free(str);
+				FieldStringType *svalue = &field->field_.svalue_;
+				const char *str = NULL;
+				svalue->strlength_ = readCellBytes(cell, &str);
+				svalue->str_ = cell + (str - cell);
 				break;
 			}
 			case FTBinary: {
-				char *bytes = fields_[index].field_.bvalue_.bytes_;
-				if (bytes)
-					free(bytes);
+				FieldBinaryType *bvalue = &field->field_.bvalue_;
+				const char *bytes = NULL;
+				bvalue->byteslength_ = readCellBytes(cell, &bytes);
+				bvalue->bytes_ = cell + (bytes - cell);
 				break;
 			}
 			case FTDate:
+			case FTTime:
+			case FTDateTime: {
+				long long packed = 0;
+				memcpy(&packed, cell, sizeof(packed));
+				unpackDate(packed, &field->field_.tvalue_);
 				break;
+			}
+			case FTIntegerList:
+			case FTInteger64List:
+			case FTRealList:
+			case FTStringList: {
+				// the values in the cell, until placeLists moves them.
+				FieldListType *list = &field->field_.listvalue_;
+				const char *values = NULL;
+				list->count_ = readCellList(cell, &values);
+				list->values_ = cell + (values - cell);
+				break;
+			}
 			default:
 				break;
 			}
 		}
 	}
+	return true;
+}
 
-	// recordcount_
-	memcpy(&recordcount_, bytes + offset, sizeof(recordcount_));
-	offset += sizeof(recordcount_);
-
-	// fieldcount_
-	memcpy(&recordcount_, bytes + offset, sizeof(recordcount_));
-	offset += sizeof(recordcount_);
+int LayerAllRecords::decodeCells(const char *types, const char *cells,
+		int length) {
+	RecordDecoding decoding;
+	decoding.section_.recordcount_ = recordcount_;
+	decoding.section_.fieldcount_ = fieldcount_;
+	decoding.section_.types_ = types;
+	decoding.section_.stride_ =
+			types ? getRecordStride(types, fieldcount_) : 0;
+	decoding.fields_ = fields_;
+	decoding.offsets_ = NULL;
+	// rows of one size need no scan for their offsets.
+	int stride = decoding.section_.stride_;
+	if (stride > 0 && (long long) stride * recordcount_ > length) {
+		fprintf(stderr, "Records overrun their length.\n");
+		recordcount_ = 0;
+		return -1;
+	}
 
-	if (fields_ == NULL) {
-		fields_ = (LayerRecordField *) malloc(
-				sizeof(LayerRecordField) * recordcount_ * fieldcount_);
-	} else {
-		fields_ = (LayerRecordField *) realloc(fields_,
-				sizeof(LayerRecordField) * recordcount_ * fieldcount_);
+	// one copy of all cells in the arena, which the strings and binaries
+	// point into; the rows are then decoded over ranges.
+	char *payload = getArena()->copy(cells, length);
+	int *offsets = NULL;
+	if (payload && stride == 0)
+		offsets = scanRecordOffsets(payload, recordcount_, fieldcount_, length);
+	if (payload == NULL || (stride == 0 && offsets == NULL)) {
+		recordcount_ = 0;
+		return -1;
 	}
-	if (fields_ == NULL) {
-		fprintf(stderr, "Fail to alloc memory for record fields.\n");
-		return;
+	decoding.cells_ = payload;
+	decoding.offsets_ = offsets;
+	runDecodeTasks(recordcount_, decodeRecords, &decoding);
+	int decoded = stride > 0 ? stride * recordcount_ : offsets[recordcount_];
+	if (offsets)
+		free(offsets);
+	// fixed-stride rows have no lists.
+	if (stride == 0 && !placeLists()) {
+		recordcount_ = 0;
+		return -1;
 	}
+	return decoded;
+}
 
+bool LayerAllRecords::placeLists() {
+	char **runs = (char **) malloc(sizeof(char *) * (fieldcount_ + 1));
+	if (runs == NULL) {
+		fprintf(stderr, "Fail to alloc memory for list runs.\n");
+		return false;
+	}
+	if (!allocateListRuns(getArena(), *this, NULL, recordcount_, runs)) {
+		free(runs);
+		return false;
+	}
 	for (int i = 0; i < recordcount_; ++i) {
 		for (int j = 0; j < fieldcount_; ++j) {
-			int index = i * fieldcount_ + j;
-			char fieldtype;
-			memcpy(&fieldtype, bytes + offset, sizeof(fieldtype));
-			offset += sizeof(fieldtype);
-			fields_[index].fieldtype_ = fieldtype;
-			switch (fieldtype) {
-			case FTInteger: {
-				int ivalue = 0;
-				memcpy(&ivalue, bytes + offset, sizeof(ivalue));
-				offset += sizeof(ivalue);
-				fields_[index].field_.ivalue_ = ivalue;
-				break;
-			}
-			case FTReal: {
-				double dvalue = 0;
-				memcpy(&dvalue, bytes + offset, sizeof(dvalue));
-				offset += sizeof(dvalue);
-				fields_[index].field_.dvalue_ = dvalue;
-				break;
-			}
-			case FTString: {
-				int strlength = 0;
-				memcpy(&strlength, bytes + offset, sizeof(strlength));
-				offset += sizeof(strlength);
-				fields_[index].field_.svalue_.strlength_ = strlength;
-				fields_[index].field_.svalue_.str_ = (char *) malloc(strlength);
-				if (fields_[index].field_.svalue_.str_ == NULL) {
-					fprintf(stderr,
-							"Fail to alloc memory for record field string.\n");
-					return;
-				}
-				memcpy(fields_[index].field_.svalue_.str_, bytes + offset,
-						strlength);
-				offset += strlength;
-				break;
-			}
-			case FTBinary: {
-				int blobsize = 0;
-				memcpy(&blobsize, bytes + offset, sizeof(blobsize));
-				offset += sizeof(blobsize);
-				fields_[index].field_.bvalue_.byteslength_ = blobsize;
-				fields_[index].field_.bvalue_.bytes_ = (char *) malloc(
-						blobsize);
-				if (fields_[index].field_.bvalue_.bytes_ == NULL) {
-					fprintf(
-							stderr,
-							"Fail to alloc memory for record field bytes array.\n");
-					return;
-				}
-				memcpy(fields_[index].field_.bvalue_.bytes_, bytes + offset,
-						blobsize);
-				offset += blobsize;
-				break;
-			}
-			case FTDate: {
-				int year, mon, day, hour, min, sec, tag;
-				memcpy(&year, bytes + offset, sizeof(year));
-				offset += sizeof(year);
-				memcpy(&mon, bytes + offset, sizeof(mon));
-				offset += sizeof(mon);
-				memcpy(&day, bytes + offset, sizeof(day));
-				offset += sizeof(day);
-				memcpy(&hour, bytes + offset, sizeof(hour));
-				offset += sizeof(hour);
-				memcpy(&min, bytes + offset, sizeof(min));
-				offset += sizeof(min);
-				memcpy(&sec, bytes + offset, sizeof(sec));
-				offset += sizeof(sec);
-				memcpy(&tag, bytes + offset, sizeof(tag));
-				offset += sizeof(tag);
-
-				fields_[index].field_.tvalue_.year_ = year;
-				fields_[index].field_.tvalue_.mon_ = mon;
-				fields_[index].field_.tvalue_.day_ = day;
-				fields_[index].field_.tvalue_.hour_ = hour;
-				fields_[index].field_.tvalue_.min_ = min;
-				fields_[index].field_.tvalue_.sec_ = sec;
-				fields_[index].field_.tvalue_.tag_ = tag;
-				break;
+			LayerRecordField *field = fields_ + i * fieldcount_ + j;
+			if (!isListType(field->fieldtype_))
+				continue;
+			FieldListType *list = &field->field_.listvalue_;
+			char *values = (char *) list->values_;
+			list->values_ = list->count_ > 0 ? runs[j] : NULL;
+			if (list->count_ == 0)
+				continue;
+			if (field->fieldtype_ != FTStringList) {
+				int size = list->count_ * getListValueSize(field->fieldtype_);
+				memcpy(runs[j], values, size);
+				runs[j] += size;
+				continue;
 			}
-			default:
-				break;
+			// the strings stay in the cells, their lengths are read out.
+			FieldStringType *strs = (FieldStringType *) runs[j];
+			for (int k = 0; k < list->count_; ++k) {
+				const char *str = NULL;
+				strs[k].strlength_ = readCellBytes(values, &str);
+				strs[k].str_ = values + (str - values);
+				values = strs[k].str_ + strs[k].strlength_;
 			}
+			runs[j] += list->count_ * sizeof(FieldStringType);
 		}
 	}
+	free(runs);
+	return true;
+}
+
+void LayerAllRecords::setAllRecords(const char * bytes) {
+	if (bytes == NULL)
+		return;
+
+	int offset = 0;
+	// recordlength_
+	memcpy(&recordlength_, bytes + offset, sizeof(recordlength_));
+	offset += sizeof(recordlength_);
+
+	// recordcount_
+	memcpy(&recordcount_, bytes + offset, sizeof(recordcount_));
+	offset += sizeof(recordcount_);
+
+	// fieldcount_, and the types of fixed-stride rows.
+	RecordSection section;
+	if (!readRecordSection(bytes, recordlength_, &section)) {
+		recordcount_ = 0;
+		return;
+	}
+	fieldcount_ = section.fieldcount_;
+	offset = section.cells_ - bytes;
+
+	if (!resetFields(recordcount_, fieldcount_)) {
+		recordcount_ = 0;
+		return;
+	}
+
+	int decoded = decodeCells(section.types_, bytes + offset,
+			recordlength_ - offset);
+	if (decoded < 0)
+		return;
+	offset += decoded;
+	buildColumns();
 
 	assert(offset == recordlength_);
+	if (section.types_) {
+		// kept as tagged cells: no types in the header, one per cell.
+		recordlength_ = 3 * sizeof(int)
+				+ getTaggedLength(fields_, recordcount_, fieldcount_);
+		if (bufferflag_ == LATEST)
+			bufferflag_ = STALE;
+		return;
+	}
 	// alloc memory for buffer_
 	if (bufferflag_ == UNINITIALIZED) {
 		buffer_ = (char *) malloc(recordlength_);
@@ -411,98 +483,132 @@ void LayerAllRecords::setAllRecords(const char * bytes) {
 }
 
 void LayerAllRecords::setAllRecords(const LayerAllRecords & allrecords) {
-	// recordlength_
-	recordlength_ = allrecords.getRecordLength();
+	if (&allrecords == this)
+		return;
+	// fields on a caller's arena may not outlive it, so they are copied.
+	if (allrecords.callerarena_ || allrecords.payload_ == NULL) {
+		setAllRecords(allrecords, NULL, allrecords.getRecordCount());
+		return;
+	}
+	LayerPayload *payload = allrecords.payload_->retain();
+	if (payload_)
+		payload_->release();
+	payload_ = payload;
+	fields_ = allrecords.fields_;
+	columns_ = allrecords.columns_;
+	recordlength_ = allrecords.recordlength_;
+	recordcount_ = allrecords.recordcount_;
+	fieldcount_ = allrecords.fieldcount_;
 
-	// clear
-	for (int i = 0; i < recordcount_; ++i) {
-		for (int j = 0; j < fieldcount_; ++j) {
-			int index = i * fieldcount_ + j;
-			switch (fields_[index].fieldtype_) {
-			case FTInteger:
-				break;
-			case FTReal:
-				break;
-			case FTString: {
-				char *str = fields_[index].field_.svalue_.str_;
-				if (str)
-					free(str);
-				break;
-			}
-			case FTBinary: {
-				char *bytes = fields_[index].field_.bvalue_.bytes_;
-				if (bytes)
-					free(bytes);
-				break;
-			}
-			case FTDate:
-				break;
-			default:
-				break;
-			}
-		}
+	// set buffer flag.
+	if (bufferflag_ == LATEST)
+		bufferflag_ = STALE;
+}
+
+void LayerAllRecords::setAllRecords(const LayerAllRecords & allrecords,
+		const int *rows, int rowcount) {
+	if (&allrecords == this) {
+		// copied from a share of the fields, which the reset leaves alone.
+		LayerAllRecords source(*this);
+		setAllRecords(source, rows, rowcount);
+		return;
 	}
+	recordlength_ = 0;
+	// recordlength_
+	recordlength_ += sizeof(recordlength_);
 
 	// recordcount_
-	recordcount_ = allrecords.getRecordCount();
+	recordcount_ = rowcount;
+	recordlength_ += sizeof(recordcount_);
 
 	// fieldcount_
 	fieldcount_ = allrecords.getFieldCount();
+	recordlength_ += sizeof(fieldcount_);
 
-	if (fields_ == NULL) {
-		fields_ = (LayerRecordField *) malloc(
-				sizeof(LayerRecordField) * recordcount_ * fieldcount_);
-	} else {
-		fields_ = (LayerRecordField *) realloc(fields_,
-				sizeof(LayerRecordField) * recordcount_ * fieldcount_);
+	if (!resetFields(recordcount_, fieldcount_)) {
+		recordcount_ = 0;
+		return;
 	}
-	if (fields_ == NULL) {
-		fprintf(stderr, "Fail to alloc memory for record fields.\n");
+
+	// the strings and binaries of the rows, from one arena allocation.
+	int payloadlength = 0;
+	for (int i = 0; i < recordcount_; ++i) {
+		for (int j = 0; j < fieldcount_; ++j) {
+			const LayerRecordField *field = allrecords.getRecordField(
+					rows ? rows[i] : i, j);
+			if (field->fieldtype_ == FTString)
+				payloadlength += field->field_.svalue_.strlength_;
+			else if (field->fieldtype_ == FTBinary)
+				payloadlength += field->field_.bvalue_.byteslength_;
+			else if (field->fieldtype_ == FTStringList) {
+				const FieldListType &list = field->field_.listvalue_;
+				const FieldStringType *strs =
+						(const FieldStringType *) list.values_;
+				for (int k = 0; k < list.count_; ++k)
+					payloadlength += strs[k].strlength_;
+			}
+		}
+	}
+	char *payload = getArena()->allocate(payloadlength);
+	// and the values of the lists, one run per field.
+	char **runs = (char **) malloc(sizeof(char *) * (fieldcount_ + 1));
+	if (payload == NULL || runs == NULL
+			|| !allocateListRuns(getArena(), allrecords, rows, recordcount_,
+					runs)) {
+		if (runs)
+			free(runs);
+		recordcount_ = 0;
 		return;
 	}
 
+	int bitmapsize = getRowBitmapSize(fieldcount_);
 	for (int i = 0; i < recordcount_; ++i) {
+		recordlength_ += bitmapsize;
 		for (int j = 0; j < fieldcount_; ++j) {
 			int index = i * fieldcount_ + j;
-			const LayerRecordField *field = allrecords.getRecordField(i, j);
+			const LayerRecordField *field = allrecords.getRecordField(
+					rows ? rows[i] : i, j);
 			char fieldtype = field->fieldtype_;
 			fields_[index].fieldtype_ = fieldtype;
+			// unset fields have no cell.
+			if (fieldtype != FTNull)
+				recordlength_ += sizeof(fieldtype);
 			switch (fieldtype) {
 			case FTInteger:
 				fields_[index].field_.ivalue_ = field->field_.ivalue_;
+				recordlength_ += getVarintSize(
+						zigzagEncode(field->field_.ivalue_));
+				break;
+			case FTInteger64:
+				fields_[index].field_.lvalue_ = field->field_.lvalue_;
+				recordlength_ += writeVarint64(NULL,
+						zigzagEncode64(field->field_.lvalue_));
 				break;
 			case FTReal:
 				fields_[index].field_.dvalue_ = field->field_.dvalue_;
+				recordlength_ += sizeof(double);
 				break;
 			case FTString: {
 				int strlength = field->field_.svalue_.strlength_;
 				fields_[index].field_.svalue_.strlength_ = strlength;
-				fields_[index].field_.svalue_.str_ = (char *) malloc(strlength);
-				if (fields_[index].field_.svalue_.str_ == NULL) {
-					fprintf(stderr,
-							"Fail to alloc memory for record field string.\n");
-					return;
-				}
-				memcpy(fields_[index].field_.svalue_.str_,
-						field->field_.svalue_.str_, strlength);
+				fields_[index].field_.svalue_.str_ = payload;
+				memcpy(payload, field->field_.svalue_.str_, strlength);
+				payload += strlength;
+				recordlength_ += getVarintSize(strlength) + strlength;
 				break;
 			}
 			case FTBinary: {
 				int blobsize = field->field_.bvalue_.byteslength_;
 				fields_[index].field_.bvalue_.byteslength_ = blobsize;
-				fields_[index].field_.bvalue_.bytes_ = (char *) malloc(
-						blobsize);
-				if (fields_[index].field_.bvalue_.bytes_ == NULL) {
-					fprintf(
-							stderr,
-							"Fail to alloc memory for record field bytes array.\n");
-					return;
-				}
-				memcpy(fields_[index].field_.bvalue_.bytes_,
-						field->field_.bvalue_.bytes_, blobsize);
+				fields_[index].field_.bvalue_.bytes_ = payload;
+				memcpy(payload, field->field_.bvalue_.bytes_, blobsize);
+				payload += blobsize;
+				recordlength_ += getVarintSize(blobsize) + blobsize;
 				break;
 			}
-			case FTDate: {
+			case FTDate:
+			case FTTime:
+			case FTDateTime: {
 				fields_[index].field_.tvalue_.year_ =
 						field->field_.tvalue_.year_;
 				fields_[index].field_.tvalue_.mon_ = field->field_.tvalue_.mon_;
@@ -512,6 +618,31 @@ void LayerAllRecords::setAllRecords(const LayerAllRecords & allrecords) {
 				fields_[index].field_.tvalue_.min_ = field->field_.tvalue_.min_;
 				fields_[index].field_.tvalue_.sec_ = field->field_.tvalue_.sec_;
 				fields_[index].field_.tvalue_.tag_ = field->field_.tvalue_.tag_;
+				recordlength_ += sizeof(long long);
+				break;
+			}
+			case FTIntegerList:
+			case FTInteger64List:
+			case FTRealList:
+			case FTStringList: {
+				const FieldListType &list = field->field_.listvalue_;
+				FieldListType *copy = &fields_[index].field_.listvalue_;
+				copy->count_ = list.count_;
+				copy->values_ = list.count_ > 0 ? runs[j] : NULL;
+				int size = list.count_ * getListValueSize(fieldtype);
+				if (size > 0)
+					memcpy(runs[j], list.values_, size);
+				runs[j] += size;
+				// the strings of a copied list are copied too.
+				for (int k = 0; fieldtype == FTStringList && k < list.count_;
+						++k) {
+					FieldStringType *str = (FieldStringType *) copy->values_
+							+ k;
+					memcpy(payload, str->str_, str->strlength_);
+					str->str_ = payload;
+					payload += str->strlength_;
+				}
+				recordlength_ += getListCellLength(fields_[index]);
 				break;
 			}
 			default:
@@ -519,7 +650,144 @@ void LayerAllRecords::setAllRecords(const LayerAllRecords & allrecords) {
 			}
 		}
 	}
+	free(runs);
+	buildColumns();
+
+	// set buffer flag.
+	if (bufferflag_ == LATEST)
+		bufferflag_ = STALE;
+}
+
+void LayerAllRecords::swap(LayerAllRecords & allrecords) {
+	std::swap(recordlength_, allrecords.recordlength_);
+	std::swap(recordcount_, allrecords.recordcount_);
+	std::swap(fieldcount_, allrecords.fieldcount_);
+	std::swap(fields_, allrecords.fields_);
+	std::swap(columns_, allrecords.columns_);
+	std::swap(buffer_, allrecords.buffer_);
+	std::swap(bufferflag_, allrecords.bufferflag_);
+	std::swap(payload_, allrecords.payload_);
+	std::swap(callerarena_, allrecords.callerarena_);
+}
+
+#if __cplusplus >= 201103L
+LayerAllRecords::LayerAllRecords(LayerAllRecords && allrecords) :
+		recordlength_(0), recordcount_(0), fieldcount_(0), fields_(NULL), columns_(
+				NULL), buffer_(NULL), bufferflag_(UNINITIALIZED), payload_(
+				NULL), callerarena_(NULL) {
+	swap(allrecords);
+}
+
+LayerAllRecords & LayerAllRecords::operator=(LayerAllRecords && allrecords) {
+	LayerAllRecords moved(static_cast<LayerAllRecords &&>(allrecords));
+	swap(moved);
+	return *this;
+}
+#endif
+
+int getRecordCellLength(const LayerRecordField & field) {
+	const char fieldtype = field.fieldtype_;
+	switch (fieldtype) {
+	case FTInteger:
+		return sizeof(char)
+				+ getVarintSize(zigzagEncode(field.field_.ivalue_));
+	case FTInteger64:
+		return sizeof(char)
+				+ writeVarint64(NULL, zigzagEncode64(field.field_.lvalue_));
+	case FTReal:
+		return sizeof(char) + sizeof(double);
+	case FTString:
+		return sizeof(char) + getVarintSize(field.field_.svalue_.strlength_)
+				+ field.field_.svalue_.strlength_;
+	case FTBinary:
+		return sizeof(char) + getVarintSize(field.field_.bvalue_.byteslength_)
+				+ field.field_.bvalue_.byteslength_;
+	case FTDate:
+	case FTTime:
+	case FTDateTime:
+		return sizeof(char) + sizeof(long long);
+	case FTIntegerList:
+	case FTInteger64List:
+	case FTRealList:
+	case FTStringList:
+		return sizeof(char) + getListCellLength(field);
+	default:
+		return 0;
+	}
+}
 
+int writeRecordCell(char *bytes, const LayerRecordField & field) {
+	const char fieldtype = field.fieldtype_;
+	if (fieldtype == FTNull)
+		return 0;
+	int offset = 0;
+	memcpy(bytes + offset, &fieldtype, sizeof(fieldtype));
+	offset += sizeof(fieldtype);
+	switch (fieldtype) {
+	case FTInteger: {
+		int ivalue = field.field_.ivalue_;
+		offset += writeVarint(bytes + offset, zigzagEncode(ivalue));
+		break;
+	}
+	case FTInteger64: {
+		long long lvalue = field.field_.lvalue_;
+		offset += writeVarint64(bytes + offset, zigzagEncode64(lvalue));
+		break;
+	}
+	case FTReal: {
+		double dvalue = field.field_.dvalue_;
+		memcpy(bytes + offset, &dvalue, sizeof(dvalue));
+		offset += sizeof(dvalue);
+		break;
+	}
+	case FTString: {
+		int strlength = field.field_.svalue_.strlength_;
+		offset += writeVarint(bytes + offset, strlength);
+		memcpy(bytes + offset, field.field_.svalue_.str_, strlength);
+		offset += strlength;
+		break;
+	}
+	case FTBinary: {
+		int byteslength = field.field_.bvalue_.byteslength_;
+		offset += writeVarint(bytes + offset, byteslength);
+		memcpy(bytes + offset, field.field_.bvalue_.bytes_, byteslength);
+		offset += byteslength;
+		break;
+	}
+	case FTDate:
+	case FTTime:
+	case FTDateTime: {
+		long long packed = packDate(field.field_.tvalue_);
+		memcpy(bytes + offset, &packed, sizeof(packed));
+		offset += sizeof(packed);
+		break;
+	}
+	case FTIntegerList:
+	case FTInteger64List:
+	case FTRealList: {
+		const FieldListType &list = field.field_.listvalue_;
+		offset += writeVarint(bytes + offset, list.count_);
+		int size = list.count_ * getListValueSize(fieldtype);
+		if (size > 0)
+			memcpy(bytes + offset, list.values_, size);
+		offset += size;
+		break;
+	}
+	case FTStringList: {
+		const FieldListType &list = field.field_.listvalue_;
+		offset += writeVarint(bytes + offset, list.count_);
+		const FieldStringType *strs = (const FieldStringType *) list.values_;
+		for (int k = 0; k < list.count_; ++k) {
+			offset += writeVarint(bytes + offset, strs[k].strlength_);
+			memcpy(bytes + offset, strs[k].str_, strs[k].strlength_);
+			offset += strs[k].strlength_;
+		}
+		break;
+	}
+	default:
+		break;
+	}
+	return offset;
 }
 
 const char *LayerAllRecords::getBytes() {
@@ -547,62 +815,18 @@ const char *LayerAllRecords::getBytes() {
 	memcpy(bytes + offset, &fieldcount_, sizeof(fieldcount_));
 	offset += sizeof(fieldcount_);
 
+	int bitmapsize = getRowBitmapSize(fieldcount_);
 	for (int i = 0; i < recordcount_; ++i) {
+		char *bitmap = bytes + offset;
+		memset(bitmap, 0, bitmapsize);
+		offset += bitmapsize;
 		for (int j = 0; j < fieldcount_; ++j) {
 			int index = i * fieldcount_ + j;
 			char fieldtype = fields_[index].fieldtype_;
-			memcpy(bytes + offset, &fieldtype, sizeof(fieldtype));
-			offset += sizeof(fieldtype);
-			switch (fieldtype) {
-			case FTInteger: {
-				int ivalue = fields_[index].field_.ivalue_;
-				memcpy(bytes + offset, &ivalue, sizeof(ivalue));
-				offset += sizeof(ivalue);
-				break;
-			}
-			case FTReal: {
-				double dvalue = fields_[index].field_.dvalue_;
-				memcpy(bytes + offset, &dvalue, sizeof(dvalue));
-				offset += sizeof(dvalue);
-				break;
-			}
-			case FTString: {
-				int strlength = fields_[index].field_.svalue_.strlength_;
-				memcpy(bytes + offset, &strlength, sizeof(strlength));
-				offset += sizeof(strlength);
-				char *str = fields_[index].field_.svalue_.str_;
-				memcpy(bytes + offset, str, strlength);
-				break;
-			}
-			case FTBinary: {
-				int byteslength = fields_[index].field_.bvalue_.byteslength_;
-				memcpy(bytes + offset, &byteslength, sizeof(byteslength));
-				offset += sizeof(byteslength);
-				char *str = fields_[index].field_.bvalue_.bytes_;
-				memcpy(bytes + offset, str, byteslength);
-				break;
-			}
-			case FTDate: {
-				FieldDateType & time = fields_[index].field_.tvalue_;
-				memcpy(bytes + offset, &time.year_, sizeof(time.year_));
-				offset += sizeof(time.year_);
-				memcpy(bytes + offset, &time.mon_, sizeof(time.mon_));
-				offset += sizeof(time.mon_);
-				memcpy(bytes + offset, &time.day_, sizeof(time.day_));
-				offset += sizeof(time.day_);
-				memcpy(bytes + offset, &time.hour_, sizeof(time.hour_));
-				offset += sizeof(time.hour_);
-				memcpy(bytes + offset, &time.min_, sizeof(time.min_));
-				offset += sizeof(time.min_);
-				memcpy(bytes + offset, &time.sec_, sizeof(time.sec_));
-				offset += sizeof(time.sec_);
-				memcpy(bytes + offset, &time.tag_, sizeof(time.tag_));
-				offset += sizeof(time.tag_);
-				break;
-			}
-			default:
-				break;
-			}
+			if (fieldtype == FTNull)
+				continue;
+			bitmap[j / 8] |= 1 << (j % 8);
+			offset += writeRecordCell(bytes + offset, fields_[index]);
 		}
 	}
 
@@ -641,3 +865,373 @@ const LayerRecordField *LayerAllRecords::getRecordField(int rindex,
 		return NULL;
 	return &fields_[rindex * fieldcount_ + findex];
 }
+
+bool LayerAllRecords::isNull(int rindex, int findex) const {
+	const LayerRecordField *field = getRecordField(rindex, findex);
+	return field != NULL && field->fieldtype_ == FTNull;
+}
+
+const void *LayerAllRecords::getList(int rindex, int findex, char fieldtype,
+		int *count) const {
+	const LayerRecordField *field = getRecordField(rindex, findex);
+	if (field == NULL || field->fieldtype_ != fieldtype) {
+		*count = 0;
+		return NULL;
+	}
+	*count = field->field_.listvalue_.count_;
+	return field->field_.listvalue_.values_;
+}
+
+const int *LayerAllRecords::getIntegerList(int rindex, int findex,
+		int *count) const {
+	return (const int *) getList(rindex, findex, FTIntegerList, count);
+}
+
+const long long *LayerAllRecords::getInteger64List(int rindex, int findex,
+		int *count) const {
+	return (const long long *) getList(rindex, findex, FTInteger64List, count);
+}
+
+const double *LayerAllRecords::getRealList(int rindex, int findex,
+		int *count) const {
+	return (const double *) getList(rindex, findex, FTRealList, count);
+}
+
+const FieldStringType *LayerAllRecords::getStringList(int rindex, int findex,
+		int *count) const {
+	return (const FieldStringType *) getList(rindex, findex, FTStringList,
+			count);
+}
+
+void LayerAllRecords::reorder(const int *order) {
+	if (order == NULL || recordcount_ == 0 || fieldcount_ == 0)
+		return;
+	if (payload_->isShared()) {
+		// the copies keep their order, this object gets its own fields.
+		LayerAllRecords source(*this);
+		setAllRecords(source, order, recordcount_);
+		return;
+	}
+	LayerRecordField *fields = (LayerRecordField *) malloc(
+			sizeof(LayerRecordField) * recordcount_ * fieldcount_);
+	if (fields == NULL) {
+		fprintf(stderr, "Fail to alloc memory for record fields.\n");
+		return;
+	}
+	for (int i = 0; i < recordcount_; ++i) {
+		memcpy(&fields[i * fieldcount_], &fields_[order[i] * fieldcount_],
+				sizeof(LayerRecordField) * fieldcount_);
+	}
+	memcpy(fields_, fields,
+			sizeof(LayerRecordField) * recordcount_ * fieldcount_);
+	free(fields);
+	// the number columns follow, through a buffer of one column.
+	double *column = NULL;
+	for (int j = 0; columns_ && j < fieldcount_; ++j) {
+		if (columns_[j] == NULL)
+			continue;
+		if (column == NULL)
+			column = (double *) malloc(sizeof(double) * recordcount_);
+		if (column == NULL) {
+			fprintf(stderr, "Fail to alloc memory for column.\n");
+			buildColumns();
+			break;
+		}
+		for (int i = 0; i < recordcount_; ++i)
+			column[i] = columns_[j][order[i]];
+		memcpy(columns_[j], column, sizeof(double) * recordcount_);
+	}
+	if (column)
+		free(column);
+
+	// set buffer flag.
+	if (bufferflag_ == LATEST)
+		bufferflag_ = STALE;
+}
+
+#if __cplusplus >= 201103L
+LayerSpan<const LayerRecordField> LayerAllRecords::getRecordSpan(
+		int index) const {
+	const LayerRecordField *record = getRecord(index);
+	return LayerSpan<const LayerRecordField>(record, record ? fieldcount_ : 0);
+}
+
+LayerSpan<const int> LayerAllRecords::getIntegerListSpan(int rindex,
+		int findex) const {
+	int count = 0;
+	const int *values = getIntegerList(rindex, findex, &count);
+	return LayerSpan<const int>(values, count);
+}
+
+LayerSpan<const long long> LayerAllRecords::getInteger64ListSpan(int rindex,
+		int findex) const {
+	int count = 0;
+	const long long *values = getInteger64List(rindex, findex, &count);
+	return LayerSpan<const long long>(values, count);
+}
+
+LayerSpan<const double> LayerAllRecords::getRealListSpan(int rindex,
+		int findex) const {
+	int count = 0;
+	const double *values = getRealList(rindex, findex, &count);
+	return LayerSpan<const double>(values, count);
+}
+
+LayerSpan<const FieldStringType> LayerAllRecords::getStringListSpan(
+		int rindex, int findex) const {
+	int count = 0;
+	const FieldStringType *values = getStringList(rindex, findex, &count);
+	return LayerSpan<const FieldStringType>(values, count);
+}
+
+LayerSpan<const double> LayerAllRecords::getNumberColumnSpan(
+		int findex) const {
+	const double *column = getNumberColumn(findex);
+	return LayerSpan<const double>(column, column ? recordcount_ : 0);
+}
+#endif
+
+typedef struct {
+	const LayerRecordField *fields_;
+	int fieldcount_;
+	double **columns_;
+} ColumnFilling;
+
+static bool fillColumns(int begin, int end, void *context) {
+	ColumnFilling *filling = (ColumnFilling *) context;
+	for (int j = 0; j < filling->fieldcount_; ++j) {
+		double *column = filling->columns_[j];
+		if (column == NULL)
+			continue;
+		const LayerRecordField *field = filling->fields_
+				+ begin * filling->fieldcount_ + j;
+		for (int i = begin; i < end; ++i, field += filling->fieldcount_) {
+			if (field->fieldtype_ == FTReal)
+				column[i] = field->field_.dvalue_;
+			else if (field->fieldtype_ == FTInteger)
+				column[i] = field->field_.ivalue_;
+			else if (field->fieldtype_ == FTInteger64)
+				column[i] = (double) field->field_.lvalue_;
+			else
+				column[i] = NAN;
+		}
+	}
+	return true;
+}
+
+bool LayerAllRecords::buildColumns() {
+	columns_ = NULL;
+	if (fieldcount_ == 0)
+		return true;
+	LayerArena *arena = getArena();
+	double **columns = (double **) arena->allocate(
+			sizeof(double *) * fieldcount_);
+	if (columns == NULL) {
+		fprintf(stderr, "Fail to alloc memory for columns.\n");
+		return false;
+	}
+	for (int j = 0; j < fieldcount_; ++j) {
+		columns[j] = NULL;
+		char fieldtype = FTNull;
+		for (int i = 0; i < recordcount_ && fieldtype == FTNull; ++i)
+			fieldtype = fields_[i * fieldcount_ + j].fieldtype_;
+		if (fieldtype != FTInteger && fieldtype != FTInteger64
+				&& fieldtype != FTReal)
+			continue;
+		if ((long long) sizeof(double) * recordcount_ > LAYER_MAX_LENGTH) {
+			fprintf(stderr, "Column passes %lld bytes.\n", LAYER_MAX_LENGTH);
+			return false;
+		}
+		columns[j] = (double *) arena->allocate(sizeof(double) * recordcount_);
+		if (columns[j] == NULL) {
+			fprintf(stderr, "Fail to alloc memory for column.\n");
+			return false;
+		}
+	}
+	ColumnFilling filling;
+	filling.fields_ = fields_;
+	filling.fieldcount_ = fieldcount_;
+	filling.columns_ = columns;
+	runDecodeTasks(recordcount_, fillColumns, &filling);
+	columns_ = columns;
+	return true;
+}
+
+const double *LayerAllRecords::getNumberColumn(int findex) const {
+	if (findex < 0 || findex >= fieldcount_ || columns_ == NULL)
+		return NULL;
+	return columns_[findex];
+}
+
+double *LayerAllRecords::getColumn(int findex) const {
+	if (findex < 0 || findex >= fieldcount_) {
+		fprintf(stderr, "Invalid field index.\n");
+		return NULL;
+	}
+	double *column = (double *) malloc(sizeof(double) * (recordcount_ + 1));
+	if (column == NULL) {
+		fprintf(stderr, "Fail to alloc memory for column.\n");
+		return NULL;
+	}
+	const double *numbers = getNumberColumn(findex);
+	if (numbers) {
+		memcpy(column, numbers, sizeof(double) * recordcount_);
+	} else {
+		for (int i = 0; i < recordcount_; ++i)
+			column[i] = NAN;
+	}
+	return column;
+}
+
+bool LayerAllRecords::aggregate(int findex, ColumnAggregate *aggregate) const {
+	if (findex < 0 || findex >= fieldcount_) {
+		fprintf(stderr, "Invalid field index.\n");
+		return false;
+	}
+	// the kernels run on the column in place; no column, no numbers.
+	const double *column = getNumberColumn(findex);
+	aggregateColumn(column, column ? recordcount_ : 0, aggregate);
+	return aggregate->count_ > 0;
+}
+
+bool LayerAllRecords::histogram(int findex, double min, double max,
+		int bincount, int *counts) const {
+	if (findex < 0 || findex >= fieldcount_) {
+		fprintf(stderr, "Invalid field index.\n");
+		return false;
+	}
+	const double *column = getNumberColumn(findex);
+	histogramColumn(column, column ? recordcount_ : 0, min, max, bincount,
+			counts);
+	return true;
+}
+
+// the group key of a cell, hashed.
+static unsigned int hashGroupKey(const LayerRecordField & field) {
+	unsigned int hash = 2166136261u;
+	const unsigned char *bytes;
+	int length;
+	if (field.fieldtype_ == FTString) {
+		bytes = (const unsigned char *) field.field_.svalue_.str_;
+		length = field.field_.svalue_.strlength_;
+	} else {
+		bytes = (const unsigned char *) &field.field_.ivalue_;
+		length = sizeof(field.field_.ivalue_);
+	}
+	for (int i = 0; i < length; ++i) {
+		hash ^= bytes[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+static bool equalGroupKey(const LayerRecordField & a,
+		const LayerRecordField & b) {
+	if (a.fieldtype_ != b.fieldtype_)
+		return false;
+	if (a.fieldtype_ == FTString)
+		return a.field_.svalue_.strlength_ == b.field_.svalue_.strlength_
+				&& memcmp(a.field_.svalue_.str_, b.field_.svalue_.str_,
+						a.field_.svalue_.strlength_) == 0;
+	return a.field_.ivalue_ == b.field_.ivalue_;
+}
+
+int LayerAllRecords::aggregateGroups(int gindex, int findex, int **keys,
+		ColumnAggregate **aggregates) const {
+	*keys = NULL;
+	*aggregates = NULL;
+	if (gindex < 0 || gindex >= fieldcount_) {
+		fprintf(stderr, "Invalid group field index.\n");
+		return -1;
+	}
+	if (findex < 0 || findex >= fieldcount_) {
+		fprintf(stderr, "Invalid field index.\n");
+		return -1;
+	}
+	const double *column = getNumberColumn(findex);
+
+	// open addressing from key hash to group, grown at half load.
+	int slotcount = 64;
+	int *slots = (int *) malloc(sizeof(int) * slotcount);
+	int *groups = (int *) malloc(sizeof(int) * (recordcount_ + 1));
+	int groupcount = 0, keycapacity = 16;
+	*keys = (int *) malloc(sizeof(int) * keycapacity);
+	if (slots == NULL || groups == NULL || *keys == NULL) {
+		fprintf(stderr, "Fail to alloc memory for groups.\n");
+		groupcount = -1;
+	} else {
+		memset(slots, -1, sizeof(int) * slotcount);
+	}
+	for (int i = 0; groupcount >= 0 && i < recordcount_; ++i) {
+		const LayerRecordField &key = fields_[i * fieldcount_ + gindex];
+		if (key.fieldtype_ != FTInteger && key.fieldtype_ != FTString) {
+			groups[i] = -1;
+			continue;
+		}
+		unsigned int slot = hashGroupKey(key) & (slotcount - 1);
+		while (slots[slot] >= 0
+				&& !equalGroupKey(fields_[(*keys)[slots[slot]] * fieldcount_
+						+ gindex], key))
+			slot = (slot + 1) & (slotcount - 1);
+		if (slots[slot] >= 0) {
+			groups[i] = slots[slot];
+			continue;
+		}
+
+		if (groupcount == keycapacity) {
+			keycapacity *= 2;
+			int *grown = (int *) realloc(*keys, sizeof(int) * keycapacity);
+			if (grown == NULL) {
+				fprintf(stderr, "Fail to alloc memory for groups.\n");
+				groupcount = -1;
+				break;
+			}
+			*keys = grown;
+		}
+		(*keys)[groupcount] = i;
+		slots[slot] = groupcount;
+		groups[i] = groupcount++;
+
+		if (2 * groupcount > slotcount) {
+			int *grown = (int *) malloc(sizeof(int) * slotcount * 2);
+			if (grown == NULL) {
+				fprintf(stderr, "Fail to alloc memory for groups.\n");
+				groupcount = -1;
+				break;
+			}
+			free(slots);
+			slots = grown;
+			slotcount *= 2;
+			memset(slots, -1, sizeof(int) * slotcount);
+			for (int j = 0; j < groupcount; ++j) {
+				unsigned int rehash = hashGroupKey(
+						fields_[(*keys)[j] * fieldcount_ + gindex])
+						& (slotcount - 1);
+				while (slots[rehash] >= 0)
+					rehash = (rehash + 1) & (slotcount - 1);
+				slots[rehash] = j;
+			}
+		}
+	}
+
+	if (groupcount >= 0) {
+		*aggregates = (ColumnAggregate *) malloc(
+				sizeof(ColumnAggregate) * (groupcount + 1));
+		if (*aggregates == NULL) {
+			fprintf(stderr, "Fail to alloc memory for group aggregates.\n");
+			groupcount = -1;
+		} else {
+			::aggregateGroups(column, groups, column ? recordcount_ : 0,
+					groupcount, *aggregates);
+		}
+	}
+	if (groupcount < 0 && *keys) {
+		free(*keys);
+		*keys = NULL;
+	}
+	if (slots)
+		free(slots);
+	if (groups)
+		free(groups);
+	return groupcount;
+}
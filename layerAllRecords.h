@@ -7,12 +7,27 @@
 #ifndef LAYERALLRECORDS_H_
 #define LAYERALLRECORDS_H_
 
+#include "columnKernels.h"
+#include "layerArena.h"
+#include "layerSpan.h"
+
 class OGRLayer;
+class LayerEncoder;
 
+// the OGRFieldType of a field, or FTNull for a field that is not set. the
+// wide strings of OGR are not stored, their fields are left unset.
 typedef enum {
-	FTInteger = 0, FTReal = 2, FTString = 4, FTBinary = 8, FTDate = 9
+	FTInteger = 0, FTIntegerList = 1, FTReal = 2, FTRealList = 3,
+	FTString = 4, FTStringList = 5, FTBinary = 8, FTDate = 9, FTTime = 10,
+	FTDateTime = 11, FTInteger64 = 12, FTInteger64List = 13,
+	FTNull = 0x7f
 } FieldType;
 
+// true for the list types, whose values are decoded into arrays.
+bool isListType(char fieldtype);
+// size of a value of a list type in its array, -1 for other types.
+int getListValueSize(char fieldtype);
+
 typedef struct {
 	int strlength_;
 	char * str_;
@@ -27,24 +42,51 @@ typedef struct {
 	int year_, mon_, day_, hour_, min_, sec_, tag_;
 } FieldDateType;
 
+// count values of a list: ints, long longs, doubles or FieldStringTypes.
+typedef struct {
+	int count_;
+	void *values_;
+} FieldListType;
+
+// A date, a time or a date and time is serialized as one long long, ordered as the dates are: from the
+// top, year, mon (4 bits), day (5), hour (5), min (6), sec (6) and the time
+// zone tag of OGR (8). Fields out of those ranges do not survive packing.
+long long packDate(const FieldDateType & date);
+void unpackDate(long long packed, FieldDateType *date);
+// the packed date without its tag, to compare dates of one time zone.
+long long getDateKey(long long packed);
+
 typedef struct {
 	char fieldtype_;
 	union {
 		int ivalue_;
+		long long lvalue_;
 		double dvalue_;
 		FieldStringType svalue_;
 		FieldBinaryType bvalue_;
 		FieldDateType tvalue_;
+		FieldListType listvalue_;
 	} field_;
 
 } LayerRecordField;
 
+// the tagged cell of a set field, its fieldtype_ and value as a record row
+// holds them: its size, and the cell written to bytes. 0 for FTNull.
+int getRecordCellLength(const LayerRecordField & field);
+int writeRecordCell(char *bytes, const LayerRecordField & field);
+
+// strings and binaries are drawn from an arena: the object's own, or one
+// given by the caller, which must outlive the object. Copies of an object on
+// its own arena share its fields, in O(1), until one of them changes them.
+// The values of the lists of a field are kept in one array per field, from
+// the same arena, in record order; every list points at its own run.
 class LayerAllRecords {
 public:
 	LayerAllRecords();
+	explicit LayerAllRecords(LayerArena *arena);
 	LayerAllRecords(const LayerAllRecords & allrecords);
-	LayerAllRecords(OGRLayer *layer);
-	LayerAllRecords(const char * bytes);
+	LayerAllRecords(OGRLayer *layer, LayerArena *arena = 0);
+	LayerAllRecords(const char * bytes, LayerArena *arena = 0);
 	~LayerAllRecords();
 
 	const char *getBytes();
@@ -55,10 +97,65 @@ public:
 	const LayerRecordField *getRecords() const;
 	const LayerRecordField *getRecord(int index) const;
 	const LayerRecordField *getRecordField(int rindex, int findex) const;
+	// true for a field the feature had not set.
+	bool isNull(int rindex, int findex) const;
+	// the values of a list field, in place, and their count. NULL, with a
+	// count of 0, for an empty list or a field of another type.
+	const int *getIntegerList(int rindex, int findex, int *count) const;
+	const long long *getInteger64List(int rindex, int findex,
+			int *count) const;
+	const double *getRealList(int rindex, int findex, int *count) const;
+	const FieldStringType *getStringList(int rindex, int findex,
+			int *count) const;
 
 	void setAllRecords(OGRLayer *layer);
 	void setAllRecords(const char * bytes);
 	void setAllRecords(const LayerAllRecords & allrecords);
+	// the records of a layer encoded with its records.
+	void setAllRecords(const LayerEncoder & encoder);
+	// copy of the given rows only, all of them if rows is NULL.
+	void setAllRecords(const LayerAllRecords & allrecords, const int *rows,
+			int rowcount);
+
+	// exchanges the contents of two objects in O(1), without allocating.
+	void swap(LayerAllRecords & allrecords);
+#if __cplusplus >= 201103L
+	// moves leave the source empty, as if default constructed.
+	LayerAllRecords(LayerAllRecords && allrecords);
+	LayerAllRecords & operator=(LayerAllRecords && allrecords);
+	// the fields of a record, and the lists and number columns as their
+	// getters give them; empty where those give NULL.
+	LayerSpan<const LayerRecordField> getRecordSpan(int index) const;
+	LayerSpan<const int> getIntegerListSpan(int rindex, int findex) const;
+	LayerSpan<const long long> getInteger64ListSpan(int rindex,
+			int findex) const;
+	LayerSpan<const double> getRealListSpan(int rindex, int findex) const;
+	LayerSpan<const FieldStringType> getStringListSpan(int rindex,
+			int findex) const;
+	LayerSpan<const double> getNumberColumnSpan(int findex) const;
+#endif
+
+	// puts record order[i] at position i, see LayerAllFeatures::reorder.
+	void reorder(const int *order);
+
+	// the numbers of a FTInteger, FTInteger64 or FTReal field, one double a
+	// record, NaN where a cell is not set, kept contiguous from the decoding
+	// on and shared by copies. NULL for a field of another type: a field is
+	// numeric when its first set cell is.
+	const double *getNumberColumn(int findex) const;
+	// a copy of the number column, all NaN for a field of another type.
+	// free() by caller.
+	double *getColumn(int findex) const;
+	// aggregates of a numeric field, over the records where it is a number.
+	bool aggregate(int findex, ColumnAggregate *aggregate) const;
+	bool histogram(int findex, double min, double max, int bincount,
+			int *counts) const;
+	// aggregates of field findex per distinct value of the FTInteger or
+	// FTString field gindex, which should have few. keys[i] is the first
+	// record of group i. keys and aggregates are free() by caller. returns
+	// the group count, -1 on error.
+	int aggregateGroups(int gindex, int findex, int **keys,
+			ColumnAggregate **aggregates) const;
 
 private:
 	typedef enum {
@@ -67,14 +164,33 @@ private:
 
 	void operator=(const LayerAllRecords &);
 
+	// the cells of recordcount rows of fieldcount fields, false, with the
+	// reason on stderr, when they do not fit.
+	bool resetFields(int recordcount, int fieldcount);
+	LayerArena *getArena();
+	// types of fixed-stride rows, NULL for tagged cells.
+	int decodeCells(const char *types, const char *cells, int length);
+	// moves the values of the decoded lists to their arrays.
+	bool placeLists();
+	const void *getList(int rindex, int findex, char fieldtype,
+			int *count) const;
+	// the number columns of the fields, from the arena of the fields.
+	bool buildColumns();
+
 	int recordlength_;
 	int recordcount_;
 	int fieldcount_;
 
 	LayerRecordField * fields_;
+	// per field, its number column or NULL.
+	double **columns_;
 
 	char *buffer_;
 	BufferFlagType bufferflag_;
+
+	// the fields and their arena, shared by copies.
+	LayerPayload *payload_;
+	LayerArena *callerarena_;
 };
 
 #endif /* LAYERALLRECORDS_H_ */
@@ -0,0 +1,164 @@
+/// @file layerArena.cc
+/// @author luliang@ict.ac.cn
+/// @copybrief Copyright 2013 ICT, CAS. All rights reserved.
+/// @version 0.1
+/// @date 2026-10-19
+
+#include "layerArena.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <new>
+
+// block headers are padded so that the data after them stays aligned.
+static const int ARENA_HEADER_SIZE = (sizeof(ArenaBlock) + 7) & ~7;
+
+LayerArena::LayerArena(int blocksize) :
+		blocksize_(blocksize > 0 ? blocksize : 64 * 1024), blocks_(NULL), allocated_(
+				0) {
+}
+
+LayerArena::~LayerArena() {
+	while (blocks_) {
+		ArenaBlock *next = blocks_->next_;
+		free(blocks_);
+		blocks_ = next;
+	}
+}
+
+ArenaBlock *LayerArena::addBlock(int size) {
+	ArenaBlock *block = (ArenaBlock *) malloc(ARENA_HEADER_SIZE + size);
+	if (block == NULL) {
+		fprintf(stderr, "Fail to alloc memory for arena block.\n");
+		return NULL;
+	}
+	block->size_ = size;
+	block->used_ = 0;
+	return block;
+}
+
+char *LayerArena::allocate(int size) {
+	if (size < 0 || size > 0x7fffffff - 7) {
+		fprintf(stderr, "Bad arena allocation size %d.\n", size);
+		return NULL;
+	}
+	int aligned = (size + 7) & ~7;
+	ArenaBlock *block = blocks_;
+	if (block == NULL || block->size_ - block->used_ < aligned) {
+		if (aligned > blocksize_ / 4 && block != NULL) {
+			// a big allocation gets a block of its own behind the current
+			// one, which stays in use for the small ones.
+			ArenaBlock *big = addBlock(aligned);
+			if (big == NULL)
+				return NULL;
+			big->next_ = block->next_;
+			block->next_ = big;
+			block = big;
+		} else {
+			block = addBlock(aligned > blocksize_ ? aligned : blocksize_);
+			if (block == NULL)
+				return NULL;
+			block->next_ = blocks_;
+			blocks_ = block;
+		}
+	}
+	char *data = (char *) block + ARENA_HEADER_SIZE + block->used_;
+	block->used_ += aligned;
+	allocated_ += size;
+	return data;
+}
+
+char *LayerArena::copy(const void *data, int size) {
+	char *bytes = allocate(size);
+	if (bytes && size > 0)
+		memcpy(bytes, data, size);
+	return bytes;
+}
+
+void LayerArena::reset() {
+	ArenaBlock *largest = blocks_;
+	for (ArenaBlock *block = blocks_; block != NULL; block = block->next_) {
+		if (block->size_ > largest->size_)
+			largest = block;
+	}
+	while (blocks_) {
+		ArenaBlock *next = blocks_->next_;
+		if (blocks_ != largest)
+			free(blocks_);
+		blocks_ = next;
+	}
+	if (largest) {
+		largest->next_ = NULL;
+		largest->used_ = 0;
+	}
+	blocks_ = largest;
+	allocated_ = 0;
+}
+
+long long LayerArena::getAllocated() const {
+	return allocated_;
+}
+
+void LayerArena::swap(LayerArena & arena) {
+	std::swap(blocksize_, arena.blocksize_);
+	std::swap(blocks_, arena.blocks_);
+	std::swap(allocated_, arena.allocated_);
+}
+
+LayerPayload::LayerPayload() :
+		refcount_(1), items_(NULL) {
+}
+
+LayerPayload::~LayerPayload() {
+	if (items_)
+		free(items_);
+}
+
+LayerPayload *LayerPayload::create() {
+	LayerPayload *payload = new (std::nothrow) LayerPayload();
+	if (payload == NULL)
+		fprintf(stderr, "Fail to alloc memory for layer payload.\n");
+	return payload;
+}
+
+LayerPayload *LayerPayload::retain() {
+	__sync_add_and_fetch(&refcount_, 1);
+	return this;
+}
+
+void LayerPayload::release() {
+	if (__sync_sub_and_fetch(&refcount_, 1) == 0)
+		delete this;
+}
+
+bool LayerPayload::isShared() const {
+	return *(volatile const int *) &refcount_ > 1;
+}
+
+LayerArena *LayerPayload::getArena() {
+	return &arena_;
+}
+
+void *LayerPayload::getItems() const {
+	return items_;
+}
+
+void *LayerPayload::resizeItems(size_t count, size_t itemsize) {
+	if (itemsize > 0 && count > (size_t) -1 / itemsize) {
+		fprintf(stderr, "Too many layer items: %lu of %lu bytes.\n",
+				(unsigned long) count, (unsigned long) itemsize);
+		return NULL;
+	}
+	// never zero bytes, which realloc may answer with NULL.
+	size_t size = count * itemsize;
+	void *items = realloc(items_, size > 0 ? size : 1);
+	if (items == NULL) {
+		fprintf(stderr, "Fail to alloc memory for layer items.\n");
+		return NULL;
+	}
+	items_ = items;
+	return items_;
+}
@@ -0,0 +1,83 @@
+/// @file layerArena.h
+/// @author luliang@ict.ac.cn
+/// @copybrief Copyright 2013 ICT, CAS. All rights reserved.
+/// @version 0.1
+/// @date 2026-10-19
+
+#ifndef LAYERARENA_H_
+#define LAYERARENA_H_
+
+#include <stddef.h>
+
+typedef struct ArenaBlock {
+	struct ArenaBlock *next_;
+	int size_;
+	int used_;
+} ArenaBlock;
+
+// Bump allocator for the strings, binaries, wkb and titles of the Layer*
+// objects. Allocations are only released all at once, by reset() or the
+// destructor. One arena may back several objects, e.g. the parts of one
+// layer, and be reset between requests once they are gone. Not thread safe.
+class LayerArena {
+public:
+	LayerArena(int blocksize = 64 * 1024);
+	~LayerArena();
+
+	// size bytes aligned to 8, valid until reset(). NULL, with the reason on
+	// stderr, on failure.
+	char *allocate(int size);
+	char *copy(const void *data, int size);
+
+	// releases all allocations, keeping the largest block for reuse.
+	void reset();
+
+	// bytes handed out since the last reset.
+	long long getAllocated() const;
+
+	// exchanges the blocks of two arenas, in O(1).
+	void swap(LayerArena & arena);
+
+private:
+	LayerArena(const LayerArena &);
+	void operator=(const LayerArena &);
+
+	ArenaBlock *addBlock(int size);
+
+	int blocksize_;
+	ArenaBlock *blocks_; // the block allocated from first
+	long long allocated_;
+};
+
+// The contents of a Layer* object, shared by its copies: the item array and
+// the arena its strings, binaries, wkb or titles are drawn from. Copies
+// share one payload through an atomic reference count, so they may live on
+// other threads; an object about to change a shared payload makes its own.
+class LayerPayload {
+public:
+	// NULL, with the reason on stderr, on failure.
+	static LayerPayload *create();
+
+	LayerPayload *retain();
+	// the last release deletes the payload.
+	void release();
+	bool isShared() const;
+
+	LayerArena *getArena();
+	void *getItems() const;
+	// the item array resized to count items of itemsize bytes, NULL, with
+	// the reason on stderr, on failure or when the size overflows.
+	void *resizeItems(size_t count, size_t itemsize);
+
+private:
+	LayerPayload();
+	~LayerPayload();
+	LayerPayload(const LayerPayload &);
+	void operator=(const LayerPayload &);
+
+	int refcount_;
+	LayerArena arena_;
+	void *items_;
+};
+
+#endif /* LAYERARENA_H_ */
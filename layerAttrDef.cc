@@ -10,42 +10,72 @@
 #include <string.h>
 #include <assert.h>
 
+#include <algorithm>
+
 #include <ogrsf_frmts.h>
 
 LayerAttrDef::LayerAttrDef() :
 		attrdeflength_(0), fieldcount_(0), fields_(NULL), buffer_(NULL), bufferflag_(
-				UNINITIALIZED) {
+				UNINITIALIZED), payload_(NULL), callerarena_(NULL) {
+}
+
+LayerAttrDef::LayerAttrDef(LayerArena *arena) :
+		attrdeflength_(0), fieldcount_(0), fields_(NULL), buffer_(NULL), bufferflag_(
+				UNINITIALIZED), payload_(NULL), callerarena_(arena) {
 }
 
 LayerAttrDef::LayerAttrDef(const LayerAttrDef & attrdef) :
 		attrdeflength_(0), fieldcount_(0), fields_(NULL), buffer_(NULL), bufferflag_(
-				UNINITIALIZED) {
+				UNINITIALIZED), payload_(NULL), callerarena_(NULL) {
 	setAttrDef(attrdef);
 }
 
-LayerAttrDef::LayerAttrDef(OGRLayer *layer) :
+LayerAttrDef::LayerAttrDef(OGRLayer *layer, LayerArena *arena) :
 		attrdeflength_(0), fieldcount_(0), fields_(NULL), buffer_(NULL), bufferflag_(
-				UNINITIALIZED) {
+				UNINITIALIZED), payload_(NULL), callerarena_(arena) {
 	setAttrDef(layer);
 }
 
-LayerAttrDef::LayerAttrDef(const char * bytes) :
+LayerAttrDef::LayerAttrDef(const char * bytes, LayerArena *arena) :
 		attrdeflength_(0), fieldcount_(0), fields_(NULL), buffer_(NULL), bufferflag_(
-				UNINITIALIZED) {
+				UNINITIALIZED), payload_(NULL), callerarena_(arena) {
 	setAttrDef(bytes);
 }
 
 LayerAttrDef::~LayerAttrDef() {
-	for (int i = 0; i < fieldcount_; ++i) {
-		if (fields_[i].sztitle_)
-			free(fields_[i].sztitle_);
-	}
-	if (fields_)
-		free(fields_);
+	// the fields go with the payload, once no copy shares it.
+	if (payload_)
+		payload_->release();
 	if (buffer_)
 		free(buffer_);
 }
 
+bool LayerAttrDef::resetFields(int count) {
+	// a shared payload is left to the copies.
+	if (payload_ && payload_->isShared()) {
+		payload_->release();
+		payload_ = NULL;
+	}
+	if (payload_ == NULL)
+		payload_ = LayerPayload::create();
+	else
+		payload_->getArena()->reset();
+	fields_ = NULL;
+	if (count < 0) {
+		fprintf(stderr, "Invalid field count %d.\n", count);
+		return false;
+	}
+	if (payload_)
+		fields_ = (LayerAttrDefField *) payload_->resizeItems(count,
+				sizeof(LayerAttrDefField));
+	return fields_ != NULL;
+}
+
+LayerArena *LayerAttrDef::getArena() {
+	// a caller's arena is reset by the caller.
+	return callerarena_ ? callerarena_ : payload_->getArena();
+}
+
 void LayerAttrDef::setAttrDef(OGRLayer *layer) {
 	if (layer == NULL)
 		return;
@@ -53,22 +83,23 @@ void LayerAttrDef::setAttrDef(OGRLayer *layer) {
 	// attrdeflength_
 	attrdeflength_ += sizeof(attrdeflength_);
 	// fieldcount_
-	for (int i = 0; i < fieldcount_; ++i) {
-		if (fields_[i].sztitle_)
-			free(fields_[i].sztitle_);
-	}
 	fieldcount_ = layer->GetLayerDefn()->GetFieldCount();
 	attrdeflength_ += sizeof(fieldcount_);
 
-	if (fields_ == NULL) {
-		fields_ = (LayerAttrDefField *) malloc(
-				sizeof(LayerAttrDefField) * fieldcount_);
-	} else {
-		fields_ = (LayerAttrDefField *) realloc(fields_,
-				sizeof(LayerAttrDefField) * fieldcount_);
+	if (!resetFields(fieldcount_)) {
+		fieldcount_ = 0;
+		return;
 	}
-	if (fields_ == NULL) {
-		fprintf(stderr, "Fail to alloc memory for fields.\n");
+
+	// the titles of all fields, from one arena allocation.
+	int payloadlength = 0;
+	for (int ipoField = 0; ipoField < fieldcount_; ipoField++) {
+		OGRFieldDefn* poField = layer->GetLayerDefn()->GetFieldDefn(ipoField);
+		payloadlength += strlen(poField->GetNameRef()) + 1;
+	}
+	char *payload = getArena()->allocate(payloadlength);
+	if (payload == NULL) {
+		fieldcount_ = 0;
 		return;
 	}
 
@@ -80,14 +111,10 @@ void LayerAttrDef::setAttrDef(OGRLayer *layer) {
 
 		fields_[ipoField].sztitlelength_ = sztitlelength;
 
-		fields_[ipoField].sztitle_ = (char *) malloc(
-				fields_[ipoField].sztitlelength_);
-		if (fields_[ipoField].sztitle_ == NULL) {
-			fprintf(stderr, "Fail to alloc memory for field sztitle.\n");
-			return;
-		}
+		fields_[ipoField].sztitle_ = payload;
 		memcpy(fields_[ipoField].sztitle_, sztitle,
 				fields_[ipoField].sztitlelength_);
+		payload += sztitlelength;
 
 		int nWidth = poField->GetWidth();
 		attrdeflength_ += sizeof(nWidth);
@@ -117,22 +144,18 @@ void LayerAttrDef::setAttrDef(const char * bytes) {
 	offset += sizeof(attrdeflength_);
 
 	// fieldcount_
-	for (int i = 0; i < fieldcount_; ++i) {
-		if (fields_[i].sztitle_)
-			free(fields_[i].sztitle_);
-	}
 	memcpy(&fieldcount_, bytes + offset, sizeof(fieldcount_));
 	offset += sizeof(fieldcount_);
 
-	if (fields_ == NULL) {
-		fields_ = (LayerAttrDefField *) malloc(
-				sizeof(LayerAttrDefField) * fieldcount_);
-	} else {
-		fields_ = (LayerAttrDefField *) realloc(fields_,
-				sizeof(LayerAttrDefField) * fieldcount_);
+	if (!resetFields(fieldcount_)) {
+		fieldcount_ = 0;
+		return;
 	}
-	if (fields_ == NULL) {
-		fprintf(stderr, "Fail to alloc memory for fields.\n");
+
+	// one copy of the fields in the arena, which the titles point into.
+	char *payload = getArena()->copy(bytes, attrdeflength_);
+	if (payload == NULL) {
+		fieldcount_ = 0;
 		return;
 	}
 
@@ -140,18 +163,10 @@ void LayerAttrDef::setAttrDef(const char * bytes) {
 		// sztitle
 		memcpy(&fields_[ipoField].sztitlelength_, bytes + offset,
 				sizeof(fields_[ipoField].sztitlelength_));
+		offset += sizeof(fields_[ipoField].sztitlelength_);
 
-		fields_[ipoField].sztitle_ = (char *) malloc(
-				fields_[ipoField].sztitlelength_);
-		if (fields_[ipoField].sztitle_ == NULL) {
-			fprintf(stderr, "Fail to alloc memory for field sztitle.\n");
-			return;
-		}
-		memcpy(fields_[ipoField].sztitle_, bytes + offset,
-				fields_[ipoField].sztitlelength_);
-
-		offset += fields_[ipoField].sztitlelength_
-				+ sizeof(fields_[ipoField].sztitlelength_);
+		fields_[ipoField].sztitle_ = payload + offset;
+		offset += fields_[ipoField].sztitlelength_;
 
 		// nWidth
 		memcpy(&fields_[ipoField].nWidth_, bytes + offset,
@@ -188,37 +203,53 @@ void LayerAttrDef::setAttrDef(const char * bytes) {
 }
 
 void LayerAttrDef::setAttrDef(const LayerAttrDef & attrdef) {
+	if (&attrdef == this)
+		return;
+	// titles on a caller's arena may not outlive it, so they are copied.
+	if (attrdef.callerarena_ || attrdef.payload_ == NULL) {
+		copyAttrDef(attrdef);
+		return;
+	}
+	LayerPayload *payload = attrdef.payload_->retain();
+	if (payload_)
+		payload_->release();
+	payload_ = payload;
+	fields_ = attrdef.fields_;
+	attrdeflength_ = attrdef.attrdeflength_;
+	fieldcount_ = attrdef.fieldcount_;
+
+	// set buffer flag.
+	if (bufferflag_ == LATEST)
+		bufferflag_ = STALE;
+}
+
+void LayerAttrDef::copyAttrDef(const LayerAttrDef & attrdef) {
 	// attrdeflength_
 	attrdeflength_ = attrdef.getAttrDefLength();
 
 	//fieldcount_
-	for (int i = 0; i < fieldcount_; ++i) {
-		if (fields_[i].sztitle_)
-			free(fields_[i].sztitle_);
-	}
 	fieldcount_ = attrdef.getFieldCount();
 
-	if (fields_ == NULL) {
-		fields_ = (LayerAttrDefField *) malloc(
-				sizeof(LayerAttrDefField) * fieldcount_);
-	} else {
-		fields_ = (LayerAttrDefField *) realloc(fields_,
-				sizeof(LayerAttrDefField) * fieldcount_);
+	if (!resetFields(fieldcount_)) {
+		fieldcount_ = 0;
+		return;
 	}
-	if (fields_ == NULL) {
-		fprintf(stderr, "Fail to alloc memory for fields.\n");
+
+	// the titles of all fields, from one arena allocation.
+	int payloadlength = 0;
+	for (int i = 0; i < fieldcount_; ++i)
+		payloadlength += attrdef.getField(i)->sztitlelength_;
+	char *payload = getArena()->allocate(payloadlength);
+	if (payload == NULL) {
+		fieldcount_ = 0;
 		return;
 	}
 
 	for (int i = 0; i < fieldcount_; ++i) {
 		const LayerAttrDefField *field = attrdef.getField(i);
 		fields_[i].sztitlelength_ = field->sztitlelength_;
-		fields_[i].sztitle_ = (char *) malloc(
-				fields_[i].sztitlelength_);
-		if (fields_[i].sztitle_ == NULL) {
-			fprintf(stderr, "Fail to alloc memory for field sztitle.\n");
-			return;
-		}
+		fields_[i].sztitle_ = payload;
+		payload += field->sztitlelength_;
 
 		memcpy(fields_[i].sztitle_, field->sztitle_, field->sztitlelength_);
 		fields_[i].nWidth_ = field->nWidth_;
@@ -230,6 +261,30 @@ void LayerAttrDef::setAttrDef(const LayerAttrDef & attrdef) {
 		bufferflag_ = STALE;
 }
 
+void LayerAttrDef::swap(LayerAttrDef & attrdef) {
+	std::swap(attrdeflength_, attrdef.attrdeflength_);
+	std::swap(fieldcount_, attrdef.fieldcount_);
+	std::swap(fields_, attrdef.fields_);
+	std::swap(buffer_, attrdef.buffer_);
+	std::swap(bufferflag_, attrdef.bufferflag_);
+	std::swap(payload_, attrdef.payload_);
+	std::swap(callerarena_, attrdef.callerarena_);
+}
+
+#if __cplusplus >= 201103L
+LayerAttrDef::LayerAttrDef(LayerAttrDef && attrdef) :
+		attrdeflength_(0), fieldcount_(0), fields_(NULL), buffer_(NULL), bufferflag_(
+				UNINITIALIZED), payload_(NULL), callerarena_(NULL) {
+	swap(attrdef);
+}
+
+LayerAttrDef & LayerAttrDef::operator=(LayerAttrDef && attrdef) {
+	LayerAttrDef moved(static_cast<LayerAttrDef &&>(attrdef));
+	swap(moved);
+	return *this;
+}
+#endif
+
 const char *LayerAttrDef::getBytes() {
 	// alloc memory or return the buffered result.
 	if (bufferflag_ == UNINITIALIZED) {
@@ -254,12 +309,11 @@ const char *LayerAttrDef::getBytes() {
 		// sztitle
 		memcpy(bytes + offset, &fields_[ipoField].sztitlelength_,
 				sizeof(fields_[ipoField].sztitlelength_));
+		offset += sizeof(fields_[ipoField].sztitlelength_);
 
 		memcpy(bytes + offset, fields_[ipoField].sztitle_,
 				fields_[ipoField].sztitlelength_);
-
-		offset += fields_[ipoField].sztitlelength_
-				+ sizeof(fields_[ipoField].sztitlelength_);
+		offset += fields_[ipoField].sztitlelength_;
 
 		// nWidth
 		memcpy(bytes + offset, &fields_[ipoField].nWidth_,
@@ -300,3 +354,20 @@ const LayerAttrDefField *LayerAttrDef::getField(int index) const {
 		return NULL;
 	return &fields_[index];
 }
+
+#if __cplusplus >= 201103L
+LayerSpan<const LayerAttrDefField> LayerAttrDef::getFieldSpan() const {
+	return LayerSpan<const LayerAttrDefField>(fields_, fieldcount_);
+}
+
+LayerSpan<const char> LayerAttrDef::getTitleSpan(int index) const {
+	const LayerAttrDefField *field = getField(index);
+	if (field == NULL)
+		return LayerSpan<const char>();
+	// the stored length counts the terminating zero.
+	int length = field->sztitlelength_;
+	if (field->sztitle_ && length > 0 && field->sztitle_[length - 1] == '\0')
+		--length;
+	return LayerSpan<const char>(field->sztitle_, length);
+}
+#endif
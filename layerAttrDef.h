@@ -1,80 +1,83 @@
-/// @file layerAllRecords.h
+/// @file layerAttrDef.h
 /// @author luliang@ict.ac.cn
 /// @copybrief Copyright 2013 ICT, CAS. All rights reserved.
 /// @version 0.1
-/// @date 2013-06-25
+/// @date 2013-06-21
 
-#ifndef LAYERALLRECORDS_H_
-#define LAYERALLRECORDS_H_
+#ifndef LAYERATTRDEF_H_
+#define LAYERATTRDEF_H_
 
-class OGRLayer;
-
-typedef enum {
-	FTInteger = 0, FTReal = 2, FTString = 4, FTBinary = 8, FTDate = 9
-} FieldType;
-
-typedef struct {
-	int strlength_;
-	char * str_;
-} FieldStringType;
+#include "layerArena.h"
+#include "layerSpan.h"
 
-typedef struct {
-	int byteslength_;
-	char * bytes_;
-} FieldBinaryType;
+class OGRLayer;
 
 typedef struct {
-	int year_, mon_, day_, hour_, min_, sec_, tag_;
-} FieldDateType;
+	int sztitlelength_;
+	char *sztitle_;
 
-typedef struct {
+	int nWidth_;
+	int nDecimals_;
 	char fieldtype_;
-	union {
-		int ivalue_;
-		double dvalue_;
-		FieldStringType svalue_;
-		FieldBinaryType bvalue_;
-		FieldDateType tvalue_;
-	} field_;
-
-} LayerRecordField;
+} LayerAttrDefField;
 
-class LayerAllRecords {
+// titles are drawn from an arena: the object's own, or one given by the
+// caller, which must outlive the object. Copies of an object on its own
+// arena share its fields, in O(1), until one of them changes them.
+class LayerAttrDef {
 public:
-	LayerAllRecords();
-	LayerAllRecords(const LayerAllRecords & allrecords);
-	LayerAllRecords(OGRLayer *layer);
-	LayerAllRecords(const char * bytes);
-	~LayerAllRecords();
+	LayerAttrDef();
+	explicit LayerAttrDef(LayerArena *arena);
+	LayerAttrDef(const LayerAttrDef & attrdef);
+	LayerAttrDef(OGRLayer *layer, LayerArena *arena = 0);
+	LayerAttrDef(const char * bytes, LayerArena *arena = 0);
+	~LayerAttrDef();
 
 	const char *getBytes();
 
-	int getRecordLength() const;
-	int getRecordCount() const;
+	int getAttrDefLength() const;
 	int getFieldCount() const;
-	const LayerRecordField *getRecords() const;
-	const LayerRecordField *getRecord(int index) const;
-	const LayerRecordField *getRecordField(int rindex, int findex) const;
-
-	void setAllRecords(OGRLayer *layer);
-	void setAllRecords(const char * bytes);
-	void setAllRecords(const LayerAllRecords & allrecords);
+	const LayerAttrDefField *getFields() const;
+	const LayerAttrDefField *getField(int index) const;
+
+	void setAttrDef(OGRLayer *layer);
+	void setAttrDef(const char * bytes);
+	void setAttrDef(const LayerAttrDef & attrdef);
+
+	// exchanges the contents of two objects in O(1), without allocating.
+	void swap(LayerAttrDef & attrdef);
+#if __cplusplus >= 201103L
+	// moves leave the source empty, as if default constructed.
+	LayerAttrDef(LayerAttrDef && attrdef);
+	LayerAttrDef & operator=(LayerAttrDef && attrdef);
+	LayerSpan<const LayerAttrDefField> getFieldSpan() const;
+	// the title of a field, without its terminating zero, empty for an
+	// index out of range.
+	LayerSpan<const char> getTitleSpan(int index) const;
+#endif
 
 private:
 	typedef enum {
 		UNINITIALIZED, STALE, LATEST
 	} BufferFlagType;
 
-	void operator=(const LayerAllRecords &);
+	void operator=(const LayerAttrDef &);
 
-	int recordlength_;
-	int recordcount_;
+	bool resetFields(int count);
+	LayerArena *getArena();
+	void copyAttrDef(const LayerAttrDef & attrdef);
+
+	int attrdeflength_;
 	int fieldcount_;
 
-	LayerRecordField * fields_;
+	LayerAttrDefField *fields_;
 
 	char *buffer_;
 	BufferFlagType bufferflag_;
+
+	// the fields and their arena, shared by copies.
+	LayerPayload *payload_;
+	LayerArena *callerarena_;
 };
 
-#endif /* LAYERALLRECORDS_H_ */
+#endif /* LAYERATTRDEF_H_ */
@@ -0,0 +1,213 @@
+/// @file layerChangeLog.cc
+/// @author luliang@ict.ac.cn
+/// @copybrief Copyright 2013 ICT, CAS. All rights reserved.
+/// @version 0.1
+/// @date 2026-10-19
+
+#include "layerChangeLog.h"
+#include "layerDecoder.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// bytes of an entry before its payload: entrylength, kind and fid.
+static const int LOG_ENTRY_HEAD = sizeof(int) + sizeof(char)
+		+ sizeof(long long);
+
+LayerChangeLog::LayerChangeLog() :
+		bytes_(NULL), entries_(NULL), entrycount_(0) {
+}
+
+LayerChangeLog::LayerChangeLog(const char *bytes, int length) :
+		bytes_(NULL), entries_(NULL), entrycount_(0) {
+	setLog(bytes, length);
+}
+
+LayerChangeLog::~LayerChangeLog() {
+	clear();
+}
+
+void LayerChangeLog::clear() {
+	if (bytes_)
+		free(bytes_);
+	if (entries_)
+		free(entries_);
+	bytes_ = NULL;
+	entries_ = NULL;
+	entrycount_ = 0;
+}
+
+static char *encodeEntry(char kind, long long fid, int payloadlength,
+		int *length) {
+	*length = LOG_ENTRY_HEAD + payloadlength;
+	char *bytes = (char *) malloc(*length);
+	if (bytes == NULL) {
+		fprintf(stderr, "Fail to alloc memory for log entry.\n");
+		return NULL;
+	}
+	int entrylength = *length - sizeof(entrylength);
+	int offset = 0;
+	memcpy(bytes + offset, &entrylength, sizeof(entrylength));
+	offset += sizeof(entrylength);
+	memcpy(bytes + offset, &kind, sizeof(kind));
+	offset += sizeof(kind);
+	memcpy(bytes + offset, &fid, sizeof(fid));
+	return bytes;
+}
+
+char *LayerChangeLog::encodeGeometry(long long fid, const char *entry,
+		int entrysize, int *length) {
+	char *bytes = encodeEntry(LOG_GEOMETRY, fid, entrysize, length);
+	if (bytes)
+		memcpy(bytes + LOG_ENTRY_HEAD, entry, entrysize);
+	return bytes;
+}
+
+char *LayerChangeLog::encodeField(long long fid, int findex,
+		const LayerRecordField & value, int *length) {
+	int celllength = value.fieldtype_ == FTNull ?
+			(int) sizeof(char) : getRecordCellLength(value);
+	char *bytes = encodeEntry(LOG_FIELD, fid, sizeof(findex) + celllength,
+			length);
+	if (bytes == NULL)
+		return NULL;
+	char *payload = bytes + LOG_ENTRY_HEAD;
+	memcpy(payload, &findex, sizeof(findex));
+	if (value.fieldtype_ == FTNull)
+		payload[sizeof(findex)] = FTNull;
+	else
+		writeRecordCell(payload + sizeof(findex), value);
+	return bytes;
+}
+
+// by fid, field and log order.
+int LayerChangeLog::compareEntry(const void *a, const void *b) {
+	const LogEntry *ea = (const LogEntry *) a;
+	const LogEntry *eb = (const LogEntry *) b;
+	if (ea->fid_ != eb->fid_)
+		return ea->fid_ < eb->fid_ ? -1 : 1;
+	if (ea->field_ != eb->field_)
+		return ea->field_ < eb->field_ ? -1 : 1;
+	return ea->sequence_ - eb->sequence_;
+}
+
+bool LayerChangeLog::setLog(const char *bytes, int length) {
+	clear();
+	if (bytes == NULL || length <= 0)
+		return true;
+
+	// count the entries, checking every one ends within the log.
+	int count = 0;
+	for (int offset = 0; offset < length; ++count) {
+		int entrylength = 0;
+		if (length - offset < LOG_ENTRY_HEAD) {
+			fprintf(stderr, "Broken change log entry.\n");
+			return false;
+		}
+		memcpy(&entrylength, bytes + offset, sizeof(entrylength));
+		if (entrylength < LOG_ENTRY_HEAD - (int) sizeof(entrylength)
+				|| entrylength > length - offset - (int) sizeof(entrylength)) {
+			fprintf(stderr, "Broken change log entry.\n");
+			return false;
+		}
+		offset += sizeof(entrylength) + entrylength;
+	}
+
+	bytes_ = (char *) malloc(length);
+	entries_ = (LogEntry *) malloc(sizeof(LogEntry) * (count + 1));
+	if (bytes_ == NULL || entries_ == NULL) {
+		fprintf(stderr, "Fail to alloc memory for change log.\n");
+		clear();
+		return false;
+	}
+	memcpy(bytes_, bytes, length);
+
+	int offset = 0;
+	for (int i = 0; i < count; ++i) {
+		int entrylength = 0;
+		memcpy(&entrylength, bytes_ + offset, sizeof(entrylength));
+		const char *entry = bytes_ + offset;
+		const char *payload = entry + LOG_ENTRY_HEAD;
+		int payloadlength = entrylength + sizeof(entrylength)
+				- LOG_ENTRY_HEAD;
+		offset += sizeof(entrylength) + entrylength;
+
+		LogEntry &logentry = entries_[i];
+		memcpy(&logentry.fid_, entry + sizeof(int) + sizeof(char),
+				sizeof(logentry.fid_));
+		logentry.sequence_ = i;
+		bool valid = false;
+		if (entry[sizeof(int)] == LOG_GEOMETRY) {
+			int wkbsize = -1;
+			if (payloadlength >= (int) (2 * sizeof(int)))
+				memcpy(&wkbsize, payload + sizeof(int), sizeof(wkbsize));
+			valid = wkbsize == payloadlength - (int) (2 * sizeof(int));
+			logentry.field_ = -1;
+			logentry.payload_ = payload;
+		} else if (entry[sizeof(int)] == LOG_FIELD
+				&& payloadlength > (int) sizeof(int)) {
+			memcpy(&logentry.field_, payload, sizeof(logentry.field_));
+			logentry.payload_ = payload + sizeof(int);
+			int celllength = payloadlength - sizeof(int);
+			if (*logentry.payload_ == FTNull)
+				valid = celllength == (int) sizeof(char);
+			else
+				valid = scanCell(logentry.payload_, celllength) == celllength;
+			valid = valid && logentry.field_ >= 0;
+		}
+		if (!valid) {
+			fprintf(stderr, "Broken change log entry.\n");
+			clear();
+			return false;
+		}
+	}
+	entrycount_ = count;
+	qsort(entries_, entrycount_, sizeof(LogEntry), compareEntry);
+	return true;
+}
+
+int LayerChangeLog::getEntryCount() const {
+	return entrycount_;
+}
+
+int LayerChangeLog::find(long long fid, int field) const {
+	// the first entry after those of (fid, field), then one back.
+	int low = 0, high = entrycount_;
+	while (low < high) {
+		int middle = low + (high - low) / 2;
+		const LogEntry &entry = entries_[middle];
+		if (entry.fid_ < fid || (entry.fid_ == fid && entry.field_ <= field))
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	if (low == 0)
+		return -1;
+	const LogEntry &entry = entries_[low - 1];
+	return entry.fid_ == fid && entry.field_ == field ? low - 1 : -1;
+}
+
+bool LayerChangeLog::contains(long long fid) const {
+	int low = 0, high = entrycount_;
+	while (low < high) {
+		int middle = low + (high - low) / 2;
+		if (entries_[middle].fid_ < fid)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	return low < entrycount_ && entries_[low].fid_ == fid;
+}
+
+const char *LayerChangeLog::getGeometry(long long fid) const {
+	int entry = find(fid, -1);
+	return entry < 0 ? NULL : entries_[entry].payload_;
+}
+
+const char *LayerChangeLog::getField(long long fid, int findex) const {
+	if (findex < 0)
+		return NULL;
+	int entry = find(fid, findex);
+	return entry < 0 ? NULL : entries_[entry].payload_;
+}
@@ -0,0 +1,69 @@
+/// @file layerChangeLog.h
+/// @author luliang@ict.ac.cn
+/// @copybrief Copyright 2013 ICT, CAS. All rights reserved.
+/// @version 0.1
+/// @date 2026-10-19
+
+#ifndef LAYERCHANGELOG_H_
+#define LAYERCHANGELOG_H_
+
+#include "layerAllRecords.h"
+
+// kinds of change log entries.
+typedef enum {
+	LOG_GEOMETRY = 1, LOG_FIELD = 2
+} ChangeLogKind;
+
+// Changes of single features of a stored layer that did not fit in place,
+// appended to "key:log" by SpatialClient's updates and keyed by source fid.
+// Every entry is an int entrylength of what follows, the char kind and the
+// long long fid; then a feature entry (int geometrytype, int wkbsize, wkb)
+// for LOG_GEOMETRY, or for LOG_FIELD the int field and its tagged record
+// cell, FTNull alone for an unset field. Of the entries of one geometry or
+// one field, the latest wins.
+class LayerChangeLog {
+public:
+	LayerChangeLog();
+	LayerChangeLog(const char *bytes, int length);
+	~LayerChangeLog();
+
+	// an entry to append to the log, its size in *length. free() by caller.
+	static char *encodeGeometry(long long fid, const char *entry,
+			int entrysize, int *length);
+	static char *encodeField(long long fid, int findex,
+			const LayerRecordField & value, int *length);
+
+	// false, with the reason on stderr, on a broken log.
+	bool setLog(const char *bytes, int length);
+
+	int getEntryCount() const;
+	// true if any entry changes the feature.
+	bool contains(long long fid) const;
+	// the latest feature entry logged for fid, NULL if none.
+	const char *getGeometry(long long fid) const;
+	// the latest tagged cell logged for field findex of fid, NULL if none.
+	const char *getField(long long fid, int findex) const;
+
+private:
+	typedef struct {
+		long long fid_;
+		int field_; // -1 for the geometry
+		int sequence_;
+		const char *payload_;
+	} LogEntry;
+
+	LayerChangeLog(const LayerChangeLog &);
+	void operator=(const LayerChangeLog &);
+
+	void clear();
+	static int compareEntry(const void *a, const void *b);
+	// the latest entry of the geometry (field -1) or a field of fid, -1 if
+	// none.
+	int find(long long fid, int field) const;
+
+	char *bytes_;
+	LogEntry *entries_;
+	int entrycount_;
+};
+
+#endif /* LAYERCHANGELOG_H_ */
@@ -0,0 +1,507 @@
+/// @file layerDecoder.cc
+/// @author luliang@ict.ac.cn
+/// @copybrief Copyright 2013 ICT, CAS. All rights reserved.
+/// @version 0.1
+/// @date 2026-10-19
+
+#include "layerDecoder.h"
+#include "recordFilter.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+bool checkLayerHead(const char *bytes, int size, bool whole) {
+	int length = 0, version = 0;
+	if (bytes == NULL || size < LAYER_HEAD_SIZE) {
+		fprintf(stderr, "Not a layer value.\n");
+		return false;
+	}
+	memcpy(&length, bytes, sizeof(length));
+	memcpy(&version, bytes + sizeof(length), sizeof(version));
+	if (length < (int) sizeof(version)
+			|| (whole && length != size - (int) sizeof(length))) {
+		fprintf(stderr, "Not a layer value.\n");
+		return false;
+	}
+	if ((version & 0xffff0000) != LAYER_FORMAT_MAGIC) {
+		fprintf(stderr, "Layer value of an unversioned format, "
+				"put the layer again.\n");
+		return false;
+	}
+	if (version != (LAYER_FORMAT_MAGIC | LAYER_FORMAT_VERSION)) {
+		fprintf(stderr, "Layer value of format version %d, not %d, "
+				"put the layer again.\n", version & 0xffff,
+				LAYER_FORMAT_VERSION);
+		return false;
+	}
+	return true;
+}
+
+int *scanFeatureOffsets(const char *entries, int count, int length) {
+	// an entry takes two ints at least.
+	if (count < 0 || count > length / (int) (2 * sizeof(int))) {
+		fprintf(stderr, "Bad feature count.\n");
+		return NULL;
+	}
+	int *offsets = (int *) malloc(sizeof(int) * ((size_t) count + 1));
+	if (offsets == NULL) {
+		fprintf(stderr, "Fail to alloc memory for feature offsets.\n");
+		return NULL;
+	}
+	int offset = 0;
+	for (int i = 0; i < count; ++i) {
+		offsets[i] = offset;
+		if (offset + (int) sizeof(int) > length) {
+			offset = length + 1;
+			break;
+		}
+		// every entry has its size, whatever its geometry type.
+		offset += sizeof(int);
+		if (offset + (int) sizeof(int) > length) {
+			offset = length + 1;
+			break;
+		}
+		int wkbsize = 0;
+		memcpy(&wkbsize, entries + offset, sizeof(wkbsize));
+		offset += sizeof(wkbsize);
+		if (wkbsize < 0 || wkbsize > length - offset) {
+			offset = length + 1;
+			break;
+		}
+		offset += wkbsize;
+	}
+	if (offset > length) {
+		fprintf(stderr, "Features overrun their length.\n");
+		free(offsets);
+		return NULL;
+	}
+	offsets[count] = offset;
+	return offsets;
+}
+
+int *scanRecordOffsets(const char *cells, int recordcount, int fieldcount,
+		int length) {
+	if (recordcount < 0 || fieldcount < 0) {
+		fprintf(stderr, "Bad record count.\n");
+		return NULL;
+	}
+	// every row holds its bitmap at least.
+	int bitmapsize = getRowBitmapSize(fieldcount);
+	if (bitmapsize > 0 && recordcount > length / bitmapsize) {
+		fprintf(stderr, "Records overrun their length.\n");
+		return NULL;
+	}
+	int *offsets = (int *) malloc(sizeof(int) * ((size_t) recordcount + 1));
+	if (offsets == NULL) {
+		fprintf(stderr, "Fail to alloc memory for record offsets.\n");
+		return NULL;
+	}
+	int offset = 0;
+	for (int i = 0; i < recordcount && offset <= length; ++i) {
+		offsets[i] = offset;
+		if (bitmapsize > length - offset) {
+			offset = length + 1;
+			break;
+		}
+		// the cells of unset fields are not there to skip.
+		int cellcount = countSetFields(cells + offset, fieldcount);
+		offset += bitmapsize;
+		for (int j = 0; j < cellcount; ++j) {
+			int cellsize = scanCell(cells + offset, length - offset);
+			if (cellsize < 0) {
+				offset = length + 1;
+				break;
+			}
+			offset += cellsize;
+		}
+	}
+	if (offset > length) {
+		fprintf(stderr, "Records overrun their length.\n");
+		free(offsets);
+		return NULL;
+	}
+	offsets[recordcount] = offset;
+	return offsets;
+}
+
+int getFixedCellSize(char type) {
+	switch (type) {
+	case FTInteger:
+		return sizeof(int);
+	case FTReal:
+		return sizeof(double);
+	case FTInteger64:
+	case FTDate:
+	case FTTime:
+	case FTDateTime:
+		return sizeof(long long);
+	default:
+		return -1;
+	}
+}
+
+int getRowBitmapSize(int fieldcount) {
+	return (fieldcount + 7) / 8;
+}
+
+bool isFieldSet(const char *bitmap, int findex) {
+	return (bitmap[findex / 8] >> (findex % 8)) & 1;
+}
+
+int countSetFields(const char *bitmap, int fieldcount) {
+	const unsigned char *bits = (const unsigned char *) bitmap;
+	int count = 0;
+	for (int i = 0; i < fieldcount / 8; ++i)
+		count += __builtin_popcount(bits[i]);
+	if (fieldcount % 8)
+		count += __builtin_popcount(
+				bits[fieldcount / 8] & ((1 << (fieldcount % 8)) - 1));
+	return count;
+}
+
+int getRecordStride(const char *types, int fieldcount) {
+	int stride = getRowBitmapSize(fieldcount);
+	for (int i = 0; i < fieldcount; ++i) {
+		int size = getFixedCellSize(types[i]);
+		if (size < 0)
+			return 0;
+		stride += size;
+	}
+	return stride;
+}
+
+bool readRecordSection(const char *bytes, int length, RecordSection *section) {
+	int fieldcount = 0;
+	if (length < (int) (3 * sizeof(int))) {
+		fprintf(stderr, "Records overrun their length.\n");
+		return false;
+	}
+	memcpy(&section->recordcount_, bytes + sizeof(int), sizeof(int));
+	memcpy(&fieldcount, bytes + 2 * sizeof(int), sizeof(fieldcount));
+	section->cells_ = bytes + 3 * sizeof(int);
+	section->types_ = NULL;
+	section->stride_ = 0;
+	if (section->recordcount_ < 0 || fieldcount < 0) {
+		fprintf(stderr, "Bad record count.\n");
+		return false;
+	}
+	if (fieldcount & RECORDS_FIXED_STRIDE) {
+		fieldcount &= ~RECORDS_FIXED_STRIDE;
+		if (fieldcount > length - (int) (3 * sizeof(int))) {
+			fprintf(stderr, "Records overrun their length.\n");
+			return false;
+		}
+		section->types_ = section->cells_;
+		section->cells_ += fieldcount;
+		section->stride_ = getRecordStride(section->types_, fieldcount);
+		if (section->stride_ == 0 && fieldcount > 0) {
+			fprintf(stderr, "Bad fixed-stride record types.\n");
+			return false;
+		}
+	}
+	section->fieldcount_ = fieldcount;
+	section->length_ = length - (int) (section->cells_ - bytes);
+	if ((long long) section->stride_ * section->recordcount_
+			> section->length_) {
+		fprintf(stderr, "Records overrun their length.\n");
+		return false;
+	}
+	return true;
+}
+
+int writeRecordHeader(char *bytes, int recordlength, int recordcount,
+		int fieldcount, const char *types) {
+	int length = 3 * sizeof(int) + (types ? fieldcount : 0);
+	if (bytes == NULL)
+		return length;
+	int flaggedcount = types ? fieldcount | RECORDS_FIXED_STRIDE : fieldcount;
+	memcpy(bytes, &recordlength, sizeof(recordlength));
+	memcpy(bytes + sizeof(int), &recordcount, sizeof(recordcount));
+	memcpy(bytes + 2 * sizeof(int), &flaggedcount, sizeof(flaggedcount));
+	if (types)
+		memcpy(bytes + 3 * sizeof(int), types, fieldcount);
+	return length;
+}
+
+int readCell(const RecordSection & section, const char *bitmap,
+		const char *cell, int findex, char *type, const char **value) {
+	if (!isFieldSet(bitmap, findex)) {
+		*type = FTNull;
+		*value = cell;
+		return section.types_ ? getFixedCellSize(section.types_[findex]) : 0;
+	}
+	if (section.types_) {
+		*type = section.types_[findex];
+		*value = cell;
+		return getFixedCellSize(*type);
+	}
+	*type = *cell;
+	*value = cell + sizeof(char);
+	return RecordFilter::getCellSize(cell);
+}
+
+int getRowSize(const RecordSection & section, const char *row) {
+	if (section.types_)
+		return section.stride_;
+	int cellcount = countSetFields(row, section.fieldcount_);
+	int size = getRowBitmapSize(section.fieldcount_);
+	for (int i = 0; i < cellcount; ++i)
+		size += RecordFilter::getCellSize(row + size);
+	return size;
+}
+
+int readCellInteger(const RecordSection & section, const char *value) {
+	if (section.types_) {
+		int ivalue = 0;
+		memcpy(&ivalue, value, sizeof(ivalue));
+		return ivalue;
+	}
+	unsigned int zigzag = 0;
+	readVarint(value, &zigzag);
+	return zigzagDecode(zigzag);
+}
+
+int readCellBytes(const char *value, const char **bytes) {
+	unsigned int length = 0;
+	*bytes = value + readVarint(value, &length);
+	return (int) length;
+}
+
+long long readCellInteger64(const RecordSection & section,
+		const char *value) {
+	if (section.types_) {
+		long long lvalue = 0;
+		memcpy(&lvalue, value, sizeof(lvalue));
+		return lvalue;
+	}
+	unsigned long long zigzag = 0;
+	readVarint64(value, &zigzag);
+	return zigzagDecode64(zigzag);
+}
+
+int readCellList(const char *value, const char **values) {
+	unsigned int count = 0;
+	*values = value + readVarint(value, &count);
+	return (int) count;
+}
+
+// a varint length or count at bytes, -1 past length bytes or 2^31.
+static int scanLength(const char *bytes, int length, unsigned int *value) {
+	int size = scanVarint(bytes, length);
+	if (size < 0)
+		return -1;
+	readVarint(bytes, value);
+	return *value <= 0x7fffffff ? size : -1;
+}
+
+int scanCell(const char *cell, int length) {
+	if (length < (int) sizeof(char))
+		return -1;
+	char type = *cell;
+	int size = sizeof(char);
+	unsigned int count = 0;
+	int countsize = 0;
+	switch (type) {
+	case FTInteger:
+		countsize = scanVarint(cell + size, length - size);
+		return countsize < 0 ? -1 : size + countsize;
+	case FTInteger64:
+		countsize = scanVarint64(cell + size, length - size);
+		return countsize < 0 ? -1 : size + countsize;
+	case FTString:
+	case FTBinary:
+		countsize = scanLength(cell + size, length - size, &count);
+		if (countsize < 0 || count > (unsigned int) (length - size - countsize))
+			return -1;
+		return size + countsize + count;
+	case FTIntegerList:
+	case FTInteger64List:
+	case FTRealList:
+		countsize = scanLength(cell + size, length - size, &count);
+		if (countsize < 0
+				|| (long long) count * getListValueSize(type)
+						> length - size - countsize)
+			return -1;
+		return size + countsize + count * getListValueSize(type);
+	case FTStringList:
+		countsize = scanLength(cell + size, length - size, &count);
+		if (countsize < 0)
+			return -1;
+		size += countsize;
+		for (unsigned int i = 0; i < count; ++i) {
+			unsigned int strlength = 0;
+			int lengthsize = scanLength(cell + size, length - size,
+					&strlength);
+			if (lengthsize < 0
+					|| strlength > (unsigned int) (length - size - lengthsize))
+				return -1;
+			size += lengthsize + strlength;
+		}
+		return size;
+	default: {
+		int cellsize = RecordFilter::getCellSize(cell);
+		return cellsize <= length ? cellsize : -1;
+	}
+	}
+}
+
+int getVarintSize(unsigned int value) {
+	int size = 1;
+	while (value >= 0x80) {
+		value >>= 7;
+		++size;
+	}
+	return size;
+}
+
+int writeVarint(char *bytes, unsigned int value) {
+	if (bytes == NULL)
+		return getVarintSize(value);
+	int size = 0;
+	while (value >= 0x80) {
+		bytes[size++] = (char) (value | 0x80);
+		value >>= 7;
+	}
+	bytes[size++] = (char) value;
+	return size;
+}
+
+int readVarint(const char *bytes, unsigned int *value) {
+	const unsigned char *p = (const unsigned char *) bytes;
+	// most lengths and ints take one byte.
+	if (p[0] < 0x80) {
+		*value = p[0];
+		return 1;
+	}
+	unsigned int result = p[0] & 0x7f;
+	int size = 1;
+	do {
+		result |= (unsigned int) (p[size] & 0x7f) << (7 * size);
+	} while (p[size++] >= 0x80 && size < VARINT_MAX_SIZE);
+	*value = result;
+	return size;
+}
+
+static int scanVarintOf(const char *bytes, int length, int maxsize) {
+	for (int i = 0; i < length && i < maxsize; ++i) {
+		if ((unsigned char) bytes[i] < 0x80)
+			return i + 1;
+	}
+	return -1;
+}
+
+int scanVarint(const char *bytes, int length) {
+	return scanVarintOf(bytes, length, VARINT_MAX_SIZE);
+}
+
+unsigned int zigzagEncode(int value) {
+	return ((unsigned int) value << 1) ^ (unsigned int) (value >> 31);
+}
+
+int zigzagDecode(unsigned int value) {
+	return (int) (value >> 1) ^ -(int) (value & 1);
+}
+
+int writeVarint64(char *bytes, unsigned long long value) {
+	int size = 0;
+	while (value >= 0x80) {
+		if (bytes)
+			bytes[size] = (char) (value | 0x80);
+		++size;
+		value >>= 7;
+	}
+	if (bytes)
+		bytes[size] = (char) value;
+	return size + 1;
+}
+
+int readVarint64(const char *bytes, unsigned long long *value) {
+	const unsigned char *p = (const unsigned char *) bytes;
+	unsigned long long result = 0;
+	int size = 0;
+	do {
+		result |= (unsigned long long) (p[size] & 0x7f) << (7 * size);
+	} while (p[size++] >= 0x80 && size < VARINT64_MAX_SIZE);
+	*value = result;
+	return size;
+}
+
+int scanVarint64(const char *bytes, int length) {
+	return scanVarintOf(bytes, length, VARINT64_MAX_SIZE);
+}
+
+unsigned long long zigzagEncode64(long long value) {
+	return ((unsigned long long) value << 1)
+			^ (unsigned long long) (value >> 63);
+}
+
+long long zigzagDecode64(unsigned long long value) {
+	return (long long) (value >> 1) ^ -(long long) (value & 1);
+}
+
+typedef struct {
+	bool (*decode_)(int, int, void *);
+	void *context_;
+	int begin_, end_;
+	bool succeeded_;
+} DecodeTask;
+
+static void *runDecodeTask(void *arg) {
+	DecodeTask *task = (DecodeTask *) arg;
+	task->succeeded_ = task->decode_(task->begin_, task->end_,
+			task->context_);
+	return NULL;
+}
+
+bool runDecodeTasks(int count, bool (*decode)(int, int, void *),
+		void *context) {
+	long threadcount = 1;
+	if (count >= DECODE_PARALLEL_COUNT) {
+		threadcount = sysconf(_SC_NPROCESSORS_ONLN);
+		if (threadcount < 1)
+			threadcount = 1;
+		if (threadcount > count / (DECODE_PARALLEL_COUNT / 4))
+			threadcount = count / (DECODE_PARALLEL_COUNT / 4);
+	}
+	DecodeTask *tasks = NULL;
+	pthread_t *threads = NULL;
+	if (threadcount > 1) {
+		tasks = (DecodeTask *) malloc(sizeof(DecodeTask) * threadcount);
+		threads = (pthread_t *) malloc(sizeof(pthread_t) * threadcount);
+	}
+	if (tasks == NULL || threads == NULL) {
+		if (tasks)
+			free(tasks);
+		if (threads)
+			free(threads);
+		return decode(0, count, context);
+	}
+
+	int started = 0;
+	for (int i = 0; i < threadcount; ++i) {
+		tasks[i].decode_ = decode;
+		tasks[i].context_ = context;
+		tasks[i].begin_ = (int) ((long long) count * i / threadcount);
+		tasks[i].end_ = (int) ((long long) count * (i + 1) / threadcount);
+		tasks[i].succeeded_ = false;
+		// the rest run on this thread if a thread does not start.
+		if (i == started
+				&& pthread_create(&threads[i], NULL, runDecodeTask, &tasks[i])
+						== 0)
+			++started;
+	}
+	for (int i = started; i < threadcount; ++i)
+		runDecodeTask(&tasks[i]);
+	for (int i = 0; i < started; ++i)
+		pthread_join(threads[i], NULL);
+
+	bool succeeded = true;
+	for (int i = 0; i < threadcount; ++i)
+		succeeded = succeeded && tasks[i].succeeded_;
+	free(tasks);
+	free(threads);
+	return succeeded;
+}
@@ -0,0 +1,126 @@
+/// @file layerDecoder.h
+/// @author luliang@ict.ac.cn
+/// @copybrief Copyright 2013 ICT, CAS. All rights reserved.
+/// @version 0.1
+/// @date 2026-10-19
+
+#ifndef LAYERDECODER_H_
+#define LAYERDECODER_H_
+
+// Decoding of serialized features and records over ranges, in parallel. The
+// offset of every item is found first by a scan that reads only the sizes
+// and jumps over the rest; the items are then decoded straight into their
+// preallocated slots, one range of items per cpu.
+static const int DECODE_PARALLEL_COUNT = 1 << 14;
+
+// A layer value starts with int length, the bytes after it, and int
+// version: LAYER_FORMAT_MAGIC or'ed with the version of its layout. The
+// metadata follow. Values of another version, or stored before the version
+// word, are rejected: put the layer again.
+static const int LAYER_FORMAT_MAGIC = 0x53430000;
+static const int LAYER_FORMAT_VERSION = 5;
+static const int LAYER_HEAD_SIZE = 2 * sizeof(int);
+
+// false, with the reason on stderr, unless the size bytes at bytes start a
+// layer value of LAYER_FORMAT_VERSION. whole: they are the whole value.
+bool checkLayerHead(const char *bytes, int size, bool whole);
+
+// offsets of count feature entries (int geometrytype, int wkbsize, wkb, of
+// any geometry type) from entries, and of their end, count + 1 in all. NULL,
+// with the reason on stderr, if they overrun length bytes. Every reader of
+// feature entries finds them with this scan. free() by caller.
+int *scanFeatureOffsets(const char *entries, int count, int length);
+
+// offsets of recordcount rows of fieldcount fields from cells, and of their
+// end, as above.
+int *scanRecordOffsets(const char *cells, int recordcount, int fieldcount,
+		int length);
+
+// Every row starts with a bitmap of its set fields, field j at bit j % 8 of
+// byte j / 8. The cells of unset fields are left out of the row, and read
+// as FTNull.
+int getRowBitmapSize(int fieldcount);
+bool isFieldSet(const char *bitmap, int findex);
+// number of set fields among the first fieldcount of bitmap.
+int countSetFields(const char *bitmap, int fieldcount);
+
+// Records of FTInteger, FTInteger64, FTReal and the date types only are
+// stored as rows of one size: the field count carries RECORDS_FIXED_STRIDE and is followed by
+// the type of every field, one char each, and the cells have no type in
+// front. Unset fields keep their cells, zeroed, so that row i starts
+// i * stride bytes after the first.
+static const int RECORDS_FIXED_STRIDE = 0x40000000;
+
+typedef struct {
+	int recordcount_;
+	int fieldcount_;
+	const char *types_; // of fixed-stride rows, NULL for tagged cells
+	int stride_; // of fixed-stride rows, 0 for tagged cells
+	const char *cells_;
+	int length_; // of the cells, up to the end of the section
+} RecordSection;
+
+// size of a cell of type without a type in front, -1 if not fixed.
+int getFixedCellSize(char type);
+// size of a row of fields of the given types, its bitmap included, 0 if
+// one is not fixed.
+int getRecordStride(const char *types, int fieldcount);
+
+// the records section at bytes: int recordlength, int recordcount, int
+// fieldcount, the types of fixed-stride rows, then the cells, within length
+// bytes. only the header is read. false, with the reason on stderr, on a
+// bad header, or if the header or fixed-stride rows overrun length.
+bool readRecordSection(const char *bytes, int length, RecordSection *section);
+// writes the header of a records section to bytes, if not NULL; types for
+// fixed-stride rows, NULL for tagged cells. returns its size.
+int writeRecordHeader(char *bytes, int recordlength, int recordcount,
+		int fieldcount, const char *types);
+// type and value of cell, which holds field findex of the row with bitmap,
+// and the size of cell.
+int readCell(const RecordSection & section, const char *bitmap,
+		const char *cell, int findex, char *type, const char **value);
+// size of the row at row, its bitmap included.
+int getRowSize(const RecordSection & section, const char *row);
+// the int of an FTInteger value from readCell.
+int readCellInteger(const RecordSection & section, const char *value);
+// the long long of an FTInteger64 value from readCell.
+long long readCellInteger64(const RecordSection & section, const char *value);
+// the length of an FTString or FTBinary value from readCell, and its bytes.
+int readCellBytes(const char *value, const char **bytes);
+// the count of a list value from readCell, and its first value. numbers are
+// whole, unaligned; strings are as readCellBytes reads them, one by one.
+int readCellList(const char *value, const char **values);
+// size of the tagged cell at cell, -1 if it does not end within length
+// bytes.
+int scanCell(const char *cell, int length);
+
+// Integers and the lengths of strings and binaries in tagged cells are
+// varints: seven bits a byte, the low ones first, the top bit set on every
+// byte but the last. Integers are zigzag coded first, so that small negative
+// ones stay short as well. Fixed-stride rows keep their ints whole. The
+// counts of lists are varints too, their values are not.
+static const int VARINT_MAX_SIZE = 5;
+static const int VARINT64_MAX_SIZE = 10;
+
+int getVarintSize(unsigned int value);
+// writes value to bytes, if not NULL. returns its size.
+int writeVarint(char *bytes, unsigned int value);
+// reads value from bytes, returns its size.
+int readVarint(const char *bytes, unsigned int *value);
+// size of the varint at bytes, -1 if it does not end within length bytes.
+int scanVarint(const char *bytes, int length);
+unsigned int zigzagEncode(int value);
+int zigzagDecode(unsigned int value);
+// the same for FTInteger64 values.
+int writeVarint64(char *bytes, unsigned long long value);
+int readVarint64(const char *bytes, unsigned long long *value);
+int scanVarint64(const char *bytes, int length);
+unsigned long long zigzagEncode64(long long value);
+long long zigzagDecode64(unsigned long long value);
+
+// calls decode(begin, end, context) over ranges covering [0, count), one
+// range per cpu from DECODE_PARALLEL_COUNT items on. false if any call did.
+bool runDecodeTasks(int count, bool (*decode)(int, int, void *),
+		void *context);
+
+#endif /* LAYERDECODER_H_ */
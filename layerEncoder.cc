@@ -0,0 +1,583 @@
+/// @file layerEncoder.cc
+/// @author luliang@ict.ac.cn
+/// @copybrief Copyright 2013 ICT, CAS. All rights reserved.
+/// @version 0.1
+/// @date 2026-10-19
+
+#include "layerEncoder.h"
+#include "layerAllRecords.h"
+#include "layerDecoder.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <ogrsf_frmts.h>
+
+// features per batch, and batches read per round for every thread. While a
+// round is encoded the next one is read, so at most two rounds of features
+// are alive at a time.
+static const int ENCODER_BATCH_SIZE = 512;
+static const int ENCODER_BATCHES_PER_THREAD = 2;
+
+static bool reserveBytes(char **bytes, int *capacity, long long length) {
+	if (length <= *capacity)
+		return true;
+	if (length > LAYER_MAX_LENGTH) {
+		fprintf(stderr, "Encoded layer passes %lld bytes.\n",
+				LAYER_MAX_LENGTH);
+		return false;
+	}
+	long long newcapacity = *capacity ? *capacity : 4096;
+	while (newcapacity < length)
+		newcapacity *= 2;
+	if (newcapacity > LAYER_MAX_LENGTH)
+		newcapacity = LAYER_MAX_LENGTH;
+	char *newbytes = (char *) realloc(*bytes, newcapacity);
+	if (newbytes == NULL)
+		return false;
+	*bytes = newbytes;
+	*capacity = (int) newcapacity;
+	return true;
+}
+
+static bool appendBytes(char **bytes, int *length, int *capacity,
+		const void *data, int size) {
+	if (!reserveBytes(bytes, capacity, (long long) *length + size))
+		return false;
+	memcpy(*bytes + *length, data, size);
+	*length += size;
+	return true;
+}
+
+static bool appendVarint(char **bytes, int *length, int *capacity,
+		unsigned int value) {
+	char varint[VARINT_MAX_SIZE];
+	return appendBytes(bytes, length, capacity, varint,
+			writeVarint(varint, value));
+}
+
+static bool appendVarint64(char **bytes, int *length, int *capacity,
+		unsigned long long value) {
+	char varint[VARINT64_MAX_SIZE];
+	return appendBytes(bytes, length, capacity, varint,
+			writeVarint64(varint, value));
+}
+
+// the OGR types with a record cell; the others, the wide strings, are
+// left unset.
+static bool isStoredType(char type) {
+	return getFixedCellSize(type) > 0 || isListType(type) || type == FTString
+			|| type == FTBinary;
+}
+
+LayerEncoder::LayerEncoder(OGRLayer *layer, bool records, bool extents,
+		int threadcount) :
+		layer_(layer), records_(records), extents_(extents), threadcount_(
+				threadcount), fieldcount_(0), fieldtypes_(NULL), recordstride_(0), batches_(
+				NULL), nextbatch_(0), running_(NULL), runningcount_(0), featurecount_(
+				0), features_(NULL), featurelength_(0), featurecapacity_(0), recordbytes_(
+				NULL), recordlength_(0), recordcapacity_(0), featuresizes_(
+				NULL), recordsizes_(NULL), envelopes_(NULL), fids_(NULL), extentcapacity_(
+				0), sink_(
+				NULL), sinkcontext_(NULL) {
+	if (threadcount_ < 1)
+		threadcount_ = sysconf(_SC_NPROCESSORS_ONLN);
+	if (threadcount_ < 1)
+		threadcount_ = 1;
+}
+
+LayerEncoder::~LayerEncoder() {
+	if (batches_) {
+		int batchcount = 2 * threadcount_ * ENCODER_BATCHES_PER_THREAD;
+		for (int i = 0; i < batchcount; ++i) {
+			destroyBatch(&batches_[i]);
+			free(batches_[i].features_);
+			free(batches_[i].featurebytes_);
+			free(batches_[i].recordbytes_);
+			free(batches_[i].featuresizes_);
+			free(batches_[i].recordsizes_);
+			free(batches_[i].envelopes_);
+			free(batches_[i].fids_);
+		}
+		free(batches_);
+	}
+	if (fieldtypes_)
+		free(fieldtypes_);
+	if (features_)
+		free(features_);
+	if (recordbytes_)
+		free(recordbytes_);
+	if (featuresizes_)
+		free(featuresizes_);
+	if (recordsizes_)
+		free(recordsizes_);
+	if (envelopes_)
+		free(envelopes_);
+	if (fids_)
+		free(fids_);
+}
+
+void LayerEncoder::setSink(EncoderSink sink, void *context) {
+	sink_ = sink;
+	sinkcontext_ = context;
+}
+
+bool LayerEncoder::encode() {
+	if (layer_ == NULL || batches_ != NULL)
+		return false;
+
+	OGRFeatureDefn *defn = layer_->GetLayerDefn();
+	fieldcount_ = defn->GetFieldCount();
+	fieldtypes_ = (char *) malloc(fieldcount_ + 1);
+	if (fieldtypes_ == NULL) {
+		fprintf(stderr, "Fail to alloc memory for field types.\n");
+		return false;
+	}
+	for (int i = 0; i < fieldcount_; ++i) {
+		fieldtypes_[i] = (char) defn->GetFieldDefn(i)->GetType();
+		if (!isStoredType(fieldtypes_[i]))
+			fieldtypes_[i] = FTNull;
+	}
+	// the FieldType of a record cell is its OGRFieldType.
+	if (records_)
+		recordstride_ = ::getRecordStride(fieldtypes_, fieldcount_);
+
+	int roundcount = threadcount_ * ENCODER_BATCHES_PER_THREAD;
+	batches_ = (EncoderBatch *) calloc(2 * roundcount, sizeof(EncoderBatch));
+	if (batches_ == NULL) {
+		fprintf(stderr, "Fail to alloc memory for encoder batches.\n");
+		return false;
+	}
+	for (int i = 0; i < 2 * roundcount; ++i) {
+		EncoderBatch *batch = &batches_[i];
+		batch->features_ = (OGRFeature **) malloc(
+				sizeof(OGRFeature *) * ENCODER_BATCH_SIZE);
+		if (extents_) {
+			batch->featuresizes_ = (int *) malloc(
+					sizeof(int) * ENCODER_BATCH_SIZE);
+			batch->recordsizes_ = (int *) malloc(
+					sizeof(int) * ENCODER_BATCH_SIZE);
+			batch->envelopes_ = (double *) malloc(
+					sizeof(double) * 4 * ENCODER_BATCH_SIZE);
+			batch->fids_ = (long long *) malloc(
+					sizeof(long long) * ENCODER_BATCH_SIZE);
+		}
+		if (batch->features_ == NULL
+				|| (extents_
+						&& (batch->featuresizes_ == NULL
+								|| batch->recordsizes_ == NULL
+								|| batch->envelopes_ == NULL
+								|| batch->fids_ == NULL))) {
+			fprintf(stderr, "Fail to alloc memory for encoder batches.\n");
+			return false;
+		}
+	}
+
+	layer_->ResetReading();
+	EncoderBatch *current = batches_;
+	EncoderBatch *next = batches_ + roundcount;
+	int count = readBatches(current, roundcount);
+	bool succeeded = true;
+	while (count > 0) {
+		// the layer is read on this thread only, while the workers encode.
+		running_ = current;
+		runningcount_ = count;
+		nextbatch_ = 0;
+		int threadcount = threadcount_ < count ? threadcount_ : count;
+		pthread_t *threads = NULL;
+		int started = 0;
+		if (threadcount > 1) {
+			threads = (pthread_t *) malloc(sizeof(pthread_t) * threadcount);
+			for (int i = 0; threads != NULL && i < threadcount; ++i) {
+				if (pthread_create(&threads[i], NULL, encodeWorker, this) != 0)
+					break;
+				++started;
+			}
+		}
+		if (started == 0)
+			encodeWorker(this);
+
+		// a short round means the layer is exhausted.
+		int nextcount = 0;
+		if (count == roundcount
+				&& current[count - 1].count_ == ENCODER_BATCH_SIZE)
+			nextcount = readBatches(next, roundcount);
+
+		for (int i = 0; i < started; ++i)
+			pthread_join(threads[i], NULL);
+		if (threads)
+			free(threads);
+
+		for (int i = 0; i < count; ++i) {
+			if (succeeded && current[i].failed_) {
+				fprintf(stderr, "Fail to alloc memory for encoded features.\n");
+				succeeded = false;
+			}
+			if (succeeded && sink_) {
+				// the sink tells its own failure.
+				succeeded = sink_(current[i], sinkcontext_);
+				featurecount_ += current[i].encoded_;
+			} else if (succeeded && !appendBatch(current[i])) {
+				fprintf(stderr, "Fail to alloc memory for encoded layer.\n");
+				succeeded = false;
+			}
+			destroyBatch(&current[i]);
+		}
+		if (!succeeded) {
+			for (int i = 0; i < nextcount; ++i)
+				destroyBatch(&next[i]);
+			return false;
+		}
+
+		EncoderBatch *swap = current;
+		current = next;
+		next = swap;
+		count = nextcount;
+	}
+	return true;
+}
+
+int LayerEncoder::getFeatureCount() const {
+	return featurecount_;
+}
+
+const char *LayerEncoder::getFeatures() const {
+	return features_;
+}
+
+int LayerEncoder::getFeatureLength() const {
+	return featurelength_;
+}
+
+const char *LayerEncoder::getRecords() const {
+	return recordbytes_;
+}
+
+int LayerEncoder::getRecordLength() const {
+	return recordlength_;
+}
+
+int LayerEncoder::getFieldCount() const {
+	return fieldcount_;
+}
+
+const char *LayerEncoder::getFieldTypes() const {
+	return fieldtypes_;
+}
+
+int LayerEncoder::getRecordStride() const {
+	return recordstride_;
+}
+
+const int *LayerEncoder::getFeatureSizes() const {
+	return featuresizes_;
+}
+
+const int *LayerEncoder::getRecordSizes() const {
+	return recordsizes_;
+}
+
+const double *LayerEncoder::getEnvelopes() const {
+	return envelopes_;
+}
+
+const long long *LayerEncoder::getFids() const {
+	return fids_;
+}
+
+int LayerEncoder::readBatches(EncoderBatch *batches, int batchcount) {
+	int count = 0;
+	for (; count < batchcount; ++count) {
+		EncoderBatch *batch = &batches[count];
+		batch->count_ = 0;
+		batch->encoded_ = 0;
+		batch->featurelength_ = 0;
+		batch->recordlength_ = 0;
+		batch->failed_ = false;
+		while (batch->count_ < ENCODER_BATCH_SIZE) {
+			OGRFeature *feature = layer_->GetNextFeature();
+			if (feature == NULL)
+				break;
+			batch->features_[batch->count_++] = feature;
+		}
+		if (batch->count_ < ENCODER_BATCH_SIZE)
+			return batch->count_ > 0 ? count + 1 : count;
+	}
+	return count;
+}
+
+void *LayerEncoder::encodeWorker(void *arg) {
+	LayerEncoder *encoder = (LayerEncoder *) arg;
+	for (;;) {
+		int i = __sync_fetch_and_add(&encoder->nextbatch_, 1);
+		if (i >= encoder->runningcount_)
+			break;
+		EncoderBatch *batch = &encoder->running_[i];
+		batch->failed_ = !encoder->encodeBatch(batch);
+	}
+	return NULL;
+}
+
+bool LayerEncoder::encodeBatch(EncoderBatch *batch) const {
+	for (int i = 0; i < batch->count_; ++i) {
+		if (!encodeFeature(batch, batch->features_[i]))
+			return false;
+	}
+	return true;
+}
+
+bool LayerEncoder::encodeFeature(EncoderBatch *batch,
+		OGRFeature *feature) const {
+	OGRGeometry *geometry = feature->GetGeometryRef();
+	if (geometry == NULL)
+		return true;
+
+	int geometrytype = (int) geometry->getGeometryType();
+	int wkbsize = geometry->WkbSize();
+	int featuresize = sizeof(geometrytype) + sizeof(wkbsize) + wkbsize;
+	if (!reserveBytes(&batch->featurebytes_, &batch->featurecapacity_,
+			(long long) batch->featurelength_ + featuresize))
+		return false;
+	char *entry = batch->featurebytes_ + batch->featurelength_;
+	memcpy(entry, &geometrytype, sizeof(geometrytype));
+	memcpy(entry + sizeof(geometrytype), &wkbsize, sizeof(wkbsize));
+	geometry->exportToWkb((OGRwkbByteOrder) wkbNDR,
+			(unsigned char *) (entry + sizeof(geometrytype) + sizeof(wkbsize)));
+	batch->featurelength_ += featuresize;
+
+	int recordstart = batch->recordlength_;
+	if (records_) {
+		// the bitmap of set fields, filled in below.
+		int bitmapsize = getRowBitmapSize(fieldcount_);
+		if (!reserveBytes(&batch->recordbytes_, &batch->recordcapacity_,
+				(long long) batch->recordlength_ + bitmapsize))
+			return false;
+		memset(batch->recordbytes_ + recordstart, 0, bitmapsize);
+		batch->recordlength_ += bitmapsize;
+	}
+	for (int ifield = 0; records_ && ifield < fieldcount_; ++ifield) {
+		char attributetype = fieldtypes_[ifield];
+		if (attributetype == FTNull || !feature->IsFieldSet(ifield)) {
+			// no cell, but a zeroed one in fixed-stride rows.
+			if (recordstride_ > 0) {
+				int cellsize = getFixedCellSize(attributetype);
+				if (!reserveBytes(&batch->recordbytes_,
+						&batch->recordcapacity_,
+						(long long) batch->recordlength_ + cellsize))
+					return false;
+				memset(batch->recordbytes_ + batch->recordlength_, 0,
+						cellsize);
+				batch->recordlength_ += cellsize;
+			}
+			continue;
+		}
+		batch->recordbytes_[recordstart + ifield / 8] |= 1 << (ifield % 8);
+		// fixed-stride rows have their types in the records header.
+		bool appended = recordstride_ > 0
+				|| appendBytes(&batch->recordbytes_, &batch->recordlength_,
+						&batch->recordcapacity_, &attributetype,
+						sizeof(attributetype));
+		switch (attributetype) {
+		case OFTInteger: {
+			int ivalue = feature->GetFieldAsInteger(ifield);
+			if (recordstride_ > 0) {
+				appended = appended
+						&& appendBytes(&batch->recordbytes_,
+								&batch->recordlength_,
+								&batch->recordcapacity_, &ivalue,
+								sizeof(ivalue));
+			} else {
+				appended = appended
+						&& appendVarint(&batch->recordbytes_,
+								&batch->recordlength_,
+								&batch->recordcapacity_, zigzagEncode(ivalue));
+			}
+			break;
+		}
+		case OFTInteger64: {
+			long long lvalue = feature->GetFieldAsInteger64(ifield);
+			if (recordstride_ > 0) {
+				appended = appended
+						&& appendBytes(&batch->recordbytes_,
+								&batch->recordlength_,
+								&batch->recordcapacity_, &lvalue,
+								sizeof(lvalue));
+			} else {
+				appended = appended
+						&& appendVarint64(&batch->recordbytes_,
+								&batch->recordlength_,
+								&batch->recordcapacity_,
+								zigzagEncode64(lvalue));
+			}
+			break;
+		}
+		case OFTReal: {
+			double dvalue = feature->GetFieldAsDouble(ifield);
+			appended = appended
+					&& appendBytes(&batch->recordbytes_,
+							&batch->recordlength_, &batch->recordcapacity_,
+							&dvalue, sizeof(dvalue));
+			break;
+		}
+		case OFTString: {
+			const char *pstr = feature->GetFieldAsString(ifield);
+			int strlength = strlen(pstr) + 1;
+			appended = appended
+					&& appendVarint(&batch->recordbytes_,
+							&batch->recordlength_, &batch->recordcapacity_,
+							strlength)
+					&& appendBytes(&batch->recordbytes_,
+							&batch->recordlength_, &batch->recordcapacity_,
+							pstr, strlength);
+			break;
+		}
+		case OFTBinary: {
+			int blobsize;
+			unsigned char *bvalue = feature->GetFieldAsBinary(ifield,
+					&blobsize);
+			appended = appended
+					&& appendVarint(&batch->recordbytes_,
+							&batch->recordlength_, &batch->recordcapacity_,
+							blobsize)
+					&& appendBytes(&batch->recordbytes_,
+							&batch->recordlength_, &batch->recordcapacity_,
+							bvalue, blobsize);
+			break;
+		}
+		case OFTDate:
+		case OFTTime:
+		case OFTDateTime: {
+			FieldDateType date;
+			feature->GetFieldAsDateTime(ifield, &date.year_, &date.mon_,
+					&date.day_, &date.hour_, &date.min_, &date.sec_,
+					&date.tag_);
+			long long packed = packDate(date);
+			appended = appended
+					&& appendBytes(&batch->recordbytes_,
+							&batch->recordlength_, &batch->recordcapacity_,
+							&packed, sizeof(packed));
+			break;
+		}
+		case OFTIntegerList:
+		case OFTInteger64List:
+		case OFTRealList: {
+			// the count, then the values whole, as OGR holds them.
+			int count = 0;
+			const void *values = NULL;
+			if (attributetype == OFTIntegerList)
+				values = feature->GetFieldAsIntegerList(ifield, &count);
+			else if (attributetype == OFTInteger64List)
+				values = feature->GetFieldAsInteger64List(ifield, &count);
+			else
+				values = feature->GetFieldAsDoubleList(ifield, &count);
+			appended = appended
+					&& appendVarint(&batch->recordbytes_,
+							&batch->recordlength_, &batch->recordcapacity_,
+							count)
+					&& appendBytes(&batch->recordbytes_,
+							&batch->recordlength_, &batch->recordcapacity_,
+							values, count * getListValueSize(attributetype));
+			break;
+		}
+		case OFTStringList: {
+			char **strs = feature->GetFieldAsStringList(ifield);
+			int count = 0;
+			while (strs && strs[count])
+				++count;
+			appended = appended
+					&& appendVarint(&batch->recordbytes_,
+							&batch->recordlength_, &batch->recordcapacity_,
+							count);
+			for (int i = 0; appended && i < count; ++i) {
+				int strlength = strlen(strs[i]) + 1;
+				appended = appendVarint(&batch->recordbytes_,
+						&batch->recordlength_, &batch->recordcapacity_,
+						strlength)
+						&& appendBytes(&batch->recordbytes_,
+								&batch->recordlength_,
+								&batch->recordcapacity_, strs[i], strlength);
+			}
+			break;
+		}
+		default:
+			break;
+		}
+		if (!appended)
+			return false;
+	}
+
+	if (extents_) {
+		int i = batch->encoded_;
+		batch->featuresizes_[i] = featuresize;
+		batch->recordsizes_[i] = batch->recordlength_ - recordstart;
+		OGREnvelope envelope;
+		geometry->getEnvelope(&envelope);
+		batch->envelopes_[4 * i] = envelope.MinX;
+		batch->envelopes_[4 * i + 1] = envelope.MinY;
+		batch->envelopes_[4 * i + 2] = envelope.MaxX;
+		batch->envelopes_[4 * i + 3] = envelope.MaxY;
+		batch->fids_[i] = feature->GetFID();
+	}
+	++batch->encoded_;
+	return true;
+}
+
+bool LayerEncoder::appendBatch(const EncoderBatch & batch) {
+	if (!appendBytes(&features_, &featurelength_, &featurecapacity_,
+			batch.featurebytes_, batch.featurelength_))
+		return false;
+	if (!appendBytes(&recordbytes_, &recordlength_, &recordcapacity_,
+			batch.recordbytes_, batch.recordlength_))
+		return false;
+
+	if (extents_ && batch.encoded_ > 0) {
+		int count = featurecount_ + batch.encoded_;
+		if (count > extentcapacity_) {
+			int capacity = extentcapacity_ ? extentcapacity_ : 1024;
+			while (capacity < count)
+				capacity *= 2;
+			int *featuresizes = (int *) realloc(featuresizes_,
+					sizeof(int) * capacity);
+			if (featuresizes == NULL)
+				return false;
+			featuresizes_ = featuresizes;
+			int *recordsizes = (int *) realloc(recordsizes_,
+					sizeof(int) * capacity);
+			if (recordsizes == NULL)
+				return false;
+			recordsizes_ = recordsizes;
+			double *envelopes = (double *) realloc(envelopes_,
+					sizeof(double) * 4 * capacity);
+			if (envelopes == NULL)
+				return false;
+			envelopes_ = envelopes;
+			long long *fids = (long long *) realloc(fids_,
+					sizeof(long long) * capacity);
+			if (fids == NULL)
+				return false;
+			fids_ = fids;
+			extentcapacity_ = capacity;
+		}
+		memcpy(featuresizes_ + featurecount_, batch.featuresizes_,
+				sizeof(int) * batch.encoded_);
+		memcpy(recordsizes_ + featurecount_, batch.recordsizes_,
+				sizeof(int) * batch.encoded_);
+		memcpy(envelopes_ + 4 * featurecount_, batch.envelopes_,
+				sizeof(double) * 4 * batch.encoded_);
+		memcpy(fids_ + featurecount_, batch.fids_,
+				sizeof(long long) * batch.encoded_);
+	}
+	featurecount_ += batch.encoded_;
+	return true;
+}
+
+void LayerEncoder::destroyBatch(EncoderBatch *batch) const {
+	// features are made and destroyed on the reading thread only, they share
+	// the reference count of the layer definition.
+	for (int i = 0; i < batch->count_; ++i)
+		OGRFeature::DestroyFeature(batch->features_[i]);
+	batch->count_ = 0;
+}
@@ -0,0 +1,122 @@
+/// @file layerEncoder.h
+/// @author luliang@ict.ac.cn
+/// @copybrief Copyright 2013 ICT, CAS. All rights reserved.
+/// @version 0.1
+/// @date 2026-10-19
+
+#ifndef LAYERENCODER_H_
+#define LAYERENCODER_H_
+
+class OGRLayer;
+class OGRFeature;
+
+// the largest layer value: its lengths and offsets are ints.
+static const long long LAYER_MAX_LENGTH = 0x7fffffff;
+
+typedef struct {
+	OGRFeature **features_;
+	int count_; // features read into the batch
+	int encoded_; // features with a geometry, encoded
+
+	char *featurebytes_;
+	int featurelength_, featurecapacity_;
+	char *recordbytes_;
+	int recordlength_, recordcapacity_;
+
+	// per encoded feature, when extents are kept.
+	int *featuresizes_;
+	int *recordsizes_;
+	double *envelopes_;
+	long long *fids_;
+
+	bool failed_;
+} EncoderBatch;
+
+// receives the encoded batches in reading order; false stops the encoding.
+typedef bool (*EncoderSink)(const EncoderBatch & batch, void *context);
+
+// Encodes the feature entries and record cells of a layer on all cpus, in
+// one read of the layer. The reading thread pulls batches of features while
+// the workers encode the batches read before; every batch goes to its own
+// buffers, which are appended in reading order. The bytes are those the
+// single threaded serialization writes, feature by feature.
+class LayerEncoder {
+public:
+	// records: also encode the record cells. extents: also keep the size,
+	// the envelope and the fid of every feature, for spatial orders and
+	// indexes.
+	LayerEncoder(OGRLayer *layer, bool records, bool extents,
+			int threadcount = 0);
+	~LayerEncoder();
+
+	// with a sink, the batches go to the sink as they are encoded and only
+	// the feature count is kept: at most two rounds of batches are alive at
+	// a time, and the byte and extent getters return NULL.
+	void setSink(EncoderSink sink, void *context);
+
+	// false, with the reason on stderr, on failure.
+	bool encode();
+
+	int getFeatureCount() const;
+	// entries: int geometrytype, int wkbsize, wkb, one per feature.
+	const char *getFeatures() const;
+	int getFeatureLength() const;
+	// cells: char fieldtype and the value, fieldcount per feature. with a
+	// record stride, rows of that size holding the values only.
+	const char *getRecords() const;
+	int getRecordLength() const;
+	int getFieldCount() const;
+	const char *getFieldTypes() const;
+	// size of a row when every field is of fixed width, see
+	// RECORDS_FIXED_STRIDE, 0 for tagged cells. known once encoding.
+	int getRecordStride() const;
+
+	// with extents only, NULL otherwise.
+	const int *getFeatureSizes() const;
+	const int *getRecordSizes() const;
+	// minx, miny, maxx, maxy of every feature.
+	const double *getEnvelopes() const;
+	// OGRFeature::GetFID of every feature, OGRNullFID when it has none.
+	const long long *getFids() const;
+
+private:
+	LayerEncoder(const LayerEncoder &);
+	void operator=(const LayerEncoder &);
+
+	int readBatches(EncoderBatch *batches, int batchcount);
+	bool encodeBatch(EncoderBatch *batch) const;
+	bool encodeFeature(EncoderBatch *batch, OGRFeature *feature) const;
+	void encodeBatches(EncoderBatch *batches, int batchcount);
+	bool appendBatch(const EncoderBatch & batch);
+	void destroyBatch(EncoderBatch *batch) const;
+
+	static void *encodeWorker(void *arg);
+
+	OGRLayer *layer_;
+	bool records_, extents_;
+	int threadcount_;
+	int fieldcount_;
+	char *fieldtypes_;
+	int recordstride_;
+
+	EncoderBatch *batches_;
+	int nextbatch_;
+	EncoderBatch *running_;
+	int runningcount_;
+
+	int featurecount_;
+	char *features_;
+	int featurelength_, featurecapacity_;
+	char *recordbytes_;
+	int recordlength_, recordcapacity_;
+	int *featuresizes_;
+	int *recordsizes_;
+	double *envelopes_;
+	long long *fids_;
+	int extentcapacity_;
+
+	EncoderSink sink_;
+	void *sinkcontext_;
+};
+
+#endif /* LAYERENCODER_H_ */
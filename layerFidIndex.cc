@@ -0,0 +1,333 @@
+/// @file layerFidIndex.cc
+/// @author luliang@ict.ac.cn
+/// @copybrief Copyright 2013 ICT, CAS. All rights reserved.
+/// @version 0.1
+/// @date 2026-10-19
+
+#include "layerFidIndex.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+// OGRNullFID, the fid of a feature that has none.
+static const long long NULL_FID = -1;
+
+typedef struct {
+	long long fid_;
+	int offset_;
+	int size_;
+} FidItem;
+
+static int compareFidItem(const void *a, const void *b) {
+	int oa = ((const FidItem *) a)->offset_;
+	int ob = ((const FidItem *) b)->offset_;
+	if (oa < ob)
+		return -1;
+	if (oa > ob)
+		return 1;
+	return 0;
+}
+
+LayerFidIndex::LayerFidIndex() :
+		indexlength_(0), itemcount_(0), slotcount_(0), fids_(NULL), itemoffsets_(
+				NULL), itemsizes_(NULL), slots_(NULL), capacity_(0), buffer_(
+				NULL), bufferflag_(UNINITIALIZED) {
+}
+
+LayerFidIndex::LayerFidIndex(const char * bytes) :
+		indexlength_(0), itemcount_(0), slotcount_(0), fids_(NULL), itemoffsets_(
+				NULL), itemsizes_(NULL), slots_(NULL), capacity_(0), buffer_(
+				NULL), bufferflag_(UNINITIALIZED) {
+	setIndex(bytes);
+}
+
+LayerFidIndex::~LayerFidIndex() {
+	clear();
+	if (buffer_)
+		free(buffer_);
+}
+
+void LayerFidIndex::clear() {
+	if (fids_)
+		free(fids_);
+	if (itemoffsets_)
+		free(itemoffsets_);
+	if (itemsizes_)
+		free(itemsizes_);
+	if (slots_)
+		free(slots_);
+	fids_ = NULL;
+	itemoffsets_ = NULL;
+	itemsizes_ = NULL;
+	slots_ = NULL;
+	indexlength_ = itemcount_ = slotcount_ = capacity_ = 0;
+}
+
+bool LayerFidIndex::resetItems(int count) {
+	// the blocks are kept on failure and freed by clear().
+	long long *fids = (long long *) realloc(fids_,
+			sizeof(long long) * (count + 1));
+	if (fids != NULL)
+		fids_ = fids;
+	int *itemoffsets = (int *) realloc(itemoffsets_,
+			sizeof(int) * (count + 1));
+	if (itemoffsets != NULL)
+		itemoffsets_ = itemoffsets;
+	int *itemsizes = (int *) realloc(itemsizes_, sizeof(int) * (count + 1));
+	if (itemsizes != NULL)
+		itemsizes_ = itemsizes;
+	if (fids == NULL || itemoffsets == NULL || itemsizes == NULL) {
+		fprintf(stderr, "Fail to alloc memory for fid index items.\n");
+		return false;
+	}
+	capacity_ = count;
+	return true;
+}
+
+int LayerFidIndex::getHomeSlot(long long fid, int slotcount) {
+	// the murmur3 finalizer: fids are often dense, the slots should not be.
+	unsigned long long h = (unsigned long long) fid;
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return (int) (h & (unsigned long long) (slotcount - 1));
+}
+
+int LayerFidIndex::getSlotOffset(int itemcount, int slot) {
+	return HEADER_SIZE + (sizeof(long long) + 2 * sizeof(int)) * itemcount
+			+ SLOT_SIZE * slot;
+}
+
+void LayerFidIndex::readSlot(const char *bytes, long long *fid, int *item,
+		int *offset, int *size) {
+	memcpy(fid, bytes, sizeof(long long));
+	memcpy(item, bytes + sizeof(long long), sizeof(int));
+	memcpy(offset, bytes + sizeof(long long) + sizeof(int), sizeof(int));
+	memcpy(size, bytes + sizeof(long long) + 2 * sizeof(int), sizeof(int));
+}
+
+void LayerFidIndex::add(long long fid, int offset, int size) {
+	if (itemcount_ == capacity_) {
+		if (!resetItems(capacity_ ? capacity_ * 2 : 64))
+			return;
+	}
+	fids_[itemcount_] = fid;
+	itemoffsets_[itemcount_] = offset;
+	itemsizes_[itemcount_] = size;
+	++itemcount_;
+}
+
+void LayerFidIndex::finish() {
+	// stored order, the order of the features and the record rows.
+	if (itemcount_ > 0) {
+		FidItem *items = (FidItem *) malloc(sizeof(FidItem) * itemcount_);
+		if (items == NULL) {
+			fprintf(stderr, "Fail to alloc memory for fid index items.\n");
+			return;
+		}
+		for (int i = 0; i < itemcount_; ++i) {
+			items[i].fid_ = fids_[i];
+			items[i].offset_ = itemoffsets_[i];
+			items[i].size_ = itemsizes_[i];
+		}
+		qsort(items, itemcount_, sizeof(FidItem), compareFidItem);
+		for (int i = 0; i < itemcount_; ++i) {
+			fids_[i] = items[i].fid_;
+			itemoffsets_[i] = items[i].offset_;
+			itemsizes_[i] = items[i].size_;
+		}
+		free(items);
+	}
+
+	// at most two thirds full, so probes stay short.
+	slotcount_ = 1;
+	while (slotcount_ < itemcount_ + itemcount_ / 2 + 1)
+		slotcount_ *= 2;
+	int *slots = (int *) realloc(slots_, sizeof(int) * slotcount_);
+	if (slots == NULL) {
+		fprintf(stderr, "Fail to alloc memory for fid index slots.\n");
+		slotcount_ = 0;
+		return;
+	}
+	slots_ = slots;
+	for (int i = 0; i < slotcount_; ++i)
+		slots_[i] = -1;
+	for (int i = 0; i < itemcount_; ++i) {
+		if (fids_[i] == NULL_FID)
+			continue;
+		int slot = getHomeSlot(fids_[i], slotcount_);
+		while (slots_[slot] >= 0 && fids_[slots_[slot]] != fids_[i])
+			slot = (slot + 1) & (slotcount_ - 1);
+		if (slots_[slot] < 0)
+			slots_[slot] = i;
+	}
+
+	indexlength_ = getSlotOffset(itemcount_, slotcount_);
+
+	// set buffer flag.
+	if (bufferflag_ == LATEST)
+		bufferflag_ = STALE;
+}
+
+int LayerFidIndex::find(long long fid) const {
+	if (slotcount_ == 0 || fid == NULL_FID)
+		return -1;
+	int slot = getHomeSlot(fid, slotcount_);
+	while (slots_[slot] >= 0) {
+		if (fids_[slots_[slot]] == fid)
+			return slots_[slot];
+		slot = (slot + 1) & (slotcount_ - 1);
+	}
+	return -1;
+}
+
+const char *LayerFidIndex::getBytes() {
+	// alloc memory or return the buffered result.
+	if (bufferflag_ == UNINITIALIZED) {
+		buffer_ = (char *) malloc(indexlength_);
+	} else if (bufferflag_ == STALE) {
+		buffer_ = (char *) realloc(buffer_, indexlength_);
+	} else {
+		return buffer_;
+	}
+	if (buffer_ == NULL) {
+		fprintf(stderr, "Fail to alloc memory for buffer_.\n");
+		return NULL;
+	}
+
+	char *bytes = buffer_;
+	int offset = 0;
+	memcpy(bytes + offset, &indexlength_, sizeof(indexlength_));
+	offset += sizeof(indexlength_);
+	memcpy(bytes + offset, &itemcount_, sizeof(itemcount_));
+	offset += sizeof(itemcount_);
+	memcpy(bytes + offset, &slotcount_, sizeof(slotcount_));
+	offset += sizeof(slotcount_);
+	memcpy(bytes + offset, fids_, sizeof(long long) * itemcount_);
+	offset += sizeof(long long) * itemcount_;
+	memcpy(bytes + offset, itemoffsets_, sizeof(int) * itemcount_);
+	offset += sizeof(int) * itemcount_;
+	memcpy(bytes + offset, itemsizes_, sizeof(int) * itemcount_);
+	offset += sizeof(int) * itemcount_;
+	for (int slot = 0; slot < slotcount_; ++slot) {
+		int item = slots_[slot];
+		long long fid = item >= 0 ? fids_[item] : NULL_FID;
+		int itemoffset = item >= 0 ? itemoffsets_[item] : 0;
+		int itemsize = item >= 0 ? itemsizes_[item] : 0;
+		memcpy(bytes + offset, &fid, sizeof(fid));
+		offset += sizeof(fid);
+		memcpy(bytes + offset, &item, sizeof(item));
+		offset += sizeof(item);
+		memcpy(bytes + offset, &itemoffset, sizeof(itemoffset));
+		offset += sizeof(itemoffset);
+		memcpy(bytes + offset, &itemsize, sizeof(itemsize));
+		offset += sizeof(itemsize);
+	}
+
+	assert(offset == indexlength_);
+
+	bufferflag_ = LATEST;
+	return buffer_;
+}
+
+void LayerFidIndex::setIndex(const char * bytes) {
+	if (bytes == NULL)
+		return;
+	clear();
+
+	int offset = 0;
+	memcpy(&indexlength_, bytes + offset, sizeof(indexlength_));
+	offset += sizeof(indexlength_);
+	int itemcount = 0;
+	memcpy(&itemcount, bytes + offset, sizeof(itemcount));
+	offset += sizeof(itemcount);
+	memcpy(&slotcount_, bytes + offset, sizeof(slotcount_));
+	offset += sizeof(slotcount_);
+
+	// the probes mask with slotcount_ - 1 and stop at an empty slot, and the
+	// items and the slots must fill indexlength_ exactly.
+	if (itemcount < 0 || slotcount_ <= itemcount
+			|| (slotcount_ & (slotcount_ - 1)) != 0
+			|| HEADER_SIZE
+					+ (long long) (sizeof(long long) + 2 * sizeof(int))
+							* itemcount + (long long) SLOT_SIZE * slotcount_
+					!= indexlength_) {
+		fprintf(stderr, "Invalid fid index of %d items in %d slots.\n",
+				itemcount, slotcount_);
+		clear();
+		return;
+	}
+
+	slots_ = (int *) malloc(sizeof(int) * (slotcount_ + 1));
+	if (slots_ == NULL || !resetItems(itemcount)) {
+		fprintf(stderr, "Fail to alloc memory for fid index.\n");
+		clear();
+		return;
+	}
+	itemcount_ = itemcount;
+
+	memcpy(fids_, bytes + offset, sizeof(long long) * itemcount_);
+	offset += sizeof(long long) * itemcount_;
+	memcpy(itemoffsets_, bytes + offset, sizeof(int) * itemcount_);
+	offset += sizeof(int) * itemcount_;
+	memcpy(itemsizes_, bytes + offset, sizeof(int) * itemcount_);
+	offset += sizeof(int) * itemcount_;
+	for (int slot = 0; slot < slotcount_; ++slot) {
+		long long fid = 0;
+		int itemoffset = 0, itemsize = 0;
+		readSlot(bytes + offset, &fid, &slots_[slot], &itemoffset, &itemsize);
+		offset += SLOT_SIZE;
+	}
+
+	assert(offset == indexlength_);
+
+	// alloc memory for buffer_
+	if (bufferflag_ == UNINITIALIZED) {
+		buffer_ = (char *) malloc(indexlength_);
+	} else {
+		buffer_ = (char *) realloc(buffer_, indexlength_);
+	}
+	if (buffer_ == NULL) {
+		fprintf(stderr, "Fail to alloc memory for buffer_.\n");
+		return;
+	}
+
+	memcpy(buffer_, bytes, indexlength_);
+
+	// set buffer flag.
+	bufferflag_ = LATEST;
+}
+
+int LayerFidIndex::getIndexLength() const {
+	return indexlength_;
+}
+
+int LayerFidIndex::getItemCount() const {
+	return itemcount_;
+}
+
+int LayerFidIndex::getSlotCount() const {
+	return slotcount_;
+}
+
+long long LayerFidIndex::getFid(int item) const {
+	if (fids_ == NULL || item < 0 || item >= itemcount_)
+		return NULL_FID;
+	return fids_[item];
+}
+
+int LayerFidIndex::getItemOffset(int item) const {
+	if (itemoffsets_ == NULL || item < 0 || item >= itemcount_)
+		return -1;
+	return itemoffsets_[item];
+}
+
+int LayerFidIndex::getItemSize(int item) const {
+	if (itemsizes_ == NULL || item < 0 || item >= itemcount_)
+		return 0;
+	return itemsizes_[item];
+}
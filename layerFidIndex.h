@@ -0,0 +1,78 @@
+/// @file layerFidIndex.h
+/// @author luliang@ict.ac.cn
+/// @copybrief Copyright 2013 ICT, CAS. All rights reserved.
+/// @version 0.1
+/// @date 2026-10-19
+
+#ifndef LAYERFIDINDEX_H_
+#define LAYERFIDINDEX_H_
+
+// Source fids of the stored features and an open addressing hash table from
+// fid to feature. Items are in stored order, item i is feature and record
+// row i of the layer value, and carry the byte range of their feature. A
+// slot holds its fid with the item, its offset and its size, so a lookup
+// can read the header and the slots it probes alone, then the feature.
+class LayerFidIndex {
+public:
+	// bytes of a slot: long long fid, int item, int offset, int size.
+	static const int SLOT_SIZE = 20;
+	// bytes of the header: indexlength_, itemcount_, slotcount_.
+	static const int HEADER_SIZE = 12;
+
+	LayerFidIndex();
+	LayerFidIndex(const char * bytes);
+	~LayerFidIndex();
+
+	const char *getBytes();
+
+	int getIndexLength() const;
+	int getItemCount() const;
+	int getSlotCount() const;
+	// OGRNullFID for an item without a fid.
+	long long getFid(int item) const;
+	int getItemOffset(int item) const;
+	int getItemSize(int item) const;
+	// the item of a fid, the first one added if the fid repeats, -1 if none.
+	int find(long long fid) const;
+
+	// add items in any order, then finish() once to sort them by offset and
+	// hash them. items without a fid are kept but not hashed.
+	void add(long long fid, int offset, int size);
+	void finish();
+
+	void setIndex(const char * bytes);
+
+	// probing the stored bytes: the first slot of a fid, the offset of a
+	// slot in the value, and the fields of the slot at bytes (item -1 for
+	// an empty slot, ending the probe).
+	static int getHomeSlot(long long fid, int slotcount);
+	static int getSlotOffset(int itemcount, int slot);
+	static void readSlot(const char *bytes, long long *fid, int *item,
+			int *offset, int *size);
+
+private:
+	typedef enum {
+		UNINITIALIZED, STALE, LATEST
+	} BufferFlagType;
+
+	LayerFidIndex(const LayerFidIndex &);
+	void operator=(const LayerFidIndex &);
+
+	void clear();
+	bool resetItems(int count);
+
+	int indexlength_;
+	int itemcount_;
+	int slotcount_; // a power of two, at least half again the items
+	long long *fids_;
+	int *itemoffsets_;
+	int *itemsizes_;
+	int *slots_; // item of every slot, -1 when empty
+
+	int capacity_;
+
+	char *buffer_;
+	BufferFlagType bufferflag_;
+};
+
+#endif /* LAYERFIDINDEX_H_ */
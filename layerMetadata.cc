@@ -10,6 +10,8 @@
 #include <string.h>
 #include <assert.h>
 
+#include <algorithm>
+
 #include <ogrsf_frmts.h>
 
 LayerMetadata::LayerMetadata() :
@@ -44,6 +46,31 @@ LayerMetadata::~LayerMetadata() {
 		free(buffer_);
 }
 
+void LayerMetadata::swap(LayerMetadata & metadata) {
+	std::swap(metadatalength_, metadata.metadatalength_);
+	std::swap(layernamelength_, metadata.layernamelength_);
+	std::swap(layername_, metadata.layername_);
+	std::swap(geotype_, metadata.geotype_);
+	std::swap(strWKTlength_, metadata.strWKTlength_);
+	std::swap(strWKT_, metadata.strWKT_);
+	std::swap(buffer_, metadata.buffer_);
+	std::swap(bufferflag_, metadata.bufferflag_);
+}
+
+#if __cplusplus >= 201103L
+LayerMetadata::LayerMetadata(LayerMetadata && metadata) :
+		metadatalength_(0), layernamelength_(0), layername_(NULL), geotype_(0), strWKTlength_(
+				0), strWKT_(NULL), buffer_(NULL), bufferflag_(UNINITIALIZED) {
+	swap(metadata);
+}
+
+LayerMetadata & LayerMetadata::operator=(LayerMetadata && metadata) {
+	LayerMetadata moved(static_cast<LayerMetadata &&>(metadata));
+	swap(moved);
+	return *this;
+}
+#endif
+
 const char *LayerMetadata::getBytes() {
 
 	// alloc memory or return the buffered result.
@@ -111,6 +138,23 @@ const char *LayerMetadata::getStrWKT() const {
 	return strWKT_;
 }
 
+#if __cplusplus >= 201103L
+// the stored lengths count the terminating zero.
+static LayerSpan<const char> getStringSpan(const char *str, int length) {
+	if (str && length > 0 && str[length - 1] == '\0')
+		--length;
+	return LayerSpan<const char>(str, length);
+}
+
+LayerSpan<const char> LayerMetadata::getLayernameSpan() const {
+	return getStringSpan(layername_, layernamelength_);
+}
+
+LayerSpan<const char> LayerMetadata::getStrWKTSpan() const {
+	return getStringSpan(strWKT_, strWKTlength_);
+}
+#endif
+
 void LayerMetadata::setMetadata(OGRLayer *layer) {
 	if (layer == NULL)
 		return;
@@ -146,7 +190,12 @@ void LayerMetadata::setMetadata(OGRLayer *layer) {
 		poSR->exportToWkt(&strWKT_);
 	} else {
 		fprintf(stdout, "since no srs specified,default would be assigned.");
-		strWKT_ = "";
+		// an empty string of its own, freed like an exported one.
+		strWKT_ = (char *) calloc(1, 1);
+		if (strWKT_ == NULL) {
+			fprintf(stderr, "Fail to alloc memory for strWKT_.\n");
+			return;
+		}
 	}
 	strWKTlength_ = strlen(strWKT_) + 1;
 	metadatalength_ += strWKTlength_ + sizeof(strWKTlength_);
@@ -7,6 +7,8 @@
 #ifndef LAYERMETADATA_H_
 #define LAYERMETADATA_H_
 
+#include "layerSpan.h"
+
 class OGRLayer;
 
 class LayerMetadata {
@@ -34,6 +36,17 @@ public:
 	void setMetadata(const char * bytes);
 	void setMetadata(const LayerMetadata &metadata);
 
+	// exchanges the contents of two objects in O(1), without allocating.
+	void swap(LayerMetadata & metadata);
+#if __cplusplus >= 201103L
+	// moves leave the source empty, as if default constructed.
+	LayerMetadata(LayerMetadata && metadata);
+	LayerMetadata & operator=(LayerMetadata && metadata);
+	// the layer name and the WKT, without their terminating zeros.
+	LayerSpan<const char> getLayernameSpan() const;
+	LayerSpan<const char> getStrWKTSpan() const;
+#endif
+
 private:
 	typedef enum {
 		UNINITIALIZED, STALE, LATEST
@@ -0,0 +1,89 @@
+/// @file layerSnapshot.cc
+/// @author luliang@ict.ac.cn
+/// @copybrief Copyright 2013 ICT, CAS. All rights reserved.
+/// @version 0.1
+/// @date 2026-10-19
+
+#include "layerSnapshot.h"
+#include "layerEncoder.h"
+
+#include <stdio.h>
+
+LayerSnapshot::LayerSnapshot() :
+		parts_(0), decoded_(0), encoder_(NULL) {
+}
+
+LayerSnapshot::LayerSnapshot(OGRLayer *layer, int parts) :
+		parts_(0), decoded_(0), encoder_(NULL) {
+	read(layer, parts);
+}
+
+LayerSnapshot::~LayerSnapshot() {
+	clear();
+}
+
+void LayerSnapshot::clear() {
+	if (encoder_) {
+		delete encoder_;
+		encoder_ = NULL;
+	}
+	parts_ = 0;
+	decoded_ = 0;
+}
+
+bool LayerSnapshot::read(OGRLayer *layer, int parts) {
+	clear();
+	if (layer == NULL) {
+		fprintf(stderr, "Nil OGRLayer object.\n");
+		return false;
+	}
+
+	if (parts & SNAPSHOT_METADATA)
+		metadata_.setMetadata(layer);
+	if (parts & SNAPSHOT_ATTRDEF)
+		attrdef_.setAttrDef(layer);
+
+	// the one read of the features, for both the features and the records.
+	if (parts & (SNAPSHOT_FEATURES | SNAPSHOT_RECORDS | SNAPSHOT_EXTENTS)) {
+		encoder_ = new LayerEncoder(layer, (parts & SNAPSHOT_RECORDS) != 0,
+				(parts & SNAPSHOT_EXTENTS) != 0);
+		if (!encoder_->encode()) {
+			clear();
+			return false;
+		}
+	}
+	parts_ = parts;
+	return true;
+}
+
+LayerMetadata *LayerSnapshot::getMetadata() {
+	return (parts_ & SNAPSHOT_METADATA) ? &metadata_ : NULL;
+}
+
+LayerAttrDef *LayerSnapshot::getAttrDef() {
+	return (parts_ & SNAPSHOT_ATTRDEF) ? &attrdef_ : NULL;
+}
+
+LayerAllFeatures *LayerSnapshot::getAllFeatures() {
+	if (!(parts_ & SNAPSHOT_FEATURES))
+		return NULL;
+	if (!(decoded_ & SNAPSHOT_FEATURES)) {
+		allfeatures_.setAllFeatures(*encoder_);
+		decoded_ |= SNAPSHOT_FEATURES;
+	}
+	return &allfeatures_;
+}
+
+LayerAllRecords *LayerSnapshot::getAllRecords() {
+	if (!(parts_ & SNAPSHOT_RECORDS))
+		return NULL;
+	if (!(decoded_ & SNAPSHOT_RECORDS)) {
+		allrecords_.setAllRecords(*encoder_);
+		decoded_ |= SNAPSHOT_RECORDS;
+	}
+	return &allrecords_;
+}
+
+const LayerEncoder *LayerSnapshot::getEncoder() const {
+	return encoder_;
+}
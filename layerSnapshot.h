@@ -0,0 +1,66 @@
+/// @file layerSnapshot.h
+/// @author luliang@ict.ac.cn
+/// @copybrief Copyright 2013 ICT, CAS. All rights reserved.
+/// @version 0.1
+/// @date 2026-10-19
+
+#ifndef LAYERSNAPSHOT_H_
+#define LAYERSNAPSHOT_H_
+
+#include "layerMetadata.h"
+#include "layerAttrDef.h"
+#include "layerAllFeatures.h"
+#include "layerAllRecords.h"
+
+class OGRLayer;
+class LayerEncoder;
+
+// parts of a layer to snapshot, may be or'ed together.
+typedef enum {
+	SNAPSHOT_METADATA = 1,
+	SNAPSHOT_ATTRDEF = 2,
+	SNAPSHOT_FEATURES = 4,
+	SNAPSHOT_RECORDS = 8,
+	// the size and envelope of every feature, see LayerEncoder.
+	SNAPSHOT_EXTENTS = 16,
+	SNAPSHOT_ALL = 15
+} SnapshotPart;
+
+// The parts of a layer from one read of an OGRLayer. The metadata and the
+// attrdef come from the layer definition; the features and the records from
+// a single LayerEncoder pass over the features, and are decoded from it on
+// first use.
+class LayerSnapshot {
+public:
+	LayerSnapshot();
+	LayerSnapshot(OGRLayer *layer, int parts = SNAPSHOT_ALL);
+	~LayerSnapshot();
+
+	// false, with the reason on stderr, on failure.
+	bool read(OGRLayer *layer, int parts = SNAPSHOT_ALL);
+
+	// NULL for a part that was not read.
+	LayerMetadata *getMetadata();
+	LayerAttrDef *getAttrDef();
+	LayerAllFeatures *getAllFeatures();
+	LayerAllRecords *getAllRecords();
+	// the encoded features and records, NULL if neither was read.
+	const LayerEncoder *getEncoder() const;
+
+private:
+	LayerSnapshot(const LayerSnapshot &);
+	void operator=(const LayerSnapshot &);
+
+	void clear();
+
+	int parts_;
+	int decoded_; // SNAPSHOT_FEATURES and SNAPSHOT_RECORDS once decoded
+
+	LayerMetadata metadata_;
+	LayerAttrDef attrdef_;
+	LayerAllFeatures allfeatures_;
+	LayerAllRecords allrecords_;
+	LayerEncoder *encoder_;
+};
+
+#endif /* LAYERSNAPSHOT_H_ */
@@ -0,0 +1,51 @@
+/// @file layerSpan.h
+/// @author luliang@ict.ac.cn
+/// @copybrief Copyright 2013 ICT, CAS. All rights reserved.
+/// @version 0.1
+/// @date 2026-10-19
+
+#ifndef LAYERSPAN_H_
+#define LAYERSPAN_H_
+
+#if __cplusplus >= 201103L
+
+// count values in place, as a std::span or, of chars, a std::string_view:
+// a pointer and a count that range-for and the algorithms take. A span is
+// valid while the object it was taken from is, and is not changed.
+template<typename T>
+class LayerSpan {
+public:
+	LayerSpan() :
+			data_(nullptr), size_(0) {
+	}
+	LayerSpan(T *data, int size) :
+			data_(size > 0 ? data : nullptr), size_(size > 0 ? size : 0) {
+	}
+
+	T *data() const {
+		return data_;
+	}
+	int size() const {
+		return size_;
+	}
+	bool empty() const {
+		return size_ == 0;
+	}
+	T & operator[](int index) const {
+		return data_[index];
+	}
+	T *begin() const {
+		return data_;
+	}
+	T *end() const {
+		return data_ + size_;
+	}
+
+private:
+	T *data_;
+	int size_;
+};
+
+#endif
+
+#endif /* LAYERSPAN_H_ */
@@ -0,0 +1,575 @@
+/// @file layerSpatialIndex.cc
+/// @author luliang@ict.ac.cn
+/// @copybrief Copyright 2013 ICT, CAS. All rights reserved.
+/// @version 0.1
+/// @date 2026-10-19
+
+#include "layerSpatialIndex.h"
+#include "spatialCurve.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <float.h>
+
+typedef struct {
+	unsigned int hilbert_;
+	LayerEnvelope box_;
+	int index_;
+} HilbertItem;
+
+static int compareHilbertItem(const void *a, const void *b) {
+	unsigned int ha = ((const HilbertItem *) a)->hilbert_;
+	unsigned int hb = ((const HilbertItem *) b)->hilbert_;
+	if (ha < hb)
+		return -1;
+	if (ha > hb)
+		return 1;
+	return 0;
+}
+
+LayerSpatialIndex::LayerSpatialIndex(int nodesize) :
+		indexlength_(0), itemcount_(0), nodesize_(nodesize), nodecount_(0), levelcount_(
+				0), levelbounds_(NULL), boxes_(NULL), indices_(NULL), itemoffsets_(
+				NULL), itemsizes_(NULL), capacity_(0), buffer_(NULL), bufferflag_(
+				UNINITIALIZED) {
+	if (nodesize_ < 2)
+		nodesize_ = 2;
+	extent_.minx_ = extent_.miny_ = DBL_MAX;
+	extent_.maxx_ = extent_.maxy_ = -DBL_MAX;
+}
+
+LayerSpatialIndex::LayerSpatialIndex(const char * bytes) :
+		indexlength_(0), itemcount_(0), nodesize_(16), nodecount_(0), levelcount_(
+				0), levelbounds_(NULL), boxes_(NULL), indices_(NULL), itemoffsets_(
+				NULL), itemsizes_(NULL), capacity_(0), buffer_(NULL), bufferflag_(
+				UNINITIALIZED) {
+	extent_.minx_ = extent_.miny_ = DBL_MAX;
+	extent_.maxx_ = extent_.maxy_ = -DBL_MAX;
+	setIndex(bytes);
+}
+
+LayerSpatialIndex::LayerSpatialIndex(const char * bytes, int size) :
+		indexlength_(0), itemcount_(0), nodesize_(16), nodecount_(0), levelcount_(
+				0), levelbounds_(NULL), boxes_(NULL), indices_(NULL), itemoffsets_(
+				NULL), itemsizes_(NULL), capacity_(0), buffer_(NULL), bufferflag_(
+				UNINITIALIZED) {
+	extent_.minx_ = extent_.miny_ = DBL_MAX;
+	extent_.maxx_ = extent_.maxy_ = -DBL_MAX;
+	setIndex(bytes, size);
+}
+
+LayerSpatialIndex::~LayerSpatialIndex() {
+	clear();
+	if (buffer_)
+		free(buffer_);
+}
+
+void LayerSpatialIndex::clear() {
+	if (levelbounds_)
+		free(levelbounds_);
+	if (boxes_)
+		free(boxes_);
+	if (indices_)
+		free(indices_);
+	if (itemoffsets_)
+		free(itemoffsets_);
+	if (itemsizes_)
+		free(itemsizes_);
+	levelbounds_ = NULL;
+	boxes_ = NULL;
+	indices_ = NULL;
+	itemoffsets_ = NULL;
+	itemsizes_ = NULL;
+	indexlength_ = itemcount_ = nodecount_ = levelcount_ = capacity_ = 0;
+}
+
+void LayerSpatialIndex::add(double minx, double miny, double maxx,
+		double maxy, int offset, int size) {
+	if (itemcount_ == capacity_) {
+		// the blocks are kept on failure and freed with the index.
+		int capacity = capacity_ ? capacity_ * 2 : 64;
+		LayerEnvelope *boxes = (LayerEnvelope *) realloc(boxes_,
+				sizeof(LayerEnvelope) * capacity);
+		if (boxes != NULL)
+			boxes_ = boxes;
+		int *itemoffsets = (int *) realloc(itemoffsets_, sizeof(int) * capacity);
+		if (itemoffsets != NULL)
+			itemoffsets_ = itemoffsets;
+		int *itemsizes = (int *) realloc(itemsizes_, sizeof(int) * capacity);
+		if (itemsizes != NULL)
+			itemsizes_ = itemsizes;
+		if (boxes == NULL || itemoffsets == NULL || itemsizes == NULL) {
+			fprintf(stderr, "Fail to alloc memory for index items.\n");
+			return;
+		}
+		capacity_ = capacity;
+	}
+	LayerEnvelope &box = boxes_[itemcount_];
+	box.minx_ = minx;
+	box.miny_ = miny;
+	box.maxx_ = maxx;
+	box.maxy_ = maxy;
+	itemoffsets_[itemcount_] = offset;
+	itemsizes_[itemcount_] = size;
+	++itemcount_;
+
+	if (minx < extent_.minx_)
+		extent_.minx_ = minx;
+	if (miny < extent_.miny_)
+		extent_.miny_ = miny;
+	if (maxx > extent_.maxx_)
+		extent_.maxx_ = maxx;
+	if (maxy > extent_.maxy_)
+		extent_.maxy_ = maxy;
+}
+
+void LayerSpatialIndex::finish() {
+	// level bounds, from leaves up to the root.
+	levelcount_ = 1;
+	for (int n = itemcount_; n > 1; n = (n + nodesize_ - 1) / nodesize_)
+		++levelcount_;
+	if (itemcount_ == 0)
+		levelcount_ = 0;
+	int *levelbounds = (int *) realloc(levelbounds_,
+			sizeof(int) * (levelcount_ + 1));
+	if (levelbounds == NULL) {
+		fprintf(stderr, "Fail to alloc memory for index levels.\n");
+		return;
+	}
+	levelbounds_ = levelbounds;
+	nodecount_ = 0;
+	int n = itemcount_;
+	for (int level = 0; level < levelcount_; ++level) {
+		nodecount_ += n;
+		levelbounds_[level] = nodecount_;
+		n = (n + nodesize_ - 1) / nodesize_;
+	}
+
+	LayerEnvelope *boxes = (LayerEnvelope *) realloc(boxes_,
+			sizeof(LayerEnvelope) * (nodecount_ + 1));
+	if (boxes != NULL)
+		boxes_ = boxes;
+	int *indices = (int *) realloc(indices_, sizeof(int) * (nodecount_ + 1));
+	if (indices != NULL)
+		indices_ = indices;
+	int *itemoffsets = (int *) realloc(itemoffsets_,
+			sizeof(int) * (itemcount_ + 1));
+	if (itemoffsets != NULL)
+		itemoffsets_ = itemoffsets;
+	int *itemsizes = (int *) realloc(itemsizes_, sizeof(int) * (itemcount_ + 1));
+	if (itemsizes != NULL)
+		itemsizes_ = itemsizes;
+	if (boxes == NULL || indices == NULL || itemoffsets == NULL
+			|| itemsizes == NULL) {
+		fprintf(stderr, "Fail to alloc memory for index nodes.\n");
+		return;
+	}
+	capacity_ = itemcount_;
+
+	// sort leaves by the hilbert code of their center.
+	if (itemcount_ > 0) {
+		HilbertItem *items = (HilbertItem *) malloc(
+				sizeof(HilbertItem) * itemcount_);
+		if (items == NULL) {
+			fprintf(stderr, "Fail to alloc memory for hilbert items.\n");
+			return;
+		}
+		double width = extent_.maxx_ - extent_.minx_;
+		double height = extent_.maxy_ - extent_.miny_;
+		for (int i = 0; i < itemcount_; ++i) {
+			const LayerEnvelope &box = boxes_[i];
+			unsigned int x = 0, y = 0;
+			if (width > 0)
+				x = (unsigned int) (65535.0
+						* ((box.minx_ + box.maxx_) / 2 - extent_.minx_) / width);
+			if (height > 0)
+				y = (unsigned int) (65535.0
+						* ((box.miny_ + box.maxy_) / 2 - extent_.miny_) / height);
+			items[i].hilbert_ = hilbertCode(x, y);
+			items[i].box_ = box;
+			items[i].index_ = i;
+		}
+		qsort(items, itemcount_, sizeof(HilbertItem), compareHilbertItem);
+		for (int i = 0; i < itemcount_; ++i) {
+			boxes_[i] = items[i].box_;
+			indices_[i] = items[i].index_;
+		}
+		free(items);
+	}
+
+	// pack parent nodes level by level.
+	int pos = 0;
+	for (int level = 0; level + 1 < levelcount_; ++level) {
+		int end = levelbounds_[level];
+		int parent = end;
+		while (pos < end) {
+			LayerEnvelope box = boxes_[pos];
+			indices_[parent] = pos;
+			for (int i = 0; i < nodesize_ && pos < end; ++i, ++pos) {
+				const LayerEnvelope &child = boxes_[pos];
+				if (child.minx_ < box.minx_)
+					box.minx_ = child.minx_;
+				if (child.miny_ < box.miny_)
+					box.miny_ = child.miny_;
+				if (child.maxx_ > box.maxx_)
+					box.maxx_ = child.maxx_;
+				if (child.maxy_ > box.maxy_)
+					box.maxy_ = child.maxy_;
+			}
+			boxes_[parent++] = box;
+		}
+	}
+
+	indexlength_ = 0;
+	indexlength_ += sizeof(indexlength_);
+	indexlength_ += sizeof(itemcount_);
+	indexlength_ += sizeof(nodesize_);
+	indexlength_ += sizeof(nodecount_);
+	indexlength_ += sizeof(levelcount_);
+	indexlength_ += sizeof(int) * levelcount_;
+	indexlength_ += sizeof(LayerEnvelope);
+	indexlength_ += sizeof(LayerEnvelope) * nodecount_;
+	indexlength_ += sizeof(int) * nodecount_;
+	indexlength_ += 2 * sizeof(int) * itemcount_;
+
+	// set buffer flag.
+	if (bufferflag_ == LATEST)
+		bufferflag_ = STALE;
+}
+
+int LayerSpatialIndex::search(double minx, double miny, double maxx,
+		double maxy, int **items) const {
+	*items = NULL;
+	if (nodecount_ == 0)
+		return 0;
+
+	int stacksize = levelcount_ * nodesize_ + 1;
+	int *stack = (int *) malloc(sizeof(int) * 2 * stacksize);
+	if (stack == NULL) {
+		fprintf(stderr, "Fail to alloc memory for index search stack.\n");
+		return 0;
+	}
+	int top = 0;
+	int count = 0, capacity = 0;
+	int *result = NULL;
+
+	int node = nodecount_ - 1;
+	int level = levelcount_ - 1;
+	for (;;) {
+		int end = node + nodesize_;
+		if (end > levelbounds_[level])
+			end = levelbounds_[level];
+		for (int pos = node; pos < end; ++pos) {
+			const LayerEnvelope &box = boxes_[pos];
+			if (maxx < box.minx_ || maxy < box.miny_ || minx > box.maxx_
+					|| miny > box.maxy_)
+				continue;
+			if (node < itemcount_) {
+				if (count == capacity) {
+					capacity = capacity ? capacity * 2 : 64;
+					int *grown = (int *) realloc(result, sizeof(int) * capacity);
+					if (grown == NULL) {
+						fprintf(stderr, "Fail to alloc memory for index search result.\n");
+						if (result)
+							free(result);
+						free(stack);
+						return 0;
+					}
+					result = grown;
+				}
+				result[count++] = indices_[pos];
+			} else {
+				if (top == stacksize) {
+					stacksize *= 2;
+					int *grown = (int *) realloc(stack, sizeof(int) * 2 * stacksize);
+					if (grown == NULL) {
+						fprintf(stderr, "Fail to alloc memory for index search stack.\n");
+						free(stack);
+						free(result);
+						return 0;
+					}
+					stack = grown;
+				}
+				stack[2 * top] = indices_[pos];
+				stack[2 * top + 1] = level - 1;
+				++top;
+			}
+		}
+		if (top == 0)
+			break;
+		--top;
+		node = stack[2 * top];
+		level = stack[2 * top + 1];
+	}
+
+	free(stack);
+	*items = result;
+	return count;
+}
+
+LayerEnvelope *LayerSpatialIndex::getItemBoxes() const {
+	LayerEnvelope *boxes = (LayerEnvelope *) malloc(
+			sizeof(LayerEnvelope) * (itemcount_ + 1));
+	if (boxes == NULL) {
+		fprintf(stderr, "Fail to alloc memory for index boxes.\n");
+		return NULL;
+	}
+	// the leaves, in hilbert order, name their items.
+	for (int pos = 0; pos < itemcount_; ++pos)
+		boxes[indices_[pos]] = boxes_[pos];
+	return boxes;
+}
+
+bool LayerSpatialIndex::setItemBox(int offset, double minx, double miny,
+		double maxx, double maxy) {
+	int item = 0;
+	while (item < itemcount_ && itemoffsets_[item] != offset)
+		++item;
+	int pos = 0;
+	while (pos < itemcount_ && indices_[pos] != item)
+		++pos;
+	if (pos == itemcount_)
+		return false;
+	LayerEnvelope &leaf = boxes_[pos];
+	leaf.minx_ = minx;
+	leaf.miny_ = miny;
+	leaf.maxx_ = maxx;
+	leaf.maxy_ = maxy;
+
+	// the parent of a node is the one packed over its run of nodesize_.
+	int levelstart = 0;
+	for (int level = 0; level + 1 < levelcount_; ++level) {
+		pos = levelbounds_[level] + (pos - levelstart) / nodesize_;
+		levelstart = levelbounds_[level];
+		LayerEnvelope &box = boxes_[pos];
+		if (minx < box.minx_)
+			box.minx_ = minx;
+		if (miny < box.miny_)
+			box.miny_ = miny;
+		if (maxx > box.maxx_)
+			box.maxx_ = maxx;
+		if (maxy > box.maxy_)
+			box.maxy_ = maxy;
+	}
+	if (minx < extent_.minx_)
+		extent_.minx_ = minx;
+	if (miny < extent_.miny_)
+		extent_.miny_ = miny;
+	if (maxx > extent_.maxx_)
+		extent_.maxx_ = maxx;
+	if (maxy > extent_.maxy_)
+		extent_.maxy_ = maxy;
+
+	// set buffer flag.
+	if (bufferflag_ == LATEST)
+		bufferflag_ = STALE;
+	return true;
+}
+
+const char *LayerSpatialIndex::getBytes() {
+	// alloc memory or return the buffered result.
+	if (bufferflag_ == UNINITIALIZED) {
+		buffer_ = (char *) malloc(indexlength_);
+	} else if (bufferflag_ == STALE) {
+		buffer_ = (char *) realloc(buffer_, indexlength_);
+	} else {
+		return buffer_;
+	}
+	if (buffer_ == NULL) {
+		fprintf(stderr, "Fail to alloc memory for buffer_.\n");
+		return NULL;
+	}
+
+	char *bytes = buffer_;
+	int offset = 0;
+	memcpy(bytes + offset, &indexlength_, sizeof(indexlength_));
+	offset += sizeof(indexlength_);
+	memcpy(bytes + offset, &itemcount_, sizeof(itemcount_));
+	offset += sizeof(itemcount_);
+	memcpy(bytes + offset, &nodesize_, sizeof(nodesize_));
+	offset += sizeof(nodesize_);
+	memcpy(bytes + offset, &nodecount_, sizeof(nodecount_));
+	offset += sizeof(nodecount_);
+	memcpy(bytes + offset, &levelcount_, sizeof(levelcount_));
+	offset += sizeof(levelcount_);
+	memcpy(bytes + offset, levelbounds_, sizeof(int) * levelcount_);
+	offset += sizeof(int) * levelcount_;
+	memcpy(bytes + offset, &extent_, sizeof(extent_));
+	offset += sizeof(extent_);
+	memcpy(bytes + offset, boxes_, sizeof(LayerEnvelope) * nodecount_);
+	offset += sizeof(LayerEnvelope) * nodecount_;
+	memcpy(bytes + offset, indices_, sizeof(int) * nodecount_);
+	offset += sizeof(int) * nodecount_;
+	memcpy(bytes + offset, itemoffsets_, sizeof(int) * itemcount_);
+	offset += sizeof(int) * itemcount_;
+	memcpy(bytes + offset, itemsizes_, sizeof(int) * itemcount_);
+	offset += sizeof(int) * itemcount_;
+
+	assert(offset == indexlength_);
+
+	bufferflag_ = LATEST;
+	return buffer_;
+}
+
+void LayerSpatialIndex::setIndex(const char * bytes) {
+	if (bytes == NULL)
+		return;
+	int length = 0;
+	memcpy(&length, bytes, sizeof(length));
+	setIndex(bytes, length);
+}
+
+bool LayerSpatialIndex::checkIndex(int size) const {
+	// the counts are those finish() packs for itemcount_ and nodesize_.
+	if (itemcount_ < 0 || nodesize_ < 2 || nodecount_ < itemcount_
+			|| levelcount_ < 0 || indexlength_ != size)
+		return false;
+	int levelcount = 1;
+	for (int n = itemcount_; n > 1; n = (n + nodesize_ - 1) / nodesize_)
+		++levelcount;
+	if (itemcount_ == 0)
+		levelcount = 0;
+	if (levelcount_ != levelcount)
+		return false;
+	long long nodecount = 0;
+	int n = itemcount_;
+	for (int level = 0; level < levelcount_; ++level) {
+		nodecount += n;
+		n = (n + nodesize_ - 1) / nodesize_;
+	}
+	if (nodecount != nodecount_)
+		return false;
+	long long length = 5 * sizeof(int) + sizeof(int) * (long long) levelcount_
+			+ sizeof(LayerEnvelope)
+			+ (sizeof(LayerEnvelope) + sizeof(int)) * (long long) nodecount_
+			+ 2 * sizeof(int) * (long long) itemcount_;
+	return length == size;
+}
+
+bool LayerSpatialIndex::checkNodes() const {
+	// levels as finish() packs them; leaves name items, parents the first
+	// node of their run a level down.
+	int levelstart = 0, childstart = 0;
+	int n = itemcount_;
+	for (int level = 0; level < levelcount_; ++level) {
+		if (levelbounds_[level] != levelstart + n)
+			return false;
+		for (int pos = levelstart; pos < levelbounds_[level]; ++pos) {
+			int index = indices_[pos];
+			if (level == 0 ? index < 0 || index >= itemcount_ :
+					index < childstart || index >= levelstart)
+				return false;
+		}
+		childstart = levelstart;
+		levelstart = levelbounds_[level];
+		n = (n + nodesize_ - 1) / nodesize_;
+	}
+	return true;
+}
+
+bool LayerSpatialIndex::setIndex(const char * bytes, int size) {
+	if (bytes == NULL)
+		return false;
+	clear();
+
+	int offset = 0;
+	if (size < (int) (5 * sizeof(int))) {
+		fprintf(stderr, "Bad spatial index.\n");
+		return false;
+	}
+	memcpy(&indexlength_, bytes + offset, sizeof(indexlength_));
+	offset += sizeof(indexlength_);
+	memcpy(&itemcount_, bytes + offset, sizeof(itemcount_));
+	offset += sizeof(itemcount_);
+	memcpy(&nodesize_, bytes + offset, sizeof(nodesize_));
+	offset += sizeof(nodesize_);
+	memcpy(&nodecount_, bytes + offset, sizeof(nodecount_));
+	offset += sizeof(nodecount_);
+	memcpy(&levelcount_, bytes + offset, sizeof(levelcount_));
+	offset += sizeof(levelcount_);
+	if (!checkIndex(size)) {
+		fprintf(stderr, "Bad spatial index.\n");
+		clear();
+		return false;
+	}
+
+	levelbounds_ = (int *) malloc(sizeof(int) * (levelcount_ + 1));
+	boxes_ = (LayerEnvelope *) malloc(sizeof(LayerEnvelope) * (nodecount_ + 1));
+	indices_ = (int *) malloc(sizeof(int) * (nodecount_ + 1));
+	itemoffsets_ = (int *) malloc(sizeof(int) * (itemcount_ + 1));
+	itemsizes_ = (int *) malloc(sizeof(int) * (itemcount_ + 1));
+	if (levelbounds_ == NULL || boxes_ == NULL || indices_ == NULL
+			|| itemoffsets_ == NULL || itemsizes_ == NULL) {
+		fprintf(stderr, "Fail to alloc memory for index.\n");
+		clear();
+		return false;
+	}
+	capacity_ = itemcount_;
+
+	memcpy(levelbounds_, bytes + offset, sizeof(int) * levelcount_);
+	offset += sizeof(int) * levelcount_;
+	memcpy(&extent_, bytes + offset, sizeof(extent_));
+	offset += sizeof(extent_);
+	memcpy(boxes_, bytes + offset, sizeof(LayerEnvelope) * nodecount_);
+	offset += sizeof(LayerEnvelope) * nodecount_;
+	memcpy(indices_, bytes + offset, sizeof(int) * nodecount_);
+	offset += sizeof(int) * nodecount_;
+	memcpy(itemoffsets_, bytes + offset, sizeof(int) * itemcount_);
+	offset += sizeof(int) * itemcount_;
+	memcpy(itemsizes_, bytes + offset, sizeof(int) * itemcount_);
+	offset += sizeof(int) * itemcount_;
+
+	assert(offset == indexlength_);
+	if (!checkNodes()) {
+		fprintf(stderr, "Bad spatial index nodes.\n");
+		clear();
+		return false;
+	}
+
+	// alloc memory for buffer_
+	if (bufferflag_ == UNINITIALIZED) {
+		buffer_ = (char *) malloc(indexlength_);
+	} else {
+		buffer_ = (char *) realloc(buffer_, indexlength_);
+	}
+	if (buffer_ == NULL) {
+		fprintf(stderr, "Fail to alloc memory for buffer_.\n");
+		return false;
+	}
+
+	memcpy(buffer_, bytes, indexlength_);
+
+	// set buffer flag.
+	bufferflag_ = LATEST;
+	return true;
+}
+
+int LayerSpatialIndex::getIndexLength() const {
+	return indexlength_;
+}
+
+int LayerSpatialIndex::getItemCount() const {
+	return itemcount_;
+}
+
+int LayerSpatialIndex::getNodeSize() const {
+	return nodesize_;
+}
+
+const LayerEnvelope *LayerSpatialIndex::getExtent() const {
+	return &extent_;
+}
+
+int LayerSpatialIndex::getItemOffset(int item) const {
+	if (itemoffsets_ == NULL || item < 0 || item >= itemcount_)
+		return -1;
+	return itemoffsets_[item];
+}
+
+int LayerSpatialIndex::getItemSize(int item) const {
+	if (itemsizes_ == NULL || item < 0 || item >= itemcount_)
+		return 0;
+	return itemsizes_[item];
+}
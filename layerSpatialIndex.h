@@ -0,0 +1,84 @@
+/// @file layerSpatialIndex.h
+/// @author luliang@ict.ac.cn
+/// @copybrief Copyright 2013 ICT, CAS. All rights reserved.
+/// @version 0.1
+/// @date 2026-10-19
+
+#ifndef LAYERSPATIALINDEX_H_
+#define LAYERSPATIALINDEX_H_
+
+typedef struct {
+	double minx_, miny_, maxx_, maxy_;
+} LayerEnvelope;
+
+// Static packed hilbert R-tree over feature envelopes. Every item carries the
+// byte range of its feature inside the stored layer value, so a bbox query
+// can fetch the matching features alone.
+class LayerSpatialIndex {
+public:
+	LayerSpatialIndex(int nodesize = 16);
+	LayerSpatialIndex(const char * bytes);
+	// from size bytes, empty if they are not a whole index.
+	LayerSpatialIndex(const char * bytes, int size);
+	~LayerSpatialIndex();
+
+	const char *getBytes();
+
+	int getIndexLength() const;
+	int getItemCount() const;
+	int getNodeSize() const;
+	const LayerEnvelope *getExtent() const;
+	int getItemOffset(int item) const;
+	int getItemSize(int item) const;
+
+	// add items, then finish() once to pack the tree.
+	void add(double minx, double miny, double maxx, double maxy, int offset,
+			int size);
+	void finish();
+
+	// items intersecting the box are returned in *items (free() by caller).
+	int search(double minx, double miny, double maxx, double maxy,
+			int **items) const;
+	// the box of every item, in item order (free() by caller).
+	LayerEnvelope *getItemBoxes() const;
+	// sets the box of the item at offset, growing its parents to cover it,
+	// for a feature changed in place. false if no item is at offset.
+	bool setItemBox(int offset, double minx, double miny, double maxx,
+			double maxy);
+
+	void setIndex(const char * bytes);
+	// false, with the reason on stderr, if the size bytes do not hold an
+	// index whose counts, levels and nodes agree.
+	bool setIndex(const char * bytes, int size);
+
+private:
+	typedef enum {
+		UNINITIALIZED, STALE, LATEST
+	} BufferFlagType;
+
+	LayerSpatialIndex(const LayerSpatialIndex &);
+	void operator=(const LayerSpatialIndex &);
+
+	void clear();
+	bool checkIndex(int size) const;
+	bool checkNodes() const;
+
+	int indexlength_;
+	int itemcount_;
+	int nodesize_;
+	int nodecount_;
+	int levelcount_;
+	int *levelbounds_;
+	LayerEnvelope *boxes_;
+	int *indices_;
+	int *itemoffsets_;
+	int *itemsizes_;
+
+	int capacity_;
+	LayerEnvelope extent_;
+
+	char *buffer_;
+	BufferFlagType bufferflag_;
+};
+
+#endif /* LAYERSPATIALINDEX_H_ */
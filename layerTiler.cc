@@ -0,0 +1,638 @@
+/// @file layerTiler.cc
+/// @author luliang@ict.ac.cn
+/// @copybrief Copyright 2013 ICT, CAS. All rights reserved.
+/// @version 0.1
+/// @date 2026-10-19
+
+#include "layerTiler.h"
+#include "layerSnapshot.h"
+#include "mvtEncoder.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+#include <ogrsf_frmts.h>
+
+// half the width of the EPSG:3857 world.
+static const double MERCATOR_ORIGIN = 20037508.342789244;
+
+typedef struct {
+	double *xy_;
+	int count_;
+	int capacity_;
+} PointBuffer;
+
+static int compareInt(const void *a, const void *b) {
+	return *(const int *) a - *(const int *) b;
+}
+
+static void initPoints(PointBuffer *points) {
+	points->xy_ = NULL;
+	points->count_ = 0;
+	points->capacity_ = 0;
+}
+
+static void freePoints(PointBuffer *points) {
+	if (points->xy_)
+		free(points->xy_);
+	initPoints(points);
+}
+
+static bool addPoint(PointBuffer *points, double x, double y) {
+	if (points->count_ == points->capacity_) {
+		points->capacity_ = points->capacity_ ? points->capacity_ * 2 : 64;
+		points->xy_ = (double *) realloc(points->xy_,
+				sizeof(double) * 2 * points->capacity_);
+		if (points->xy_ == NULL) {
+			fprintf(stderr, "Fail to alloc memory for tile points.\n");
+			points->count_ = points->capacity_ = 0;
+			return false;
+		}
+	}
+	points->xy_[2 * points->count_] = x;
+	points->xy_[2 * points->count_ + 1] = y;
+	++points->count_;
+	return true;
+}
+
+static void readPoints(const OGRLineString *line, PointBuffer *points) {
+	points->count_ = 0;
+	int count = line->getNumPoints();
+	for (int i = 0; i < count; ++i)
+		addPoint(points, line->getX(i), line->getY(i));
+}
+
+// douglas-peucker, keeps first and last point. returns the new point count.
+static int simplifyPoints(PointBuffer *points, double tolerance) {
+	int count = points->count_;
+	if (count < 3 || tolerance <= 0)
+		return count;
+	char *keep = (char *) calloc(count, 1);
+	int *stack = (int *) malloc(sizeof(int) * 2 * count);
+	if (keep == NULL || stack == NULL) {
+		if (keep)
+			free(keep);
+		if (stack)
+			free(stack);
+		return count;
+	}
+	double sqtolerance = tolerance * tolerance;
+	const double *xy = points->xy_;
+	keep[0] = keep[count - 1] = 1;
+	int top = 0;
+	stack[top++] = 0;
+	stack[top++] = count - 1;
+	while (top > 0) {
+		int last = stack[--top];
+		int first = stack[--top];
+		double ax = xy[2 * first], ay = xy[2 * first + 1];
+		double dx = xy[2 * last] - ax, dy = xy[2 * last + 1] - ay;
+		double sqlength = dx * dx + dy * dy;
+		double maxdistance = 0;
+		int index = -1;
+		for (int i = first + 1; i < last; ++i) {
+			double px = xy[2 * i] - ax, py = xy[2 * i + 1] - ay;
+			double distance;
+			if (sqlength > 0) {
+				double t = (px * dx + py * dy) / sqlength;
+				if (t < 0)
+					t = 0;
+				else if (t > 1)
+					t = 1;
+				double ex = px - t * dx, ey = py - t * dy;
+				distance = ex * ex + ey * ey;
+			} else {
+				distance = px * px + py * py;
+			}
+			if (distance > maxdistance) {
+				maxdistance = distance;
+				index = i;
+			}
+		}
+		if (index >= 0 && maxdistance > sqtolerance) {
+			keep[index] = 1;
+			stack[top++] = first;
+			stack[top++] = index;
+			stack[top++] = index;
+			stack[top++] = last;
+		}
+	}
+	int kept = 0;
+	for (int i = 0; i < count; ++i) {
+		if (keep[i]) {
+			points->xy_[2 * kept] = xy[2 * i];
+			points->xy_[2 * kept + 1] = xy[2 * i + 1];
+			++kept;
+		}
+	}
+	points->count_ = kept;
+	free(keep);
+	free(stack);
+	return kept;
+}
+
+static bool inside(const LayerEnvelope &box, double x, double y) {
+	return x >= box.minx_ && x <= box.maxx_ && y >= box.miny_ && y <= box.maxy_;
+}
+
+// liang-barsky, clips the segment in place. false if it misses the box.
+static bool clipSegment(const LayerEnvelope &box, double *x0, double *y0,
+		double *x1, double *y1) {
+	double t0 = 0, t1 = 1;
+	double dx = *x1 - *x0, dy = *y1 - *y0;
+	double p[4] = { -dx, dx, -dy, dy };
+	double q[4] = { *x0 - box.minx_, box.maxx_ - *x0, *y0 - box.miny_, box.maxy_
+			- *y0 };
+	for (int i = 0; i < 4; ++i) {
+		if (p[i] == 0) {
+			if (q[i] < 0)
+				return false;
+			continue;
+		}
+		double t = q[i] / p[i];
+		if (p[i] < 0) {
+			if (t > t1)
+				return false;
+			if (t > t0)
+				t0 = t;
+		} else {
+			if (t < t0)
+				return false;
+			if (t < t1)
+				t1 = t;
+		}
+	}
+	double ax = *x0 + t0 * dx, ay = *y0 + t0 * dy;
+	double bx = *x0 + t1 * dx, by = *y0 + t1 * dy;
+	*x0 = ax;
+	*y0 = ay;
+	*x1 = bx;
+	*y1 = by;
+	return true;
+}
+
+static OGRLineString *makeLine(PointBuffer *points, double tolerance) {
+	simplifyPoints(points, tolerance);
+	if (points->count_ < 2)
+		return NULL;
+	OGRLineString *line = new OGRLineString();
+	line->setNumPoints(points->count_);
+	for (int i = 0; i < points->count_; ++i)
+		line->setPoint(i, points->xy_[2 * i], points->xy_[2 * i + 1]);
+	return line;
+}
+
+static void clipLine(OGRLineString *line, const LayerEnvelope &box,
+		double tolerance, OGRMultiLineString *pieces) {
+	int count = line->getNumPoints();
+	PointBuffer piece;
+	initPoints(&piece);
+	for (int i = 0; i + 1 < count; ++i) {
+		double x0 = line->getX(i), y0 = line->getY(i);
+		double x1 = line->getX(i + 1), y1 = line->getY(i + 1);
+		bool startinside = inside(box, x0, y0);
+		if (!clipSegment(box, &x0, &y0, &x1, &y1))
+			continue;
+		if (piece.count_ == 0 || !startinside)
+			addPoint(&piece, x0, y0);
+		addPoint(&piece, x1, y1);
+		// the segment leaves the box, the piece ends here.
+		if (!inside(box, line->getX(i + 1), line->getY(i + 1))) {
+			OGRLineString *clipped = makeLine(&piece, tolerance);
+			if (clipped)
+				pieces->addGeometryDirectly(clipped);
+			piece.count_ = 0;
+		}
+	}
+	if (piece.count_ > 0) {
+		OGRLineString *clipped = makeLine(&piece, tolerance);
+		if (clipped)
+			pieces->addGeometryDirectly(clipped);
+	}
+	freePoints(&piece);
+}
+
+// sutherland-hodgman against the four box edges.
+static OGRLinearRing *clipRing(OGRLinearRing *ring, const LayerEnvelope &box,
+		double tolerance) {
+	PointBuffer input, output;
+	initPoints(&input);
+	initPoints(&output);
+	readPoints(ring, &input);
+	// drop the closing point, it is added back at the end.
+	if (input.count_ > 1 && input.xy_[0] == input.xy_[2 * input.count_ - 2]
+			&& input.xy_[1] == input.xy_[2 * input.count_ - 1])
+		--input.count_;
+
+	for (int edge = 0; edge < 4 && input.count_ > 0; ++edge) {
+		output.count_ = 0;
+		for (int i = 0; i < input.count_; ++i) {
+			int j = (i + 1) % input.count_;
+			double ax = input.xy_[2 * i], ay = input.xy_[2 * i + 1];
+			double bx = input.xy_[2 * j], by = input.xy_[2 * j + 1];
+			double da, db;
+			switch (edge) {
+			case 0:
+				da = ax - box.minx_;
+				db = bx - box.minx_;
+				break;
+			case 1:
+				da = box.maxx_ - ax;
+				db = box.maxx_ - bx;
+				break;
+			case 2:
+				da = ay - box.miny_;
+				db = by - box.miny_;
+				break;
+			default:
+				da = box.maxy_ - ay;
+				db = box.maxy_ - by;
+				break;
+			}
+			if (da >= 0)
+				addPoint(&output, ax, ay);
+			if ((da >= 0) != (db >= 0)) {
+				double t = da / (da - db);
+				addPoint(&output, ax + t * (bx - ax), ay + t * (by - ay));
+			}
+		}
+		PointBuffer swap = input;
+		input = output;
+		output = swap;
+	}
+	freePoints(&output);
+
+	OGRLinearRing *clipped = NULL;
+	if (input.count_ >= 3) {
+		addPoint(&input, input.xy_[0], input.xy_[1]);
+		simplifyPoints(&input, tolerance);
+		if (input.count_ >= 4) {
+			clipped = new OGRLinearRing();
+			clipped->setNumPoints(input.count_);
+			for (int i = 0; i < input.count_; ++i)
+				clipped->setPoint(i, input.xy_[2 * i], input.xy_[2 * i + 1]);
+		}
+	}
+	freePoints(&input);
+	return clipped;
+}
+
+static OGRPolygon *clipPolygon(OGRPolygon *polygon, const LayerEnvelope &box,
+		double tolerance) {
+	OGRLinearRing *exterior = polygon->getExteriorRing();
+	if (exterior == NULL)
+		return NULL;
+	OGRLinearRing *ring = clipRing(exterior, box, tolerance);
+	if (ring == NULL)
+		return NULL;
+	OGRPolygon *clipped = new OGRPolygon();
+	clipped->addRingDirectly(ring);
+	for (int i = 0; i < polygon->getNumInteriorRings(); ++i) {
+		ring = clipRing(polygon->getInteriorRing(i), box, tolerance);
+		if (ring)
+			clipped->addRingDirectly(ring);
+	}
+	return clipped;
+}
+
+// a new geometry of the parts inside the box, NULL if nothing is left.
+static OGRGeometry *clipGeometry(OGRGeometry *geometry,
+		const LayerEnvelope &box, double tolerance) {
+	switch (wkbFlatten(geometry->getGeometryType())) {
+	case wkbPoint: {
+		OGRPoint *point = (OGRPoint *) geometry;
+		if (!inside(box, point->getX(), point->getY()))
+			return NULL;
+		return new OGRPoint(point->getX(), point->getY());
+	}
+	case wkbLineString: {
+		OGRMultiLineString pieces;
+		clipLine((OGRLineString *) geometry, box, tolerance, &pieces);
+		if (pieces.getNumGeometries() == 0)
+			return NULL;
+		if (pieces.getNumGeometries() == 1)
+			return pieces.getGeometryRef(0)->clone();
+		return pieces.clone();
+	}
+	case wkbPolygon:
+		return clipPolygon((OGRPolygon *) geometry, box, tolerance);
+	case wkbMultiPoint:
+	case wkbMultiLineString:
+	case wkbMultiPolygon:
+	case wkbGeometryCollection: {
+		OGRGeometryCollection *collection = (OGRGeometryCollection *) geometry;
+		OGRGeometryCollection *clipped;
+		switch (wkbFlatten(geometry->getGeometryType())) {
+		case wkbMultiPoint:
+			clipped = new OGRMultiPoint();
+			break;
+		case wkbMultiLineString:
+			clipped = new OGRMultiLineString();
+			break;
+		case wkbMultiPolygon:
+			clipped = new OGRMultiPolygon();
+			break;
+		default:
+			clipped = new OGRGeometryCollection();
+			break;
+		}
+		for (int i = 0; i < collection->getNumGeometries(); ++i) {
+			OGRGeometry *part = collection->getGeometryRef(i);
+			if (wkbFlatten(part->getGeometryType()) == wkbLineString) {
+				// keep a multilinestring flat.
+				clipLine((OGRLineString *) part, box, tolerance,
+						(OGRMultiLineString *) clipped);
+				continue;
+			}
+			OGRGeometry *clippedpart = clipGeometry(part, box, tolerance);
+			if (clippedpart)
+				clipped->addGeometryDirectly(clippedpart);
+		}
+		if (clipped->getNumGeometries() == 0) {
+			delete clipped;
+			return NULL;
+		}
+		return clipped;
+	}
+	default:
+		return NULL;
+	}
+}
+
+LayerTiler::LayerTiler(OGRLayer *layer, int extent, int buffer,
+		double tolerance) :
+		failed_(false), featurecount_(0), geometries_(NULL), index_(), attrdef_(), records_(), name_(
+				NULL), extent_(extent), buffer_(buffer), tolerance_(tolerance) {
+	if (layer == NULL)
+		return;
+	name_ = strdup(layer->GetName());
+
+	OGRSpatialReference mercator;
+	mercator.importFromEPSG(3857);
+	OGRSpatialReference wgs84;
+	wgs84.SetWellKnownGeogCS("EPSG:4326");
+	OGRSpatialReference *source = layer->GetSpatialRef();
+	if (source == NULL)
+		source = &wgs84;
+	OGRCoordinateTransformation *transformation = NULL;
+	if (!source->IsSame(&mercator)) {
+		transformation = OGRCreateCoordinateTransformation(source, &mercator);
+		if (transformation == NULL) {
+			fprintf(stderr, "Fail to create transformation to EPSG:3857.\n");
+			return;
+		}
+	}
+
+	// the one read of the features, for the geometries and the records.
+	LayerSnapshot snapshot;
+	if (!snapshot.read(layer,
+			SNAPSHOT_ATTRDEF | SNAPSHOT_FEATURES | SNAPSHOT_RECORDS)) {
+		failed_ = true;
+		if (transformation)
+			delete transformation;
+		return;
+	}
+	attrdef_.swap(*snapshot.getAttrDef());
+	records_.swap(*snapshot.getAllRecords());
+	const LayerAllFeatures *features = snapshot.getAllFeatures();
+
+	// one slot per record, so that feature i matches record i.
+	int count = features->getFeatureCount();
+	geometries_ = (OGRGeometry **) malloc(
+			sizeof(OGRGeometry *) * (count + 1));
+	if (geometries_ == NULL) {
+		fprintf(stderr, "Fail to alloc memory for tile geometries.\n");
+		failed_ = true;
+		count = 0;
+	}
+	for (int i = 0; i < count; ++i) {
+		const LayerFeature *feature = features->getFeature(i);
+		OGRGeometry *projected = NULL;
+		OGRGeometryFactory::createFromWkb((unsigned char *) feature->wkbbytes_,
+				NULL, &projected, feature->wkbsize_);
+		if (projected && transformation
+				&& projected->transform(transformation) != OGRERR_NONE) {
+			delete projected;
+			projected = NULL;
+		}
+		geometries_[featurecount_] = projected;
+		if (projected) {
+			OGREnvelope envelope;
+			projected->getEnvelope(&envelope);
+			index_.add(envelope.MinX, envelope.MinY, envelope.MaxX,
+					envelope.MaxY, featurecount_, 0);
+		}
+		++featurecount_;
+	}
+	index_.finish();
+	if (transformation)
+		delete transformation;
+
+	assert(failed_ || records_.getRecordCount() == featurecount_);
+}
+
+LayerTiler::~LayerTiler() {
+	for (int i = 0; i < featurecount_; ++i) {
+		if (geometries_[i])
+			delete geometries_[i];
+	}
+	if (geometries_)
+		free(geometries_);
+	if (name_)
+		free(name_);
+}
+
+bool LayerTiler::failed() const {
+	return failed_;
+}
+
+int LayerTiler::getFeatureCount() const {
+	return featurecount_;
+}
+
+const LayerEnvelope *LayerTiler::getExtent() const {
+	return index_.getExtent();
+}
+
+void LayerTiler::getTileBounds(int z, int x, int y,
+		LayerEnvelope *bounds) const {
+	double size = 2 * MERCATOR_ORIGIN / (double) (1 << z);
+	bounds->minx_ = -MERCATOR_ORIGIN + x * size;
+	bounds->maxx_ = bounds->minx_ + size;
+	bounds->maxy_ = MERCATOR_ORIGIN - y * size;
+	bounds->miny_ = bounds->maxy_ - size;
+}
+
+void LayerTiler::getTileRange(int z, int *minx, int *miny, int *maxx,
+		int *maxy) const {
+	int tiles = 1 << z;
+	double size = 2 * MERCATOR_ORIGIN / tiles;
+	double margin = size * buffer_ / extent_;
+	const LayerEnvelope *extent = index_.getExtent();
+	*minx = (int) floor((extent->minx_ - margin + MERCATOR_ORIGIN) / size);
+	*maxx = (int) floor((extent->maxx_ + margin + MERCATOR_ORIGIN) / size);
+	*miny = (int) floor((MERCATOR_ORIGIN - extent->maxy_ - margin) / size);
+	*maxy = (int) floor((MERCATOR_ORIGIN - extent->miny_ + margin) / size);
+	if (*minx < 0)
+		*minx = 0;
+	if (*miny < 0)
+		*miny = 0;
+	if (*maxx > tiles - 1)
+		*maxx = tiles - 1;
+	if (*maxy > tiles - 1)
+		*maxy = tiles - 1;
+	if (index_.getItemCount() == 0) {
+		*minx = *miny = 0;
+		*maxx = *maxy = -1;
+	}
+}
+
+double LayerTiler::getBufferedBounds(int z, int x, int y,
+		LayerEnvelope *box) const {
+	getTileBounds(z, x, y, box);
+	double size = box->maxx_ - box->minx_;
+	double margin = size * buffer_ / extent_;
+	box->minx_ -= margin;
+	box->miny_ -= margin;
+	box->maxx_ += margin;
+	box->maxy_ += margin;
+	return size;
+}
+
+bool LayerTiler::touchesTile(int z, int x, int y) const {
+	LayerEnvelope box;
+	getBufferedBounds(z, x, y, &box);
+	int *items = NULL;
+	int count = index_.search(box.minx_, box.miny_, box.maxx_, box.maxy_,
+			&items);
+	if (items)
+		free(items);
+	return count > 0;
+}
+
+char *LayerTiler::getTileBytes(int z, int x, int y, int *length,
+		TileFormat format, MvtEncoder *encoder) const {
+	LayerEnvelope box;
+	double size = getBufferedBounds(z, x, y, &box);
+	double tolerance = tolerance_ * size / 256;
+
+	int *items = NULL;
+	int count = index_.search(box.minx_, box.miny_, box.maxx_, box.maxy_,
+			&items);
+	if (count == 0)
+		return NULL;
+
+	OGRGeometry **clipped = (OGRGeometry **) malloc(
+			sizeof(OGRGeometry *) * count);
+	int *rows = (int *) malloc(sizeof(int) * count);
+	if (clipped == NULL || rows == NULL) {
+		fprintf(stderr, "Fail to alloc memory for tile features.\n");
+		free(items);
+		if (clipped)
+			free(clipped);
+		if (rows)
+			free(rows);
+		return NULL;
+	}
+
+	// features in layer order, each clipped to the buffered tile.
+	int rowcount = 0;
+	int featurelength = 2 * sizeof(int);
+	for (int i = 0; i < count; ++i)
+		rows[i] = index_.getItemOffset(items[i]);
+	free(items);
+	qsort(rows, count, sizeof(int), compareInt);
+	for (int i = 0; i < count; ++i) {
+		OGRGeometry *geometry = clipGeometry(geometries_[rows[i]], box,
+				tolerance);
+		if (geometry == NULL)
+			continue;
+		clipped[rowcount] = geometry;
+		rows[rowcount] = rows[i];
+		featurelength += 2 * sizeof(int) + geometry->WkbSize();
+		++rowcount;
+	}
+
+	char *bytes = NULL;
+	if (rowcount > 0 && format == TILE_MVT) {
+		MvtEncoder *mvt = encoder ? encoder : new MvtEncoder(extent_);
+		LayerEnvelope bounds;
+		getTileBounds(z, x, y, &bounds);
+		mvt->clear();
+		mvt->beginLayer(name_ ? name_ : "", attrdef_, bounds);
+		unsigned char *wkb = NULL;
+		int wkbcapacity = 0;
+		for (int i = 0; i < rowcount; ++i) {
+			int wkbsize = clipped[i]->WkbSize();
+			if (wkbsize > wkbcapacity) {
+				unsigned char *grown = (unsigned char *) realloc(wkb, wkbsize);
+				if (grown == NULL) {
+					fprintf(stderr, "Fail to alloc memory for tile wkb.\n");
+					continue;
+				}
+				wkb = grown;
+				wkbcapacity = wkbsize;
+			}
+			clipped[i]->exportToWkb((OGRwkbByteOrder) wkbNDR, wkb);
+			mvt->addFeature((const char *) wkb, wkbsize,
+					records_.getRecord(rows[i]));
+		}
+		mvt->endLayer();
+		if (wkb)
+			free(wkb);
+
+		*length = mvt->getLength();
+		bytes = (char *) malloc(*length);
+		if (bytes == NULL)
+			fprintf(stderr, "Fail to alloc memory for tile bytes.\n");
+		else
+			memcpy(bytes, mvt->getBytes(), *length);
+		if (mvt != encoder)
+			delete mvt;
+	} else if (rowcount > 0) {
+		LayerAllRecords records;
+		records.setAllRecords(records_, rows, rowcount);
+		int recordlength = records.getRecordLength();
+		const char *recordbytes = records.getBytes();
+
+		*length = sizeof(int) + featurelength + recordlength;
+		bytes = (char *) malloc(*length);
+		if (bytes == NULL || recordbytes == NULL) {
+			fprintf(stderr, "Fail to alloc memory for tile bytes.\n");
+			if (bytes)
+				free(bytes);
+			bytes = NULL;
+		} else {
+			int offset = 0;
+			memcpy(bytes + offset, length, sizeof(*length));
+			offset += sizeof(*length);
+			memcpy(bytes + offset, &featurelength, sizeof(featurelength));
+			offset += sizeof(featurelength);
+			memcpy(bytes + offset, &rowcount, sizeof(rowcount));
+			offset += sizeof(rowcount);
+			for (int i = 0; i < rowcount; ++i) {
+				int geometrytype = (int) clipped[i]->getGeometryType();
+				memcpy(bytes + offset, &geometrytype, sizeof(geometrytype));
+				offset += sizeof(geometrytype);
+				int wkbsize = clipped[i]->WkbSize();
+				memcpy(bytes + offset, &wkbsize, sizeof(wkbsize));
+				offset += sizeof(wkbsize);
+				clipped[i]->exportToWkb((OGRwkbByteOrder) wkbNDR,
+						(unsigned char *) (bytes + offset));
+				offset += wkbsize;
+			}
+			memcpy(bytes + offset, recordbytes, recordlength);
+			offset += recordlength;
+			assert(offset == *length);
+		}
+	}
+
+	for (int i = 0; i < rowcount; ++i)
+		delete clipped[i];
+	free(clipped);
+	free(rows);
+	return bytes;
+}
@@ -0,0 +1,71 @@
+/// @file layerTiler.h
+/// @author luliang@ict.ac.cn
+/// @copybrief Copyright 2013 ICT, CAS. All rights reserved.
+/// @version 0.1
+/// @date 2026-10-19
+
+#ifndef LAYERTILER_H_
+#define LAYERTILER_H_
+
+#include "layerAttrDef.h"
+#include "layerAllRecords.h"
+#include "layerSpatialIndex.h"
+
+class OGRLayer;
+class OGRGeometry;
+class MvtEncoder;
+
+typedef enum {
+	TILE_LAYER = 0, TILE_MVT = 1
+} TileFormat;
+
+// Cuts a layer into z/x/y web mercator tiles. The layer is read and
+// projected once; getTileBytes() only reads shared state and may be called
+// from several threads at the same time.
+class LayerTiler {
+public:
+	// buffer: tile margin in 1/extent units of the tile width.
+	// tolerance: simplification tolerance in pixels of a 256 pixel tile.
+	LayerTiler(OGRLayer *layer, int extent = 4096, int buffer = 64,
+			double tolerance = 1.0);
+	~LayerTiler();
+
+	// true when the layer could not be read whole, e.g. out of memory.
+	bool failed() const;
+	int getFeatureCount() const;
+	const LayerEnvelope *getExtent() const;
+
+	// inclusive range of the tiles of zoom z touching the layer extent.
+	void getTileRange(int z, int *minx, int *miny, int *maxx, int *maxy) const;
+	void getTileBounds(int z, int x, int y, LayerEnvelope *bounds) const;
+	// true when the extent of a feature touches the tile and its buffer.
+	// the tiles under a tile that none touches are empty too.
+	bool touchesTile(int z, int x, int y) const;
+
+	// the clipped and simplified features of one tile, NULL if none touch
+	// it. free() by caller. a TILE_MVT tile is one vector tile layer named
+	// after the OGRLayer; encoder, if given, is reused instead of a new one,
+	// so a thread may keep one for all its tiles.
+	char *getTileBytes(int z, int x, int y, int *length, TileFormat format =
+			TILE_LAYER, MvtEncoder *encoder = 0) const;
+
+private:
+	LayerTiler(const LayerTiler &);
+	void operator=(const LayerTiler &);
+	// the tile and its buffer; returns the width of the tile.
+	double getBufferedBounds(int z, int x, int y, LayerEnvelope *box) const;
+
+	bool failed_;
+	int featurecount_;
+	OGRGeometry **geometries_;
+	LayerSpatialIndex index_;
+	LayerAttrDef attrdef_;
+	LayerAllRecords records_;
+	char *name_;
+
+	int extent_;
+	int buffer_;
+	double tolerance_;
+};
+
+#endif /* LAYERTILER_H_ */
@@ -0,0 +1,493 @@
+/// @file mvtEncoder.cc
+/// @author luliang@ict.ac.cn
+/// @copybrief Copyright 2013 ICT, CAS. All rights reserved.
+/// @version 0.1
+/// @date 2026-10-19
+
+#include "mvtEncoder.h"
+#include "wkbReader.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// protobuf wire types.
+enum {
+	WIRE_VARINT = 0, WIRE_FIXED64 = 1, WIRE_BYTES = 2
+};
+
+// vector tile geometry types and commands.
+enum {
+	MVT_POINT = 1, MVT_LINESTRING = 2, MVT_POLYGON = 3
+};
+enum {
+	CMD_MOVETO = 1, CMD_LINETO = 2, CMD_CLOSEPATH = 7
+};
+
+static bool reserve(MvtBuffer *buffer, int more) {
+	if (buffer->length_ + more <= buffer->capacity_)
+		return true;
+	int capacity = buffer->capacity_ ? buffer->capacity_ : 256;
+	while (capacity < buffer->length_ + more)
+		capacity *= 2;
+	char *data = (char *) realloc(buffer->data_, capacity);
+	if (data == NULL) {
+		fprintf(stderr, "Fail to alloc memory for mvt buffer.\n");
+		return false;
+	}
+	buffer->data_ = data;
+	buffer->capacity_ = capacity;
+	return true;
+}
+
+static void appendBytes(MvtBuffer *buffer, const void *bytes, int length) {
+	if (length <= 0 || !reserve(buffer, length))
+		return;
+	memcpy(buffer->data_ + buffer->length_, bytes, length);
+	buffer->length_ += length;
+}
+
+static void appendVarint(MvtBuffer *buffer, unsigned long long value) {
+	if (!reserve(buffer, 10))
+		return;
+	unsigned char *p = (unsigned char *) buffer->data_ + buffer->length_;
+	int length = 0;
+	while (value >= 0x80) {
+		p[length++] = (unsigned char) (value | 0x80);
+		value >>= 7;
+	}
+	p[length++] = (unsigned char) value;
+	buffer->length_ += length;
+}
+
+static void appendKey(MvtBuffer *buffer, int field, int wiretype) {
+	appendVarint(buffer, (field << 3) | wiretype);
+}
+
+static void appendString(MvtBuffer *buffer, int field, const char *str,
+		int length) {
+	appendKey(buffer, field, WIRE_BYTES);
+	appendVarint(buffer, length);
+	appendBytes(buffer, str, length);
+}
+
+static int varintSize(unsigned long long value) {
+	int size = 1;
+	while (value >= 0x80) {
+		value >>= 7;
+		++size;
+	}
+	return size;
+}
+
+static unsigned int zigzag(int value) {
+	return ((unsigned int) value << 1) ^ (unsigned int) (value >> 31);
+}
+
+static unsigned long long zigzag64(long long value) {
+	return ((unsigned long long) value << 1)
+			^ (unsigned long long) (value >> 63);
+}
+
+static void initArray(MvtIntArray *array) {
+	array->data_ = NULL;
+	array->count_ = 0;
+	array->capacity_ = 0;
+}
+
+static void pushInt(MvtIntArray *array, int value) {
+	if (array->count_ == array->capacity_) {
+		int capacity = array->capacity_ ? array->capacity_ * 2 : 64;
+		int *data = (int *) realloc(array->data_, sizeof(int) * capacity);
+		if (data == NULL) {
+			fprintf(stderr, "Fail to alloc memory for mvt array.\n");
+			return;
+		}
+		array->data_ = data;
+		array->capacity_ = capacity;
+	}
+	array->data_[array->count_++] = value;
+}
+
+// packed varints of a feature field.
+static void appendPacked(MvtBuffer *buffer, int field,
+		const MvtIntArray *array) {
+	int length = 0;
+	for (int i = 0; i < array->count_; ++i)
+		length += varintSize((unsigned int) array->data_[i]);
+	appendKey(buffer, field, WIRE_BYTES);
+	appendVarint(buffer, length);
+	for (int i = 0; i < array->count_; ++i)
+		appendVarint(buffer, (unsigned int) array->data_[i]);
+}
+
+static int packedSize(int field, const MvtIntArray *array) {
+	int length = 0;
+	for (int i = 0; i < array->count_; ++i)
+		length += varintSize((unsigned int) array->data_[i]);
+	return varintSize(field << 3) + varintSize(length) + length;
+}
+
+static unsigned int hashBytes(const char *bytes, int length) {
+	unsigned int hash = 2166136261u;
+	for (int i = 0; i < length; ++i) {
+		hash ^= (unsigned char) bytes[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+static void skipPoints(WkbReader & reader, int count) {
+	double x, y;
+	for (int i = 0; i < count && !reader.failed(); ++i)
+		reader.readPoint(&x, &y);
+}
+
+MvtEncoder::MvtEncoder(int extent) :
+		extent_(extent), attrdef_(NULL), originx_(0), originy_(0), scalex_(1), scaley_(
+				1), cursorx_(0), cursory_(0), slots_(NULL), slotcount_(0) {
+	MvtBuffer empty = { NULL, 0, 0 };
+	tile_ = name_ = features_ = values_ = scratch_ = empty;
+	initArray(&commands_);
+	initArray(&tags_);
+	initArray(&points_);
+	initArray(&valueoffsets_);
+}
+
+MvtEncoder::~MvtEncoder() {
+	MvtBuffer *buffers[] = { &tile_, &name_, &features_, &values_, &scratch_ };
+	for (int i = 0; i < 5; ++i) {
+		if (buffers[i]->data_)
+			free(buffers[i]->data_);
+	}
+	MvtIntArray *arrays[] = { &commands_, &tags_, &points_, &valueoffsets_ };
+	for (int i = 0; i < 4; ++i) {
+		if (arrays[i]->data_)
+			free(arrays[i]->data_);
+	}
+	if (slots_)
+		free(slots_);
+}
+
+void MvtEncoder::clear() {
+	tile_.length_ = 0;
+}
+
+const char *MvtEncoder::getBytes() const {
+	return tile_.data_;
+}
+
+int MvtEncoder::getLength() const {
+	return tile_.length_;
+}
+
+void MvtEncoder::beginLayer(const char *name, const LayerAttrDef & attrdef,
+		const LayerEnvelope & bounds) {
+	attrdef_ = &attrdef;
+	name_.length_ = 0;
+	appendBytes(&name_, name, strlen(name));
+	features_.length_ = 0;
+	values_.length_ = 0;
+	valueoffsets_.count_ = 0;
+	for (int i = 0; i < slotcount_; ++i)
+		slots_[i] = -1;
+
+	originx_ = bounds.minx_;
+	originy_ = bounds.maxy_;
+	double width = bounds.maxx_ - bounds.minx_;
+	double height = bounds.maxy_ - bounds.miny_;
+	scalex_ = width > 0 ? extent_ / width : 1;
+	scaley_ = height > 0 ? extent_ / height : 1;
+}
+
+void MvtEncoder::addFeature(const char *wkb, int wkbsize,
+		const LayerRecordField *record) {
+	int geomtype = 0;
+	if (!encodeGeometry(wkb, wkbsize, &geomtype))
+		return;
+
+	tags_.count_ = 0;
+	int fieldcount = attrdef_ ? attrdef_->getFieldCount() : 0;
+	for (int i = 0; record && i < fieldcount; ++i) {
+		int value = valueIndex(&record[i]);
+		if (value < 0)
+			continue;
+		pushInt(&tags_, i);
+		pushInt(&tags_, value);
+	}
+
+	// Feature: tags = 2, type = 3, geometry = 4.
+	int length = 0;
+	if (tags_.count_ > 0)
+		length += packedSize(2, &tags_);
+	length += varintSize(3 << 3) + varintSize(geomtype);
+	length += packedSize(4, &commands_);
+
+	appendKey(&features_, 2, WIRE_BYTES);
+	appendVarint(&features_, length);
+	if (tags_.count_ > 0)
+		appendPacked(&features_, 2, &tags_);
+	appendKey(&features_, 3, WIRE_VARINT);
+	appendVarint(&features_, geomtype);
+	appendPacked(&features_, 4, &commands_);
+}
+
+void MvtEncoder::endLayer() {
+	// Layer: name = 1, features = 2, keys = 3, values = 4, extent = 5,
+	// version = 15.
+	MvtBuffer &layer = scratch_;
+	layer.length_ = 0;
+	appendKey(&layer, 15, WIRE_VARINT);
+	appendVarint(&layer, 2);
+	appendString(&layer, 1, name_.data_, name_.length_);
+	appendBytes(&layer, features_.data_, features_.length_);
+	int fieldcount = attrdef_ ? attrdef_->getFieldCount() : 0;
+	for (int i = 0; i < fieldcount; ++i) {
+		const char *title = attrdef_->getField(i)->sztitle_;
+		appendString(&layer, 3, title, strlen(title));
+	}
+	for (int i = 0; i < valueoffsets_.count_; ++i) {
+		int start = valueoffsets_.data_[i];
+		int end = i + 1 < valueoffsets_.count_ ?
+				valueoffsets_.data_[i + 1] : values_.length_;
+		appendString(&layer, 4, values_.data_ + start, end - start);
+	}
+	appendKey(&layer, 5, WIRE_VARINT);
+	appendVarint(&layer, extent_);
+
+	// Tile: layers = 3.
+	appendString(&tile_, 3, layer.data_, layer.length_);
+	attrdef_ = NULL;
+}
+
+void MvtEncoder::addLayer(const char *name, const LayerAttrDef & attrdef,
+		const LayerAllFeatures & features, const LayerAllRecords & records,
+		const LayerEnvelope & bounds) {
+	beginLayer(name, attrdef, bounds);
+	int featurecount = features.getFeatureCount();
+	for (int i = 0; i < featurecount; ++i) {
+		const LayerFeature *feature = features.getFeature(i);
+		addFeature(feature->wkbbytes_, feature->wkbsize_, records.getRecord(i));
+	}
+	endLayer();
+}
+
+bool MvtEncoder::encodeGeometry(const char *wkb, int wkbsize,
+		int *geomtype) {
+	commands_.count_ = 0;
+	cursorx_ = cursory_ = 0;
+	*geomtype = 0;
+	WkbReader reader(wkb, wkbsize);
+	int type = reader.readHeader();
+	if (type < 0)
+		return false;
+	encodePart(reader, type, geomtype);
+	if (reader.failed() || commands_.count_ == 0)
+		return false;
+	// the points of a multipoint share one MoveTo.
+	if (*geomtype == MVT_POINT && commands_.count_ > 3) {
+		int count = commands_.count_ / 3;
+		for (int i = 0; i < count; ++i) {
+			commands_.data_[1 + 2 * i] = commands_.data_[3 * i + 1];
+			commands_.data_[2 + 2 * i] = commands_.data_[3 * i + 2];
+		}
+		commands_.data_[0] = CMD_MOVETO | (count << 3);
+		commands_.count_ = 1 + 2 * count;
+	}
+	return true;
+}
+
+// walks one (sub)geometry, whose header is read. parts of a collection
+// not of the type of its first part are read but not encoded.
+void MvtEncoder::encodePart(WkbReader & reader, int type, int *geomtype) {
+	switch (type) {
+	case 1: // point
+		encodePoints(reader, 1, MVT_POINT, -1, geomtype);
+		break;
+	case 2: // linestring
+		encodePoints(reader, reader.readCount(), MVT_LINESTRING, -1,
+				geomtype);
+		break;
+	case 3: { // polygon
+		// holes of a dropped exterior ring are dropped too.
+		unsigned int rings = reader.readCount();
+		bool exterior = false;
+		for (unsigned int i = 0; i < rings && !reader.failed(); ++i) {
+			int count = reader.readCount();
+			if (i == 0)
+				exterior = encodePoints(reader, count, MVT_POLYGON, i, geomtype);
+			else if (exterior)
+				encodePoints(reader, count, MVT_POLYGON, i, geomtype);
+			else
+				skipPoints(reader, count);
+		}
+		break;
+	}
+	default: { // multi geometries and collections
+		unsigned int parts = reader.readCount();
+		for (unsigned int i = 0; i < parts && !reader.failed(); ++i) {
+			int parttype = reader.readHeader();
+			if (parttype < 0)
+				return;
+			encodePart(reader, parttype, geomtype);
+		}
+		break;
+	}
+	}
+}
+
+// false if the points are dropped.
+bool MvtEncoder::encodePoints(WkbReader & reader, int count, int type,
+		int ring, int *geomtype) {
+	points_.count_ = 0;
+	for (int i = 0; i < count && !reader.failed(); ++i) {
+		double x, y;
+		reader.readPoint(&x, &y);
+		int tx = (int) floor((x - originx_) * scalex_ + 0.5);
+		int ty = (int) floor((originy_ - y) * scaley_ + 0.5);
+		// points closer than a tile unit collapse.
+		if (type != MVT_POINT && points_.count_ > 0
+				&& points_.data_[points_.count_ - 2] == tx
+				&& points_.data_[points_.count_ - 1] == ty)
+			continue;
+		pushInt(&points_, tx);
+		pushInt(&points_, ty);
+	}
+	if (*geomtype != 0 && *geomtype != type)
+		return false;
+
+	int npoints = points_.count_ / 2;
+	if (type == MVT_POLYGON) {
+		// drop the closing point, ClosePath repeats it.
+		if (npoints > 1 && points_.data_[0] == points_.data_[2 * npoints - 2]
+				&& points_.data_[1] == points_.data_[2 * npoints - 1])
+			--npoints;
+		if (npoints < 3)
+			return false;
+		// exterior rings have positive area in tile coordinates (y down),
+		// interior rings negative.
+		long long area = 0;
+		for (int i = 0; i < npoints; ++i) {
+			int j = (i + 1) % npoints;
+			area += (long long) points_.data_[2 * i] * points_.data_[2 * j + 1]
+					- (long long) points_.data_[2 * j] * points_.data_[2 * i + 1];
+		}
+		if (area == 0)
+			return false;
+		if ((ring == 0) != (area > 0)) {
+			for (int i = 0, j = npoints - 1; i < j; ++i, --j) {
+				int x = points_.data_[2 * i], y = points_.data_[2 * i + 1];
+				points_.data_[2 * i] = points_.data_[2 * j];
+				points_.data_[2 * i + 1] = points_.data_[2 * j + 1];
+				points_.data_[2 * j] = x;
+				points_.data_[2 * j + 1] = y;
+			}
+		}
+	} else if (type == MVT_LINESTRING && npoints < 2) {
+		return false;
+	} else if (npoints < 1) {
+		return false;
+	}
+	*geomtype = type;
+
+	for (int i = 0; i < npoints; ++i) {
+		if (i == 0)
+			pushInt(&commands_, CMD_MOVETO | (1 << 3));
+		else if (i == 1 && type != MVT_POINT)
+			pushInt(&commands_, CMD_LINETO | ((npoints - 1) << 3));
+		int x = points_.data_[2 * i], y = points_.data_[2 * i + 1];
+		pushInt(&commands_, (int) zigzag(x - cursorx_));
+		pushInt(&commands_, (int) zigzag(y - cursory_));
+		cursorx_ = x;
+		cursory_ = y;
+	}
+	if (type == MVT_POLYGON)
+		pushInt(&commands_, CMD_CLOSEPATH | (1 << 3));
+	return true;
+}
+
+// index of the value of a record cell in the layer, -1 if it has none.
+int MvtEncoder::valueIndex(const LayerRecordField *field) {
+	// Value: string = 1, double = 3, sint = 6.
+	MvtBuffer &value = scratch_;
+	value.length_ = 0;
+	switch (field->fieldtype_) {
+	case FTInteger:
+		appendKey(&value, 6, WIRE_VARINT);
+		appendVarint(&value, zigzag64(field->field_.ivalue_));
+		break;
+	case FTInteger64:
+		appendKey(&value, 6, WIRE_VARINT);
+		appendVarint(&value, zigzag64(field->field_.lvalue_));
+		break;
+	case FTReal:
+		appendKey(&value, 3, WIRE_FIXED64);
+		appendBytes(&value, &field->field_.dvalue_, sizeof(double));
+		break;
+	case FTString: {
+		const FieldStringType &str = field->field_.svalue_;
+		int length = str.strlength_;
+		if (length > 0 && str.str_[length - 1] == '\0')
+			--length;
+		appendString(&value, 1, str.str_, length);
+		break;
+	}
+	case FTDate:
+	case FTTime:
+	case FTDateTime: {
+		const FieldDateType &time = field->field_.tvalue_;
+		char text[64];
+		int length = snprintf(text, sizeof(text),
+				"%04d-%02d-%02dT%02d:%02d:%02d", time.year_, time.mon_,
+				time.day_, time.hour_, time.min_, time.sec_);
+		appendString(&value, 1, text, length);
+		break;
+	}
+	default:
+		return -1;
+	}
+
+	// grow the table at half load.
+	if (2 * (valueoffsets_.count_ + 1) > slotcount_) {
+		int slotcount = slotcount_ ? slotcount_ * 2 : 256;
+		int *slots = (int *) malloc(sizeof(int) * slotcount);
+		if (slots == NULL) {
+			fprintf(stderr, "Fail to alloc memory for mvt values.\n");
+			return -1;
+		}
+		for (int i = 0; i < slotcount; ++i)
+			slots[i] = -1;
+		for (int i = 0; i < valueoffsets_.count_; ++i) {
+			int start = valueoffsets_.data_[i];
+			int end = i + 1 < valueoffsets_.count_ ?
+					valueoffsets_.data_[i + 1] : values_.length_;
+			unsigned int slot = hashBytes(values_.data_ + start, end - start)
+					& (slotcount - 1);
+			while (slots[slot] >= 0)
+				slot = (slot + 1) & (slotcount - 1);
+			slots[slot] = i;
+		}
+		if (slots_)
+			free(slots_);
+		slots_ = slots;
+		slotcount_ = slotcount;
+	}
+
+	unsigned int slot = hashBytes(value.data_, value.length_)
+			& (slotcount_ - 1);
+	for (; slots_[slot] >= 0; slot = (slot + 1) & (slotcount_ - 1)) {
+		int i = slots_[slot];
+		int start = valueoffsets_.data_[i];
+		int end = i + 1 < valueoffsets_.count_ ?
+				valueoffsets_.data_[i + 1] : values_.length_;
+		if (end - start == value.length_
+				&& memcmp(values_.data_ + start, value.data_, value.length_)
+						== 0)
+			return i;
+	}
+	slots_[slot] = valueoffsets_.count_;
+	pushInt(&valueoffsets_, values_.length_);
+	appendBytes(&values_, value.data_, value.length_);
+	return valueoffsets_.count_ - 1;
+}
@@ -0,0 +1,86 @@
+/// @file mvtEncoder.h
+/// @author luliang@ict.ac.cn
+/// @copybrief Copyright 2013 ICT, CAS. All rights reserved.
+/// @version 0.1
+/// @date 2026-10-19
+
+#ifndef MVTENCODER_H_
+#define MVTENCODER_H_
+
+#include "layerAttrDef.h"
+#include "layerAllFeatures.h"
+#include "layerAllRecords.h"
+#include "layerSpatialIndex.h"
+
+class WkbReader;
+
+typedef struct {
+	char *data_;
+	int length_;
+	int capacity_;
+} MvtBuffer;
+
+typedef struct {
+	int *data_;
+	int count_;
+	int capacity_;
+} MvtIntArray;
+
+// Mapbox vector tile (version 2) encoder. Features are read from their WKB
+// and records as they are; keys are the fields of the attribute definition
+// and equal values are stored once per layer. All buffers are kept across
+// clear(), so one encoder can be reused for many tiles.
+class MvtEncoder {
+public:
+	MvtEncoder(int extent = 4096);
+	~MvtEncoder();
+
+	// bounds: the tile in the coordinates of the features.
+	void beginLayer(const char *name, const LayerAttrDef & attrdef,
+			const LayerEnvelope & bounds);
+	// record: fieldcount cells of the feature, may be NULL.
+	void addFeature(const char *wkb, int wkbsize,
+			const LayerRecordField *record);
+	void endLayer();
+
+	void addLayer(const char *name, const LayerAttrDef & attrdef,
+			const LayerAllFeatures & features, const LayerAllRecords & records,
+			const LayerEnvelope & bounds);
+
+	const char *getBytes() const;
+	int getLength() const;
+	void clear();
+
+private:
+	MvtEncoder(const MvtEncoder &);
+	void operator=(const MvtEncoder &);
+
+	bool encodeGeometry(const char *wkb, int wkbsize, int *geomtype);
+	void encodePart(WkbReader & reader, int type, int *geomtype);
+	bool encodePoints(WkbReader & reader, int count, int type, int ring,
+			int *geomtype);
+	int valueIndex(const LayerRecordField *field);
+
+	int extent_;
+	const LayerAttrDef *attrdef_;
+	double originx_, originy_, scalex_, scaley_;
+
+	MvtBuffer tile_;
+	MvtBuffer name_;
+	MvtBuffer features_;
+	MvtBuffer values_;
+	MvtBuffer scratch_;
+
+	// geometry commands, tags and tile points of the current feature.
+	MvtIntArray commands_;
+	MvtIntArray tags_;
+	MvtIntArray points_;
+	int cursorx_, cursory_;
+
+	// open addressing table of the encoded values of the current layer.
+	MvtIntArray valueoffsets_;
+	int *slots_;
+	int slotcount_;
+};
+
+#endif /* MVTENCODER_H_ */
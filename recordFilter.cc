@@ -0,0 +1,854 @@
+/// @file recordFilter.cc
+/// @author luliang@ict.ac.cn
+/// @copybrief Copyright 2013 ICT, CAS. All rights reserved.
+/// @version 0.1
+/// @date 2026-10-19
+
+#include "recordFilter.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include <algorithm>
+
+enum {
+	NODE_AND, NODE_OR, NODE_NOT, NODE_COMPARE, NODE_IN, NODE_BETWEEN, NODE_PREFIX
+};
+enum {
+	CMP_EQ, CMP_NE, CMP_LT, CMP_LE, CMP_GT, CMP_GE
+};
+// truth of a predicate, unknown over an unset field as in SQL: AND takes
+// the least, OR the greatest, NOT turns it around, and a row matches only
+// when true.
+enum {
+	MATCH_FALSE, MATCH_UNKNOWN, MATCH_TRUE
+};
+
+static void skipSpace(const char **cursor) {
+	while (isspace((unsigned char) **cursor))
+		++*cursor;
+}
+
+// consumes keyword, in any case, if it is the next word.
+static bool acceptKeyword(const char **cursor, const char *keyword) {
+	skipSpace(cursor);
+	int length = strlen(keyword);
+	for (int i = 0; i < length; ++i) {
+		if (toupper((unsigned char) (*cursor)[i]) != keyword[i])
+			return false;
+	}
+	char next = (*cursor)[length];
+	if (isalnum((unsigned char) next) || next == '_')
+		return false;
+	*cursor += length;
+	return true;
+}
+
+static bool acceptChar(const char **cursor, char c) {
+	skipSpace(cursor);
+	if (**cursor != c)
+		return false;
+	++*cursor;
+	return true;
+}
+
+
+// a string without the terminating null the records keep.
+static int stringLength(const char *str, int length) {
+	return length > 0 && str[length - 1] == '\0' ? length - 1 : length;
+}
+
+RecordFilter::RecordFilter() :
+		titles_(NULL), types_(NULL), fieldcount_(0), nodes_(NULL), nodecount_(0), nodecapacity_(
+				0), values_(NULL), valuecount_(0), valuecapacity_(0), root_(-1), used_(
+				NULL), lastfield_(-1) {
+}
+
+RecordFilter::~RecordFilter() {
+	clear();
+	if (nodes_)
+		free(nodes_);
+	if (values_)
+		free(values_);
+}
+
+void RecordFilter::clear() {
+	for (int i = 0; i < valuecount_; ++i) {
+		if (values_[i].str_)
+			free(values_[i].str_);
+	}
+	nodecount_ = 0;
+	valuecount_ = 0;
+	root_ = -1;
+	if (used_)
+		free(used_);
+	used_ = NULL;
+	lastfield_ = -1;
+}
+
+int RecordFilter::getCellSize(const char *cell) {
+	switch (*cell) {
+	case FTInteger: {
+		unsigned int zigzag = 0;
+		return sizeof(char) + readVarint(cell + sizeof(char), &zigzag);
+	}
+	case FTReal:
+		return sizeof(char) + sizeof(double);
+	case FTString:
+	case FTBinary: {
+		unsigned int length = 0;
+		int size = readVarint(cell + sizeof(char), &length);
+		return sizeof(char) + size + length;
+	}
+	case FTInteger64: {
+		unsigned long long zigzag = 0;
+		return sizeof(char) + readVarint64(cell + sizeof(char), &zigzag);
+	}
+	case FTDate:
+	case FTTime:
+	case FTDateTime:
+		return sizeof(char) + sizeof(long long);
+	case FTIntegerList:
+	case FTInteger64List:
+	case FTRealList: {
+		unsigned int count = 0;
+		int size = readVarint(cell + sizeof(char), &count);
+		return sizeof(char) + size + count * getListValueSize(*cell);
+	}
+	case FTStringList: {
+		unsigned int count = 0;
+		int size = sizeof(char) + readVarint(cell + sizeof(char), &count);
+		for (unsigned int i = 0; i < count; ++i) {
+			unsigned int length = 0;
+			size += readVarint(cell + size, &length);
+			size += length;
+		}
+		return size;
+	}
+	default:
+		return sizeof(char);
+	}
+}
+
+// fixed-stride rows are copied whole, in one piece each.
+static char *copyFixedRows(const RecordSection & section, const int *rows,
+		int rowcount, int *length) {
+	for (int i = 0; i < rowcount; ++i) {
+		if (rows[i] < 0 || rows[i] >= section.recordcount_) {
+			fprintf(stderr, "Rows out of the records.\n");
+			return NULL;
+		}
+	}
+	int headlength = writeRecordHeader(NULL, 0, rowcount, section.fieldcount_,
+			section.types_);
+	int recordlength = headlength + rowcount * section.stride_;
+	char *subset = (char *) malloc(recordlength);
+	if (subset == NULL) {
+		fprintf(stderr, "Fail to alloc memory for bytes.\n");
+		return NULL;
+	}
+	writeRecordHeader(subset, recordlength, rowcount, section.fieldcount_,
+			section.types_);
+	char *row = subset + headlength;
+	for (int i = 0; i < rowcount; ++i) {
+		memcpy(row, section.cells_ + rows[i] * section.stride_,
+				section.stride_);
+		row += section.stride_;
+	}
+	*length = recordlength;
+	return subset;
+}
+
+char *RecordFilter::copyRows(const char *bytes, int length,
+		const int *rows, int rowcount, int *copylength) {
+	RecordSection section;
+	if (!readRecordSection(bytes, length, &section))
+		return NULL;
+	if (section.types_)
+		return copyFixedRows(section, rows, rowcount, copylength);
+	int recordcount = section.recordcount_;
+	int fieldcount = section.fieldcount_;
+	const char *cells = section.cells_;
+
+	// offsets of the rows, checked against the section, then one copy each.
+	int *rowoffsets = scanRecordOffsets(cells, recordcount, fieldcount,
+			section.length_);
+	if (rowoffsets == NULL)
+		return NULL;
+	int recordlength = 3 * sizeof(int);
+	for (int i = 0; i < rowcount; ++i) {
+		if (rows[i] < 0 || rows[i] >= recordcount) {
+			fprintf(stderr, "Rows out of the records.\n");
+			free(rowoffsets);
+			return NULL;
+		}
+		recordlength += rowoffsets[rows[i] + 1] - rowoffsets[rows[i]];
+	}
+
+	char *subset = (char *) malloc(recordlength);
+	if (subset == NULL) {
+		fprintf(stderr, "Fail to alloc memory for bytes.\n");
+		free(rowoffsets);
+		return NULL;
+	}
+	int offset = 0;
+	memcpy(subset + offset, &recordlength, sizeof(recordlength));
+	offset += sizeof(recordlength);
+	memcpy(subset + offset, &rowcount, sizeof(rowcount));
+	offset += sizeof(rowcount);
+	memcpy(subset + offset, &fieldcount, sizeof(fieldcount));
+	offset += sizeof(fieldcount);
+	for (int i = 0; i < rowcount; ++i) {
+		int start = rowoffsets[rows[i]];
+		int rowlength = rowoffsets[rows[i] + 1] - start;
+		memcpy(subset + offset, cells + start, rowlength);
+		offset += rowlength;
+	}
+	free(rowoffsets);
+	*copylength = recordlength;
+	return subset;
+}
+
+bool RecordFilter::compile(const char *where, const LayerAttrDef & attrdef) {
+	int fieldcount = attrdef.getFieldCount();
+	const char **titles = (const char **) malloc(
+			sizeof(char *) * (fieldcount + 1));
+	char *types = (char *) malloc(fieldcount + 1);
+	if (titles == NULL || types == NULL) {
+		fprintf(stderr, "Fail to alloc memory for filter fields.\n");
+		if (titles)
+			free(titles);
+		if (types)
+			free(types);
+		return false;
+	}
+	for (int i = 0; i < fieldcount; ++i) {
+		titles[i] = attrdef.getField(i)->sztitle_;
+		types[i] = attrdef.getField(i)->fieldtype_;
+	}
+	bool compiled = compile(where, titles, types, fieldcount);
+	free(titles);
+	free(types);
+	return compiled;
+}
+
+bool RecordFilter::compile(const char *where, const char * const *titles,
+		const char *types, int fieldcount) {
+	clear();
+	if (where == NULL) {
+		fprintf(stderr, "Empty filter.\n");
+		return false;
+	}
+	used_ = (char *) calloc(fieldcount + 1, 1);
+	if (used_ == NULL) {
+		fprintf(stderr, "Fail to alloc memory for filter fields.\n");
+		return false;
+	}
+	titles_ = titles;
+	types_ = types;
+	fieldcount_ = fieldcount;
+
+	const char *cursor = where;
+	root_ = parseOr(&cursor);
+	skipSpace(&cursor);
+	if (root_ >= 0 && *cursor != '\0') {
+		fprintf(stderr, "Filter syntax error near \"%s\".\n", cursor);
+		root_ = -1;
+	}
+	titles_ = NULL;
+	types_ = NULL;
+	if (root_ < 0) {
+		clear();
+		return false;
+	}
+	for (int i = 0; i < fieldcount_; ++i) {
+		if (used_[i])
+			lastfield_ = i;
+	}
+	return true;
+}
+
+int RecordFilter::addNode(int kind) {
+	if (nodecount_ == nodecapacity_) {
+		int capacity = nodecapacity_ ? nodecapacity_ * 2 : 16;
+		FilterNode *nodes = (FilterNode *) realloc(nodes_,
+				sizeof(FilterNode) * capacity);
+		if (nodes == NULL) {
+			fprintf(stderr, "Fail to alloc memory for filter nodes.\n");
+			return -1;
+		}
+		nodes_ = nodes;
+		nodecapacity_ = capacity;
+	}
+	FilterNode &node = nodes_[nodecount_];
+	memset(&node, 0, sizeof(node));
+	node.kind_ = kind;
+	node.left_ = node.right_ = node.field_ = -1;
+	return nodecount_++;
+}
+
+int RecordFilter::addValue() {
+	if (valuecount_ == valuecapacity_) {
+		int capacity = valuecapacity_ ? valuecapacity_ * 2 : 16;
+		FilterValue *values = (FilterValue *) realloc(values_,
+				sizeof(FilterValue) * capacity);
+		if (values == NULL) {
+			fprintf(stderr, "Fail to alloc memory for filter values.\n");
+			return -1;
+		}
+		values_ = values;
+		valuecapacity_ = capacity;
+	}
+	FilterValue &value = values_[valuecount_];
+	value.number_ = 0;
+	value.str_ = NULL;
+	value.strlength_ = 0;
+	return valuecount_++;
+}
+
+int RecordFilter::parseOr(const char **cursor) {
+	int left = parseAnd(cursor);
+	while (left >= 0 && acceptKeyword(cursor, "OR")) {
+		int right = parseAnd(cursor);
+		if (right < 0)
+			return -1;
+		int node = addNode(NODE_OR);
+		if (node < 0)
+			return -1;
+		nodes_[node].left_ = left;
+		nodes_[node].right_ = right;
+		left = node;
+	}
+	return left;
+}
+
+int RecordFilter::parseAnd(const char **cursor) {
+	int left = parseNot(cursor);
+	while (left >= 0 && acceptKeyword(cursor, "AND")) {
+		int right = parseNot(cursor);
+		if (right < 0)
+			return -1;
+		int node = addNode(NODE_AND);
+		if (node < 0)
+			return -1;
+		nodes_[node].left_ = left;
+		nodes_[node].right_ = right;
+		left = node;
+	}
+	return left;
+}
+
+int RecordFilter::parseNot(const char **cursor) {
+	if (acceptKeyword(cursor, "NOT")) {
+		int operand = parseNot(cursor);
+		if (operand < 0)
+			return -1;
+		int node = addNode(NODE_NOT);
+		if (node >= 0)
+			nodes_[node].left_ = operand;
+		return node;
+	}
+	if (acceptChar(cursor, '(')) {
+		int node = parseOr(cursor);
+		if (node >= 0 && !acceptChar(cursor, ')')) {
+			fprintf(stderr, "Filter syntax error: missing ')'.\n");
+			return -1;
+		}
+		return node;
+	}
+	return parsePredicate(cursor);
+}
+
+int RecordFilter::findField(const char *name, int length) const {
+	for (int i = 0; i < fieldcount_; ++i) {
+		if (titles_[i] && (int) strlen(titles_[i]) == length
+				&& strncmp(titles_[i], name, length) == 0)
+			return i;
+	}
+	return -1;
+}
+
+bool RecordFilter::parseLiteral(const char **cursor, int field,
+		FilterValue *value) {
+	skipSpace(cursor);
+	char type = types_[field];
+	if (type == FTInteger || type == FTInteger64 || type == FTReal) {
+		char *end = NULL;
+		value->number_ = strtod(*cursor, &end);
+		if (end == *cursor) {
+			fprintf(stderr, "Filter syntax error: number expected near \"%s\".\n",
+					*cursor);
+			return false;
+		}
+		*cursor = end;
+		return true;
+	}
+
+	if (**cursor != '\'') {
+		fprintf(stderr, "Filter syntax error: string expected near \"%s\".\n",
+				*cursor);
+		return false;
+	}
+	// '' stands for a quote.
+	const char *start = ++*cursor;
+	int length = 0;
+	for (const char *p = start;; ++p) {
+		if (*p == '\0') {
+			fprintf(stderr, "Filter syntax error: unterminated string.\n");
+			return false;
+		}
+		if (*p == '\'') {
+			if (p[1] != '\'')
+				break;
+			++p;
+		}
+		++length;
+	}
+	value->str_ = (char *) malloc(length + 1);
+	if (value->str_ == NULL) {
+		fprintf(stderr, "Fail to alloc memory for filter string.\n");
+		return false;
+	}
+	const char *p = start;
+	for (int i = 0; i < length; ++i, ++p) {
+		if (*p == '\'')
+			++p;
+		value->str_[i] = *p;
+	}
+	value->str_[length] = '\0';
+	value->strlength_ = length;
+	*cursor = p + 1;
+
+	if (type == FTDate || type == FTTime || type == FTDateTime) {
+		FieldDateType date;
+		memset(&date, 0, sizeof(date));
+		char separator = ' ';
+		int count = 0;
+		if (type == FTTime) {
+			// a time has no date, as OGR gives it.
+			count = sscanf(value->str_, "%d:%d:%d", &date.hour_, &date.min_,
+					&date.sec_) == 3 ? 3 : 0;
+		} else {
+			count = sscanf(value->str_, "%d-%d-%d%c%d:%d:%d", &date.year_,
+					&date.mon_, &date.day_, &separator, &date.hour_,
+					&date.min_, &date.sec_);
+		}
+		if (count != 3 && count != 6 && count != 7) {
+			fprintf(stderr, "Filter syntax error: bad date '%s'.\n",
+					value->str_);
+			return false;
+		}
+		// compared as the packed dates of the cells are, in whole.
+		value->number_ = getDateKey(packDate(date));
+	}
+	return true;
+}
+
+// field op literal, field [NOT] IN (...), field [NOT] BETWEEN a AND b,
+// field [NOT] LIKE 'prefix%'.
+int RecordFilter::parsePredicate(const char **cursor) {
+	skipSpace(cursor);
+	const char *name = *cursor;
+	int namelength = 0;
+	if (*name == '"') {
+		++name;
+		const char *end = strchr(name, '"');
+		if (end == NULL) {
+			fprintf(stderr, "Filter syntax error: unterminated field name.\n");
+			return -1;
+		}
+		namelength = end - name;
+		*cursor = end + 1;
+	} else {
+		while (isalnum((unsigned char) name[namelength])
+				|| name[namelength] == '_')
+			++namelength;
+		*cursor += namelength;
+	}
+	if (namelength == 0) {
+		fprintf(stderr, "Filter syntax error: field expected near \"%s\".\n",
+				name);
+		return -1;
+	}
+	int field = findField(name, namelength);
+	if (field < 0) {
+		fprintf(stderr, "Unknown filter field \"%.*s\".\n", namelength, name);
+		return -1;
+	}
+	char type = types_[field];
+	if (type != FTInteger && type != FTInteger64 && type != FTReal
+			&& type != FTString && type != FTDate && type != FTTime
+			&& type != FTDateTime) {
+		fprintf(stderr, "Filter field \"%.*s\" cannot be compared.\n",
+				namelength, name);
+		return -1;
+	}
+	used_[field] = 1;
+
+	bool negate = acceptKeyword(cursor, "NOT");
+	int node = -1;
+	if (acceptKeyword(cursor, "IN")) {
+		if (!acceptChar(cursor, '(')) {
+			fprintf(stderr, "Filter syntax error: '(' expected after IN.\n");
+			return -1;
+		}
+		node = addNode(NODE_IN);
+		if (node < 0)
+			return -1;
+		nodes_[node].value_ = valuecount_;
+		do {
+			int value = addValue();
+			if (value < 0 || !parseLiteral(cursor, field, &values_[value]))
+				return -1;
+			++nodes_[node].valuecount_;
+		} while (acceptChar(cursor, ','));
+		if (!acceptChar(cursor, ')')) {
+			fprintf(stderr, "Filter syntax error: ')' expected after IN list.\n");
+			return -1;
+		}
+	} else if (acceptKeyword(cursor, "BETWEEN")) {
+		if (type == FTString) {
+			fprintf(stderr, "Filter: BETWEEN needs a number or date field.\n");
+			return -1;
+		}
+		node = addNode(NODE_BETWEEN);
+		if (node < 0)
+			return -1;
+		nodes_[node].value_ = valuecount_;
+		nodes_[node].valuecount_ = 2;
+		int low = addValue();
+		if (low < 0 || !parseLiteral(cursor, field, &values_[low]))
+			return -1;
+		if (!acceptKeyword(cursor, "AND")) {
+			fprintf(stderr, "Filter syntax error: AND expected in BETWEEN.\n");
+			return -1;
+		}
+		int high = addValue();
+		if (high < 0 || !parseLiteral(cursor, field, &values_[high]))
+			return -1;
+	} else if (acceptKeyword(cursor, "LIKE")) {
+		if (type != FTString) {
+			fprintf(stderr, "Filter: LIKE needs a string field.\n");
+			return -1;
+		}
+		int value = addValue();
+		if (value < 0 || !parseLiteral(cursor, field, &values_[value]))
+			return -1;
+		FilterValue &pattern = values_[value];
+		// only a trailing % is special: a prefix match.
+		if (pattern.strlength_ > 0 && pattern.str_[pattern.strlength_ - 1] == '%') {
+			--pattern.strlength_;
+			node = addNode(NODE_PREFIX);
+		} else {
+			node = addNode(NODE_COMPARE);
+			if (node >= 0)
+				nodes_[node].compare_ = CMP_EQ;
+		}
+		if (node < 0)
+			return -1;
+		nodes_[node].value_ = value;
+		nodes_[node].valuecount_ = 1;
+	} else {
+		if (negate) {
+			fprintf(stderr, "Filter syntax error: IN, BETWEEN or LIKE expected "
+					"after NOT.\n");
+			return -1;
+		}
+		skipSpace(cursor);
+		static const struct {
+			const char *text_;
+			int compare_;
+		} OPERATORS[] = { { "==", CMP_EQ }, { "!=", CMP_NE }, { "<>", CMP_NE }, {
+				"<=", CMP_LE }, { ">=", CMP_GE }, { "=", CMP_EQ }, { "<", CMP_LT }, {
+				">", CMP_GT } };
+		int compare = -1;
+		for (unsigned int i = 0; i < sizeof(OPERATORS) / sizeof(OPERATORS[0]);
+				++i) {
+			int length = strlen(OPERATORS[i].text_);
+			if (strncmp(*cursor, OPERATORS[i].text_, length) == 0) {
+				compare = OPERATORS[i].compare_;
+				*cursor += length;
+				break;
+			}
+		}
+		if (compare < 0) {
+			fprintf(stderr, "Filter syntax error: operator expected near \"%s\".\n",
+					*cursor);
+			return -1;
+		}
+		if (type == FTString && compare != CMP_EQ && compare != CMP_NE) {
+			fprintf(stderr, "Filter: strings only compare for equality.\n");
+			return -1;
+		}
+		node = addNode(NODE_COMPARE);
+		if (node < 0)
+			return -1;
+		nodes_[node].compare_ = compare;
+		int value = addValue();
+		if (value < 0 || !parseLiteral(cursor, field, &values_[value]))
+			return -1;
+		nodes_[node].value_ = value;
+		nodes_[node].valuecount_ = 1;
+	}
+	nodes_[node].field_ = field;
+
+	if (negate) {
+		int notnode = addNode(NODE_NOT);
+		if (notnode < 0)
+			return -1;
+		nodes_[notnode].left_ = node;
+		node = notnode;
+	}
+	return node;
+}
+
+bool RecordFilter::compareNumber(const FilterNode & node, double number) const {
+	const FilterValue *values = values_ + node.value_;
+	switch (node.kind_) {
+	case NODE_IN:
+		for (int i = 0; i < node.valuecount_; ++i) {
+			if (number == values[i].number_)
+				return true;
+		}
+		return false;
+	case NODE_BETWEEN:
+		return number >= values[0].number_ && number <= values[1].number_;
+	default:
+		break;
+	}
+	switch (node.compare_) {
+	case CMP_EQ:
+		return number == values[0].number_;
+	case CMP_NE:
+		return number != values[0].number_;
+	case CMP_LT:
+		return number < values[0].number_;
+	case CMP_LE:
+		return number <= values[0].number_;
+	case CMP_GT:
+		return number > values[0].number_;
+	default:
+		return number >= values[0].number_;
+	}
+}
+
+bool RecordFilter::compareString(const FilterNode & node, const char *str,
+		int length) const {
+	const FilterValue *values = values_ + node.value_;
+	switch (node.kind_) {
+	case NODE_IN:
+		for (int i = 0; i < node.valuecount_; ++i) {
+			if (length == values[i].strlength_
+					&& memcmp(str, values[i].str_, length) == 0)
+				return true;
+		}
+		return false;
+	case NODE_PREFIX:
+		return length >= values[0].strlength_
+				&& memcmp(str, values[0].str_, values[0].strlength_) == 0;
+	default: {
+		bool equal = length == values[0].strlength_
+				&& memcmp(str, values[0].str_, length) == 0;
+		return node.compare_ == CMP_NE ? !equal : equal;
+	}
+	}
+}
+
+bool RecordFilter::matchCell(const FilterNode & node,
+		const RecordSection & section, char type, const char *value) const {
+	switch (type) {
+	case FTInteger:
+		return compareNumber(node, readCellInteger(section, value));
+	case FTInteger64:
+		return compareNumber(node, readCellInteger64(section, value));
+	case FTReal: {
+		double dvalue = 0;
+		memcpy(&dvalue, value, sizeof(dvalue));
+		return compareNumber(node, dvalue);
+	}
+	case FTString: {
+		const char *str = NULL;
+		int length = readCellBytes(value, &str);
+		return compareString(node, str, stringLength(str, length));
+	}
+	case FTDate:
+	case FTTime:
+	case FTDateTime: {
+		long long packed = 0;
+		memcpy(&packed, value, sizeof(packed));
+		return compareNumber(node, getDateKey(packed));
+	}
+	default:
+		return false;
+	}
+}
+
+bool RecordFilter::matchField(const FilterNode & node,
+		const LayerRecordField & field) const {
+	switch (field.fieldtype_) {
+	case FTInteger:
+		return compareNumber(node, field.field_.ivalue_);
+	case FTInteger64:
+		return compareNumber(node, field.field_.lvalue_);
+	case FTReal:
+		return compareNumber(node, field.field_.dvalue_);
+	case FTString: {
+		const FieldStringType &str = field.field_.svalue_;
+		return compareString(node, str.str_,
+				stringLength(str.str_, str.strlength_));
+	}
+	case FTDate:
+	case FTTime:
+	case FTDateTime: {
+		return compareNumber(node, getDateKey(packDate(field.field_.tvalue_)));
+	}
+	default:
+		return false;
+	}
+}
+
+int RecordFilter::evaluate(int index, const RecordSection *section,
+		const char * const *values, const char *celltypes,
+		const LayerRecordField *record) const {
+	const FilterNode &node = nodes_[index];
+	switch (node.kind_) {
+	case NODE_AND: {
+		int left = evaluate(node.left_, section, values, celltypes, record);
+		if (left == MATCH_FALSE)
+			return MATCH_FALSE;
+		return std::min(left,
+				evaluate(node.right_, section, values, celltypes, record));
+	}
+	case NODE_OR: {
+		int left = evaluate(node.left_, section, values, celltypes, record);
+		if (left == MATCH_TRUE)
+			return MATCH_TRUE;
+		return std::max(left,
+				evaluate(node.right_, section, values, celltypes, record));
+	}
+	case NODE_NOT:
+		return MATCH_TRUE
+				- evaluate(node.left_, section, values, celltypes, record);
+	default:
+		if (section) {
+			if (celltypes[node.field_] == FTNull)
+				return MATCH_UNKNOWN;
+			return matchCell(node, *section, celltypes[node.field_],
+					values[node.field_]) ? MATCH_TRUE : MATCH_FALSE;
+		}
+		if (record[node.field_].fieldtype_ == FTNull)
+			return MATCH_UNKNOWN;
+		return matchField(node, record[node.field_]) ?
+				MATCH_TRUE : MATCH_FALSE;
+	}
+}
+
+int RecordFilter::select(const char *bytes, int length, int **rows) const {
+	*rows = NULL;
+	if (root_ < 0 || bytes == NULL) {
+		fprintf(stderr, "Filter is not compiled.\n");
+		return -1;
+	}
+	RecordSection section;
+	if (!readRecordSection(bytes, length, &section))
+		return -1;
+	int recordcount = section.recordcount_;
+	int fieldcount = section.fieldcount_;
+	if (lastfield_ >= fieldcount) {
+		fprintf(stderr, "Filter fields do not match the records.\n");
+		return -1;
+	}
+
+	*rows = (int *) malloc(sizeof(int) * (recordcount + 1));
+	const char **values = (const char **) malloc(
+			sizeof(char *) * (lastfield_ + 1));
+	char *celltypes = (char *) malloc(lastfield_ + 1);
+	if (*rows == NULL || values == NULL || celltypes == NULL) {
+		fprintf(stderr, "Fail to alloc memory for selected rows.\n");
+		if (*rows)
+			free(*rows);
+		*rows = NULL;
+		if (values)
+			free(values);
+		if (celltypes)
+			free(celltypes);
+		return -1;
+	}
+
+	int count = 0;
+	if (section.types_) {
+		// fixed-stride rows: the filter fields are at the same place in
+		// every row, and the rest is never looked at.
+		int offset = getRowBitmapSize(fieldcount);
+		for (int j = 0; j <= lastfield_; ++j) {
+			values[j] = section.cells_ + offset;
+			offset += getFixedCellSize(section.types_[j]);
+		}
+		const char *bitmap = section.cells_;
+		for (int i = 0; i < recordcount; ++i) {
+			for (int j = 0; j <= lastfield_; ++j)
+				celltypes[j] = isFieldSet(bitmap, j) ?
+						(char) section.types_[j] : (char) FTNull;
+			if (evaluate(root_, &section, values, celltypes, NULL)
+					== MATCH_TRUE)
+				(*rows)[count++] = i;
+			for (int j = 0; j <= lastfield_; ++j)
+				values[j] += section.stride_;
+			bitmap += section.stride_;
+		}
+	} else {
+		// the rows are checked against the section by one scan of their
+		// sizes; only the cells of filter fields are looked at.
+		int *rowoffsets = scanRecordOffsets(section.cells_, recordcount,
+				fieldcount, section.length_);
+		if (rowoffsets == NULL) {
+			free(*rows);
+			*rows = NULL;
+			free(values);
+			free(celltypes);
+			return -1;
+		}
+		int bitmapsize = getRowBitmapSize(fieldcount);
+		for (int i = 0; i < recordcount; ++i) {
+			const char *row = section.cells_ + rowoffsets[i];
+			const char *cell = row + bitmapsize;
+			for (int j = 0; j <= lastfield_; ++j)
+				cell += readCell(section, row, cell, j, &celltypes[j],
+						&values[j]);
+			if (evaluate(root_, &section, values, celltypes, NULL)
+					== MATCH_TRUE)
+				(*rows)[count++] = i;
+		}
+		free(rowoffsets);
+	}
+	free(values);
+	free(celltypes);
+	return count;
+}
+
+int RecordFilter::select(const LayerAllRecords & records, int **rows) const {
+	*rows = NULL;
+	if (root_ < 0) {
+		fprintf(stderr, "Filter is not compiled.\n");
+		return -1;
+	}
+	int recordcount = records.getRecordCount();
+	if (recordcount > 0 && lastfield_ >= records.getFieldCount()) {
+		fprintf(stderr, "Filter fields do not match the records.\n");
+		return -1;
+	}
+	*rows = (int *) malloc(sizeof(int) * (recordcount + 1));
+	if (*rows == NULL) {
+		fprintf(stderr, "Fail to alloc memory for selected rows.\n");
+		return -1;
+	}
+	int count = 0;
+	for (int i = 0; i < recordcount; ++i) {
+		if (evaluate(root_, NULL, NULL, NULL, records.getRecord(i))
+				== MATCH_TRUE)
+			(*rows)[count++] = i;
+	}
+	return count;
+}
@@ -0,0 +1,104 @@
+/// @file recordFilter.h
+/// @author luliang@ict.ac.cn
+/// @copybrief Copyright 2013 ICT, CAS. All rights reserved.
+/// @version 0.1
+/// @date 2026-10-19
+
+#ifndef RECORDFILTER_H_
+#define RECORDFILTER_H_
+
+#include "layerAttrDef.h"
+#include "layerAllRecords.h"
+#include "layerDecoder.h"
+
+typedef struct {
+	int kind_;
+	int compare_;
+	int field_;
+	int left_, right_; // operands of AND, OR and NOT
+	int value_, valuecount_; // literals in values_
+} FilterNode;
+
+typedef struct {
+	double number_; // numbers, and dates as sortable keys
+	char *str_;
+	int strlength_;
+} FilterValue;
+
+// Where clause evaluated straight over serialized records, e.g.
+//   population > 10000 AND class = 'city'
+//   kind IN ('a', 'b') OR NOT (area BETWEEN 1 AND 2.5)
+//   name LIKE 'Bei%' AND built >= '2001-01-01'
+// Fields are named by title, double quoted if needed. Integers, reals,
+// dates and times take comparisons, IN and BETWEEN; strings take equality,
+// IN and prefix LIKE 'abc%'; lists and binaries cannot be compared. Dates
+// are written 'YYYY-MM-DD[ HH:MM:SS]', times 'HH:MM:SS'. 64-bit integers are
+// compared as doubles, exact up to 2^53. A predicate over an unset field
+// is unknown, as in SQL, so neither it nor its NOT matches the row.
+class RecordFilter {
+public:
+	RecordFilter();
+	~RecordFilter();
+
+	// false, with the reason on stderr, on a syntax error or unknown field.
+	bool compile(const char *where, const LayerAttrDef & attrdef);
+	bool compile(const char *where, const char * const *titles,
+			const char *types, int fieldcount);
+
+	// rows matching the filter, in order, free() by caller. -1 on error.
+	// bytes: LayerAllRecords bytes, or the records of a layer value, within
+	// length bytes.
+	int select(const char *bytes, int length, int **rows) const;
+	int select(const LayerAllRecords & records, int **rows) const;
+
+	// size in bytes of one serialized record cell, with its type in front.
+	static int getCellSize(const char *cell);
+	// LayerAllRecords bytes of the given rows of the serialized records
+	// within length bytes, copied row by row, fixed-stride rows staying so.
+	// free() by caller.
+	static char *copyRows(const char *bytes, int length, const int *rows,
+			int rowcount, int *copylength);
+
+private:
+	RecordFilter(const RecordFilter &);
+	void operator=(const RecordFilter &);
+
+	void clear();
+	int addNode(int kind);
+	int addValue();
+	int parseOr(const char **cursor);
+	int parseAnd(const char **cursor);
+	int parseNot(const char **cursor);
+	int parsePredicate(const char **cursor);
+	bool parseLiteral(const char **cursor, int field, FilterValue *value);
+	int findField(const char *name, int length) const;
+
+	bool matchCell(const FilterNode & node, const RecordSection & section,
+			char type, const char *value) const;
+	bool matchField(const FilterNode & node,
+			const LayerRecordField & field) const;
+	bool compareNumber(const FilterNode & node, double number) const;
+	bool compareString(const FilterNode & node, const char *str,
+			int length) const;
+	// over the values and types of the cells of a records section, or over
+	// a record if section is NULL; true, false or unknown, see MATCH_TRUE.
+	int evaluate(int node, const RecordSection *section,
+			const char * const *values, const char *celltypes,
+			const LayerRecordField *record) const;
+
+	const char * const *titles_;
+	const char *types_;
+	int fieldcount_;
+
+	FilterNode *nodes_;
+	int nodecount_, nodecapacity_;
+	FilterValue *values_;
+	int valuecount_, valuecapacity_;
+	int root_;
+
+	// fields read by the filter, and the last one.
+	char *used_;
+	int lastfield_;
+};
+
+#endif /* RECORDFILTER_H_ */
@@ -0,0 +1,562 @@
+/// @file sctestRoundTrip.cc
+/// @author luliang@ict.ac.cn
+/// @copybrief Copyright 2013 ICT, CAS. All rights reserved.
+/// @version 0.1
+/// @date 2026-10-19
+///
+/// Round trip of layers through the serialization format. Layers of an OGR
+/// Memory datasource are encoded and decoded by LayerAllFeatures and
+/// LayerAllRecords and, with a redis server at 127.0.0.1:6379, by putLayer
+/// and getLayer, and by putLayerParts and getLayerParts, and compared with
+/// their source feature by feature. A layer value of another format version
+/// must be rejected. Features are looked up by fid, selected by where clauses
+/// over unset fields, and updated, logged and compacted. Exits with 1 on a
+/// mismatch.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <ogrsf_frmts.h>
+
+#include "spatialClient.h"
+#include "layerDecoder.h"
+
+static const int FEATURE_COUNT = 1000;
+// enough features for a few parts of PART_LENGTH bytes.
+static const int PARTS_FEATURE_COUNT = 40000;
+static const long long PART_LENGTH = 1 << 20;
+static const char *ROUND_TRIP_KEY = "sctest:roundtrip";
+static const char *UPDATE_KEY = "sctest:update";
+// field 0 of the fixed layer, an integer, matches when above this.
+static const int FILTER_THRESHOLD = 3000000;
+
+static int failures = 0;
+
+static void check(bool same, const char *layer, const char *what, int row,
+		int field) {
+	if (same)
+		return;
+	fprintf(stderr, "%s: %s differs at feature %d, field %d.\n", layer, what,
+			row, field);
+	++failures;
+}
+
+// field j of feature i is left unset now and then.
+static bool isUnset(int i, int j) {
+	return (i + j) % 7 == 0;
+}
+
+// the value of field j of feature i, a function of both.
+static void setField(OGRFeature *feature, int i, int j, OGRFieldType type) {
+	if (isUnset(i, j))
+		return;
+	switch (type) {
+	case OFTInteger:
+		feature->SetField(j, i * 7919 - 1000000 * j);
+		break;
+	case OFTReal:
+		feature->SetField(j, i * 0.25 - j / 3.0);
+		break;
+	case OFTString: {
+		char str[32];
+		snprintf(str, sizeof(str), "value %d of %d", i, j);
+		feature->SetField(j, str);
+		break;
+	}
+	case OFTDate:
+		feature->SetField(j, 1970 + i % 100, 1 + i % 12, 1 + i % 28, 0, 0, 0,
+				0);
+		break;
+	case OFTTime:
+		feature->SetField(j, 0, 0, 0, i % 24, i % 60, (i * 7) % 60, 0);
+		break;
+	case OFTDateTime:
+		// local, utc and utc offsets of quarter hours.
+		feature->SetField(j, 1900 + i % 200, 1 + i % 12, 1 + i % 28, i % 24,
+				i % 60, (i * 7) % 60, i % 3 == 0 ? 1 : 100 + (i % 9 - 4) * 4);
+		break;
+	case OFTInteger64:
+		feature->SetField(j, (GIntBig) i * 1000000007LL * (i % 2 ? -1 : 1));
+		break;
+	case OFTIntegerList: {
+		int values[4] = { i, -i, i * 3, j };
+		feature->SetField(j, i % 5, values);
+		break;
+	}
+	case OFTInteger64List: {
+		GIntBig values[3] = { (GIntBig) i << 33, -i, j };
+		feature->SetField(j, i % 4, values);
+		break;
+	}
+	case OFTRealList: {
+		double values[3] = { i * 0.5, -i / 7.0, (double) j };
+		feature->SetField(j, i % 4, values);
+		break;
+	}
+	case OFTStringList: {
+		char first[32], second[32];
+		snprintf(first, sizeof(first), "item %d", i);
+		snprintf(second, sizeof(second), "%d", j);
+		char *values[4] = { first, second, (char *) "", NULL };
+		values[i % 4] = NULL;
+		feature->SetField(j, values);
+		break;
+	}
+	default:
+		break;
+	}
+}
+
+// a layer of featurecount points and lines with fields of the given types.
+static OGRLayer *createLayer(OGRDataSource *pds, const char *name,
+		const OGRFieldType *types, int fieldcount, int featurecount) {
+	OGRLayer *layer = pds->CreateLayer(name, NULL, wkbUnknown, NULL);
+	if (layer == NULL)
+		return NULL;
+	for (int j = 0; j < fieldcount; ++j) {
+		char title[16];
+		snprintf(title, sizeof(title), "f%d", j);
+		OGRFieldDefn field(title, types[j]);
+		layer->CreateField(&field);
+	}
+	for (int i = 0; i < featurecount; ++i) {
+		OGRFeature *feature = OGRFeature::CreateFeature(layer->GetLayerDefn());
+		for (int j = 0; j < fieldcount; ++j)
+			setField(feature, i, j, types[j]);
+		if (i % 2) {
+			OGRPoint point(i * 0.5, -i * 0.25);
+			feature->SetGeometry(&point);
+		} else {
+			OGRLineString line;
+			for (int k = 0; k <= i % 5; ++k)
+				line.addPoint(i + k, i - k * 0.5);
+			feature->SetGeometry(&line);
+		}
+		layer->CreateFeature(feature);
+		OGRFeature::DestroyFeature(feature);
+	}
+	return layer;
+}
+
+static bool sameWkb(const OGRGeometry *geometry, const char *wkb,
+		int wkbsize) {
+	if (geometry == NULL || geometry->WkbSize() != wkbsize)
+		return false;
+	unsigned char *bytes = (unsigned char *) malloc(wkbsize + 1);
+	if (bytes == NULL)
+		return false;
+	geometry->exportToWkb(wkbNDR, bytes);
+	bool same = memcmp(bytes, wkb, wkbsize) == 0;
+	free(bytes);
+	return same;
+}
+
+static bool sameGeometry(const OGRGeometry *a, const OGRGeometry *b) {
+	if (a == NULL || b == NULL)
+		return a == b;
+	unsigned char *bytes = (unsigned char *) malloc(b->WkbSize() + 1);
+	if (bytes == NULL)
+		return false;
+	b->exportToWkb(wkbNDR, bytes);
+	bool same = sameWkb(a, (const char *) bytes, b->WkbSize());
+	free(bytes);
+	return same;
+}
+
+// a decoded record field against field j of the source feature.
+static bool sameField(OGRFeature *source, int j, OGRFieldType type,
+		const LayerRecordField & field) {
+	if (!source->IsFieldSet(j))
+		return field.fieldtype_ == FTNull;
+	switch (type) {
+	case OFTInteger:
+		return field.fieldtype_ == FTInteger
+				&& field.field_.ivalue_ == source->GetFieldAsInteger(j);
+	case OFTReal:
+		return field.fieldtype_ == FTReal
+				&& field.field_.dvalue_ == source->GetFieldAsDouble(j);
+	case OFTString: {
+		const char *str = source->GetFieldAsString(j);
+		return field.fieldtype_ == FTString
+				&& field.field_.svalue_.strlength_ == (int) strlen(str)
+				&& memcmp(field.field_.svalue_.str_, str, strlen(str)) == 0;
+	}
+	case OFTDate:
+	case OFTTime:
+	case OFTDateTime: {
+		int year, mon, day, hour, min, sec, tag;
+		source->GetFieldAsDateTime(j, &year, &mon, &day, &hour, &min, &sec,
+				&tag);
+		const FieldDateType &date = field.field_.tvalue_;
+		return field.fieldtype_ == (char) type && date.year_ == year
+				&& date.mon_ == mon && date.day_ == day && date.hour_ == hour
+				&& date.min_ == min && date.sec_ == sec && date.tag_ == tag;
+	}
+	case OFTInteger64:
+		return field.fieldtype_ == FTInteger64
+				&& field.field_.lvalue_ == source->GetFieldAsInteger64(j);
+	case OFTIntegerList:
+	case OFTInteger64List:
+	case OFTRealList: {
+		int count = 0;
+		const void *values = NULL;
+		int valuesize = getListValueSize((char) type);
+		if (type == OFTIntegerList)
+			values = source->GetFieldAsIntegerList(j, &count);
+		else if (type == OFTInteger64List)
+			values = source->GetFieldAsInteger64List(j, &count);
+		else
+			values = source->GetFieldAsDoubleList(j, &count);
+		const FieldListType &list = field.field_.listvalue_;
+		return field.fieldtype_ == (char) type && list.count_ == count
+				&& (count == 0 || memcmp(list.values_, values,
+						(size_t) count * valuesize) == 0);
+	}
+	case OFTStringList: {
+		char **strs = source->GetFieldAsStringList(j);
+		const FieldListType &list = field.field_.listvalue_;
+		const FieldStringType *values = (const FieldStringType *) list.values_;
+		int count = 0;
+		while (strs && strs[count])
+			++count;
+		if (field.fieldtype_ != FTStringList || list.count_ != count)
+			return false;
+		for (int k = 0; k < count; ++k)
+			if (values[k].strlength_ != (int) strlen(strs[k])
+					|| memcmp(values[k].str_, strs[k], strlen(strs[k])) != 0)
+				return false;
+		return true;
+	}
+	default:
+		return false;
+	}
+}
+
+// two OGR features, field by field.
+static bool sameFeatureField(OGRFeature *a, OGRFeature *b, int j) {
+	if (a->IsFieldSet(j) != b->IsFieldSet(j))
+		return false;
+	return strcmp(a->GetFieldAsString(j), b->GetFieldAsString(j)) == 0;
+}
+
+// the layer through LayerAllFeatures and LayerAllRecords bytes.
+static void checkParts(OGRLayer *layer, const OGRFieldType *types,
+		int fieldcount) {
+	const char *name = layer->GetName();
+	LayerAllFeatures features(layer);
+	LayerAllRecords records(layer);
+	LayerAllFeatures decodedfeatures(features.getBytes());
+	LayerAllRecords decodedrecords(records.getBytes());
+	check(decodedfeatures.getFeatureCount() == FEATURE_COUNT, name,
+			"feature count", -1, -1);
+	check(decodedrecords.getRecordCount() == FEATURE_COUNT, name,
+			"record count", -1, -1);
+	if (decodedfeatures.getFeatureCount() != FEATURE_COUNT
+			|| decodedrecords.getRecordCount() != FEATURE_COUNT)
+		return;
+	layer->ResetReading();
+	for (int i = 0; i < FEATURE_COUNT; ++i) {
+		OGRFeature *source = layer->GetNextFeature();
+		const LayerFeature *feature = decodedfeatures.getFeature(i);
+		check(sameWkb(source->GetGeometryRef(), feature->wkbbytes_,
+				feature->wkbsize_), name, "geometry", i, -1);
+		for (int j = 0; j < fieldcount; ++j)
+			check(sameField(source, j, types[j],
+					*decodedrecords.getRecordField(i, j)), name, "record", i,
+					j);
+		OGRFeature::DestroyFeature(source);
+	}
+}
+
+// the features of a layer read back, in order, against their source.
+static void compareLayers(OGRLayer *layer, OGRLayer *copy, int fieldcount,
+		int featurecount) {
+	const char *name = layer->GetName();
+	layer->ResetReading();
+	copy->ResetReading();
+	for (int i = 0; i < featurecount; ++i) {
+		OGRFeature *source = layer->GetNextFeature();
+		OGRFeature *feature = copy->GetNextFeature();
+		check(feature != NULL, name, "feature", i, -1);
+		if (feature == NULL) {
+			OGRFeature::DestroyFeature(source);
+			break;
+		}
+		check(sameGeometry(source->GetGeometryRef(),
+				feature->GetGeometryRef()), name, "geometry", i, -1);
+		for (int j = 0; j < fieldcount; ++j)
+			check(sameFeatureField(source, feature, j), name, "field", i, j);
+		OGRFeature::DestroyFeature(source);
+		OGRFeature::DestroyFeature(feature);
+	}
+}
+
+// removes the keys matching pattern.
+static void removeKeys(SpatialClient & client, const char *pattern) {
+	int keycount = 0;
+	char **keys = client.scanKeys(pattern, &keycount);
+	for (int i = 0; keys && i < keycount; ++i) {
+		client.remove(keys[i]);
+		free(keys[i]);
+	}
+	free(keys);
+}
+
+// the layer through a layer value in redis.
+static void checkValue(SpatialClient & client, OGRLayer *layer,
+		int fieldcount) {
+	client.putLayer(ROUND_TRIP_KEY, layer, PUT_SPATIAL_INDEX);
+	OGRLayer *copy = client.getLayer(ROUND_TRIP_KEY);
+	check(copy != NULL, layer->GetName(), "layer value", -1, -1);
+	if (copy)
+		compareLayers(layer, copy, fieldcount, FEATURE_COUNT);
+}
+
+// the layer through several layer values.
+static void checkLayerParts(SpatialClient & client, OGRLayer *layer,
+		int fieldcount) {
+	const char *name = layer->GetName();
+	bool put = client.putLayerParts(ROUND_TRIP_KEY, layer,
+			PUT_SPATIAL_INDEX | PUT_FID_INDEX, PART_LENGTH);
+	check(put, name, "put of parts", -1, -1);
+	long long featurecount = 0, length = 0;
+	int partcount = client.getLayerPartCount(ROUND_TRIP_KEY, &featurecount,
+			&length);
+	check(partcount > 1 && featurecount == PARTS_FEATURE_COUNT
+			&& length > PART_LENGTH, name, "parts", -1, -1);
+	OGRLayer *copy = client.getLayerParts(ROUND_TRIP_KEY);
+	check(copy != NULL && copy->GetFeatureCount() == PARTS_FEATURE_COUNT,
+			name, "parts layer", -1, -1);
+	if (copy)
+		compareLayers(layer, copy, fieldcount, PARTS_FEATURE_COUNT);
+	// the parts, their indexes and their counts.
+	removeKeys(client, "sctest:roundtrip:*");
+}
+
+// a value of an older format version is not read.
+static void checkVersion(SpatialClient & client) {
+	int size = 0;
+	char *bytes = client.get(ROUND_TRIP_KEY, &size);
+	check(bytes != NULL && size > LAYER_HEAD_SIZE, ROUND_TRIP_KEY,
+			"stored value", -1, -1);
+	if (bytes == NULL)
+		return;
+	int version = LAYER_FORMAT_MAGIC | (LAYER_FORMAT_VERSION - 1);
+	memcpy(bytes + sizeof(int), &version, sizeof(version));
+	client.put(ROUND_TRIP_KEY, bytes, size);
+	free(bytes);
+	OGRLayer *layer = client.getLayer(ROUND_TRIP_KEY);
+	check(layer == NULL, ROUND_TRIP_KEY, "older version", -1, -1);
+	client.remove(ROUND_TRIP_KEY);
+}
+
+// features by fid, in the order asked, without the fids the layer lacks.
+static void checkFids(SpatialClient & client, OGRLayer *layer) {
+	const char *name = layer->GetName();
+	const long long fids[] = { 7, FEATURE_COUNT - 2, FEATURE_COUNT + 5, 0 };
+	const int fidcount = sizeof(fids) / sizeof(fids[0]);
+	LayerAllFeatures *found = client.getFeaturesByFid(UPDATE_KEY, fids,
+			fidcount);
+	check(found != NULL && found->getFeatureCount() == fidcount - 1, name,
+			"fid lookup", -1, -1);
+	if (found == NULL || found->getFeatureCount() != fidcount - 1) {
+		delete found;
+		return;
+	}
+	int index = 0;
+	for (int i = 0; i < fidcount; ++i) {
+		if (fids[i] >= FEATURE_COUNT)
+			continue;
+		OGRFeature *source = layer->GetFeature(fids[i]);
+		const LayerFeature *feature = found->getFeature(index++);
+		check(source != NULL && sameWkb(source->GetGeometryRef(),
+				feature->wkbbytes_, feature->wkbsize_), name, "fid lookup",
+				(int) fids[i], -1);
+		OGRFeature::DestroyFeature(source);
+	}
+	delete found;
+}
+
+// the rows where selects, and whether any of them has field 0 unset.
+static int countWhere(SpatialClient & client, const char *where,
+		bool *unset) {
+	LayerAllRecords *records = NULL;
+	LayerAllFeatures *features = client.getFeaturesWhere(UPDATE_KEY, where,
+			&records);
+	int count = features ? features->getFeatureCount() : -1;
+	*unset = false;
+	for (int i = 0; records && i < records->getRecordCount(); ++i)
+		if (records->isNull(i, 0))
+			*unset = true;
+	delete features;
+	delete records;
+	return count;
+}
+
+// a predicate over an unset field is unknown: neither it nor its NOT
+// matches the row.
+static void checkFilterNulls(SpatialClient & client, OGRLayer *layer) {
+	const char *name = layer->GetName();
+	int above = 0, below = 0;
+	for (int i = 0; i < FEATURE_COUNT; ++i) {
+		if (isUnset(i, 0))
+			continue;
+		if (i * 7919 > FILTER_THRESHOLD)
+			++above;
+		else
+			++below;
+	}
+	char where[128];
+	bool unset = false;
+	snprintf(where, sizeof(where), "f0 > %d", FILTER_THRESHOLD);
+	check(countWhere(client, where, &unset) == above && !unset, name, where,
+			-1, 0);
+	snprintf(where, sizeof(where), "NOT f0 > %d", FILTER_THRESHOLD);
+	check(countWhere(client, where, &unset) == below && !unset, name, where,
+			-1, 0);
+	snprintf(where, sizeof(where), "f0 > %d OR NOT f0 > %d",
+			FILTER_THRESHOLD, FILTER_THRESHOLD);
+	check(countWhere(client, where, &unset) == above + below && !unset, name,
+			where, -1, 0);
+}
+
+// field 0 and the geometry of a feature of a layer read back.
+static bool hasUpdate(OGRLayer *copy, long long fid, int value,
+		const OGRGeometry *geometry) {
+	OGRFeature *feature = copy->GetFeature(fid);
+	bool same = feature != NULL
+			&& (geometry == NULL
+					|| sameGeometry(geometry, feature->GetGeometryRef()))
+			&& (value < 0 ?
+					!feature->IsFieldSet(0) :
+					feature->IsFieldSet(0)
+							&& feature->GetFieldAsInteger(0) == value);
+	OGRFeature::DestroyFeature(feature);
+	return same;
+}
+
+// a field overwritten in place, then changes that go to the log, read
+// merged, and the log compacted into the value.
+static void checkUpdates(SpatialClient & client, OGRLayer *layer) {
+	const char *name = layer->GetName();
+	LayerRecordField value;
+	memset(&value, 0, sizeof(value));
+	value.fieldtype_ = FTInteger;
+	value.field_.ivalue_ = 4242;
+	check(client.updateRecordField(UPDATE_KEY, 10, 0, value), name,
+			"update in place", 10, 0);
+	// reads of the stored bytes work until the log holds changes.
+	LayerAllFeatures *box = client.getFeaturesInBBox(UPDATE_KEY, 9.5, 9.5,
+			10.5, 10.5);
+	check(box != NULL, name, "read without a log", 10, -1);
+	delete box;
+
+	// feature 12 is a line: a point is of another size and is logged.
+	OGRPoint point(1000.5, -3);
+	check(client.updateFeatureGeometry(UPDATE_KEY, 12, &point), name,
+			"logged geometry", 12, -1);
+	value.field_.ivalue_ = 777;
+	check(client.updateRecordField(UPDATE_KEY, 10, 0, value), name,
+			"logged field", 10, 0);
+	value.fieldtype_ = FTNull;
+	check(client.updateRecordField(UPDATE_KEY, 13, 0, value), name,
+			"logged unset", 13, 0);
+	box = client.getFeaturesInBBox(UPDATE_KEY, 1000, -4, 1001, -2);
+	check(box == NULL, name, "read with a log", 12, -1);
+	delete box;
+
+	const long long fid = 12;
+	LayerAllFeatures *found = client.getFeaturesByFid(UPDATE_KEY, &fid, 1);
+	check(found != NULL && found->getFeatureCount() == 1
+			&& sameWkb(&point, found->getFeature(0)->wkbbytes_,
+					found->getFeature(0)->wkbsize_), name, "merged fid lookup",
+			12, -1);
+	delete found;
+
+	// the value read merged with its log, then compacted.
+	for (int pass = 0; pass < 2; ++pass) {
+		if (pass == 1)
+			check(client.compactLayer(UPDATE_KEY), name, "compaction", -1,
+					-1);
+		OGRLayer *copy = client.getLayer(UPDATE_KEY);
+		check(copy != NULL && copy->GetFeatureCount() == FEATURE_COUNT
+				&& hasUpdate(copy, 10, 777, NULL)
+				&& hasUpdate(copy, 12, 12 * 7919, &point)
+				&& hasUpdate(copy, 13, -1, NULL), name,
+				pass ? "compacted layer" : "merged layer", -1, -1);
+	}
+	box = client.getFeaturesInBBox(UPDATE_KEY, 1000, -4, 1001, -2);
+	check(box != NULL && box->getFeatureCount() == 1
+			&& sameWkb(&point, box->getFeature(0)->wkbbytes_,
+					box->getFeature(0)->wkbsize_), name,
+			"read after compaction", 12, -1);
+	delete box;
+}
+
+// fid lookups, filters and updates of a layer value with its indexes.
+static void checkChanges(SpatialClient & client, OGRLayer *layer) {
+	bool put = client.putLayer(UPDATE_KEY, layer,
+			PUT_SPATIAL_INDEX | PUT_FID_INDEX);
+	check(put, layer->GetName(), "put with indexes", -1, -1);
+	if (put) {
+		checkFids(client, layer);
+		checkFilterNulls(client, layer);
+		checkUpdates(client, layer);
+	}
+	removeKeys(client, "sctest:update*");
+}
+
+int main() {
+	OGRRegisterAll();
+	OGRSFDriver *driver =
+			OGRSFDriverRegistrar::GetRegistrar()->GetDriverByName("Memory");
+	OGRDataSource *pds = driver ? driver->CreateDataSource("sctest") : NULL;
+	if (pds == NULL) {
+		fprintf(stderr, "Can not create a Memory datasource.\n");
+		return 1;
+	}
+	// fixed-width fields only are stored as fixed-stride rows, the others
+	// as tagged cells.
+	const OGRFieldType fixedtypes[] = { OFTInteger, OFTReal, OFTDate,
+			OFTInteger64, OFTTime, OFTDateTime };
+	const OGRFieldType taggedtypes[] = { OFTInteger, OFTString, OFTReal,
+			OFTDate, OFTInteger64, OFTTime, OFTDateTime, OFTIntegerList,
+			OFTInteger64List, OFTRealList, OFTStringList };
+	int fixedcount = sizeof(fixedtypes) / sizeof(fixedtypes[0]);
+	int taggedcount = sizeof(taggedtypes) / sizeof(taggedtypes[0]);
+	OGRLayer *fixed = createLayer(pds, "fixed", fixedtypes, fixedcount,
+			FEATURE_COUNT);
+	OGRLayer *tagged = createLayer(pds, "tagged", taggedtypes, taggedcount,
+			FEATURE_COUNT);
+	OGRLayer *large = createLayer(pds, "large", taggedtypes, taggedcount,
+			PARTS_FEATURE_COUNT);
+	if (fixed == NULL || tagged == NULL || large == NULL) {
+		fprintf(stderr, "Can not create the test layers.\n");
+		OGRDataSource::DestroyDataSource(pds);
+		return 1;
+	}
+
+	checkParts(fixed, fixedtypes, fixedcount);
+	checkParts(tagged, taggedtypes, taggedcount);
+
+	SpatialClient client;
+	if (client.connect()) {
+		checkValue(client, fixed, fixedcount);
+		checkValue(client, tagged, taggedcount);
+		checkVersion(client);
+		checkLayerParts(client, large, taggedcount);
+		checkChanges(client, fixed);
+	} else {
+		fprintf(stderr, "Can not connect the redis server, "
+				"layer values are not checked.\n");
+	}
+
+	OGRDataSource::DestroyDataSource(pds);
+	if (failures) {
+		fprintf(stderr, "%d mismatches.\n", failures);
+		return 1;
+	}
+	printf("Round trip ok.\n");
+	return 0;
+}
@@ -6,145 +6,240 @@
 
 #include "spatialClient.h"
 
+#include <stdlib.h>
 #include <string.h>
+#include <math.h>
 #include <assert.h>
 
+#include <pthread.h>
+#include <unistd.h>
+
 #include <hiredis.h>
 #include <ogrsf_frmts.h>
 
-SpatialClient::SpatialClient() :
-		con_(NULL) {
-}
-
-SpatialClient::~SpatialClient() {
-	disconnect();
+#include "layerDecoder.h"
+#include "layerEncoder.h"
+#include "layerSnapshot.h"
+#include "mvtEncoder.h"
+#include "recordFilter.h"
+#include "layerChangeLog.h"
+#include "wkbReader.h"
+
+// features closer than this in the stored value are fetched by one GETRANGE.
+static const int RANGE_GAP = 4096;
+// tile writes sent before waiting for their replies.
+static const int TILE_PIPELINE = 64;
+static const int MAX_TILE_ZOOM = 24;
+// encoded bytes per chunk of a streamed layer, chunks queued for the writer,
+// and chunk writes sent before waiting for their replies.
+static const int STREAM_CHUNK_SIZE = 1 << 20;
+static const int STREAM_WINDOW = 8;
+static const int STREAM_PIPELINE = 4;
+// fid index slots read by one GETRANGE of a probe.
+static const int FID_PROBE_SLOTS = 8;
+// "key:parts" of a layer put in parts: int LAYER_PARTS_MAGIC or'ed with the
+// version of its layout, int partcount, int options, then long long
+// featurecount and long long length of the whole layer.
+static const int LAYER_PARTS_MAGIC = 0x53500000;
+static const int LAYER_PARTS_VERSION = 1;
+static const int LAYER_PARTS_SIZE = 3 * sizeof(int) + 2 * sizeof(long long);
+
+typedef struct {
+	int offset_;
+	int size_;
+} ByteRange;
+
+static int compareByteRange(const void *a, const void *b) {
+	return ((const ByteRange *) a)->offset_ - ((const ByteRange *) b)->offset_;
 }
 
-bool SpatialClient::connect(const char *ip, int port, int dbno) {
-	con_ = redisConnect(ip, port);
-	if (con_ == NULL || con_->err) {
-		fprintf(stderr, "Connection error: %s\n", con_->errstr);
-		if (con_)
-			redisFree(con_);
-		return false;
-	}
-	redisReply *reply = (redisReply *)redisCommand(con_, "select %d", dbno);
-	if (reply == NULL || reply->type == REDIS_REPLY_ERROR) {
-		fprintf(stderr, "Select db error: %s\n", reply->str);
+// reads the replies of pipelined write commands, the number of them that
+// failed.
+static int getFailedReplies(redisContext *con, int count) {
+	int failed = 0;
+	for (int i = 0; i < count; ++i) {
+		redisReply *reply = NULL;
+		if (redisGetReply(con, (void **) &reply) != REDIS_OK || reply == NULL
+				|| reply->type == REDIS_REPLY_ERROR) {
+			fprintf(stderr, "Redis pipelined command error.\n");
+			++failed;
+		}
 		if (reply)
 			freeReplyObject(reply);
-		return false;
 	}
-	freeReplyObject(reply);
-	return true;
+	return failed;
 }
 
-void SpatialClient::disconnect() {
-	redisContext * temp = con_;
-	con_ = 0;
-	if (temp) {
-		redisFree(temp);
-	}
+static bool getReplies(redisContext *con, int count) {
+	return getFailedReplies(con, count) == 0;
 }
 
-char *SpatialClient::get(const char *key) const {
-	return get(key, 0);
+// offset of featurelength in a layer value.
+static int featureSectionOffset(const char *bytes) {
+	int offset = LAYER_HEAD_SIZE;
+	int sectionlength = 0;
+	// metadata
+	memcpy(&sectionlength, bytes + offset, sizeof(sectionlength));
+	offset += sizeof(sectionlength) + sectionlength;
+	// attribute definition
+	memcpy(&sectionlength, bytes + offset, sizeof(sectionlength));
+	offset += sizeof(sectionlength) + sectionlength;
+	return offset;
 }
 
-char *SpatialClient::get(const char *key, int *size) const {
-	if (con_ == NULL) {
-		fprintf(stderr, "Redis connection is not available.\n");
+// the features at the given ranges of a layer value, in order, with one
+// pipelined GETRANGE per run of close features.
+static LayerAllFeatures *readFeatures(redisContext *con, const char *key,
+		const ByteRange *features, int featurecount) {
+	int featurelength = sizeof(featurelength) + sizeof(featurecount);
+	for (int i = 0; i < featurecount; ++i)
+		featurelength += features[i].size_;
+
+	char *bytes = (char *) malloc(featurelength);
+	if (bytes == NULL) {
+		fprintf(stderr, "Fail to alloc memory for bytes.\n");
 		return NULL;
 	}
-	redisReply *reply = (redisReply *)redisCommand(con_, "GET %s", key);
-	if (reply == NULL || reply->type != REDIS_REPLY_STRING) {
-		fprintf(stderr, "Redis reply error: not a string.\n");
+	int offset = 0;
+	memcpy(bytes + offset, &featurelength, sizeof(featurelength));
+	offset += sizeof(featurelength);
+	memcpy(bytes + offset, &featurecount, sizeof(featurecount));
+	offset += sizeof(featurecount);
+
+	int readcount = 0;
+	for (int i = 0; i < featurecount;) {
+		int start = features[i].offset_;
+		int end = start + features[i].size_;
+		for (++i; i < featurecount && features[i].offset_ <= end + RANGE_GAP;
+				++i) {
+			if (features[i].offset_ + features[i].size_ > end)
+				end = features[i].offset_ + features[i].size_;
+		}
+		redisAppendCommand(con, "GETRANGE %s %d %d", key, start, end - 1);
+		++readcount;
+	}
+
+	bool failed = false;
+	int ifeature = 0;
+	for (int iread = 0; iread < readcount; ++iread) {
+		redisReply *reply = NULL;
+		if (redisGetReply(con, (void **) &reply) != REDIS_OK || reply == NULL
+				|| reply->type != REDIS_REPLY_STRING) {
+			fprintf(stderr, "Redis reply error: not a string.\n");
+			failed = true;
+		}
+		int start = features[ifeature].offset_;
+		int end = start + features[ifeature].size_;
+		do {
+			if (features[ifeature].offset_ + features[ifeature].size_ > end)
+				end = features[ifeature].offset_ + features[ifeature].size_;
+			if (!failed
+					&& features[ifeature].offset_ + features[ifeature].size_
+							- start <= (int) reply->len) {
+				memcpy(bytes + offset,
+						reply->str + features[ifeature].offset_ - start,
+						features[ifeature].size_);
+				offset += features[ifeature].size_;
+			} else {
+				failed = true;
+			}
+			++ifeature;
+		} while (ifeature < featurecount
+				&& features[ifeature].offset_ <= end + RANGE_GAP);
 		if (reply)
 			freeReplyObject(reply);
-		return NULL;
 	}
-	if (size)
-		*size = reply->len;
-	char *result = (char *) malloc((reply->len + 1) * sizeof(char));
-	if (result == NULL) {
-		fprintf(stderr, "redis get result malloc failed.\n");
+
+	if (failed) {
+		fprintf(stderr, "Fail to get the layer features bytes.\n");
+		free(bytes);
 		return NULL;
 	}
-	memcpy(result, reply->str, reply->len + 1);
-
-	freeReplyObject(reply);
-	return result;
-}
+	assert(offset == featurelength);
 
-bool SpatialClient::put(const char *key, const char *value) const {
-	return put(key, value, 0);
+	LayerAllFeatures *allfeatures = new LayerAllFeatures(bytes);
+	free(bytes);
+	return allfeatures;
 }
 
-bool SpatialClient::put(const char *key, const char *value, int size) const {
-	if (con_ == NULL) {
-		fprintf(stderr, "Redis connection is not available.\n");
-		return false;
-	}
-	redisReply *reply = NULL;
-	if (size) {
-		reply = (redisReply *)redisCommand(con_, "SET %s %b", key, value, size);
-	} else {
-		reply = (redisReply *)redisCommand(con_, "SET %s %s", key, value);
+static char *suffixKey(const char *key, const char *suffix) {
+	int keylength = strlen(key);
+	int suffixlength = strlen(suffix);
+	char *result = (char *) malloc(keylength + suffixlength + 1);
+	if (result == NULL) {
+		fprintf(stderr, "Fail to alloc memory for key.\n");
+		return NULL;
 	}
+	memcpy(result, key, keylength);
+	memcpy(result + keylength, suffix, suffixlength + 1);
+	return result;
+}
 
-	if (reply == NULL || reply->type == REDIS_REPLY_ERROR) {
-		fprintf(stderr, "Redis set command error: %s.\n", reply->str);
+// the length of a change log, 0 when there is none, -1 on failure.
+static long long getLogLength(redisContext *con, const char *logkey) {
+	redisReply *reply = (redisReply *) redisCommand(con, "STRLEN %s", logkey);
+	if (reply == NULL || reply->type != REDIS_REPLY_INTEGER) {
+		fprintf(stderr, "Redis strlen command error.\n");
 		if (reply)
 			freeReplyObject(reply);
-		return false;
+		return -1;
 	}
-
+	long long length = reply->integer;
 	freeReplyObject(reply);
-	return true;
+	return length;
 }
 
-void SpatialClient::putLayer(const char *key, OGRLayer *layer) const {
-	if (key == NULL) {
-		fprintf(stderr, "Empty key.\n");
-		return;
-	}
-	if (layer == NULL) {
-		fprintf(stderr, "Empty OGRLayer.\n");
-		return;
-	}
-	char *bytes = serialize(layer);
-	if (bytes == NULL) {
-		fprintf(stderr, "Nil OGRLayer bytes.\n");
-		return;
+// false, with the reason on stderr, while "key:log" holds changes of
+// updateFeatureGeometry or updateRecordField, which reads of the value do not
+// see until compactLayer, or when the log cannot be checked.
+static bool checkNoChangeLog(redisContext *con, const char *key) {
+	if (con == NULL) {
+		fprintf(stderr, "Redis connection is not available.\n");
+		return false;
 	}
-	int length = 0;
-	memcpy(&length, bytes, sizeof(length));
-	put(key, bytes, length);
+	char *logkey = suffixKey(key, ":log");
+	if (logkey == NULL)
+		return false;
+	long long length = getLogLength(con, logkey);
+	if (length > 0)
+		fprintf(stderr, "%s has logged changes, compactLayer first.\n", key);
+	free(logkey);
+	return length == 0;
 }
 
-OGRLayer *SpatialClient::getLayer(const char *key) const {
-	if (key == NULL) {
-		fprintf(stderr, "Empty key.\n");
+// the value of a key that may not exist, as get() returns it, and NULL
+// without a complaint for a missing key.
+static char *getIfExists(redisContext *con, const char *key, int *size) {
+	if (con == NULL) {
+		fprintf(stderr, "Redis connection is not available.\n");
 		return NULL;
 	}
-	char *bytes = get(key);
-	if (bytes == NULL) {
-		fprintf(stderr, "Fail to get the layer bytes.\n");
+	redisReply *reply = (redisReply *) redisCommand(con, "GET %s", key);
+	if (reply == NULL || reply->type != REDIS_REPLY_STRING) {
+		if (reply == NULL || reply->type != REDIS_REPLY_NIL)
+			fprintf(stderr, "Redis reply error: not a string.\n");
+		if (reply)
+			freeReplyObject(reply);
 		return NULL;
 	}
-	OGRLayer *layer = deserialize(bytes);
-	return layer;
-}
-
-char *SpatialClient::serialize(OGRLayer *poLayer) const {
-	if (poLayer == NULL)
+	char *result = (char *) malloc(reply->len + 1);
+	if (result == NULL) {
+		fprintf(stderr, "Fail to alloc memory for value of %s.\n", key);
+		freeReplyObject(reply);
 		return NULL;
+	}
+	memcpy(result, reply->str, reply->len + 1);
+	*size = (int) reply->len;
+	freeReplyObject(reply);
+	return result;
+}
 
-	int length = 0;
+// the version word, then the metadata and the attribute definition of a
+// layer value, each after its length, as serialize() writes them. free() by
+// caller.
+static char *encodeLayerHead(OGRLayer *poLayer, int *length) {
 	int metadatalength = 0;
 	int attributedeflength = 0;
-	int featurelength = 0;
-	int attributerecordlength = 0;
 
 	// compute metadata size
 	const char *layername = poLayer->GetName();
@@ -164,7 +259,6 @@ char *SpatialClient::serialize(OGRLayer *poLayer) const {
 	}
 	int strWKTlength = strlen(strWKT) + 1;
 	metadatalength += strWKTlength + sizeof(strWKTlength);
-	length += metadatalength + sizeof(metadatalength);
 
 	//compute attribute definition data size
 	int fieldcount = poLayer->GetLayerDefn()->GetFieldCount();
@@ -185,80 +279,19 @@ char *SpatialClient::serialize(OGRLayer *poLayer) const {
 		char fieldtype = (char) poField->GetType();
 		attributedeflength += sizeof(fieldtype);
 	}
-	length += attributedeflength + sizeof(attributedeflength);
-
-	// compute feature size and attribute record size.
-	int featurecount = 0;
-	featurelength += sizeof(featurecount);
-
-	int attributerecordcount = 0;
-	attributerecordlength += sizeof(attributerecordcount);
-	attributerecordlength += sizeof(fieldcount);
-	poLayer->ResetReading();
-	for (OGRFeature *feature = poLayer->GetNextFeature(); feature != NULL;
-			feature = poLayer->GetNextFeature()) {
-		OGRGeometry *geometry = feature->GetGeometryRef();
-		if (geometry) {
-			// int geometrytype = (int)geometry->getGeometryType();
-			featurelength += sizeof(int);
-			int wkbsize = geometry->WkbSize();
-			featurelength += sizeof(wkbsize) + wkbsize;
-
-			++featurecount;
-			++attributerecordcount;
-
-			for (int ifield = 0; ifield < fieldcount; ++ifield) {
-				OGRFieldDefn* poField = poLayer->GetLayerDefn()->GetFieldDefn(
-						ifield);
-				char attributetype = (char) poField->GetType();
-				attributerecordlength += sizeof(attributetype);
-				switch (attributetype) {
-				case OFTInteger:
-					attributerecordlength += sizeof(int);
-					break;
-				case OFTReal:
-					attributerecordlength += sizeof(double);
-					break;
-				case OFTString: {
-					const char *pstr = feature->GetFieldAsString(ifield);
-					int strlength = strlen(pstr) + 1;
-					attributerecordlength += sizeof(strlength) + strlength;
-					break;
-				}
-				case OFTBinary: {
-					int blobsize;
-					feature->GetFieldAsBinary(ifield, &blobsize);
-					int byteslength = blobsize;
-					attributerecordlength += sizeof(byteslength) + byteslength;
-					break;
-				}
-				case OFTDate:
-					attributerecordlength += 7 * sizeof(int); //int year, mon, day, hour, min, sec, tag;
-					break;
-				default:
-					continue;
-				}
-			}
-		}
-		OGRFeature::DestroyFeature(feature);
-	}
-	length += featurelength + sizeof(featurelength);
-	length += attributerecordlength + sizeof(attributerecordlength);
-	length += sizeof(length);
 
-	// alloc memory for serialization.
-	char *bytes = (char *) malloc((length + 10));
+	int version = LAYER_FORMAT_MAGIC | LAYER_FORMAT_VERSION;
+	*length = sizeof(version) + metadatalength + sizeof(metadatalength)
+			+ attributedeflength + sizeof(attributedeflength);
+	char *bytes = (char *) malloc(*length);
 	if (bytes == NULL) {
-		fprintf(stderr, "Fail to alloc memory for bytes.\n");
+		fprintf(stderr, "Fail to alloc memory for layer head.\n");
 		return NULL;
 	}
 
-	assert(bytes != NULL);
-
 	int offset = 0;
-	memcpy(bytes + offset, &length, sizeof(length));
-	offset += sizeof(length);
-	// serialize metadata.
+	memcpy(bytes + offset, &version, sizeof(version));
+	offset += sizeof(version);
 	// metadatalength
 	memcpy(bytes + offset, &metadatalength, sizeof(metadatalength));
 	offset += sizeof(metadatalength);
@@ -279,7 +312,7 @@ char *SpatialClient::serialize(OGRLayer *poLayer) const {
 	memcpy(bytes + offset, strWKT, strWKTlength);
 	offset += strWKTlength;
 
-	//serialize attribute definition data
+	// attribute definition
 	memcpy(bytes + offset, &attributedeflength, sizeof(attributedeflength));
 	offset += sizeof(attributedeflength);
 	memcpy(bytes + offset, &fieldcount, sizeof(fieldcount));
@@ -298,14 +331,2140 @@ char *SpatialClient::serialize(OGRLayer *poLayer) const {
 		memcpy(bytes + offset, &nWidth, sizeof(nWidth));
 		offset += sizeof(nWidth);
 
-		int nDecimals = poField->GetPrecision();
-		memcpy(bytes + offset, &nDecimals, sizeof(nDecimals));
-		offset += sizeof(nDecimals);
+		int nDecimals = poField->GetPrecision();
+		memcpy(bytes + offset, &nDecimals, sizeof(nDecimals));
+		offset += sizeof(nDecimals);
+
+		char fieldtype = (char) poField->GetType();
+		memcpy(bytes + offset, &fieldtype, sizeof(fieldtype));
+		offset += sizeof(fieldtype);
+	}
+	return bytes;
+}
+
+SpatialClient::SpatialClient() :
+		con_(NULL), ip_(NULL), port_(0), dbno_(0) {
+}
+
+SpatialClient::~SpatialClient() {
+	disconnect();
+	if (ip_)
+		free(ip_);
+}
+
+bool SpatialClient::connect(const char *ip, int port, int dbno) {
+	disconnect();
+	// remembered for the extra connections of the parallel writers.
+	int iplength = strlen(ip) + 1;
+	ip_ = (char *) realloc(ip_, iplength);
+	if (ip_ == NULL) {
+		fprintf(stderr, "Fail to alloc memory for ip.\n");
+		return false;
+	}
+	memcpy(ip_, ip, iplength);
+	port_ = port;
+	dbno_ = dbno;
+
+	con_ = openConnection();
+	return con_ != NULL;
+}
+
+redisContext *SpatialClient::openConnection() const {
+	if (ip_ == NULL) {
+		fprintf(stderr, "Redis connection is not available.\n");
+		return NULL;
+	}
+	redisContext *con = redisConnect(ip_, port_);
+	if (con == NULL || con->err) {
+		fprintf(stderr, "Connection error: %s\n",
+				con ? con->errstr : "can not alloc redis context");
+		if (con)
+			redisFree(con);
+		return NULL;
+	}
+	redisReply *reply = (redisReply *) redisCommand(con, "select %d", dbno_);
+	if (reply == NULL || reply->type == REDIS_REPLY_ERROR) {
+		fprintf(stderr, "Select db error: %s\n",
+				reply ? reply->str : con->errstr);
+		if (reply)
+			freeReplyObject(reply);
+		redisFree(con);
+		return NULL;
+	}
+	freeReplyObject(reply);
+	return con;
+}
+
+void SpatialClient::disconnect() {
+	redisContext * temp = con_;
+	con_ = 0;
+	if (temp) {
+		redisFree(temp);
+	}
+}
+
+char *SpatialClient::get(const char *key) const {
+	return get(key, 0);
+}
+
+char *SpatialClient::get(const char *key, int *size) const {
+	if (con_ == NULL) {
+		fprintf(stderr, "Redis connection is not available.\n");
+		return NULL;
+	}
+	redisReply *reply = (redisReply *)redisCommand(con_, "GET %s", key);
+	if (reply == NULL || reply->type != REDIS_REPLY_STRING) {
+		fprintf(stderr, "Redis reply error: not a string.\n");
+		if (reply)
+			freeReplyObject(reply);
+		return NULL;
+	}
+	if ((long long) reply->len > LAYER_MAX_LENGTH) {
+		fprintf(stderr, "Redis reply of %lld bytes passes an int size.\n",
+				(long long) reply->len);
+		freeReplyObject(reply);
+		return NULL;
+	}
+	if (size)
+		*size = (int) reply->len;
+	char *result = (char *) malloc((reply->len + 1) * sizeof(char));
+	if (result == NULL) {
+		fprintf(stderr, "redis get result malloc failed.\n");
+		return NULL;
+	}
+	memcpy(result, reply->str, reply->len + 1);
+
+	freeReplyObject(reply);
+	return result;
+}
+
+bool SpatialClient::put(const char *key, const char *value) const {
+	return put(key, value, 0);
+}
+
+bool SpatialClient::put(const char *key, const char *value, int size) const {
+	if (con_ == NULL) {
+		fprintf(stderr, "Redis connection is not available.\n");
+		return false;
+	}
+	redisReply *reply = NULL;
+	if (size) {
+		reply = (redisReply *)redisCommand(con_, "SET %s %b", key, value, (size_t) size);
+	} else {
+		reply = (redisReply *)redisCommand(con_, "SET %s %s", key, value);
+	}
+
+	if (reply == NULL || reply->type == REDIS_REPLY_ERROR) {
+		fprintf(stderr, "Redis set command error: %s.\n", reply->str);
+		if (reply)
+			freeReplyObject(reply);
+		return false;
+	}
+
+	freeReplyObject(reply);
+	return true;
+}
+
+char *SpatialClient::getRange(const char *key, int start, int end,
+		int *size) const {
+	if (con_ == NULL) {
+		fprintf(stderr, "Redis connection is not available.\n");
+		return NULL;
+	}
+	redisReply *reply = (redisReply *) redisCommand(con_, "GETRANGE %s %d %d",
+			key, start, end);
+	if (reply == NULL || reply->type != REDIS_REPLY_STRING) {
+		fprintf(stderr, "Redis reply error: not a string.\n");
+		if (reply)
+			freeReplyObject(reply);
+		return NULL;
+	}
+	if ((long long) reply->len > LAYER_MAX_LENGTH) {
+		fprintf(stderr, "Redis reply of %lld bytes passes an int size.\n",
+				(long long) reply->len);
+		freeReplyObject(reply);
+		return NULL;
+	}
+	if (size)
+		*size = (int) reply->len;
+	char *result = (char *) malloc((reply->len + 1) * sizeof(char));
+	if (result == NULL) {
+		fprintf(stderr, "redis getrange result malloc failed.\n");
+		freeReplyObject(reply);
+		return NULL;
+	}
+	memcpy(result, reply->str, reply->len + 1);
+
+	freeReplyObject(reply);
+	return result;
+}
+
+bool SpatialClient::remove(const char *key) const {
+	if (con_ == NULL) {
+		fprintf(stderr, "Redis connection is not available.\n");
+		return false;
+	}
+	redisReply *reply = (redisReply *) redisCommand(con_, "DEL %s", key);
+	if (reply == NULL || reply->type == REDIS_REPLY_ERROR) {
+		fprintf(stderr, "Redis del command error.\n");
+		if (reply)
+			freeReplyObject(reply);
+		return false;
+	}
+
+	freeReplyObject(reply);
+	return true;
+}
+
+char **SpatialClient::scanKeys(const char *pattern, int *count) const {
+	if (con_ == NULL) {
+		fprintf(stderr, "Redis connection is not available.\n");
+		return NULL;
+	}
+	char **keys = NULL;
+	int keycount = 0, capacity = 0;
+	bool succeeded = true;
+	char cursor[32] = "0";
+	do {
+		redisReply *reply = (redisReply *) redisCommand(con_,
+				"SCAN %s MATCH %s COUNT 1000", cursor,
+				pattern ? pattern : "*");
+		if (reply == NULL || reply->type != REDIS_REPLY_ARRAY
+				|| reply->elements != 2
+				|| reply->element[0]->type != REDIS_REPLY_STRING
+				|| reply->element[0]->len >= sizeof(cursor)) {
+			fprintf(stderr, "Redis scan command error.\n");
+			if (reply)
+				freeReplyObject(reply);
+			succeeded = false;
+			break;
+		}
+		memcpy(cursor, reply->element[0]->str, reply->element[0]->len + 1);
+		redisReply *batch = reply->element[1];
+		for (size_t i = 0; succeeded && i < batch->elements; ++i) {
+			if (keycount == capacity) {
+				capacity = capacity ? capacity * 2 : 1024;
+				char **grown = (char **) realloc(keys,
+						sizeof(char *) * capacity);
+				if (grown == NULL) {
+					fprintf(stderr, "Fail to alloc memory for keys.\n");
+					succeeded = false;
+					break;
+				}
+				keys = grown;
+			}
+			keys[keycount] = (char *) malloc(batch->element[i]->len + 1);
+			if (keys[keycount] == NULL) {
+				fprintf(stderr, "Fail to alloc memory for keys.\n");
+				succeeded = false;
+				break;
+			}
+			memcpy(keys[keycount], batch->element[i]->str,
+					batch->element[i]->len + 1);
+			++keycount;
+		}
+		freeReplyObject(reply);
+	} while (succeeded && strcmp(cursor, "0") != 0);
+
+	if (!succeeded) {
+		for (int i = 0; i < keycount; ++i)
+			free(keys[i]);
+		if (keys)
+			free(keys);
+		return NULL;
+	}
+	if (count)
+		*count = keycount;
+	// never NULL on success, even without a key.
+	return keys ? keys : (char **) malloc(sizeof(char *));
+}
+
+// KEYS: the layer value, its spatial index, order and fid index, and its
+// change log. ARGV: the value, the indexes, then a '1' or '0' for each of
+// the indexes, put or removed. all are written, and the log removed, at
+// once: never a value beside indexes of an older one.
+static const char *PUT_LAYER_SCRIPT =
+		"redis.call('SET', KEYS[1], ARGV[1]) "
+				"for i = 2, 4 do "
+				"if string.sub(ARGV[5], i - 1, i - 1) == '1' then "
+				"redis.call('SET', KEYS[i], ARGV[i]) "
+				"else redis.call('DEL', KEYS[i]) end end "
+				"redis.call('DEL', KEYS[5]) "
+				"return 1";
+
+bool SpatialClient::putLayer(const char *key, OGRLayer *layer,
+		int options) const {
+	if (key == NULL) {
+		fprintf(stderr, "Empty key.\n");
+		return false;
+	}
+	if (layer == NULL) {
+		fprintf(stderr, "Empty OGRLayer.\n");
+		return false;
+	}
+	if (con_ == NULL) {
+		fprintf(stderr, "Redis connection is not available.\n");
+		return false;
+	}
+	LayerSpatialIndex *index = NULL;
+	if (options & PUT_SPATIAL_INDEX)
+		index = new LayerSpatialIndex();
+	SpatialCurveType curve = CURVE_NONE;
+	if (options & PUT_HILBERT_ORDER)
+		curve = CURVE_HILBERT;
+	else if (options & PUT_MORTON_ORDER)
+		curve = CURVE_MORTON;
+	LayerFidIndex *fidindex = NULL;
+	if (options & PUT_FID_INDEX)
+		fidindex = new LayerFidIndex();
+	int *order = NULL;
+	char *bytes = serialize(layer, index, curve, &order, fidindex);
+	if (bytes == NULL) {
+		fprintf(stderr, "Nil OGRLayer bytes.\n");
+		delete index;
+		delete fidindex;
+		return false;
+	}
+	// the value is its length int and length bytes after it.
+	int length = 0;
+	memcpy(&length, bytes, sizeof(length));
+	int featurecount = 0;
+	memcpy(&featurecount, bytes + featureSectionOffset(bytes) + sizeof(int),
+			sizeof(featurecount));
+
+	const char *indexbytes = NULL, *fidbytes = NULL;
+	if (index) {
+		index->finish();
+		indexbytes = index->getBytes();
+	}
+	if (fidindex) {
+		fidindex->finish();
+		fidbytes = fidindex->getBytes();
+	}
+	char *indexkey = suffixKey(key, ":rtree");
+	char *orderkey = suffixKey(key, ":order");
+	char *fidkey = suffixKey(key, ":fid");
+	char *logkey = suffixKey(key, ":log");
+	bool stored = indexkey && orderkey && fidkey && logkey
+			&& (index == NULL || indexbytes)
+			&& (fidindex == NULL || fidbytes);
+	if (stored) {
+		char flags[4] = { indexbytes ? '1' : '0', order ? '1' : '0',
+				fidbytes ? '1' : '0', '\0' };
+		redisReply *reply = (redisReply *) redisCommand(con_,
+				"EVAL %s 5 %s %s %s %s %s %b %b %b %b %s", PUT_LAYER_SCRIPT,
+				key, indexkey, orderkey, fidkey, logkey, bytes,
+				(size_t) length + sizeof(length), indexbytes ? indexbytes : "",
+				indexbytes ? (size_t) index->getIndexLength() : (size_t) 0,
+				order ? (const char *) order : "",
+				order ? sizeof(int) * featurecount : (size_t) 0,
+				fidbytes ? fidbytes : "",
+				fidbytes ? (size_t) fidindex->getIndexLength() : (size_t) 0,
+				flags);
+		if (reply == NULL || reply->type == REDIS_REPLY_ERROR) {
+			fprintf(stderr, "Redis eval command error: %s.\n",
+					reply ? reply->str : "no reply");
+			stored = false;
+		}
+		if (reply)
+			freeReplyObject(reply);
+	} else {
+		fprintf(stderr, "Fail to build the indexes of the layer.\n");
+	}
+	free(bytes);
+	delete index;
+	delete fidindex;
+	if (order)
+		free(order);
+	if (indexkey)
+		free(indexkey);
+	if (orderkey)
+		free(orderkey);
+	if (fidkey)
+		free(fidkey);
+	if (logkey)
+		free(logkey);
+	return stored;
+}
+
+OGRLayer *SpatialClient::getLayer(const char *key) const {
+	if (key == NULL) {
+		fprintf(stderr, "Empty key.\n");
+		return NULL;
+	}
+	int size = 0;
+	char *bytes = get(key, &size);
+	if (bytes == NULL) {
+		fprintf(stderr, "Fail to get the layer bytes.\n");
+		return NULL;
+	}
+	if (!checkLayerHead(bytes, size, true)) {
+		fprintf(stderr, "%s does not hold a layer.\n", key);
+		free(bytes);
+		return NULL;
+	}
+	LayerFidIndex *fids = getFidIndex(key);
+	LayerChangeLog *log = fids ? getChangeLog(key) : NULL;
+	OGRLayer *layer = deserialize(bytes, NULL, fids, log);
+	free(bytes);
+	delete fids;
+	delete log;
+	return layer;
+}
+
+OGRLayer *SpatialClient::getLayer(const char *key,
+		OGRDataSource *datasource) const {
+	if (key == NULL) {
+		fprintf(stderr, "Empty key.\n");
+		return NULL;
+	}
+	if (datasource == NULL) {
+		fprintf(stderr, "Nil OGRDataSource object.\n");
+		return NULL;
+	}
+	int size = 0;
+	char *bytes = get(key, &size);
+	if (bytes == NULL) {
+		fprintf(stderr, "Fail to get the layer bytes.\n");
+		return NULL;
+	}
+	if (!checkLayerHead(bytes, size, true)) {
+		fprintf(stderr, "%s does not hold a layer.\n", key);
+		free(bytes);
+		return NULL;
+	}
+	LayerFidIndex *fids = getFidIndex(key);
+	LayerChangeLog *log = fids ? getChangeLog(key) : NULL;
+	OGRLayer *layer = deserialize(bytes, datasource, fids, log);
+	free(bytes);
+	delete fids;
+	delete log;
+	return layer;
+}
+
+LayerFidIndex *SpatialClient::getFidIndex(const char *key) const {
+	char *fidkey = suffixKey(key, ":fid");
+	if (fidkey == NULL)
+		return NULL;
+	int size = 0;
+	char *fidbytes = getIfExists(con_, fidkey, &size);
+	free(fidkey);
+	if (fidbytes == NULL)
+		return NULL;
+	int indexlength = -1;
+	if (size >= LayerFidIndex::HEADER_SIZE)
+		memcpy(&indexlength, fidbytes, sizeof(indexlength));
+	LayerFidIndex *fids = NULL;
+	if (indexlength == size)
+		fids = new LayerFidIndex(fidbytes);
+	else
+		fprintf(stderr, "%s:fid does not hold a fid index.\n", key);
+	free(fidbytes);
+	return fids;
+}
+
+LayerChangeLog *SpatialClient::getChangeLog(const char *key) const {
+	char *logkey = suffixKey(key, ":log");
+	if (logkey == NULL)
+		return NULL;
+	int size = 0;
+	char *logbytes = getIfExists(con_, logkey, &size);
+	free(logkey);
+	if (logbytes == NULL)
+		return NULL;
+	LayerChangeLog *log = new LayerChangeLog();
+	if (!log->setLog(logbytes, size)) {
+		delete log;
+		log = NULL;
+	}
+	free(logbytes);
+	return log;
+}
+
+bool SpatialClient::getLayerGeoJson(const char *key,
+		GeoJsonWriter *writer) const {
+	if (key == NULL) {
+		fprintf(stderr, "Empty key.\n");
+		return false;
+	}
+	if (writer == NULL) {
+		fprintf(stderr, "Nil GeoJsonWriter object.\n");
+		return false;
+	}
+	int size = 0;
+	char *bytes = get(key, &size);
+	if (bytes == NULL) {
+		fprintf(stderr, "Fail to get the layer bytes.\n");
+		return false;
+	}
+	if (!checkNoChangeLog(con_, key)) {
+		free(bytes);
+		return false;
+	}
+	bool written = writer->writeLayer(bytes, size);
+	free(bytes);
+	return written;
+}
+
+int *SpatialClient::getFeatureOrder(const char *key, int *count) const {
+	if (key == NULL) {
+		fprintf(stderr, "Empty key.\n");
+		return NULL;
+	}
+	char *orderkey = suffixKey(key, ":order");
+	if (orderkey == NULL)
+		return NULL;
+	int size = 0;
+	char *bytes = get(orderkey, &size);
+	free(orderkey);
+	if (bytes == NULL) {
+		fprintf(stderr, "Fail to get the feature order bytes.\n");
+		return NULL;
+	}
+	if (count)
+		*count = size / sizeof(int);
+	return (int *) bytes;
+}
+
+LayerAllFeatures *SpatialClient::getFeaturesInBBox(const char *key,
+		double minx, double miny, double maxx, double maxy) const {
+	if (key == NULL) {
+		fprintf(stderr, "Empty key.\n");
+		return NULL;
+	}
+	if (con_ == NULL) {
+		fprintf(stderr, "Redis connection is not available.\n");
+		return NULL;
+	}
+	if (!checkNoChangeLog(con_, key))
+		return NULL;
+	char *indexkey = suffixKey(key, ":rtree");
+	if (indexkey == NULL)
+		return NULL;
+	int indexsize = 0;
+	char *indexbytes = get(indexkey, &indexsize);
+	free(indexkey);
+	if (indexbytes == NULL) {
+		fprintf(stderr, "Fail to get the spatial index bytes.\n");
+		return NULL;
+	}
+	LayerSpatialIndex index(indexbytes, indexsize);
+	free(indexbytes);
+
+	int *items = NULL;
+	int featurecount = index.search(minx, miny, maxx, maxy, &items);
+	ByteRange *features = (ByteRange *) malloc(
+			sizeof(ByteRange) * (featurecount + 1));
+	if (features == NULL) {
+		fprintf(stderr, "Fail to alloc memory for feature ranges.\n");
+		free(items);
+		return NULL;
+	}
+	for (int i = 0; i < featurecount; ++i) {
+		features[i].offset_ = index.getItemOffset(items[i]);
+		features[i].size_ = index.getItemSize(items[i]);
+	}
+	free(items);
+	// stored order, so that neighbouring features share one range read.
+	qsort(features, featurecount, sizeof(ByteRange), compareByteRange);
+
+	LayerAllFeatures *allfeatures = readFeatures(con_, key, features,
+			featurecount);
+	free(features);
+	return allfeatures;
+}
+
+typedef struct {
+	long long fid_;
+	int request_; // position among the fids asked for
+	int slot_; // next slot to read, -1 once the probe ended
+	bool reading_;
+	int item_; // the stored position of the feature, -1 until found
+	int offset_, size_;
+} FidProbe;
+
+static int compareFidProbe(const void *a, const void *b) {
+	return ((const FidProbe *) a)->offset_ - ((const FidProbe *) b)->offset_;
+}
+
+// finds the features of the probes in the fid index under fidkey, reading
+// its header and the slots probed only. false, with the reason on stderr,
+// on failure; a fid the layer does not hold keeps item_ -1.
+static bool probeFids(const SpatialClient *client, redisContext *con,
+		const char *fidkey, FidProbe *probes, int probecount) {
+	int headersize = 0;
+	char *header = client->getRange(fidkey, 0,
+			LayerFidIndex::HEADER_SIZE - 1, &headersize);
+	if (header == NULL || headersize < LayerFidIndex::HEADER_SIZE) {
+		fprintf(stderr, "Fail to get the fid index bytes.\n");
+		if (header)
+			free(header);
+		return false;
+	}
+	int itemcount = 0, slotcount = 0;
+	memcpy(&itemcount, header + sizeof(int), sizeof(itemcount));
+	memcpy(&slotcount, header + 2 * sizeof(int), sizeof(slotcount));
+	free(header);
+
+	for (int i = 0; i < probecount; ++i) {
+		FidProbe &probe = probes[i];
+		probe.slot_ =
+				slotcount > 0 ?
+						LayerFidIndex::getHomeSlot(probe.fid_, slotcount) : -1;
+		probe.item_ = -1;
+		probe.offset_ = probe.size_ = 0;
+	}
+
+	// every round reads the next slots of all unfinished probes with one
+	// pipelined GETRANGE each; a probe ends at its fid or an empty slot, and
+	// has read every slot after one round more than the table takes.
+	bool failed = false;
+	int roundcount = slotcount / FID_PROBE_SLOTS + 2;
+	for (int round = 0; !failed && round < roundcount; ++round) {
+		int readcount = 0;
+		for (int i = 0; i < probecount; ++i) {
+			FidProbe &probe = probes[i];
+			probe.reading_ = probe.slot_ >= 0;
+			if (!probe.reading_)
+				continue;
+			int count = slotcount - probe.slot_;
+			if (count > FID_PROBE_SLOTS)
+				count = FID_PROBE_SLOTS;
+			int start = LayerFidIndex::getSlotOffset(itemcount, probe.slot_);
+			redisAppendCommand(con, "GETRANGE %s %d %d", fidkey, start,
+					start + count * LayerFidIndex::SLOT_SIZE - 1);
+			++readcount;
+		}
+		if (readcount == 0)
+			break;
+		for (int i = 0; i < probecount; ++i) {
+			FidProbe &probe = probes[i];
+			if (!probe.reading_)
+				continue;
+			redisReply *reply = NULL;
+			if (redisGetReply(con, (void **) &reply) != REDIS_OK
+					|| reply == NULL || reply->type != REDIS_REPLY_STRING
+					|| reply->len < (size_t) LayerFidIndex::SLOT_SIZE) {
+				fprintf(stderr, "Redis reply error: not a string.\n");
+				failed = true;
+				probe.slot_ = -1;
+			}
+			int count = failed ? 0 : reply->len / LayerFidIndex::SLOT_SIZE;
+			for (int j = 0; j < count; ++j) {
+				long long fid = 0;
+				int item = 0, offset = 0, size = 0;
+				LayerFidIndex::readSlot(
+						reply->str + j * LayerFidIndex::SLOT_SIZE, &fid, &item,
+						&offset, &size);
+				if (item < 0 || fid == probe.fid_) {
+					probe.item_ = item;
+					probe.offset_ = offset;
+					probe.size_ = size;
+					probe.slot_ = -1;
+					break;
+				}
+			}
+			if (probe.slot_ >= 0)
+				probe.slot_ = (probe.slot_ + count) & (slotcount - 1);
+			if (reply)
+				freeReplyObject(reply);
+		}
+	}
+	return !failed;
+}
+
+// a feature entry for the geometry, its size in *size. free() by caller.
+static char *encodeFeatureEntry(const OGRGeometry *geometry, int *size) {
+	int geometrytype = (int) geometry->getGeometryType();
+	int wkbsize = geometry->WkbSize();
+	*size = sizeof(geometrytype) + sizeof(wkbsize) + wkbsize;
+	char *entry = (char *) malloc(*size);
+	if (entry == NULL) {
+		fprintf(stderr, "Fail to alloc memory for feature entry.\n");
+		return NULL;
+	}
+	memcpy(entry, &geometrytype, sizeof(geometrytype));
+	memcpy(entry + sizeof(geometrytype), &wkbsize, sizeof(wkbsize));
+	geometry->exportToWkb((OGRwkbByteOrder) wkbNDR,
+			(unsigned char *) (entry + sizeof(geometrytype) + sizeof(wkbsize)));
+	return entry;
+}
+
+// the features with the geometries logged for their fids in place of their
+// own.
+static void mergeLoggedGeometries(LayerAllFeatures *allfeatures,
+		const long long *fids, const LayerChangeLog & log) {
+	int featurecount = allfeatures->getFeatureCount();
+	int featurelength = sizeof(featurelength) + sizeof(featurecount);
+	bool logged = false;
+	for (int i = 0; i < featurecount; ++i) {
+		const char *entry = log.getGeometry(fids[i]);
+		int wkbsize = allfeatures->getFeature(i)->wkbsize_;
+		if (entry) {
+			memcpy(&wkbsize, entry + sizeof(int), sizeof(wkbsize));
+			logged = true;
+		}
+		featurelength += 2 * sizeof(int) + wkbsize;
+	}
+	if (!logged)
+		return;
+
+	char *bytes = (char *) malloc(featurelength);
+	if (bytes == NULL) {
+		fprintf(stderr, "Fail to alloc memory for bytes.\n");
+		return;
+	}
+	int offset = 0;
+	memcpy(bytes + offset, &featurelength, sizeof(featurelength));
+	offset += sizeof(featurelength);
+	memcpy(bytes + offset, &featurecount, sizeof(featurecount));
+	offset += sizeof(featurecount);
+	for (int i = 0; i < featurecount; ++i) {
+		const char *entry = log.getGeometry(fids[i]);
+		if (entry) {
+			int wkbsize = 0;
+			memcpy(&wkbsize, entry + sizeof(int), sizeof(wkbsize));
+			memcpy(bytes + offset, entry, 2 * sizeof(int) + wkbsize);
+			offset += 2 * sizeof(int) + wkbsize;
+			continue;
+		}
+		const LayerFeature *feature = allfeatures->getFeature(i);
+		memcpy(bytes + offset, &feature->geometrytype_, sizeof(int));
+		offset += sizeof(int);
+		memcpy(bytes + offset, &feature->wkbsize_, sizeof(int));
+		offset += sizeof(int);
+		memcpy(bytes + offset, feature->wkbbytes_, feature->wkbsize_);
+		offset += feature->wkbsize_;
+	}
+	assert(offset == featurelength);
+	allfeatures->setAllFeatures(bytes);
+	free(bytes);
+}
+
+LayerAllFeatures *SpatialClient::getFeatureByFid(const char *key,
+		long long fid) const {
+	return getFeaturesByFid(key, &fid, 1);
+}
+
+LayerAllFeatures *SpatialClient::getFeaturesByFid(const char *key,
+		const long long *fids, int fidcount) const {
+	if (key == NULL) {
+		fprintf(stderr, "Empty key.\n");
+		return NULL;
+	}
+	if (fids == NULL && fidcount > 0) {
+		fprintf(stderr, "Nil fids.\n");
+		return NULL;
+	}
+	if (con_ == NULL) {
+		fprintf(stderr, "Redis connection is not available.\n");
+		return NULL;
+	}
+	char *fidkey = suffixKey(key, ":fid");
+	if (fidkey == NULL)
+		return NULL;
+	FidProbe *probes = (FidProbe *) malloc(sizeof(FidProbe) * (fidcount + 1));
+	if (probes == NULL) {
+		fprintf(stderr, "Fail to alloc memory for fid probes.\n");
+		free(fidkey);
+		return NULL;
+	}
+	for (int i = 0; i < fidcount; ++i) {
+		probes[i].fid_ = fids[i];
+		probes[i].request_ = i;
+	}
+	bool probed = probeFids(this, con_, fidkey, probes, fidcount);
+	free(fidkey);
+	if (!probed) {
+		free(probes);
+		return NULL;
+	}
+
+	// stored order, so that neighbouring features share one range read,
+	// then back to the order asked for.
+	int foundcount = 0;
+	for (int i = 0; i < fidcount; ++i) {
+		if (probes[i].item_ >= 0)
+			probes[foundcount++] = probes[i];
+	}
+	qsort(probes, foundcount, sizeof(FidProbe), compareFidProbe);
+	ByteRange *features = (ByteRange *) malloc(
+			sizeof(ByteRange) * (foundcount + 1));
+	int *positions = (int *) malloc(sizeof(int) * (fidcount + 1));
+	int *order = (int *) malloc(sizeof(int) * (foundcount + 1));
+	long long *foundfids = (long long *) malloc(
+			sizeof(long long) * (foundcount + 1));
+	if (features == NULL || positions == NULL || order == NULL
+			|| foundfids == NULL) {
+		fprintf(stderr, "Fail to alloc memory for feature ranges.\n");
+		free(probes);
+		free(features);
+		free(positions);
+		free(order);
+		free(foundfids);
+		return NULL;
+	}
+	for (int i = 0; i < fidcount; ++i)
+		positions[i] = -1;
+	for (int i = 0; i < foundcount; ++i) {
+		features[i].offset_ = probes[i].offset_;
+		features[i].size_ = probes[i].size_;
+		positions[probes[i].request_] = i;
+	}
+	int ordercount = 0;
+	for (int i = 0; i < fidcount; ++i) {
+		if (positions[i] >= 0) {
+			foundfids[ordercount] = fids[i];
+			order[ordercount++] = positions[i];
+		}
+	}
+	free(probes);
+	free(positions);
+
+	LayerAllFeatures *allfeatures = readFeatures(con_, key, features,
+			foundcount);
+	LayerChangeLog *log = allfeatures ? getChangeLog(key) : NULL;
+	if (allfeatures)
+		allfeatures->reorder(order);
+	if (log)
+		mergeLoggedGeometries(allfeatures, foundfids, *log);
+	delete log;
+	free(features);
+	free(order);
+	free(foundfids);
+	return allfeatures;
+}
+
+// the byte ranges of all features of a layer value, from the spatial index
+// if there is one, else from the features section.
+static ByteRange *getFeatureRanges(const SpatialClient *client,
+		const char *key, int featureoffset, int featurelength,
+		int featurecount) {
+	if (featurecount < 0 || featurelength < (int) sizeof(int)) {
+		fprintf(stderr, "%s does not hold a layer.\n", key);
+		return NULL;
+	}
+	ByteRange *features = (ByteRange *) malloc(
+			sizeof(ByteRange) * ((size_t) featurecount + 1));
+	if (features == NULL) {
+		fprintf(stderr, "Fail to alloc memory for feature ranges.\n");
+		return NULL;
+	}
+	char *indexkey = suffixKey(key, ":rtree");
+	int indexsize = 0;
+	char *indexbytes = indexkey ? client->get(indexkey, &indexsize) : NULL;
+	if (indexkey)
+		free(indexkey);
+	if (indexbytes) {
+		LayerSpatialIndex index(indexbytes, indexsize);
+		free(indexbytes);
+		// features without a geometry are not indexed.
+		if (index.getItemCount() == featurecount) {
+			for (int i = 0; i < featurecount; ++i) {
+				features[i].offset_ = index.getItemOffset(i);
+				features[i].size_ = index.getItemSize(i);
+			}
+			qsort(features, featurecount, sizeof(ByteRange), compareByteRange);
+			return features;
+		}
+	}
+
+	int start = featureoffset + 2 * sizeof(int);
+	int size = 0;
+	char *bytes = client->getRange(key, start,
+			featureoffset + sizeof(int) + featurelength - 1, &size);
+	if (bytes == NULL) {
+		free(features);
+		return NULL;
+	}
+	int *offsets = scanFeatureOffsets(bytes, featurecount, size);
+	free(bytes);
+	if (offsets == NULL) {
+		free(features);
+		return NULL;
+	}
+	for (int i = 0; i < featurecount; ++i) {
+		features[i].offset_ = start + offsets[i];
+		features[i].size_ = offsets[i + 1] - offsets[i];
+	}
+	free(offsets);
+	return features;
+}
+
+// LayerAllRecords of the given rows of serialized records.
+static LayerAllRecords *selectRecords(const char *bytes, int length,
+		const int *rows, int rowcount) {
+	int subsetlength = 0;
+	char *subset = RecordFilter::copyRows(bytes, length, rows, rowcount,
+			&subsetlength);
+	if (subset == NULL)
+		return NULL;
+	LayerAllRecords *allrecords = new LayerAllRecords(subset);
+	free(subset);
+	return allrecords;
+}
+
+// the field count of the attribute definition at attrdef of a layer value,
+// whose fields end at end, before featurelength, checked field by field;
+// with titles and types not NULL, the titles, pointing into attrdef, and
+// types of the fields too. -1 when attrdef does not hold one.
+static int readAttrDefFields(const char *attrdef, int end,
+		const char **titles, char *types) {
+	int offset = sizeof(int);
+	int fieldcount = -1;
+	if (end >= offset + (int) sizeof(fieldcount))
+		memcpy(&fieldcount, attrdef + offset, sizeof(fieldcount));
+	offset += sizeof(fieldcount);
+	// a title of one zero, its width and decimals and its type at least.
+	int minfieldsize = 3 * sizeof(int) + 2;
+	if (fieldcount < 0 || fieldcount > (end - offset) / minfieldsize)
+		return -1;
+	for (int i = 0; i < fieldcount; ++i) {
+		int titlelength = 0;
+		if (end - offset < (int) sizeof(titlelength))
+			return -1;
+		memcpy(&titlelength, attrdef + offset, sizeof(titlelength));
+		offset += sizeof(titlelength);
+		if (titlelength <= 0
+				|| titlelength > end - offset - (int) (2 * sizeof(int)) - 1
+				|| attrdef[offset + titlelength - 1] != '\0')
+			return -1;
+		if (titles)
+			titles[i] = attrdef + offset;
+		offset += titlelength + 2 * sizeof(int);
+		if (types)
+			types[i] = attrdef[offset];
+		offset += sizeof(char);
+	}
+	return offset == end ? fieldcount : -1;
+}
+
+LayerAllFeatures *SpatialClient::getFeaturesWhere(const char *key,
+		const char *where, LayerAllRecords **records) const {
+	if (records)
+		*records = NULL;
+	if (key == NULL) {
+		fprintf(stderr, "Empty key.\n");
+		return NULL;
+	}
+	if (con_ == NULL) {
+		fprintf(stderr, "Redis connection is not available.\n");
+		return NULL;
+	}
+	if (!checkNoChangeLog(con_, key))
+		return NULL;
+
+	// attribute definition, featurelength and featurecount.
+	int size = 0;
+	char *bytes = getRange(key, 0, LAYER_HEAD_SIZE + sizeof(int) - 1, &size);
+	if (bytes == NULL)
+		return NULL;
+	if (size != LAYER_HEAD_SIZE + (int) sizeof(int)
+			|| !checkLayerHead(bytes, size, false)) {
+		fprintf(stderr, "%s does not hold a layer.\n", key);
+		free(bytes);
+		return NULL;
+	}
+	int metadatalength = 0;
+	memcpy(&metadatalength, bytes + LAYER_HEAD_SIZE, sizeof(metadatalength));
+	free(bytes);
+	int attrdefoffset = LAYER_HEAD_SIZE + sizeof(int) + metadatalength;
+	bytes = getRange(key, attrdefoffset, attrdefoffset + sizeof(int) - 1,
+			&size);
+	if (bytes == NULL)
+		return NULL;
+	int attrdeflength = -1;
+	if (size == (int) sizeof(attrdeflength))
+		memcpy(&attrdeflength, bytes, sizeof(attrdeflength));
+	free(bytes);
+	if (metadatalength < 0 || attrdeflength < 0
+			|| attrdefoffset + (long long) attrdeflength + 3 * sizeof(int)
+					> LAYER_MAX_LENGTH) {
+		fprintf(stderr, "%s does not hold a layer.\n", key);
+		return NULL;
+	}
+	int featureoffset = attrdefoffset + sizeof(int) + attrdeflength;
+	char *attrdef = getRange(key, attrdefoffset,
+			featureoffset + 2 * sizeof(int) - 1, &size);
+	if (attrdef == NULL)
+		return NULL;
+	int offset = sizeof(int) + attrdeflength;
+	int fieldcount =
+			size == attrdeflength + (int) (3 * sizeof(int)) ?
+					readAttrDefFields(attrdef, offset, NULL, NULL) : -1;
+	if (fieldcount < 0) {
+		fprintf(stderr, "%s does not hold a layer.\n", key);
+		free(attrdef);
+		return NULL;
+	}
+	const char **titles = (const char **) malloc(
+			sizeof(char *) * (fieldcount + 1));
+	char *types = (char *) malloc(fieldcount + 1);
+	if (titles == NULL || types == NULL) {
+		fprintf(stderr, "Fail to alloc memory for filter fields.\n");
+		if (titles)
+			free(titles);
+		if (types)
+			free(types);
+		free(attrdef);
+		return NULL;
+	}
+	readAttrDefFields(attrdef, offset, titles, types);
+	int featurelength = 0;
+	memcpy(&featurelength, attrdef + offset, sizeof(featurelength));
+	offset += sizeof(featurelength);
+	int featurecount = 0;
+	memcpy(&featurecount, attrdef + offset, sizeof(featurecount));
+
+	RecordFilter filter;
+	bool compiled = filter.compile(where, titles, types, fieldcount);
+	free(titles);
+	free(types);
+	free(attrdef);
+	if (!compiled)
+		return NULL;
+
+	// one scan of the records picks the rows.
+	int recordoffset = featureoffset + 2 * sizeof(int) + featurelength;
+	int recordsize = 0;
+	char *recordbytes = getRange(key, recordoffset, -1, &recordsize);
+	if (recordbytes == NULL)
+		return NULL;
+	int *rows = NULL;
+	int rowcount = filter.select(recordbytes, recordsize, &rows);
+	if (rowcount < 0) {
+		free(recordbytes);
+		return NULL;
+	}
+
+	if (records)
+		*records = selectRecords(recordbytes, recordsize, rows, rowcount);
+	free(recordbytes);
+
+	// then only the matching features are read.
+	LayerAllFeatures *allfeatures = NULL;
+	ByteRange *features = getFeatureRanges(this, key, featureoffset,
+			featurelength, featurecount);
+	if (features) {
+		for (int i = 0; i < rowcount; ++i)
+			features[i] = features[rows[i]];
+		allfeatures = readFeatures(con_, key, features, rowcount);
+		free(features);
+	}
+	free(rows);
+	if (allfeatures == NULL && records) {
+		delete *records;
+		*records = NULL;
+	}
+	return allfeatures;
+}
+
+// the features and records of a SC.BBOX or SC.FILTER reply.
+static LayerAllFeatures *readSelection(redisReply *reply,
+		LayerAllRecords **records) {
+	if (reply == NULL || reply->type != REDIS_REPLY_ARRAY
+			|| reply->elements != 2
+			|| reply->element[0]->type != REDIS_REPLY_STRING
+			|| reply->element[1]->type != REDIS_REPLY_STRING) {
+		if (reply && reply->type == REDIS_REPLY_ERROR)
+			fprintf(stderr, "Redis reply error: %s.\n", reply->str);
+		else
+			fprintf(stderr, "Redis reply error: not a layer selection.\n");
+		if (reply)
+			freeReplyObject(reply);
+		return NULL;
+	}
+	LayerAllFeatures *allfeatures = new LayerAllFeatures(
+			reply->element[0]->str);
+	if (records)
+		*records = new LayerAllRecords(reply->element[1]->str);
+	freeReplyObject(reply);
+	return allfeatures;
+}
+
+LayerAllFeatures *SpatialClient::getServerFeaturesInBBox(const char *key,
+		double minx, double miny, double maxx, double maxy,
+		LayerAllRecords **records) const {
+	if (records)
+		*records = NULL;
+	if (key == NULL) {
+		fprintf(stderr, "Empty key.\n");
+		return NULL;
+	}
+	if (con_ == NULL) {
+		fprintf(stderr, "Redis connection is not available.\n");
+		return NULL;
+	}
+	// shortest round trip text, so that the server sees the same doubles.
+	double values[4] = { minx, miny, maxx, maxy };
+	char bounds[4][32];
+	for (int i = 0; i < 4; ++i)
+		bounds[i][formatDouble(values[i], -1, bounds[i])] = '\0';
+	char *indexkey = suffixKey(key, ":rtree");
+	char *logkey = suffixKey(key, ":log");
+	redisReply *reply = indexkey && logkey ?
+			(redisReply *) redisCommand(con_, "SC.BBOX %s %s %s %s %s %s %s",
+					key, indexkey, logkey, bounds[0], bounds[1], bounds[2],
+					bounds[3]) :
+			NULL;
+	if (indexkey)
+		free(indexkey);
+	if (logkey)
+		free(logkey);
+	return readSelection(reply, records);
+}
+
+LayerAllFeatures *SpatialClient::getServerFeaturesWhere(const char *key,
+		const char *where, LayerAllRecords **records) const {
+	if (records)
+		*records = NULL;
+	if (key == NULL || where == NULL) {
+		fprintf(stderr, "Empty key or filter.\n");
+		return NULL;
+	}
+	if (con_ == NULL) {
+		fprintf(stderr, "Redis connection is not available.\n");
+		return NULL;
+	}
+	char *logkey = suffixKey(key, ":log");
+	redisReply *reply = logkey ?
+			(redisReply *) redisCommand(con_, "SC.FILTER %s %s %s", key, logkey,
+					where) :
+			NULL;
+	if (logkey)
+		free(logkey);
+	return readSelection(reply, records);
+}
+
+typedef struct StreamChunk {
+	char *features_;
+	int featurelength_, featurecapacity_;
+	char *records_;
+	int recordlength_, recordcapacity_;
+	struct StreamChunk *next_;
+} StreamChunk;
+
+typedef struct {
+	const SpatialClient *client_;
+	const char *valuekey_; // the value being built
+	const char *recordkey_; // its records, appended to it at the end
+	LayerSpatialIndex *index_;
+	LayerFidIndex *fidindex_;
+	int featureoffset_; // offset of the next feature in the value
+	int featuretotal_, recordtotal_;
+	int headlength_; // and a record type per field, to bound the value
+
+	StreamChunk *filling_; // filled by the sink
+	StreamChunk *first_, *last_; // queued for the writer, oldest first
+	int queued_;
+	bool finished_, failed_;
+	pthread_mutex_t mutex_;
+	pthread_cond_t cond_;
+} StreamJob;
+
+static void freeStreamChunk(StreamChunk *chunk) {
+	free(chunk->features_);
+	free(chunk->records_);
+	free(chunk);
+}
+
+static bool appendStreamBytes(char **bytes, int *length, int *capacity,
+		const char *data, int size) {
+	if (*length + size > *capacity) {
+		int newcapacity = *capacity ? *capacity : STREAM_CHUNK_SIZE / 2;
+		while (newcapacity < *length + size)
+			newcapacity *= 2;
+		char *newbytes = (char *) realloc(*bytes, newcapacity);
+		if (newbytes == NULL) {
+			fprintf(stderr, "Fail to alloc memory for stream chunk.\n");
+			return false;
+		}
+		*bytes = newbytes;
+		*capacity = newcapacity;
+	}
+	memcpy(*bytes + *length, data, size);
+	*length += size;
+	return true;
+}
+
+// hands the filled chunk to the writer, waiting while the window is full.
+static bool queueStreamChunk(StreamJob *job) {
+	StreamChunk *chunk = job->filling_;
+	job->filling_ = NULL;
+	pthread_mutex_lock(&job->mutex_);
+	while (job->queued_ >= STREAM_WINDOW && !job->failed_)
+		pthread_cond_wait(&job->cond_, &job->mutex_);
+	bool failed = job->failed_;
+	if (!failed) {
+		if (job->last_)
+			job->last_->next_ = chunk;
+		else
+			job->first_ = chunk;
+		job->last_ = chunk;
+		++job->queued_;
+		pthread_cond_broadcast(&job->cond_);
+	}
+	pthread_mutex_unlock(&job->mutex_);
+	if (failed)
+		freeStreamChunk(chunk);
+	return !failed;
+}
+
+// the encoder sink: batches are gathered into chunks, on the reading thread.
+static bool streamBatch(const EncoderBatch & batch, void *context) {
+	StreamJob *job = (StreamJob *) context;
+	// stopped before any length or offset of the value overflows.
+	if ((long long) job->headlength_ + 8 * sizeof(int) + job->featuretotal_
+			+ job->recordtotal_ + batch.featurelength_ + batch.recordlength_
+			> LAYER_MAX_LENGTH) {
+		fprintf(stderr, "Layer passes the %lld bytes of a layer value.\n",
+				LAYER_MAX_LENGTH);
+		return false;
+	}
+	for (int i = 0; (job->index_ || job->fidindex_) && i < batch.encoded_;
+			++i) {
+		const double *envelope = batch.envelopes_ + 4 * i;
+		if (job->index_)
+			job->index_->add(envelope[0], envelope[1], envelope[2],
+					envelope[3], job->featureoffset_, batch.featuresizes_[i]);
+		if (job->fidindex_)
+			job->fidindex_->add(batch.fids_[i], job->featureoffset_,
+					batch.featuresizes_[i]);
+		job->featureoffset_ += batch.featuresizes_[i];
+	}
+	job->featuretotal_ += batch.featurelength_;
+	job->recordtotal_ += batch.recordlength_;
+
+	if (job->filling_ == NULL) {
+		job->filling_ = (StreamChunk *) calloc(1, sizeof(StreamChunk));
+		if (job->filling_ == NULL) {
+			fprintf(stderr, "Fail to alloc memory for stream chunk.\n");
+			return false;
+		}
+	}
+	StreamChunk *chunk = job->filling_;
+	if (!appendStreamBytes(&chunk->features_, &chunk->featurelength_,
+			&chunk->featurecapacity_, batch.featurebytes_,
+			batch.featurelength_)
+			|| !appendStreamBytes(&chunk->records_, &chunk->recordlength_,
+					&chunk->recordcapacity_, batch.recordbytes_,
+					batch.recordlength_))
+		return false;
+	if (chunk->featurelength_ + chunk->recordlength_ >= STREAM_CHUNK_SIZE)
+		return queueStreamChunk(job);
+	return true;
+}
+
+void *SpatialClient::putStreamWriter(void *arg) {
+	StreamJob *job = (StreamJob *) arg;
+	redisContext *con = job->client_->openConnection();
+	bool failed = con == NULL;
+
+	int pending = 0;
+	while (!failed) {
+		pthread_mutex_lock(&job->mutex_);
+		while (job->first_ == NULL && !job->finished_)
+			pthread_cond_wait(&job->cond_, &job->mutex_);
+		StreamChunk *chunk = job->first_;
+		if (chunk) {
+			job->first_ = chunk->next_;
+			if (job->first_ == NULL)
+				job->last_ = NULL;
+			--job->queued_;
+			pthread_cond_broadcast(&job->cond_);
+		}
+		pthread_mutex_unlock(&job->mutex_);
+		if (chunk == NULL)
+			break;
+
+		if (chunk->featurelength_ > 0) {
+			redisAppendCommand(con, "APPEND %s %b", job->valuekey_,
+					chunk->features_, (size_t) chunk->featurelength_);
+			++pending;
+		}
+		if (chunk->recordlength_ > 0) {
+			redisAppendCommand(con, "APPEND %s %b", job->recordkey_,
+					chunk->records_, (size_t) chunk->recordlength_);
+			++pending;
+		}
+		freeStreamChunk(chunk);
+		if (pending >= STREAM_PIPELINE) {
+			failed = !getReplies(con, pending);
+			pending = 0;
+		}
+	}
+	if (!failed && !getReplies(con, pending))
+		failed = true;
+	if (con)
+		redisFree(con);
+
+	if (failed) {
+		pthread_mutex_lock(&job->mutex_);
+		job->failed_ = true;
+		pthread_cond_broadcast(&job->cond_);
+		pthread_mutex_unlock(&job->mutex_);
+	}
+	return NULL;
+}
+
+// appends the record header and the records to the value, fills in the
+// lengths and puts the value in place of the old one, all at once. the
+// staged spatial and fid indexes replace those of the old value, or those
+// are removed, with its order and change log.
+static const char *STREAM_FINISH_SCRIPT =
+		"redis.call('APPEND', KEYS[1], ARGV[1]) "
+				"local records = redis.call('GET', KEYS[2]) "
+				"if records then redis.call('APPEND', KEYS[1], records) end "
+				"redis.call('SETRANGE', KEYS[1], 0, ARGV[2]) "
+				"redis.call('SETRANGE', KEYS[1], ARGV[3], ARGV[4]) "
+				"redis.call('DEL', KEYS[2]) "
+				"redis.call('RENAME', KEYS[1], KEYS[3]) "
+				"for i = 4, 5 do "
+				"if redis.call('EXISTS', KEYS[i]) == 1 then "
+				"redis.call('RENAME', KEYS[i], KEYS[i + 2]) "
+				"else redis.call('DEL', KEYS[i + 2]) end end "
+				"redis.call('DEL', KEYS[8], KEYS[9]) "
+				"return 1";
+
+bool SpatialClient::putLayerStream(const char *key, OGRLayer *layer,
+		int options) const {
+	if (key == NULL) {
+		fprintf(stderr, "Empty key.\n");
+		return false;
+	}
+	if (layer == NULL) {
+		fprintf(stderr, "Empty OGRLayer.\n");
+		return false;
+	}
+	if (options & (PUT_HILBERT_ORDER | PUT_MORTON_ORDER)) {
+		fprintf(stderr, "Curve orders need the whole layer, use putLayer.\n");
+		return false;
+	}
+	if (con_ == NULL) {
+		fprintf(stderr, "Redis connection is not available.\n");
+		return false;
+	}
+
+	// every import builds its value under keys of its own version, so that
+	// imports of one key never mix and readers see the old value until the
+	// new one is complete.
+	char *versionkey = suffixKey(key, ":stream");
+	if (versionkey == NULL)
+		return false;
+	redisReply *reply = (redisReply *) redisCommand(con_, "INCR %s",
+			versionkey);
+	if (reply == NULL || reply->type != REDIS_REPLY_INTEGER) {
+		fprintf(stderr, "Redis incr command error.\n");
+		if (reply)
+			freeReplyObject(reply);
+		free(versionkey);
+		return false;
+	}
+	char *valuekey = (char *) malloc(strlen(versionkey) + 32);
+	char *recordkey = (char *) malloc(strlen(versionkey) + 48);
+	if (valuekey == NULL || recordkey == NULL) {
+		fprintf(stderr, "Fail to alloc memory for key.\n");
+		freeReplyObject(reply);
+		free(versionkey);
+		free(valuekey);
+		free(recordkey);
+		return false;
+	}
+	sprintf(valuekey, "%s:%lld", versionkey, (long long) reply->integer);
+	sprintf(recordkey, "%s:records", valuekey);
+	freeReplyObject(reply);
+	free(versionkey);
+
+	// the value starts with its head; the length, the feature length and
+	// the feature count are filled in at the end.
+	int headlength = 0;
+	char *head = encodeLayerHead(layer, &headlength);
+	int startlength = sizeof(int) + headlength + 2 * sizeof(int);
+	char *start = head ? (char *) calloc(startlength, 1) : NULL;
+	bool succeeded = start != NULL;
+	if (start) {
+		memcpy(start + sizeof(int), head, headlength);
+		succeeded = put(valuekey, start, startlength);
+	}
+	if (head)
+		free(head);
+	if (start)
+		free(start);
+
+	StreamJob job;
+	memset(&job, 0, sizeof(job));
+	job.client_ = this;
+	job.valuekey_ = valuekey;
+	job.recordkey_ = recordkey;
+	job.featureoffset_ = startlength;
+	job.headlength_ = headlength + layer->GetLayerDefn()->GetFieldCount();
+	if (options & PUT_SPATIAL_INDEX)
+		job.index_ = new LayerSpatialIndex();
+	if (options & PUT_FID_INDEX)
+		job.fidindex_ = new LayerFidIndex();
+	pthread_mutex_init(&job.mutex_, NULL);
+	pthread_cond_init(&job.cond_, NULL);
+
+	// the layer is read and encoded on this thread and the encoder's
+	// workers while the writer sends the chunks before.
+	pthread_t writer;
+	if (succeeded && pthread_create(&writer, NULL, putStreamWriter, &job) != 0) {
+		fprintf(stderr, "Fail to start stream writer.\n");
+		succeeded = false;
+	}
+	int featurecount = 0;
+	char *recordtypes = NULL;
+	if (succeeded) {
+		LayerEncoder encoder(layer, true,
+				job.index_ != NULL || job.fidindex_ != NULL);
+		encoder.setSink(streamBatch, &job);
+		succeeded = encoder.encode();
+		if (succeeded && job.filling_)
+			succeeded = queueStreamChunk(&job);
+		featurecount = encoder.getFeatureCount();
+		// fixed-stride rows carry their types in the records header.
+		if (succeeded && encoder.getRecordStride() > 0) {
+			recordtypes = (char *) malloc(encoder.getFieldCount() + 1);
+			if (recordtypes)
+				memcpy(recordtypes, encoder.getFieldTypes(),
+						encoder.getFieldCount());
+			else
+				succeeded = false;
+		}
+
+		pthread_mutex_lock(&job.mutex_);
+		job.finished_ = true;
+		if (!succeeded)
+			job.failed_ = true;
+		pthread_cond_broadcast(&job.cond_);
+		pthread_mutex_unlock(&job.mutex_);
+		pthread_join(writer, NULL);
+		succeeded = succeeded && !job.failed_;
+	}
+	if (job.filling_)
+		freeStreamChunk(job.filling_);
+	while (job.first_) {
+		StreamChunk *next = job.first_->next_;
+		freeStreamChunk(job.first_);
+		job.first_ = next;
+	}
+	pthread_mutex_destroy(&job.mutex_);
+	pthread_cond_destroy(&job.cond_);
+
+	// the indexes are staged beside the value, under keys of its version.
+	char *stagedindexkey = suffixKey(valuekey, ":rtree");
+	char *stagedfidkey = suffixKey(valuekey, ":fid");
+	char *indexkey = suffixKey(key, ":rtree");
+	char *fidkey = suffixKey(key, ":fid");
+	char *orderkey = suffixKey(key, ":order");
+	char *logkey = suffixKey(key, ":log");
+	if (stagedindexkey == NULL || stagedfidkey == NULL || indexkey == NULL
+			|| fidkey == NULL || orderkey == NULL || logkey == NULL)
+		succeeded = false;
+	if (succeeded && job.index_) {
+		job.index_->finish();
+		const char *indexbytes = job.index_->getBytes();
+		succeeded = indexbytes
+				&& put(stagedindexkey, indexbytes, job.index_->getIndexLength());
+	}
+	if (succeeded && job.fidindex_) {
+		job.fidindex_->finish();
+		const char *fidbytes = job.fidindex_->getBytes();
+		succeeded = fidbytes
+				&& put(stagedfidkey, fidbytes, job.fidindex_->getIndexLength());
+	}
+
+	if (succeeded) {
+		// the same lengths serialize() writes.
+		int fieldcount = layer->GetLayerDefn()->GetFieldCount();
+		int featurelength = sizeof(featurecount) + job.featuretotal_;
+		int recordlength = sizeof(featurecount) + sizeof(fieldcount)
+				+ job.recordtotal_ + (recordtypes ? fieldcount : 0);
+		int length = headlength + featurelength + sizeof(featurelength)
+				+ recordlength + sizeof(recordlength) + sizeof(length);
+		// the gap after the features, then the records header.
+		int taillength = sizeof(int) + writeRecordHeader(NULL, recordlength,
+				featurecount, fieldcount, recordtypes);
+		char *tailbytes = (char *) malloc(taillength);
+		if (tailbytes == NULL) {
+			fprintf(stderr, "Fail to alloc memory for records header.\n");
+			succeeded = false;
+		}
+		int features[2] = { featurelength, featurecount };
+		if (succeeded) {
+			memset(tailbytes, 0, sizeof(int));
+			writeRecordHeader(tailbytes + sizeof(int), recordlength,
+					featurecount, fieldcount, recordtypes);
+			reply = (redisReply *) redisCommand(con_,
+					"EVAL %s 9 %s %s %s %s %s %s %s %s %s %b %b %d %b",
+					STREAM_FINISH_SCRIPT, valuekey, recordkey, key,
+					stagedindexkey, stagedfidkey, indexkey, fidkey, orderkey,
+					logkey, tailbytes, (size_t) taillength, &length,
+					sizeof(length), (int) sizeof(int) + headlength, features,
+					sizeof(features));
+			if (reply == NULL || reply->type == REDIS_REPLY_ERROR) {
+				fprintf(stderr, "Redis eval command error: %s.\n",
+						reply ? reply->str : con_->errstr);
+				succeeded = false;
+			}
+			if (reply)
+				freeReplyObject(reply);
+		}
+		if (tailbytes)
+			free(tailbytes);
+	}
+	if (recordtypes)
+		free(recordtypes);
+	if (!succeeded) {
+		remove(valuekey);
+		remove(recordkey);
+		if (stagedindexkey)
+			remove(stagedindexkey);
+		if (stagedfidkey)
+			remove(stagedfidkey);
+	}
+
+	delete job.index_;
+	delete job.fidindex_;
+	free(stagedindexkey);
+	free(stagedfidkey);
+	free(indexkey);
+	free(fidkey);
+	free(orderkey);
+	free(logkey);
+	free(valuekey);
+	free(recordkey);
+	return succeeded;
+}
+
+// the key of part n of a layer. free() by caller.
+static char *partKey(const char *key, int n) {
+	char suffix[32];
+	snprintf(suffix, sizeof(suffix), ":part:%d", n);
+	return suffixKey(key, suffix);
+}
+
+// a part of a layer and the keys beside it.
+static void removePart(const SpatialClient *client, const char *key, int n) {
+	static const char *suffixes[] = { "", ":rtree", ":order", ":fid", ":log",
+			":stream" };
+	char *partkey = partKey(key, n);
+	if (partkey == NULL)
+		return;
+	for (size_t i = 0; i < sizeof(suffixes) / sizeof(suffixes[0]); ++i) {
+		char *suffixed = suffixKey(partkey, suffixes[i]);
+		if (suffixed) {
+			client->remove(suffixed);
+			free(suffixed);
+		}
+	}
+	free(partkey);
+}
+
+// an empty layer of the definition of layer, in a new Memory datasource.
+static OGRLayer *createPartLayer(OGRLayer *layer, OGRDataSource **pds) {
+	OGRSFDriver *pdriver =
+			OGRSFDriverRegistrar::GetRegistrar()->GetDriverByName("Memory");
+	*pds = pdriver ? pdriver->CreateDataSource("PART") : NULL;
+	if (*pds == NULL) {
+		fprintf(stderr, "Fail to create a Memory datasource.\n");
+		return NULL;
+	}
+	OGRLayer *part = (*pds)->CreateLayer(layer->GetName(),
+			layer->GetSpatialRef(), layer->GetGeomType(), NULL);
+	OGRFeatureDefn *defn = layer->GetLayerDefn();
+	for (int i = 0; part && i < defn->GetFieldCount(); ++i)
+		if (part->CreateField(defn->GetFieldDefn(i)) != OGRERR_NONE)
+			part = NULL;
+	if (part == NULL) {
+		fprintf(stderr, "Fail to create a part of layer %s.\n",
+				layer->GetName());
+		OGRDataSource::DestroyDataSource(*pds);
+		*pds = NULL;
+	}
+	return part;
+}
+
+// about the bytes the feature takes in a layer value, never less.
+static long long estimateFeatureLength(OGRFeature *feature) {
+	OGRFeatureDefn *defn = feature->GetDefnRef();
+	int fieldcount = defn->GetFieldCount();
+	long long length = 2 * sizeof(int) + (fieldcount + 7) / 8;
+	OGRGeometry *geometry = feature->GetGeometryRef();
+	if (geometry)
+		length += geometry->WkbSize();
+	for (int i = 0; i < fieldcount; ++i) {
+		if (!feature->IsFieldSet(i))
+			continue;
+		switch (defn->GetFieldDefn(i)->GetType()) {
+		case OFTInteger:
+		case OFTReal:
+		case OFTDate:
+		case OFTTime:
+		case OFTDateTime:
+			length += 1 + sizeof(long long) + 1;
+			break;
+		default:
+			// as long as its text, and a tag and a length.
+			length += 1 + sizeof(int) + 1 + strlen(feature->GetFieldAsString(i));
+			break;
+		}
+	}
+	return length;
+}
+
+bool SpatialClient::putLayerParts(const char *key, OGRLayer *layer,
+		int options, long long partLength) const {
+	if (key == NULL) {
+		fprintf(stderr, "Empty key.\n");
+		return false;
+	}
+	if (layer == NULL) {
+		fprintf(stderr, "Empty OGRLayer.\n");
+		return false;
+	}
+	if (options & (PUT_HILBERT_ORDER | PUT_MORTON_ORDER)) {
+		fprintf(stderr, "Curve orders need the whole layer, use putLayer.\n");
+		return false;
+	}
+	if (con_ == NULL) {
+		fprintf(stderr, "Redis connection is not available.\n");
+		return false;
+	}
+	if (partLength < STREAM_CHUNK_SIZE || partLength > LAYER_MAX_LENGTH) {
+		fprintf(stderr, "Part length %lld out of [%d, %lld].\n", partLength,
+				STREAM_CHUNK_SIZE, LAYER_MAX_LENGTH);
+		return false;
+	}
+	// every part repeats the head, the lengths and the record types.
+	int headlength = 0;
+	char *head = encodeLayerHead(layer, &headlength);
+	if (head == NULL)
+		return false;
+	free(head);
+	long long room = partLength - headlength - 8 * sizeof(int)
+			- layer->GetLayerDefn()->GetFieldCount();
+	if (room < STREAM_CHUNK_SIZE / 2) {
+		fprintf(stderr, "Part length %lld leaves no room for features.\n",
+				partLength);
+		return false;
+	}
+	char *partskey = suffixKey(key, ":parts");
+	if (partskey == NULL)
+		return false;
+	int oldcount = getLayerPartCount(key);
+
+	// features are gathered in a Memory layer until they fill a part, which
+	// is then streamed: a part is held at a time, never the whole layer.
+	OGRRegisterAll();
+	OGRDataSource *pds = NULL;
+	OGRLayer *part = createPartLayer(layer, &pds);
+	bool succeeded = part != NULL;
+	int partcount = 0;
+	long long featurecount = 0, length = 0;
+	long long partlength = 0;
+	layer->ResetReading();
+	while (succeeded) {
+		OGRFeature *feature = layer->GetNextFeature();
+		long long featurelength = feature ? estimateFeatureLength(feature) : 0;
+		if (feature == NULL || (partlength > 0
+				&& partlength + featurelength > room)) {
+			char *partkey = partKey(key, partcount);
+			succeeded = partkey && putLayerStream(partkey, part, options);
+			if (succeeded) {
+				redisReply *reply = (redisReply *) redisCommand(con_,
+						"STRLEN %s", partkey);
+				if (reply && reply->type == REDIS_REPLY_INTEGER)
+					length += reply->integer;
+				else
+					succeeded = false;
+				if (reply)
+					freeReplyObject(reply);
+			}
+			if (partkey)
+				free(partkey);
+			++partcount;
+			OGRDataSource::DestroyDataSource(pds);
+			part = succeeded && feature ? createPartLayer(layer, &pds) : NULL;
+			if (part == NULL)
+				pds = NULL;
+			succeeded = succeeded && (feature == NULL || part != NULL);
+			partlength = 0;
+		}
+		if (feature == NULL)
+			break;
+		if (succeeded) {
+			OGRFeature *copy = OGRFeature::CreateFeature(part->GetLayerDefn());
+			copy->SetFrom(feature);
+			copy->SetFID(feature->GetFID());
+			if (part->CreateFeature(copy) != OGRERR_NONE) {
+				fprintf(stderr, "Fail to add feature %ld to a part.\n",
+						feature->GetFID());
+				succeeded = false;
+			}
+			OGRFeature::DestroyFeature(copy);
+		}
+		partlength += featurelength;
+		++featurecount;
+		OGRFeature::DestroyFeature(feature);
+	}
+	if (pds)
+		OGRDataSource::DestroyDataSource(pds);
+
+	if (succeeded) {
+		char parts[LAYER_PARTS_SIZE];
+		int words[3] = { LAYER_PARTS_MAGIC | LAYER_PARTS_VERSION, partcount,
+				options };
+		memcpy(parts, words, sizeof(words));
+		memcpy(parts + sizeof(words), &featurecount, sizeof(featurecount));
+		memcpy(parts + sizeof(words) + sizeof(featurecount), &length,
+				sizeof(length));
+		succeeded = put(partskey, parts, LAYER_PARTS_SIZE);
+	}
+	// parts past the count, of an earlier put or of this one, are left out.
+	int lastcount = oldcount > partcount ? oldcount : partcount;
+	for (int i = succeeded ? partcount : 0; i < lastcount; ++i)
+		removePart(this, key, i);
+	if (!succeeded)
+		remove(partskey);
+	free(partskey);
+	return succeeded;
+}
+
+// the part count of a layer put in parts, and its options, feature count
+// and length. -1, quietly when there are no parts.
+static int readLayerParts(redisContext *con, const char *key, int *options,
+		long long *featurecount, long long *length) {
+	char *partskey = suffixKey(key, ":parts");
+	if (partskey == NULL)
+		return -1;
+	int size = 0;
+	char *parts = getIfExists(con, partskey, &size);
+	free(partskey);
+	if (parts == NULL)
+		return -1;
+	int head[3];
+	if (size != LAYER_PARTS_SIZE) {
+		fprintf(stderr, "Bad parts of layer %s.\n", key);
+		free(parts);
+		return -1;
+	}
+	memcpy(head, parts, sizeof(head));
+	if (head[0] != (LAYER_PARTS_MAGIC | LAYER_PARTS_VERSION) || head[1] < 0) {
+		fprintf(stderr, "Parts of layer %s of another format version, "
+				"put the layer again.\n", key);
+		free(parts);
+		return -1;
+	}
+	if (options)
+		*options = head[2];
+	if (featurecount)
+		memcpy(featurecount, parts + sizeof(head), sizeof(*featurecount));
+	if (length)
+		memcpy(length, parts + sizeof(head) + sizeof(long long),
+				sizeof(*length));
+	free(parts);
+	return head[1];
+}
+
+int SpatialClient::getLayerPartCount(const char *key, long long *featurecount,
+		long long *length) const {
+	if (key == NULL) {
+		fprintf(stderr, "Empty key.\n");
+		return -1;
+	}
+	return readLayerParts(con_, key, NULL, featurecount, length);
+}
+
+OGRLayer *SpatialClient::getLayerParts(const char *key,
+		OGRDataSource *datasource) const {
+	if (key == NULL) {
+		fprintf(stderr, "Empty key.\n");
+		return NULL;
+	}
+	int options = 0;
+	int partcount = readLayerParts(con_, key, &options, NULL, NULL);
+	if (partcount <= 0) {
+		fprintf(stderr, "%s holds no layer parts.\n", key);
+		return NULL;
+	}
+	char *partkey = partKey(key, 0);
+	OGRLayer *layer = NULL;
+	if (partkey)
+		layer = datasource ? getLayer(partkey, datasource) : getLayer(partkey);
+	free(partkey);
+	// the features of the other parts are moved over one part at a time.
+	// without a fid index every part numbers its features from 0, and the
+	// moved features are given new fids.
+	OGRRegisterAll();
+	OGRSFDriver *pdriver =
+			OGRSFDriverRegistrar::GetRegistrar()->GetDriverByName("Memory");
+	for (int i = 1; layer && i < partcount; ++i) {
+		OGRDataSource *pds = pdriver ? pdriver->CreateDataSource("PART") : NULL;
+		partkey = pds ? partKey(key, i) : NULL;
+		OGRLayer *part = partkey ? getLayer(partkey, pds) : NULL;
+		free(partkey);
+		if (part == NULL) {
+			fprintf(stderr, "Fail to get part %d of layer %s.\n", i, key);
+			layer = NULL;
+		}
+		OGRFeature *feature = NULL;
+		while (layer && (feature = part->GetNextFeature()) != NULL) {
+			OGRFeature *copy = OGRFeature::CreateFeature(layer->GetLayerDefn());
+			copy->SetFrom(feature);
+			copy->SetFID(options & PUT_FID_INDEX ? feature->GetFID()
+					: OGRNullFID);
+			if (layer->CreateFeature(copy) != OGRERR_NONE) {
+				fprintf(stderr, "Fail to add part %d of layer %s.\n", i, key);
+				layer = NULL;
+			}
+			OGRFeature::DestroyFeature(copy);
+			OGRFeature::DestroyFeature(feature);
+		}
+		if (pds)
+			OGRDataSource::DestroyDataSource(pds);
+	}
+	return layer;
+}
+
+typedef struct {
+	const SpatialClient *client_;
+	const LayerTiler *tiler_;
+	const char *key_;
+	TileFormat format_;
+	int minzoom_, maxzoom_;
+	int zoom_;
+	int *tiles_; // x, y of the tiles of zoom_ that features touch
+	long long tilecount_;
+	long long next_;
+	// x, y of their children that features touch, gathered by the workers.
+	int *children_;
+	long long childcount_, childcapacity_;
+	long long failedtiles_; // tiles whose SET failed
+	bool failed_;
+	pthread_mutex_t mutex_;
+} TileJob;
+
+static bool appendTiles(int **tiles, long long *count, long long *capacity,
+		const int *added, long long addedcount) {
+	if (addedcount == 0)
+		return true;
+	if (*count + addedcount > *capacity) {
+		long long newcapacity = *capacity ? *capacity : 256;
+		while (newcapacity < *count + addedcount)
+			newcapacity *= 2;
+		int *newtiles = (int *) realloc(*tiles,
+				sizeof(int) * 2 * (size_t) newcapacity);
+		if (newtiles == NULL) {
+			fprintf(stderr, "Fail to alloc memory for tiles.\n");
+			return false;
+		}
+		*tiles = newtiles;
+		*capacity = newcapacity;
+	}
+	memcpy(*tiles + 2 * *count, added, sizeof(int) * 2 * (size_t) addedcount);
+	*count += addedcount;
+	return true;
+}
+
+bool SpatialClient::putLayerTiles(const char *key, OGRLayer *layer,
+		int minZoom, int maxZoom, TileFormat format) const {
+	if (key == NULL) {
+		fprintf(stderr, "Empty key.\n");
+		return false;
+	}
+	if (layer == NULL) {
+		fprintf(stderr, "Empty OGRLayer.\n");
+		return false;
+	}
+	if (minZoom < 0 || maxZoom < minZoom || maxZoom > MAX_TILE_ZOOM) {
+		fprintf(stderr, "Invalid zoom range.\n");
+		return false;
+	}
+
+	LayerTiler tiler(layer);
+	if (tiler.failed()) {
+		fprintf(stderr, "Fail to read layer %s into tiles.\n", key);
+		return false;
+	}
+
+	TileJob job;
+	memset(&job, 0, sizeof(job));
+	job.client_ = this;
+	job.tiler_ = &tiler;
+	job.key_ = key;
+	job.format_ = format;
+	job.minzoom_ = minZoom;
+	job.maxzoom_ = maxZoom;
+	pthread_mutex_init(&job.mutex_, NULL);
+
+	long cpucount = sysconf(_SC_NPROCESSORS_ONLN);
+	if (cpucount < 1)
+		cpucount = 1;
+	pthread_t *threads = (pthread_t *) malloc(sizeof(pthread_t) * cpucount);
+	if (threads == NULL)
+		fprintf(stderr, "Fail to alloc memory for tile writers.\n");
+
+	// the pyramid is walked down from the world tile, zoom by zoom: only the
+	// children of the tiles features touch are visited.
+	long long capacity = 0;
+	int world[2] = { 0, 0 };
+	if (tiler.touchesTile(0, 0, 0))
+		appendTiles(&job.tiles_, &job.tilecount_, &capacity, world, 1);
+	for (int z = 0; z <= maxZoom && job.tilecount_ > 0 && !job.failed_; ++z) {
+		job.zoom_ = z;
+		job.next_ = 0;
+		job.childcount_ = 0;
+		long threadcount = threads ? cpucount : 0;
+		if (threadcount > job.tilecount_)
+			threadcount = job.tilecount_;
+		int started = 0;
+		for (int i = 0; i < threadcount; ++i) {
+			if (pthread_create(&threads[i], NULL, putTilesWorker, &job) != 0) {
+				fprintf(stderr, "Fail to start tile writer.\n");
+				break;
+			}
+			++started;
+		}
+		if (started == 0)
+			putTilesWorker(&job);
+		for (int i = 0; i < started; ++i)
+			pthread_join(threads[i], NULL);
+
+		int *tiles = job.tiles_;
+		job.tiles_ = job.children_;
+		job.tilecount_ = job.childcount_;
+		job.children_ = tiles;
+		long long childcapacity = job.childcapacity_;
+		job.childcapacity_ = capacity;
+		capacity = childcapacity;
+	}
+
+	pthread_mutex_destroy(&job.mutex_);
+	if (threads)
+		free(threads);
+	if (job.tiles_)
+		free(job.tiles_);
+	if (job.children_)
+		free(job.children_);
+	if (job.failedtiles_ > 0)
+		fprintf(stderr, "%lld tiles of %s failed to store.\n", job.failedtiles_,
+				key);
+	return !job.failed_ && job.failedtiles_ == 0;
+}
+
+void *SpatialClient::putTilesWorker(void *arg) {
+	TileJob *job = (TileJob *) arg;
+	int z = job->zoom_;
+	// the tiles above minzoom are not stored, only walked through.
+	redisContext *con = NULL;
+	bool failed = z >= job->minzoom_
+			&& (con = job->client_->openConnection()) == NULL;
+	char *tilekey = (char *) malloc(strlen(job->key_) + 64);
+	if (tilekey == NULL) {
+		fprintf(stderr, "Fail to alloc memory for tile key.\n");
+		failed = true;
+	}
+	MvtEncoder encoder;
+	int *children = NULL;
+	long long childcount = 0, childcapacity = 0;
+
+	int pending = 0;
+	long long failedtiles = 0;
+	while (!failed) {
+		long long tile = __sync_fetch_and_add(&job->next_, 1);
+		if (tile >= job->tilecount_)
+			break;
+		int x = job->tiles_[2 * tile];
+		int y = job->tiles_[2 * tile + 1];
+
+		for (int i = 0; z < job->maxzoom_ && i < 4; ++i) {
+			int child[2] = { 2 * x + (i & 1), 2 * y + (i >> 1) };
+			if (job->tiler_->touchesTile(z + 1, child[0], child[1])
+					&& !appendTiles(&children, &childcount, &childcapacity,
+							child, 1))
+				failed = true;
+		}
+		if (con == NULL)
+			continue;
+		int length = 0;
+		char *bytes = job->tiler_->getTileBytes(z, x, y, &length,
+				job->format_, &encoder);
+		if (bytes == NULL)
+			continue;
+		sprintf(tilekey, "%s:%d:%d:%d", job->key_, z, x, y);
+		redisAppendCommand(con, "SET %s %b", tilekey, bytes, (size_t) length);
+		free(bytes);
+		++pending;
+
+		if (pending == TILE_PIPELINE) {
+			failedtiles += getFailedReplies(con, pending);
+			pending = 0;
+		}
+	}
+	if (con) {
+		failedtiles += getFailedReplies(con, pending);
+		redisFree(con);
+	}
+
+	pthread_mutex_lock(&job->mutex_);
+	job->failedtiles_ += failedtiles;
+	if (failed || !appendTiles(&job->children_, &job->childcount_,
+			&job->childcapacity_, children, childcount))
+		job->failed_ = true;
+	pthread_mutex_unlock(&job->mutex_);
+	if (children)
+		free(children);
+	if (tilekey)
+		free(tilekey);
+	return NULL;
+}
+
+char *SpatialClient::getTile(const char *key, int z, int x, int y,
+		int *size) const {
+	if (key == NULL) {
+		fprintf(stderr, "Empty key.\n");
+		return NULL;
+	}
+	char *tilekey = (char *) malloc(strlen(key) + 64);
+	if (tilekey == NULL) {
+		fprintf(stderr, "Fail to alloc memory for tile key.\n");
+		return NULL;
+	}
+	sprintf(tilekey, "%s:%d:%d:%d", key, z, x, y);
+	char *bytes = get(tilekey, size);
+	free(tilekey);
+	return bytes;
+}
+
+char *SpatialClient::serialize(OGRLayer *poLayer, LayerSpatialIndex *index,
+		SpatialCurveType curve, int **order, LayerFidIndex *fidindex) const {
+	if (poLayer == NULL)
+		return NULL;
+	if (order)
+		*order = NULL;
+
+	int length = 0;
+	int featurelength = 0;
+	int attributerecordlength = 0;
+
+	// metadata and attribute definition.
+	int headlength = 0;
+	char *head = encodeLayerHead(poLayer, &headlength);
+	if (head == NULL)
+		return NULL;
+	length += headlength;
+	int fieldcount = poLayer->GetLayerDefn()->GetFieldCount();
+
+	// compute feature size and attribute record size. the features and
+	// records are encoded once, on all cpus, and copied into place below.
+	int parts = SNAPSHOT_FEATURES | SNAPSHOT_RECORDS;
+	if (index != NULL || curve != CURVE_NONE || fidindex != NULL)
+		parts |= SNAPSHOT_EXTENTS;
+	LayerSnapshot snapshot;
+	if (!snapshot.read(poLayer, parts)) {
+		free(head);
+		return NULL;
+	}
+	const LayerEncoder & encoder = *snapshot.getEncoder();
+	if ((long long) headlength + 8 * sizeof(int) + fieldcount
+			+ encoder.getFeatureLength()
+			+ encoder.getRecordLength() > LAYER_MAX_LENGTH) {
+		fprintf(stderr, "Layer passes the %lld bytes of a layer value.\n",
+				LAYER_MAX_LENGTH);
+		free(head);
+		return NULL;
+	}
+	int featurecount = encoder.getFeatureCount();
+	featurelength += sizeof(featurecount);
+	featurelength += encoder.getFeatureLength();
+
+	int attributerecordcount = featurecount;
+	attributerecordlength += sizeof(attributerecordcount);
+	attributerecordlength += sizeof(fieldcount);
+	attributerecordlength += encoder.getRecordLength();
+	// fixed-stride rows carry their types in the header.
+	const char *recordtypes =
+			encoder.getRecordStride() > 0 ? encoder.getFieldTypes() : NULL;
+	if (recordtypes)
+		attributerecordlength += fieldcount;
+
+	// for a curve order, the offset of every feature and record relative to
+	// the first feature and the first record, in reading order.
+	const int *featuresizes = encoder.getFeatureSizes();
+	const int *recordsizes = encoder.getRecordSizes();
+	const double *envelopes = encoder.getEnvelopes();
+	const long long *fids = encoder.getFids();
+	int *featureoffsets = NULL, *recordoffsets = NULL;
+	if (curve != CURVE_NONE && featurecount > 0) {
+		double *xs = (double *) malloc(sizeof(double) * featurecount);
+		double *ys = (double *) malloc(sizeof(double) * featurecount);
+		featureoffsets = (int *) malloc(sizeof(int) * featurecount);
+		recordoffsets = (int *) malloc(sizeof(int) * featurecount);
+		if (xs == NULL || ys == NULL || featureoffsets == NULL
+				|| recordoffsets == NULL) {
+			fprintf(stderr, "Fail to alloc memory for feature order.\n");
+			free(xs);
+			free(ys);
+			free(featureoffsets);
+			free(recordoffsets);
+			free(head);
+			return NULL;
+		}
+		for (int i = 0; i < featurecount; ++i) {
+			xs[i] = (envelopes[4 * i] + envelopes[4 * i + 2]) / 2;
+			ys[i] = (envelopes[4 * i + 1] + envelopes[4 * i + 3]) / 2;
+		}
+		int *featureorder = spatialOrder(xs, ys, featurecount, curve);
+		free(xs);
+		free(ys);
+		if (featureorder == NULL) {
+			free(featureoffsets);
+			free(recordoffsets);
+			free(head);
+			return NULL;
+		}
+		int featureoffset = 0, recordoffset = 0;
+		for (int i = 0; i < featurecount; ++i) {
+			int ifeature = featureorder[i];
+			featureoffsets[ifeature] = featureoffset;
+			recordoffsets[ifeature] = recordoffset;
+			featureoffset += featuresizes[ifeature];
+			recordoffset += recordsizes[ifeature];
+		}
+		if (order)
+			*order = featureorder;
+		else
+			free(featureorder);
+	}
+	length += featurelength + sizeof(featurelength);
+	length += attributerecordlength + sizeof(attributerecordlength);
+	length += sizeof(length);
+
+	// alloc memory for serialization.
+	char *bytes = (char *) malloc((length + 10));
+	if (bytes == NULL) {
+		fprintf(stderr, "Fail to alloc memory for bytes.\n");
+		free(head);
+		if (featureoffsets) {
+			free(featureoffsets);
+			free(recordoffsets);
+			if (order) {
+				free(*order);
+				*order = NULL;
+			}
+		}
+		return NULL;
+	}
+
+	assert(bytes != NULL);
 
-		char fieldtype = (char) poField->GetType();
-		memcpy(bytes + offset, &fieldtype, sizeof(fieldtype));
-		offset += sizeof(fieldtype);
-	}
+	int offset = 0;
+	memcpy(bytes + offset, &length, sizeof(length));
+	offset += sizeof(length);
+	memcpy(bytes + offset, head, headlength);
+	offset += headlength;
+	free(head);
 
 	// serialize feature size and attribute record.
 	memcpy(bytes + offset, &featurelength, sizeof(featurelength));
@@ -314,123 +2473,238 @@ char *SpatialClient::serialize(OGRLayer *poLayer) const {
 	offset += sizeof(featurecount);
 
 	int offset2 = offset + featurelength;
-	memcpy(bytes + offset2, &attributerecordlength,
-			sizeof(attributerecordlength));
-	offset2 += sizeof(attributerecordlength);
+	offset2 += writeRecordHeader(bytes + offset2, attributerecordlength,
+			attributerecordcount, fieldcount, recordtypes);
+
+	int featurebase = offset;
+	int recordbase = offset2;
+	const char *features = encoder.getFeatures();
+	const char *records = encoder.getRecords();
+	if (featureoffsets == NULL) {
+		memcpy(bytes + featurebase, features, encoder.getFeatureLength());
+		memcpy(bytes + recordbase, records, encoder.getRecordLength());
+		offset2 += encoder.getRecordLength();
+		for (int i = 0; (index || fidindex) && i < featurecount; ++i) {
+			const double *envelope = envelopes + 4 * i;
+			if (index)
+				index->add(envelope[0], envelope[1], envelope[2], envelope[3],
+						offset, featuresizes[i]);
+			if (fidindex)
+				fidindex->add(fids[i], offset, featuresizes[i]);
+			offset += featuresizes[i];
+		}
+	} else {
+		int featuresource = 0, recordsource = 0;
+		for (int i = 0; i < featurecount; ++i) {
+			offset = featurebase + featureoffsets[i];
+			offset2 = recordbase + recordoffsets[i];
+			if (index) {
+				const double *envelope = envelopes + 4 * i;
+				index->add(envelope[0], envelope[1], envelope[2], envelope[3],
+						offset, featuresizes[i]);
+			}
+			if (fidindex)
+				fidindex->add(fids[i], offset, featuresizes[i]);
+			memcpy(bytes + offset, features + featuresource, featuresizes[i]);
+			memcpy(bytes + offset2, records + recordsource, recordsizes[i]);
+			featuresource += featuresizes[i];
+			recordsource += recordsizes[i];
+		}
+		free(featureoffsets);
+		free(recordoffsets);
+	}
+	// the value ends with the records, sizeof(length) after its length.
+	assert(curve != CURVE_NONE || offset2 == length + (int) sizeof(length));
 
-	memcpy(bytes + offset2, &attributerecordcount,
-			sizeof(attributerecordlength));
-	offset2 += sizeof(attributerecordcount);
+	return bytes;
+}
 
-	memcpy(bytes + offset2, &fieldcount, sizeof(fieldcount));
-	offset2 += sizeof(fieldcount);
+typedef struct {
+	const char *entries_;
+	const int *offsets_;
+	OGRGeometry **geometries_;
+} GeometryDecoding;
+
+// the geometry of a feature entry, NULL for a null or unknown geometry.
+static OGRGeometry *decodeGeometry(const char *entry) {
+	int geointtype = 0;
+	memcpy(&geointtype, entry, sizeof(geointtype));
+	OGRwkbGeometryType geometrytype = (OGRwkbGeometryType) geointtype;
+	OGRGeometry *geometry = NULL;
+	switch (geometrytype) {
+	case wkbPoint:
+	case wkbPoint25D:
+		geometry = new OGRPoint();
+		break;
+	case wkbLineString:
+	case wkbLineString25D:
+		geometry = new OGRLineString();
+		break;
+	case wkbPolygon:
+	case wkbPolygon25D:
+		geometry = new OGRPolygon();
+		break;
+	case wkbMultiPoint:
+	case wkbMultiPoint25D:
+		geometry = new OGRMultiPoint();
+		break;
+	case wkbMultiLineString:
+	case wkbMultiLineString25D:
+		geometry = new OGRMultiLineString();
+		break;
+	case wkbMultiPolygon:
+	case wkbMultiPolygon25D:
+		geometry = new OGRMultiPolygon();
+		break;
+	case wkbGeometryCollection:
+	case wkbGeometryCollection25D:
+		geometry = new OGRGeometryCollection();
+		break;
+	default:
+		break;
+	}
+	if (geometry) {
+		// wkb feature
+		int wkbsize = 0;
+		memcpy(&wkbsize, entry + sizeof(geointtype), sizeof(wkbsize));
+		geometry->importFromWkb(
+				(unsigned char *) (entry + sizeof(geointtype) + sizeof(wkbsize)),
+				wkbsize);
+	}
+	return geometry;
+}
 
-	poLayer->ResetReading();
-	for (OGRFeature *feature = poLayer->GetNextFeature(); feature != NULL;
-			feature = poLayer->GetNextFeature()) {
-		OGRGeometry *geometry = feature->GetGeometryRef();
-		if (geometry) {
-			int geometrytype = (int) geometry->getGeometryType();
-			memcpy(bytes + offset, &geometrytype, sizeof(geometrytype));
-			offset += sizeof(geometrytype);
-
-			int wkbsize = geometry->WkbSize();
-			memcpy(bytes + offset, &wkbsize, sizeof(wkbsize));
-			offset += sizeof(wkbsize);
-
-			geometry->exportToWkb((OGRwkbByteOrder) wkbNDR,
-					(unsigned char *) (bytes + offset));
-			offset += geometry->WkbSize();
-
-			for (int ifield = 0; ifield < fieldcount; ++ifield) {
-				OGRFieldDefn* poField = poLayer->GetLayerDefn()->GetFieldDefn(
-						ifield);
-				char attributetype = (char) poField->GetType();
-				memcpy(bytes + offset2, &attributetype, sizeof(attributetype));
-				offset2 += sizeof(attributetype);
-
-				switch (attributetype) {
-				case OFTInteger: {
-					int ivalue = feature->GetFieldAsInteger(ifield);
-					memcpy(bytes + offset2, &ivalue, sizeof(ivalue));
-					offset2 += sizeof(ivalue);
-					break;
-				}
-				case OFTReal: {
-					double dvalue = feature->GetFieldAsDouble(ifield);
-					memcpy(bytes + offset2, &dvalue, sizeof(dvalue));
-					offset2 += sizeof(dvalue);
-					break;
-				}
-				case OFTString: {
-					const char *pstr = feature->GetFieldAsString(ifield);
-					int strlength = strlen(pstr) + 1;
-					memcpy(bytes + offset2, &strlength, sizeof(strlength));
-					offset2 += sizeof(strlength);
-					memcpy(bytes + offset2, pstr, strlength);
-					offset2 += strlength;
-					break;
-				}
-				case OFTBinary: {
-					int blobsize;
-					unsigned char * bvalue = feature->GetFieldAsBinary(ifield,
-							&blobsize);
-					int bvaluelength = blobsize;
-					memcpy(bytes + offset2, &bvaluelength,
-							sizeof(bvaluelength));
-					offset2 += sizeof(bvaluelength);
-					memcpy(bytes + offset2, bvalue, bvaluelength);
-					offset2 += bvaluelength;
-					break;
-				}
-				case OFTDate: {
-					int year, mon, day, hour, min, sec, tag;
-					feature->GetFieldAsDateTime(ifield, &year, &mon, &day,
-							&hour, &min, &sec, &tag);
-					memcpy(bytes + offset2, &year, sizeof(year));
-					offset2 += sizeof(year);
-					memcpy(bytes + offset2, &mon, sizeof(mon));
-					offset2 += sizeof(mon);
-					memcpy(bytes + offset2, &day, sizeof(day));
-					offset2 += sizeof(day);
-					memcpy(bytes + offset2, &hour, sizeof(hour));
-					offset2 += sizeof(hour);
-					memcpy(bytes + offset2, &min, sizeof(min));
-					offset2 += sizeof(min);
-					memcpy(bytes + offset2, &sec, sizeof(sec));
-					offset2 += sizeof(sec);
-					memcpy(bytes + offset2, &tag, sizeof(tag));
-					offset2 += sizeof(tag);
-					break;
-				}
-				default:
-					break;
-				}
-			}
-		}
-		OGRFeature::DestroyFeature(feature);
+static bool decodeGeometries(int begin, int end, void *context) {
+	GeometryDecoding *decoding = (GeometryDecoding *) context;
+	for (int i = begin; i < end; ++i)
+		decoding->geometries_[i] = decodeGeometry(
+				decoding->entries_ + decoding->offsets_[i]);
+	return true;
+}
+
+// sets field ifield of feature to a value from readCell. false, with the
+// reason on stderr, on failure.
+static bool setFeatureField(OGRFeature *feature, int ifield,
+		const RecordSection & records, char ftype, const char *value) {
+	OGRFieldType fieldtype = (OGRFieldType) ftype;
+	switch (fieldtype) {
+	case OFTInteger:
+		feature->SetField(ifield, readCellInteger(records, value));
+		break;
+	case OFTInteger64:
+		feature->SetField(ifield,
+				(GIntBig) readCellInteger64(records, value));
+		break;
+	case OFTReal: {
+		double dvalue = 0;
+		memcpy(&dvalue, value, sizeof(dvalue));
+
+		feature->SetField(ifield, dvalue);
+		break;
 	}
+	case OFTString: {
+		const char *str = NULL;
+		int strlength = readCellBytes(value, &str);
+		char *pstr = (char *) malloc(strlength + 1);
+		if (pstr == NULL) {
+			fprintf(stderr, "Fail to alloc memory for pstr.\n");
+			return false;
+		}
+		memcpy(pstr, str, strlength);
+		pstr[strlength] = '\0';
 
-	assert(offset2 == length);
+		feature->SetField(ifield, pstr);
+		free(pstr);
+		break;
+	}
+	case OFTBinary: {
+		const char *bvalue = NULL;
+		int bvaluelength = readCellBytes(value, &bvalue);
 
-	return bytes;
+		feature->SetField(ifield, bvaluelength,
+				(unsigned char *) bvalue);
+		break;
+	}
+	case OFTDate:
+	case OFTTime:
+	case OFTDateTime: {
+		long long packed = 0;
+		memcpy(&packed, value, sizeof(packed));
+
+		FieldDateType date;
+		unpackDate(packed, &date);
+		feature->SetField(ifield, date.year_, date.mon_, date.day_,
+				date.hour_, date.min_, date.sec_, date.tag_);
+		break;
+	}
+	case OFTIntegerList:
+	case OFTInteger64List:
+	case OFTRealList: {
+		// aligned copies of the values, for OGR to copy again.
+		const char *values = NULL;
+		int count = readCellList(value, &values);
+		int size = count * getListValueSize(ftype);
+		void *list = malloc(size > 0 ? size : 1);
+		if (list == NULL) {
+			fprintf(stderr, "Fail to alloc memory for list.\n");
+			return false;
+		}
+		memcpy(list, values, size);
+		if (fieldtype == OFTIntegerList)
+			feature->SetField(ifield, count, (int *) list);
+		else if (fieldtype == OFTInteger64List)
+			feature->SetField(ifield, count, (const GIntBig *) list);
+		else
+			feature->SetField(ifield, count, (double *) list);
+		free(list);
+		break;
+	}
+	case OFTStringList: {
+		const char *values = NULL;
+		int count = readCellList(value, &values);
+		char **list = (char **) calloc(count + 1, sizeof(char *));
+		if (list == NULL) {
+			fprintf(stderr, "Fail to alloc memory for list.\n");
+			return false;
+		}
+		// the strings are stored with their terminators.
+		for (int i = 0; i < count; ++i) {
+			const char *str = NULL;
+			int strlength = readCellBytes(values, &str);
+			list[i] = (char *) str;
+			values = str + strlength;
+		}
+		feature->SetField(ifield, list);
+		free(list);
+		break;
+	}
+	default:
+		break;
+	}
+	return true;
 }
 
-OGRLayer *SpatialClient::deserialize(const char *bytes) const {
-	OGRRegisterAll();
-	OGRSFDriver *pdriver =
-			OGRSFDriverRegistrar::GetRegistrar()->GetDriverByName("Memory");
-	if (!pdriver)
-		return NULL;
+OGRLayer *SpatialClient::deserialize(const char *bytes,
+		OGRDataSource *pds, const LayerFidIndex *fids,
+		const LayerChangeLog *log) const {
+	if (pds == NULL) {
+		OGRRegisterAll();
+		OGRSFDriver *pdriver =
+				OGRSFDriverRegistrar::GetRegistrar()->GetDriverByName("Memory");
+		if (!pdriver)
+			return NULL;
 
-	OGRDataSource *pds = pdriver->CreateDataSource("DRAMA");
-	if (!pds)
-		return NULL;
+		pds = pdriver->CreateDataSource("DRAMA");
+		if (!pds)
+			return NULL;
+	}
 
 	int offset = 0;
 	int length = 0;
 	memcpy(&length, bytes + offset, sizeof(length));
 	offset += sizeof(length);
+	// the version word, checked by the caller.
+	offset += sizeof(int);
 	// serialize metadata.
 	// metadatalength
 	int metadatalength = 0;
@@ -472,8 +2746,11 @@ OGRLayer *SpatialClient::deserialize(const char *bytes) const {
 		fprintf(stdout, "since no srs specified, EPSG:4326 would be assigned.");
 		srs.SetWellKnownGeogCS("EPSG:4326");
 	} else {
-		srs.importFromWkt(&strWKT);
+		// importFromWkt moves the pointer it is given.
+		char *wkt = strWKT;
+		srs.importFromWkt(&wkt);
 	}
+	free(strWKT);
 
 	char **papszOptions = NULL;
 	papszOptions = CSLSetNameValue(papszOptions, "OVERWRITE", "YES");
@@ -546,164 +2823,963 @@ OGRLayer *SpatialClient::deserialize(const char *bytes) const {
 	int attributerecordlength = 0;
 	memcpy(&attributerecordlength, bytes + offset2,
 			sizeof(attributerecordlength));
-	offset2 += sizeof(attributerecordlength);
-
-	int attributerecordcount = 0;
-	memcpy(&attributerecordcount, bytes + offset2,
-			sizeof(attributerecordcount));
-	offset2 += sizeof(attributerecordcount);
-
-	int recordfieldcount = 0;
-	memcpy(&recordfieldcount, bytes + offset2, sizeof(recordfieldcount));
-	offset2 += sizeof(recordfieldcount);
 
+	// recordcount, fieldcount and the types of fixed-stride rows.
+	RecordSection records;
+	if (!readRecordSection(bytes + offset2,
+			length + (int) sizeof(length) - offset2, &records))
+		return NULL;
+	int recordfieldcount = records.fieldcount_;
+	offset2 = records.cells_ - bytes;
+
+	// the geometries are made from their wkb over ranges first, then the
+	// features are created in order on this thread.
+	int *featureoffsets = scanFeatureOffsets(bytes + offset, featurecount,
+			featurelength - sizeof(featurecount));
+	OGRGeometry **geometries = (OGRGeometry **) malloc(
+			sizeof(OGRGeometry *) * (featurecount + 1));
+	if (featureoffsets == NULL || geometries == NULL) {
+		fprintf(stderr, "Fail to decode features.\n");
+		if (featureoffsets)
+			free(featureoffsets);
+		if (geometries)
+			free(geometries);
+		return NULL;
+	}
+	GeometryDecoding decoding = { bytes + offset, featureoffsets, geometries };
+	runDecodeTasks(featurecount, decodeGeometries, &decoding);
+	offset += featureoffsets[featurecount];
+	free(featureoffsets);
+
+	// an index of an older value is of no use, and the log needs the fids.
+	if (fids && fids->getItemCount() != featurecount)
+		fids = NULL;
+	if (fids == NULL)
+		log = NULL;
+	RecordSection logcells = { 0, recordfieldcount, NULL, 0, NULL, 0 };
 	OGRFeatureDefn *defn = poLayer->GetLayerDefn();
 	for (int iFeature = 0; iFeature < featurecount; iFeature++) {
-		int geointtype = 0;
-		memcpy(&geointtype, bytes + offset, sizeof(geointtype));
-		offset += sizeof(geointtype);
-		OGRwkbGeometryType geometrytype = (OGRwkbGeometryType) geointtype;
-		OGRGeometry *geometry = NULL;
-		switch (geometrytype) {
-		case wkbPoint:
-		case wkbPoint25D:
-			geometry = new OGRPoint();
-			break;
-		case wkbLineString:
-		case wkbLineString25D:
-			geometry = new OGRLineString();
-			break;
-		case wkbPolygon:
-		case wkbPolygon25D:
-			geometry = new OGRPolygon();
-			break;
-		case wkbMultiPoint:
-		case wkbMultiPoint25D:
-			geometry = new OGRMultiPoint();
-			break;
-		case wkbMultiLineString:
-		case wkbMultiLineString25D:
-			geometry = new OGRMultiLineString();
-			break;
-		case wkbMultiPolygon:
-		case wkbMultiPolygon25D:
-			geometry = new OGRMultiPolygon();
-			break;
-		case wkbGeometryCollection:
-		case wkbGeometryCollection25D:
-			geometry = new OGRGeometryCollection();
-			break;
-		default:
-			break;
-		}
+		OGRGeometry *geometry = geometries[iFeature];
 		if (geometry) {
-			// wkb feature
-			int wkbsize = 0;
-			memcpy(&wkbsize, bytes + offset, sizeof(wkbsize));
-			offset += sizeof(wkbsize);
-			geometry->importFromWkb((unsigned char *) (bytes + offset),
-					wkbsize);
-			offset += geometry->WkbSize();
-
+			long long fid = fids ? fids->getFid(iFeature) : OGRNullFID;
+			bool logged = log && log->contains(fid);
+			const char *logentry = logged ? log->getGeometry(fid) : NULL;
+			OGRGeometry *loggedgeometry =
+					logentry ? decodeGeometry(logentry) : NULL;
+			if (loggedgeometry) {
+				delete geometry;
+				geometry = loggedgeometry;
+			}
 			OGRFeature *feature = new OGRFeature(defn);
-			feature->SetGeometry(geometry);
-			poLayer->CreateFeature(feature);
+			feature->SetGeometryDirectly(geometry);
+			if (fids)
+				feature->SetFID(fid);
 
+			const char *bitmap = bytes + offset2;
+			offset2 += getRowBitmapSize(recordfieldcount);
 			for (int ifield = 0; ifield < recordfieldcount; ++ifield) {
+				// unset fields are left unset; readCell steps over their
+				// zeroed cell in fixed-stride rows.
 				char ftype = 0;
-				memcpy(&ftype, bytes + offset2, sizeof(ftype));
-				offset2 += sizeof(ftype);
-				OGRFieldType fieldtype = (OGRFieldType) ftype;
-				switch (fieldtype) {
-				case OFTInteger: {
-					int ivalue = 0;
-					memcpy(&ivalue, bytes + offset2, sizeof(ivalue));
-					offset2 += sizeof(ivalue);
-
-					feature->SetField(ifield, ivalue);
-					break;
-				}
-				case OFTReal: {
-					double dvalue = 0;
-					memcpy(&dvalue, bytes + offset2, sizeof(dvalue));
-					offset2 += sizeof(dvalue);
+				const char *value = NULL;
+				offset2 += readCell(records, bitmap, bytes + offset2, ifield,
+						&ftype, &value);
+				if (!setFeatureField(feature, ifield, records, ftype, value))
+					return NULL;
+			}
+			// then the fields changed since, from their tagged cells.
+			for (int ifield = 0; logged && ifield < recordfieldcount;
+					++ifield) {
+				const char *cell = log->getField(fid, ifield);
+				if (cell == NULL)
+					continue;
+				if (*cell == FTNull)
+					feature->UnsetField(ifield);
+				else if (!setFeatureField(feature, ifield, logcells, *cell,
+						cell + sizeof(char)))
+					return NULL;
+			}
+			// the layer stores a copy, made once the fields are set.
+			poLayer->CreateFeature(feature);
+			OGRFeature::DestroyFeature(feature);
+		}
+	}
+	free(geometries);
 
-					feature->SetField(ifield, dvalue);
-					break;
-				}
-				case OFTString: {
-					int strlength;
-					memcpy(&strlength, bytes + offset2, sizeof(strlength));
-					offset2 += sizeof(strlength);
-					char *pstr = (char *) malloc(strlength);
-					if (pstr == NULL) {
-						fprintf(stderr, "Fail to alloc memory for pstr.\n");
-						return NULL;
-					}
-					memcpy(pstr, bytes + offset2, strlength);
-					offset2 += strlength;
-
-					feature->SetField(ifield, pstr);
-					break;
-				}
-				case OFTBinary: {
-					int bvaluelength = 0;
-					memcpy(&bvaluelength, bytes + offset2,
-							sizeof(bvaluelength));
-					offset2 += sizeof(bvaluelength);
-					char *bvalue = (char *) malloc(bvaluelength);
-					if (bvalue == NULL) {
-						fprintf(stderr, "Fail to alloc memory for bvalue.\n");
-						return NULL;
-					}
-
-					memcpy(bvalue, bytes + offset2, bvaluelength);
-					offset2 += bvaluelength;
-
-					feature->SetField(ifield, bvaluelength,
-							(unsigned char *) bvalue);
-					break;
-				}
-				case OFTDate: {
-					int year, mon, day, hour, min, sec, tag;
-					year = mon = day = hour = min = sec = tag;
-
-					memcpy(&year, bytes + offset2, sizeof(year));
-					offset2 += sizeof(year);
-					memcpy(&mon, bytes + offset2, sizeof(mon));
-					offset2 += sizeof(mon);
-					memcpy(&day, bytes + offset2, sizeof(day));
-					offset2 += sizeof(day);
-					memcpy(&hour, bytes + offset2, sizeof(hour));
-					offset2 += sizeof(hour);
-					memcpy(&min, bytes + offset2, sizeof(min));
-					offset2 += sizeof(min);
-					memcpy(&sec, bytes + offset2, sizeof(sec));
-					offset2 += sizeof(sec);
-					memcpy(&tag, bytes + offset2, sizeof(tag));
-					offset2 += sizeof(tag);
-
-					feature->SetField(ifield, year, mon, day, hour, min, sec,
-							tag);
+	// the value ends with the records, sizeof(length) after its length.
+	assert(offset2 == length + (int) sizeof(length));
+
+	return poLayer;
+}
+
+// the layout of a stored layer that updates need, read by a few GETRANGEs:
+// the size of the value, the offsets of featurelength and of the records
+// section, and the types of the fields of the attribute definition (free()
+// by caller).
+typedef struct {
+	int valuesize_;
+	int featureoffset_;
+	int recordoffset_;
+	int fieldcount_;
+	char *fieldtypes_;
+} LayerHead;
+
+static bool readLayerHead(const SpatialClient *client, const char *key,
+		LayerHead *head) {
+	head->fieldtypes_ = NULL;
+	int size = 0;
+	char *bytes = client->getRange(key, 0, LAYER_HEAD_SIZE + sizeof(int) - 1,
+			&size);
+	if (bytes == NULL || size != LAYER_HEAD_SIZE + (int) sizeof(int)
+			|| !checkLayerHead(bytes, size, false)) {
+		fprintf(stderr, "%s does not hold a layer.\n", key);
+		if (bytes)
+			free(bytes);
+		return false;
+	}
+	int length = 0, metadatalength = 0;
+	memcpy(&length, bytes, sizeof(length));
+	memcpy(&metadatalength, bytes + LAYER_HEAD_SIZE, sizeof(metadatalength));
+	free(bytes);
+	head->valuesize_ = length + sizeof(length);
+	int attrdefoffset = LAYER_HEAD_SIZE + sizeof(int) + metadatalength;
+	bytes = client->getRange(key, attrdefoffset,
+			attrdefoffset + sizeof(int) - 1, &size);
+	if (bytes == NULL || size < (int) sizeof(int)) {
+		fprintf(stderr, "%s does not hold a layer.\n", key);
+		if (bytes)
+			free(bytes);
+		return false;
+	}
+	int attrdeflength = 0;
+	memcpy(&attrdeflength, bytes, sizeof(attrdeflength));
+	free(bytes);
+	if (metadatalength < 0 || attrdeflength < 0
+			|| attrdefoffset + (long long) attrdeflength + 3 * sizeof(int)
+					> LAYER_MAX_LENGTH) {
+		fprintf(stderr, "%s does not hold a layer.\n", key);
+		return false;
+	}
+	head->featureoffset_ = attrdefoffset + sizeof(int) + attrdeflength;
+	char *attrdef = client->getRange(key, attrdefoffset,
+			head->featureoffset_ + sizeof(int) - 1, &size);
+	int offset = sizeof(int) + attrdeflength;
+	int fieldcount =
+			attrdef && size == attrdeflength + (int) (2 * sizeof(int)) ?
+					readAttrDefFields(attrdef, offset, NULL, NULL) : -1;
+	if (fieldcount < 0) {
+		fprintf(stderr, "%s does not hold a layer.\n", key);
+		if (attrdef)
+			free(attrdef);
+		return false;
+	}
+	head->fieldtypes_ = (char *) malloc(fieldcount + 1);
+	if (head->fieldtypes_ == NULL) {
+		fprintf(stderr, "Fail to alloc memory for field types.\n");
+		free(attrdef);
+		return false;
+	}
+	head->fieldcount_ = fieldcount;
+	readAttrDefFields(attrdef, offset, NULL, head->fieldtypes_);
+	int featurelength = 0;
+	memcpy(&featurelength, attrdef + offset, sizeof(featurelength));
+	free(attrdef);
+	head->recordoffset_ = head->featureoffset_ + 2 * sizeof(int)
+			+ featurelength;
+	return true;
+}
+
+// the stored position and byte range of the feature of fid, through
+// "key:fid". false, with the reason on stderr, without the index or the
+// feature.
+static bool findFeature(const SpatialClient *client, redisContext *con,
+		const char *key, long long fid, FidProbe *probe) {
+	char *fidkey = suffixKey(key, ":fid");
+	if (fidkey == NULL)
+		return false;
+	probe->fid_ = fid;
+	probe->request_ = 0;
+	bool probed = probeFids(client, con, fidkey, probe, 1);
+	free(fidkey);
+	if (probed && probe->item_ < 0)
+		fprintf(stderr, "%s holds no feature of fid %lld.\n", key, fid);
+	return probed && probe->item_ >= 0;
+}
+
+static bool appendLog(redisContext *con, const char *logkey,
+		const char *entry, int length) {
+	redisReply *reply = (redisReply *) redisCommand(con, "APPEND %s %b",
+			logkey, entry, (size_t) length);
+	if (reply == NULL || reply->type == REDIS_REPLY_ERROR) {
+		fprintf(stderr, "Redis append command error.\n");
+		if (reply)
+			freeReplyObject(reply);
+		return false;
+	}
+	freeReplyObject(reply);
+	return true;
+}
+
+// the value of a tagged cell of a fixed-size type, written to fixed as
+// fixed-stride rows hold it.
+static void writeFixedCell(char *fixed, const char *cell) {
+	const RecordSection tagged = { 0, 0, NULL, 0, NULL, 0 };
+	switch (*cell) {
+	case FTInteger: {
+		int ivalue = readCellInteger(tagged, cell + sizeof(char));
+		memcpy(fixed, &ivalue, sizeof(ivalue));
+		break;
+	}
+	case FTInteger64: {
+		long long lvalue = readCellInteger64(tagged, cell + sizeof(char));
+		memcpy(fixed, &lvalue, sizeof(lvalue));
+		break;
+	}
+	default:
+		// reals and dates are whole in both.
+		memcpy(fixed, cell + sizeof(char), getFixedCellSize(*cell));
+		break;
+	}
+}
+
+// the envelope of the geometry of a feature entry, as getEnvelope gives it.
+// false for an empty or malformed geometry.
+static bool getEntryBox(const char *entry, int size, LayerEnvelope *box) {
+	int wkbsize = 0;
+	if (size < 2 * (int) sizeof(int))
+		return false;
+	memcpy(&wkbsize, entry + sizeof(int), sizeof(wkbsize));
+	if (wkbsize <= 0 || wkbsize > size - 2 * (int) sizeof(int))
+		return false;
+	WkbReader reader(entry + 2 * sizeof(int), wkbsize);
+	box->minx_ = box->miny_ = HUGE_VAL;
+	box->maxx_ = box->maxy_ = -HUGE_VAL;
+	int type = reader.readHeader();
+	if (type > 0)
+		reader.readEnvelope(type, box);
+	return type > 0 && !reader.failed() && box->minx_ <= box->maxx_;
+}
+
+// most levels of a spatial index, of nodes of at least two entries.
+static const int INDEX_MAX_LEVELS = 32;
+// node reads of a descent, before the leaves are scanned instead.
+static const int INDEX_DESCENT_READS = 64;
+
+typedef struct {
+	int indexlength_;
+	int extentoffset_;
+	// the byte offsets of the box of a leaf and of the boxes over it.
+	int offsets_[INDEX_MAX_LEVELS];
+} IndexPath;
+
+// the int at item of the ints at offset of "key:rtree", read by GETRANGE.
+// -1 when it cannot be read.
+static int readIndexInt(const SpatialClient *client, const char *indexkey,
+		int offset, int item) {
+	int size = 0, value = -1;
+	char *bytes = client->getRange(indexkey, offset + sizeof(int) * item,
+			offset + sizeof(int) * (item + 1) - 1, &size);
+	if (bytes && size == (int) sizeof(value))
+		memcpy(&value, bytes, sizeof(value));
+	if (bytes)
+		free(bytes);
+	return value;
+}
+
+// the boxes over the feature at offset of the layer value in "key:rtree",
+// read by GETRANGE. its leaf, the one whose item has that item offset, is
+// found by descending from the root through the nodes that cover box, the
+// box the feature has in the index, or, when box is NULL or the descent
+// reads too many nodes, by a scan of the leaves. returns the count of
+// offsets in path, 0 when the layer has no index, -1 on failure.
+static int findIndexPath(const SpatialClient *client, const char *indexkey,
+		int offset, const LayerEnvelope *box, IndexPath *path) {
+	int size = 0;
+	int headsize = 5 * sizeof(int);
+	char *head = client->getRange(indexkey, 0,
+			headsize + sizeof(int) * INDEX_MAX_LEVELS - 1, &size);
+	if (head == NULL)
+		return -1;
+	if (size == 0) {
+		free(head);
+		return 0;
+	}
+	int header[5] = { 0, 0, 0, 0, 0 };
+	int levelbounds[INDEX_MAX_LEVELS];
+	if (size >= headsize)
+		memcpy(header, head, headsize);
+	int itemcount = header[1], nodesize = header[2], nodecount = header[3],
+			levelcount = header[4];
+	bool valid = size >= headsize && header[0] >= size && nodesize > 1
+			&& levelcount > 0 && levelcount <= INDEX_MAX_LEVELS
+			&& size >= headsize + (int) sizeof(int) * levelcount;
+	if (valid)
+		memcpy(levelbounds, head + headsize, sizeof(int) * levelcount);
+	free(head);
+	if (!valid || levelbounds[levelcount - 1] != nodecount
+			|| levelbounds[0] != itemcount) {
+		fprintf(stderr, "%s does not hold a spatial index.\n", indexkey);
+		return -1;
+	}
+	path->indexlength_ = header[0];
+	path->extentoffset_ = headsize + sizeof(int) * levelcount;
+	int boxesoffset = path->extentoffset_ + sizeof(LayerEnvelope);
+	int indicesoffset = boxesoffset + sizeof(LayerEnvelope) * nodecount;
+	int itemsoffset = indicesoffset + sizeof(int) * nodecount;
+
+	int pos = -1, reads = 0, top = 0;
+	int *stack = box ?
+			(int *) malloc(
+					sizeof(int) * 2 * (INDEX_DESCENT_READS * nodesize + 1)) :
+			NULL;
+	int node = nodecount - 1, level = levelcount - 1;
+	while (stack && pos < 0 && reads++ < INDEX_DESCENT_READS) {
+		int end = node + nodesize;
+		if (end > levelbounds[level])
+			end = levelbounds[level];
+		int boxsize = 0, indexsize = 0;
+		char *boxes = client->getRange(indexkey,
+				boxesoffset + sizeof(LayerEnvelope) * node,
+				boxesoffset + sizeof(LayerEnvelope) * end - 1, &boxsize);
+		char *indices = boxes ?
+				client->getRange(indexkey, indicesoffset + sizeof(int) * node,
+						indicesoffset + sizeof(int) * end - 1, &indexsize) :
+				NULL;
+		bool read = indices
+				&& boxsize == (int) sizeof(LayerEnvelope) * (end - node)
+				&& indexsize == (int) sizeof(int) * (end - node);
+		for (int i = 0; read && i < end - node; ++i) {
+			LayerEnvelope nodebox;
+			int index = 0;
+			memcpy(&nodebox, boxes + sizeof(LayerEnvelope) * i,
+					sizeof(nodebox));
+			memcpy(&index, indices + sizeof(int) * i, sizeof(index));
+			if (nodebox.minx_ > box->minx_ || nodebox.miny_ > box->miny_
+					|| nodebox.maxx_ < box->maxx_
+					|| nodebox.maxy_ < box->maxy_)
+				continue;
+			if (level > 0) {
+				stack[2 * top] = index;
+				stack[2 * top + 1] = level - 1;
+				++top;
+			} else if (index >= 0 && index < itemcount
+					&& readIndexInt(client, indexkey, itemsoffset, index)
+							== offset) {
+				pos = node + i;
+				break;
+			}
+		}
+		if (boxes)
+			free(boxes);
+		if (indices)
+			free(indices);
+		if (!read || top == 0)
+			break;
+		--top;
+		node = stack[2 * top];
+		level = stack[2 * top + 1];
+	}
+	if (stack)
+		free(stack);
+	if (pos < 0) {
+		// the items of the leaves, then their item offsets, which follow.
+		int indexsize = 0;
+		char *indices = client->getRange(indexkey, indicesoffset,
+				itemsoffset + sizeof(int) * itemcount - 1, &indexsize);
+		bool read = indices
+				&& indexsize == (int) sizeof(int) * (nodecount + itemcount);
+		for (int i = 0; read && i < itemcount; ++i) {
+			int index = 0, itemoffset = -1;
+			memcpy(&index, indices + sizeof(int) * i, sizeof(index));
+			if (index >= 0 && index < itemcount)
+				memcpy(&itemoffset,
+						indices + sizeof(int) * (nodecount + index),
+						sizeof(itemoffset));
+			if (itemoffset == offset) {
+				pos = i;
+				break;
+			}
+		}
+		if (indices)
+			free(indices);
+	}
+	if (pos < 0) {
+		fprintf(stderr, "%s holds no feature at %d.\n", indexkey, offset);
+		return -1;
+	}
+
+	// the parent of a node is the one packed over its run of nodesize, as
+	// in LayerSpatialIndex::setItemBox.
+	path->offsets_[0] = boxesoffset + sizeof(LayerEnvelope) * pos;
+	int levelstart = 0;
+	for (level = 0; level + 1 < levelcount; ++level) {
+		pos = levelbounds[level] + (pos - levelstart) / nodesize;
+		levelstart = levelbounds[level];
+		path->offsets_[level + 1] = boxesoffset + sizeof(LayerEnvelope) * pos;
+	}
+	return levelcount;
+}
+
+// KEYS: the layer value, its spatial index and its change log. ARGV: the
+// offset and bytes of a feature entry, then the new box of the feature, the
+// offset of the extent, the offsets of the leaf box and of the boxes over
+// it as ints, and the length of the index, all empty but the extent offset
+// without an index. the entry and the leaf box are overwritten, the other
+// boxes grown to cover the new one. 0, with nothing written, once the layer
+// has a log.
+static const char *UPDATE_GEOMETRY_SCRIPT =
+		"if redis.call('STRLEN', KEYS[3]) > 0 then return 0 end "
+				"if ARGV[5] ~= '' and redis.call('STRLEN', KEYS[2]) "
+				"~= tonumber(ARGV[6]) then "
+				"return redis.error_reply('spatial index changed') end "
+				"redis.call('SETRANGE', KEYS[1], ARGV[1], ARGV[2]) "
+				"if ARGV[5] == '' then return 1 end "
+				"local x0, y0, x1, y1 = struct.unpack('dddd', ARGV[3]) "
+				"local function grow(at) "
+				"local a, b, c, d = struct.unpack('dddd', "
+				"redis.call('GETRANGE', KEYS[2], at, at + 31)) "
+				"redis.call('SETRANGE', KEYS[2], at, struct.pack('dddd', "
+				"math.min(a, x0), math.min(b, y0), math.max(c, x1), "
+				"math.max(d, y1))) end "
+				"redis.call('SETRANGE', KEYS[2], "
+				"(struct.unpack('i', ARGV[5])), ARGV[3]) "
+				"for i = 5, string.len(ARGV[5]), 4 do "
+				"grow((struct.unpack('i', ARGV[5], i))) end "
+				"grow(tonumber(ARGV[4])) "
+				"return 1";
+
+// overwrites the entry of the feature of probe, of the same size, and its
+// boxes in "key:rtree", if the layer has one, at once, unless the layer has
+// a log. 1 when written, 0 for a layer with a log, -1 on failure.
+static int updateInPlace(const SpatialClient *client, redisContext *con,
+		const char *key, const char *logkey, const FidProbe & probe,
+		const OGRGeometry *geometry, const char *entry) {
+	char *indexkey = suffixKey(key, ":rtree");
+	if (indexkey == NULL)
+		return -1;
+	// the entry replaced gives the box the feature has in the index.
+	int oldsize = 0;
+	char *oldentry = client->getRange(key, probe.offset_,
+			probe.offset_ + probe.size_ - 1, &oldsize);
+	LayerEnvelope oldbox;
+	bool boxed = oldentry && oldsize == probe.size_
+			&& getEntryBox(oldentry, oldsize, &oldbox);
+	if (oldentry)
+		free(oldentry);
+	IndexPath path;
+	memset(&path, 0, sizeof(path));
+	int levelcount = findIndexPath(client, indexkey, probe.offset_,
+			boxed ? &oldbox : NULL, &path);
+	if (levelcount < 0) {
+		free(indexkey);
+		return -1;
+	}
+
+	OGREnvelope envelope;
+	geometry->getEnvelope(&envelope);
+	LayerEnvelope box = { envelope.MinX, envelope.MinY, envelope.MaxX,
+			envelope.MaxY };
+	redisReply *reply = (redisReply *) redisCommand(con,
+			"EVAL %s 3 %s %s %s %d %b %b %d %b %d", UPDATE_GEOMETRY_SCRIPT, key,
+			indexkey, logkey, probe.offset_, entry, (size_t) probe.size_, &box,
+			levelcount > 0 ? sizeof(box) : (size_t) 0, path.extentoffset_,
+			path.offsets_, sizeof(int) * levelcount, path.indexlength_);
+	free(indexkey);
+	int updated = -1;
+	if (reply && reply->type == REDIS_REPLY_INTEGER)
+		updated = reply->integer > 0 ? 1 : 0;
+	else
+		fprintf(stderr, "Redis eval command error: %s.\n",
+				reply && reply->type == REDIS_REPLY_ERROR ?
+						reply->str : "no reply");
+	if (reply)
+		freeReplyObject(reply);
+	return updated;
+}
+
+bool SpatialClient::updateFeatureGeometry(const char *key, long long fid,
+		const OGRGeometry *geometry) const {
+	if (key == NULL) {
+		fprintf(stderr, "Empty key.\n");
+		return false;
+	}
+	if (geometry == NULL) {
+		fprintf(stderr, "Nil OGRGeometry object.\n");
+		return false;
+	}
+	if (con_ == NULL) {
+		fprintf(stderr, "Redis connection is not available.\n");
+		return false;
+	}
+	FidProbe probe;
+	if (!findFeature(this, con_, key, fid, &probe))
+		return false;
+	char *logkey = suffixKey(key, ":log");
+	if (logkey == NULL)
+		return false;
+	int entrysize = 0;
+	char *entry = encodeFeatureEntry(geometry, &entrysize);
+	long long loglength = entry ? getLogLength(con_, logkey) : -1;
+
+	// the entry fits the one stored: overwritten where it is, unless a log
+	// was started since.
+	int inplace = 0;
+	if (loglength == 0 && entrysize == probe.size_)
+		inplace = updateInPlace(this, con_, key, logkey, probe, geometry,
+				entry);
+	bool updated = inplace > 0;
+	if (inplace == 0 && loglength >= 0) {
+		int length = 0;
+		char *logentry = LayerChangeLog::encodeGeometry(fid, entry, entrysize,
+				&length);
+		updated = logentry && appendLog(con_, logkey, logentry, length);
+		if (logentry)
+			free(logentry);
+	}
+	if (entry)
+		free(entry);
+	free(logkey);
+	return updated;
+}
+
+// KEYS: the layer value and its change log. ARGV: the offset of a cell of
+// fixed-stride rows and its bytes, then the bit of the field in the bitmap
+// of the row and its value. 0, with nothing written, once the layer has a
+// log.
+static const char *UPDATE_FIELD_SCRIPT =
+		"if redis.call('STRLEN', KEYS[2]) > 0 then return 0 end "
+				"redis.call('SETRANGE', KEYS[1], ARGV[1], ARGV[2]) "
+				"redis.call('SETBIT', KEYS[1], ARGV[3], ARGV[4]) "
+				"return 1";
+
+bool SpatialClient::updateRecordField(const char *key, long long fid,
+		int field, const LayerRecordField & value) const {
+	if (key == NULL) {
+		fprintf(stderr, "Empty key.\n");
+		return false;
+	}
+	if (con_ == NULL) {
+		fprintf(stderr, "Redis connection is not available.\n");
+		return false;
+	}
+	FidProbe probe;
+	LayerHead head;
+	if (!findFeature(this, con_, key, fid, &probe)
+			|| !readLayerHead(this, key, &head))
+		return false;
+	if (field < 0 || field >= head.fieldcount_) {
+		fprintf(stderr, "%s has no field %d.\n", key, field);
+		free(head.fieldtypes_);
+		return false;
+	}
+	char fieldtype = head.fieldtypes_[field];
+	free(head.fieldtypes_);
+	if (value.fieldtype_ != FTNull && value.fieldtype_ != fieldtype) {
+		fprintf(stderr, "Value of type %d for field %d of type %d.\n",
+				value.fieldtype_, field, fieldtype);
+		return false;
+	}
+	char *logkey = suffixKey(key, ":log");
+	if (logkey == NULL)
+		return false;
+	long long loglength = getLogLength(con_, logkey);
+
+	// fixed-stride rows: the bit of the field and its cell are overwritten
+	// where they are, with no read of the row, unless a log was started
+	// since.
+	int inplace = 0;
+	int size = 0;
+	// the header of fixed-stride rows, with the types.
+	int headersize = 3 * sizeof(int) + head.fieldcount_;
+	char *header =
+			loglength == 0 ?
+					getRange(key, head.recordoffset_,
+							head.recordoffset_ + headersize - 1, &size) :
+					NULL;
+	RecordSection section;
+	if (header && size == headersize
+			&& readRecordSection(header, head.valuesize_ - head.recordoffset_,
+					&section)
+			&& section.stride_ > 0 && section.fieldcount_ == head.fieldcount_
+			&& probe.item_ < section.recordcount_) {
+		int rowoffset = head.recordoffset_ + headersize
+				+ probe.item_ * section.stride_;
+		int celloffset = rowoffset + getRowBitmapSize(section.fieldcount_);
+		for (int i = 0; i < field; ++i)
+			celloffset += getFixedCellSize(section.types_[i]);
+		// redis numbers the bits of a byte from the top one.
+		long long bit = 8LL * (rowoffset + field / 8) + 7 - field % 8;
+		char cell[sizeof(long long)];
+		memset(cell, 0, sizeof(cell));
+		if (value.fieldtype_ != FTNull) {
+			char tagged[sizeof(char) + VARINT64_MAX_SIZE];
+			writeRecordCell(tagged, value);
+			writeFixedCell(cell, tagged);
+		}
+		redisReply *reply = (redisReply *) redisCommand(con_,
+				"EVAL %s 2 %s %s %d %b %lld %d", UPDATE_FIELD_SCRIPT, key,
+				logkey, celloffset, cell,
+				(size_t) getFixedCellSize(section.types_[field]), bit,
+				value.fieldtype_ == FTNull ? 0 : 1);
+		if (reply && reply->type == REDIS_REPLY_INTEGER)
+			inplace = reply->integer > 0 ? 1 : 0;
+		else {
+			inplace = -1;
+			fprintf(stderr, "Redis eval command error: %s.\n",
+					reply && reply->type == REDIS_REPLY_ERROR ?
+							reply->str : "no reply");
+		}
+		if (reply)
+			freeReplyObject(reply);
+	}
+	if (header)
+		free(header);
+
+	bool updated = inplace > 0;
+	if (inplace == 0 && loglength >= 0) {
+		int length = 0;
+		char *logentry = LayerChangeLog::encodeField(fid, field, value,
+				&length);
+		updated = logentry && appendLog(con_, logkey, logentry, length);
+		if (logentry)
+			free(logentry);
+	}
+	free(logkey);
+	return updated;
+}
+
+// the row of feature fid with the fields logged for it, written to bytes if
+// not NULL; returns its size.
+static int compactRow(char *bytes, const RecordSection & section,
+		const char *row, long long fid, const LayerChangeLog & log) {
+	int bitmapsize = getRowBitmapSize(section.fieldcount_);
+	if (section.types_) {
+		if (bytes == NULL)
+			return section.stride_;
+		memcpy(bytes, row, section.stride_);
+		int offset = bitmapsize;
+		for (int i = 0; i < section.fieldcount_; ++i) {
+			int cellsize = getFixedCellSize(section.types_[i]);
+			const char *cell = log.getField(fid, i);
+			if (cell && *cell == FTNull) {
+				bytes[i / 8] &= ~(1 << (i % 8));
+				memset(bytes + offset, 0, cellsize);
+			} else if (cell) {
+				bytes[i / 8] |= 1 << (i % 8);
+				writeFixedCell(bytes + offset, cell);
+			}
+			offset += cellsize;
+		}
+		return section.stride_;
+	}
+
+	if (bytes)
+		memset(bytes, 0, bitmapsize);
+	int size = bitmapsize;
+	const char *stored = row + bitmapsize;
+	for (int i = 0; i < section.fieldcount_; ++i) {
+		const char *cell = NULL;
+		if (isFieldSet(row, i)) {
+			cell = stored;
+			stored += RecordFilter::getCellSize(stored);
+		}
+		const char *logged = log.getField(fid, i);
+		if (logged)
+			cell = *logged == FTNull ? NULL : logged;
+		if (cell == NULL)
+			continue;
+		int cellsize = RecordFilter::getCellSize(cell);
+		if (bytes) {
+			bytes[i / 8] |= 1 << (i % 8);
+			memcpy(bytes + size, cell, cellsize);
+		}
+		size += cellsize;
+	}
+	return size;
+}
+
+// the position of the feature starting at offset among the features
+// starting at offsets, -1 if none.
+static int findFeatureOffset(const int *offsets, int count, int offset) {
+	int low = 0, high = count;
+	while (low < high) {
+		int middle = low + (high - low) / 2;
+		if (offsets[middle] < offset)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	return low < count && offsets[low] == offset ? low : -1;
+}
+
+// KEYS: the layer value, its spatial index, its fid index and its change
+// log. ARGV: the compacted value and its indexes, the spatial one empty for
+// a layer without, then the length of the log compacted. the value and its
+// indexes are put and the log removed at once; 0, with nothing written, when
+// the log was appended to since.
+static const char *COMPACT_SCRIPT =
+		"if redis.call('STRLEN', KEYS[4]) ~= tonumber(ARGV[4]) then "
+				"return 0 end "
+				"redis.call('SET', KEYS[1], ARGV[1]) "
+				"if ARGV[2] ~= '' then redis.call('SET', KEYS[2], ARGV[2]) end "
+				"redis.call('SET', KEYS[3], ARGV[3]) "
+				"redis.call('DEL', KEYS[4]) "
+				"return 1";
+
+bool SpatialClient::compactLayer(const char *key) const {
+	if (key == NULL) {
+		fprintf(stderr, "Empty key.\n");
+		return false;
+	}
+	if (con_ == NULL) {
+		fprintf(stderr, "Redis connection is not available.\n");
+		return false;
+	}
+	char *logkey = suffixKey(key, ":log");
+	char *indexkey = suffixKey(key, ":rtree");
+	char *fidkey = suffixKey(key, ":fid");
+	long long loglength =
+			logkey && indexkey && fidkey ? getLogLength(con_, logkey) : -1;
+	LayerChangeLog *log = loglength > 0 ? getChangeLog(key) : NULL;
+	LayerFidIndex *fids = log ? getFidIndex(key) : NULL;
+	int size = 0;
+	char *bytes = fids ? get(key, &size) : NULL;
+	if (loglength == 0 || bytes == NULL) {
+		// nothing logged, or nothing to compact it into.
+		if (log && fids == NULL)
+			fprintf(stderr, "%s has no fid index.\n", key);
+		else if (fids)
+			fprintf(stderr, "Fail to get the layer bytes.\n");
+		delete log;
+		delete fids;
+		free(logkey);
+		free(indexkey);
+		free(fidkey);
+		return loglength == 0;
+	}
+
+	// the stored features and rows.
+	bool valid = checkLayerHead(bytes, size, true);
+	int featureoffset = valid ? featureSectionOffset(bytes) : 0;
+	int featurelength = 0, featurecount = 0;
+	valid = valid && featureoffset + (int) (2 * sizeof(int)) <= size;
+	if (valid) {
+		memcpy(&featurelength, bytes + featureoffset, sizeof(featurelength));
+		memcpy(&featurecount, bytes + featureoffset + sizeof(int),
+				sizeof(featurecount));
+	}
+	const char *entries = bytes + featureoffset + 2 * sizeof(int);
+	int recordoffset = featureoffset + 2 * sizeof(int) + featurelength;
+	valid = valid && featurelength >= (int) sizeof(int)
+			&& recordoffset <= size - (int) (3 * sizeof(int));
+	int *featureoffsets =
+			valid ? scanFeatureOffsets(entries, featurecount,
+							featurelength - sizeof(int)) :
+					NULL;
+	RecordSection section = { 0, 0, NULL, 0, NULL, 0 };
+	valid = featureoffsets
+			&& readRecordSection(bytes + recordoffset, size - recordoffset,
+					&section)
+			&& section.recordcount_ == featurecount
+			&& fids->getItemCount() == featurecount;
+	int rowslength = valid ? size - (int) (section.cells_ - bytes) : 0;
+	int *rowoffsets =
+			valid && section.stride_ == 0 ?
+					scanRecordOffsets(section.cells_, featurecount,
+							section.fieldcount_, rowslength) :
+					NULL;
+	valid = valid
+			&& (section.stride_ > 0 ?
+					(long long) section.stride_ * featurecount <= rowslength :
+					rowoffsets != NULL);
+	if (!valid)
+		fprintf(stderr, "%s does not hold a layer of its fid index.\n", key);
+
+	// the sizes of the features and rows as rewritten.
+	int *newoffsets = valid ?
+			(int *) malloc(sizeof(int) * (featurecount + 1)) : NULL;
+	int *newsizes = valid ?
+			(int *) malloc(sizeof(int) * (featurecount + 1)) : NULL;
+	if (valid && (newoffsets == NULL || newsizes == NULL)) {
+		fprintf(stderr, "Fail to alloc memory for feature ranges.\n");
+		valid = false;
+	}
+	long long newfeaturelength = sizeof(featurecount);
+	long long newrecordlength = writeRecordHeader(NULL, 0, 0,
+			section.fieldcount_, section.types_) - sizeof(int);
+	for (int i = 0; valid && i < featurecount; ++i) {
+		long long fid = fids->getFid(i);
+		const char *entry = log->getGeometry(fid);
+		if (entry) {
+			int wkbsize = 0;
+			memcpy(&wkbsize, entry + sizeof(int), sizeof(wkbsize));
+			newsizes[i] = 2 * sizeof(int) + wkbsize;
+		} else {
+			newsizes[i] = featureoffsets[i + 1] - featureoffsets[i];
+		}
+		newfeaturelength += newsizes[i];
+		const char *row = section.cells_
+				+ (section.stride_ > 0 ? i * section.stride_ : rowoffsets[i]);
+		if (log->contains(fid))
+			newrecordlength += compactRow(NULL, section, row, fid, *log);
+		else
+			newrecordlength += section.stride_ > 0 ?
+					section.stride_ : rowoffsets[i + 1] - rowoffsets[i];
+	}
+	long long newlength = featureoffset - sizeof(int) + newfeaturelength
+			+ newrecordlength + 3 * sizeof(int);
+	if (valid && newlength + (long long) sizeof(int) > LAYER_MAX_LENGTH) {
+		fprintf(stderr, "Layer passes the %lld bytes of a layer value.\n",
+				LAYER_MAX_LENGTH);
+		valid = false;
+	}
+	char *value = valid ? (char *) malloc(newlength + sizeof(int)) : NULL;
+	if (valid && value == NULL)
+		fprintf(stderr, "Fail to alloc memory for bytes.\n");
+
+	// the head as stored, the features and rows in their stored order.
+	LayerFidIndex newfids;
+	int offset = 0;
+	if (value) {
+		int intlength = (int) newlength;
+		memcpy(value + offset, &intlength, sizeof(intlength));
+		offset += sizeof(intlength);
+		memcpy(value + offset, bytes + offset, featureoffset - offset);
+		offset = featureoffset;
+		int intfeaturelength = (int) newfeaturelength;
+		memcpy(value + offset, &intfeaturelength, sizeof(intfeaturelength));
+		offset += sizeof(intfeaturelength);
+		memcpy(value + offset, &featurecount, sizeof(featurecount));
+		offset += sizeof(featurecount);
+		for (int i = 0; i < featurecount; ++i) {
+			long long fid = fids->getFid(i);
+			const char *entry = log->getGeometry(fid);
+			if (entry == NULL)
+				entry = entries + featureoffsets[i];
+			newoffsets[i] = offset;
+			memcpy(value + offset, entry, newsizes[i]);
+			offset += newsizes[i];
+			newfids.add(fid, newoffsets[i], newsizes[i]);
+		}
+		// the int after the features is not read.
+		memset(value + offset, 0, sizeof(int));
+		offset += sizeof(int);
+		offset += writeRecordHeader(value + offset,
+				(int) newrecordlength, featurecount, section.fieldcount_,
+				section.types_);
+		for (int i = 0; i < featurecount; ++i) {
+			long long fid = fids->getFid(i);
+			const char *row = section.cells_
+					+ (section.stride_ > 0 ?
+							i * section.stride_ : rowoffsets[i]);
+			if (log->contains(fid)) {
+				offset += compactRow(value + offset, section, row, fid, *log);
+			} else {
+				int rowsize = section.stride_ > 0 ?
+						section.stride_ : rowoffsets[i + 1] - rowoffsets[i];
+				memcpy(value + offset, row, rowsize);
+				offset += rowsize;
+			}
+		}
+		assert(offset == newlength + (long long) sizeof(int));
+		newfids.finish();
+	}
+
+	// the spatial index, over the same boxes but where features changed.
+	LayerSpatialIndex *index = NULL;
+	int indexsize = 0;
+	char *indexbytes = value ? getIfExists(con_, indexkey, &indexsize) : NULL;
+	bool indexed = indexbytes != NULL;
+	if (indexed) {
+		LayerSpatialIndex oldindex(indexbytes, indexsize);
+		LayerEnvelope *boxes =
+				indexsize == oldindex.getIndexLength()
+						&& oldindex.getItemCount() == featurecount ?
+						oldindex.getItemBoxes() : NULL;
+		if (boxes) {
+			index = new LayerSpatialIndex(oldindex.getNodeSize());
+			int entrybase = featureoffset + 2 * sizeof(int);
+			for (int item = 0; item < featurecount; ++item) {
+				int i = findFeatureOffset(featureoffsets, featurecount,
+						oldindex.getItemOffset(item) - entrybase);
+				if (i < 0) {
+					delete index;
+					index = NULL;
 					break;
 				}
-				default:
-					break;
+				LayerEnvelope box = boxes[item];
+				const char *entry = log->getGeometry(fids->getFid(i));
+				OGRGeometry *geometry = entry ? decodeGeometry(entry) : NULL;
+				if (geometry) {
+					OGREnvelope envelope;
+					geometry->getEnvelope(&envelope);
+					box.minx_ = envelope.MinX;
+					box.miny_ = envelope.MinY;
+					box.maxx_ = envelope.MaxX;
+					box.maxy_ = envelope.MaxY;
+					delete geometry;
 				}
-
+				index->add(box.minx_, box.miny_, box.maxx_, box.maxy_,
+						newoffsets[i], newsizes[i]);
 			}
-
+			free(boxes);
 		}
+		if (index == NULL)
+			fprintf(stderr, "%s does not hold a spatial index of the layer.\n",
+					indexkey);
+		free(indexbytes);
 	}
 
-	assert(offset2 == length);
+	// the value, its indexes and the log, all at once; never a value its
+	// indexes do not describe.
+	const char *indexvalue = NULL, *fidvalue = NULL;
+	if (index) {
+		index->finish();
+		indexvalue = index->getBytes();
+	}
+	if (value)
+		fidvalue = newfids.getBytes();
+	bool compacted = false;
+	if (value && (!indexed || indexvalue) && fidvalue) {
+		redisReply *reply = (redisReply *) redisCommand(con_,
+				"EVAL %s 4 %s %s %s %s %b %b %b %lld", COMPACT_SCRIPT, key,
+				indexkey, fidkey, logkey, value,
+				(size_t) newlength + sizeof(int), indexvalue ? indexvalue : "",
+				indexvalue ? (size_t) index->getIndexLength() : (size_t) 0,
+				fidvalue, (size_t) newfids.getIndexLength(), loglength);
+		if (reply && reply->type == REDIS_REPLY_INTEGER) {
+			compacted = reply->integer > 0;
+			if (!compacted)
+				fprintf(stderr, "%s was logged to since, compact it again.\n",
+						key);
+		} else {
+			fprintf(stderr, "Redis eval command error: %s.\n",
+					reply && reply->type == REDIS_REPLY_ERROR ?
+							reply->str : "no reply");
+		}
+		if (reply)
+			freeReplyObject(reply);
+	}
 
-	return poLayer;
+	delete index;
+	if (value)
+		free(value);
+	free(newoffsets);
+	free(newsizes);
+	free(featureoffsets);
+	free(rowoffsets);
+	free(bytes);
+	delete log;
+	delete fids;
+	free(logkey);
+	free(indexkey);
+	free(fidkey);
+	return compacted;
 }
 
 void SpatialClient::putMetadata(const char *key, OGRLayer *layer) const {
-	LayerMetadata metadata(layer);
-	putMetadata(key, &metadata);
+	LayerSnapshot snapshot(layer, SNAPSHOT_METADATA);
+	putMetadata(key, snapshot.getMetadata());
 }
 
 void SpatialClient::putMetadata(const char *key,
@@ -745,8 +3821,8 @@ LayerMetadata * SpatialClient::getMetadata(const char *key) const {
 
 void SpatialClient::putAttributeDef(const char *key,
 		OGRLayer *layer) const {
-	LayerAttrDef attrdef(layer);
-	putAttributeDef(key, &attrdef);
+	LayerSnapshot snapshot(layer, SNAPSHOT_ATTRDEF);
+	putAttributeDef(key, snapshot.getAttrDef());
 }
 void SpatialClient::putAttributeDef(const char *key,
 		LayerAttrDef * attrdef) const {
@@ -787,8 +3863,8 @@ LayerAttrDef * SpatialClient::getAttributeDef(const char *key) const {
 
 void SpatialClient::putAllFeatures(const char *key,
 		OGRLayer *layer) const {
-	LayerAllFeatures features(layer);
-	putAllFeatures(key, &features);
+	LayerSnapshot snapshot(layer, SNAPSHOT_FEATURES);
+	putAllFeatures(key, snapshot.getAllFeatures());
 }
 
 void SpatialClient::putAllFeatures(const char *key,
@@ -818,6 +3894,8 @@ LayerAllFeatures * SpatialClient::getAllFeatures(const char *key) const {
 		fprintf(stderr, "Empty key.\n");
 		return NULL;
 	}
+	if (!checkNoChangeLog(con_, key))
+		return NULL;
 	char *bytes = get(key);
 
 	if (bytes == NULL) {
@@ -830,8 +3908,8 @@ LayerAllFeatures * SpatialClient::getAllFeatures(const char *key) const {
 
 void SpatialClient::putAllRecords(const char *key,
 		OGRLayer *layer) const {
-	LayerAllRecords records(layer);
-	putAllRecords(key, &records);
+	LayerSnapshot snapshot(layer, SNAPSHOT_RECORDS);
+	putAllRecords(key, snapshot.getAllRecords());
 }
 
 void SpatialClient::putAllRecords(const char *key,
@@ -861,6 +3939,8 @@ LayerAllRecords * SpatialClient::getAllRecords(const char *key) const {
 		fprintf(stderr, "Empty key.\n");
 		return NULL;
 	}
+	if (!checkNoChangeLog(con_, key))
+		return NULL;
 	char *bytes = get(key);
 
 	if (bytes == NULL) {
@@ -870,3 +3950,49 @@ LayerAllRecords * SpatialClient::getAllRecords(const char *key) const {
 	LayerAllRecords *records = new LayerAllRecords(bytes);
 	return records;
 }
+
+#if __cplusplus >= 201103L
+std::unique_ptr<LayerMetadata> SpatialClient::getUniqueMetadata(
+		const char *key) const {
+	return std::unique_ptr<LayerMetadata>(getMetadata(key));
+}
+
+std::unique_ptr<LayerAttrDef> SpatialClient::getUniqueAttributeDef(
+		const char *key) const {
+	return std::unique_ptr<LayerAttrDef>(getAttributeDef(key));
+}
+
+std::unique_ptr<LayerAllFeatures> SpatialClient::getUniqueAllFeatures(
+		const char *key) const {
+	return std::unique_ptr<LayerAllFeatures>(getAllFeatures(key));
+}
+
+std::unique_ptr<LayerAllRecords> SpatialClient::getUniqueAllRecords(
+		const char *key) const {
+	return std::unique_ptr<LayerAllRecords>(getAllRecords(key));
+}
+
+std::unique_ptr<LayerAllFeatures> SpatialClient::getUniqueFeaturesInBBox(
+		const char *key, double minx, double miny, double maxx,
+		double maxy) const {
+	return std::unique_ptr<LayerAllFeatures>(
+			getFeaturesInBBox(key, minx, miny, maxx, maxy));
+}
+
+std::unique_ptr<LayerAllFeatures> SpatialClient::getUniqueFeaturesByFid(
+		const char *key, const long long *fids, int fidcount) const {
+	return std::unique_ptr<LayerAllFeatures>(
+			getFeaturesByFid(key, fids, fidcount));
+}
+
+std::unique_ptr<LayerAllFeatures> SpatialClient::getUniqueFeaturesWhere(
+		const char *key, const char *where,
+		std::unique_ptr<LayerAllRecords> *records) const {
+	LayerAllRecords *matched = NULL;
+	std::unique_ptr<LayerAllFeatures> features(
+			getFeaturesWhere(key, where, records ? &matched : 0));
+	if (records)
+		records->reset(matched);
+	return features;
+}
+#endif
@@ -11,10 +11,35 @@
 #include "layerAttrDef.h"
 #include "layerAllFeatures.h"
 #include "layerAllRecords.h"
+#include "layerSnapshot.h"
+#include "layerSpatialIndex.h"
+#include "layerFidIndex.h"
+#include "layerTiler.h"
+#include "geoJsonWriter.h"
+
+#if __cplusplus >= 201103L
+#include <memory>
+#endif
 
 struct redisContext;
 class OGRLayer;
+class OGRGeometry;
+class OGRDataSource;
 class LayerMetadata;
+class LayerChangeLog;
+
+// options of putLayer, may be or'ed together.
+typedef enum {
+	PUT_DEFAULT = 0,
+	PUT_SPATIAL_INDEX = 1,
+	PUT_HILBERT_ORDER = 2,
+	PUT_MORTON_ORDER = 4,
+	PUT_FID_INDEX = 8
+} PutLayerOption;
+
+// the most bytes of one part of a layer put by putLayerParts, below the
+// 512 MB proto-max-bulk-len redis caps a value at by default.
+static const long long LAYER_PART_LENGTH = 1 << 28;
 
 class SpatialClient {
 public:
@@ -28,10 +53,105 @@ public:
 	char *get(const char *key, int *size) const; // size: return size of the value.
 	bool put(const char *key, const char *value) const;
 	bool put(const char *key, const char *value, int size) const; //size means value size.
+	char *getRange(const char *key, int start, int end, int *size = 0) const; // bytes [start, end] of the value.
+	bool remove(const char *key) const;
+	// the keys matching a glob-style pattern, by SCAN: keys changed during
+	// the scan may be missed or repeated. the keys and the array are free()
+	// by caller.
+	char **scanKeys(const char *pattern, int *count) const;
 
-	void putLayer(const char *key, OGRLayer *layer) const;
+	// the spatial index, if asked for, is stored under "key:rtree". with a
+	// curve order the features are stored along the curve, and "key:order"
+	// holds the source reading position of every stored feature. the fid
+	// index, if asked for, is stored under "key:fid": getLayer then gives
+	// the features their source fids back. the value and its indexes are
+	// put at once; false, with the reason on stderr and nothing written, on
+	// failure.
+	bool putLayer(const char *key, OGRLayer *layer, int options = PUT_DEFAULT) const;
+	// the same value as putLayer, streamed: the layer is read, encoded and
+	// sent in chunks at once, and only a few chunks are held at a time. the
+	// value and its indexes are built under "key:stream:n" and replace the
+	// old ones at once when complete. curve orders need the whole layer and
+	// are not supported.
+	bool putLayerStream(const char *key, OGRLayer *layer,
+			int options = PUT_DEFAULT) const;
+	// a layer of any size, read once and put as layer values of at most
+	// partLength bytes under "key:part:0", "key:part:1"..., each by
+	// putLayerStream with the options. "key:parts" holds the part count and
+	// the 64-bit feature count and length of the whole layer. every part is
+	// an ordinary layer value: the reads of one key run on one part. parts
+	// are not to be read beside a put of the same key.
+	bool putLayerParts(const char *key, OGRLayer *layer,
+			int options = PUT_DEFAULT,
+			long long partLength = LAYER_PART_LENGTH) const;
+	// the number of parts, -1 when the key was not put in parts.
+	int getLayerPartCount(const char *key, long long *featurecount = 0,
+			long long *length = 0) const;
+	// the parts of a layer, in order, as one layer in datasource, or in a
+	// new Memory datasource when it is NULL.
+	OGRLayer *getLayerParts(const char *key, OGRDataSource *datasource = 0) const;
 	OGRLayer *getLayer(const char *key) const;
+	// the layer created in datasource, e.g. a file of an OGR driver. NULL
+	// when the key does not hold a whole layer.
+	OGRLayer *getLayer(const char *key, OGRDataSource *datasource) const;
+	// the layer as GeoJSON, written from its bytes without building OGR
+	// objects.
+	bool getLayerGeoJson(const char *key, GeoJsonWriter *writer) const;
+	int *getFeatureOrder(const char *key, int *count) const; // free() by caller.
+	LayerAllFeatures *getFeaturesInBBox(const char *key, double minx,
+			double miny, double maxx, double maxy) const;
+	// features by source fid through "key:fid", reading only the probed
+	// slots of the index and the features. the features are in the order of
+	// fids; fids the layer does not hold are left out.
+	LayerAllFeatures *getFeatureByFid(const char *key, long long fid) const;
+	LayerAllFeatures *getFeaturesByFid(const char *key, const long long *fids,
+			int fidcount) const;
+	// changes of one feature of a layer put with PUT_FID_INDEX. a geometry
+	// of the same encoded size, or a field of fixed-stride records, is
+	// overwritten in place by SETRANGE (with its "key:rtree" box); any other
+	// change, and every change once the layer has one, is appended to the
+	// change log "key:log". getLayer and getFeaturesByFid merge the log,
+	// the other reads fail while it holds changes, until compactLayer(). a
+	// value of fieldtype_ FTNull unsets the field, any other must be of the
+	// type of the field. false, with the reason on stderr, on failure.
+	bool updateFeatureGeometry(const char *key, long long fid,
+			const OGRGeometry *geometry) const;
+	bool updateRecordField(const char *key, long long fid, int field,
+			const LayerRecordField & value) const;
+	// rewrites the layer value with the changes of its log, in the same
+	// feature order, rebuilds its spatial and fid indexes and removes the
+	// log, all put at once. fails, to be run again, when the layer was
+	// updated meanwhile.
+	bool compactLayer(const char *key) const;
+	// features whose records match a RecordFilter where clause, and with
+	// records given, their records. the filter runs over the stored
+	// records; only matching features are read and decoded.
+	LayerAllFeatures *getFeaturesWhere(const char *key, const char *where,
+			LayerAllRecords **records = 0) const;
+	// the same queries answered inside redis by spatialModule (SC.BBOX and
+	// SC.FILTER): only the matching features and records are sent back.
+	LayerAllFeatures *getServerFeaturesInBBox(const char *key, double minx,
+			double miny, double maxx, double maxy,
+			LayerAllRecords **records = 0) const;
+	LayerAllFeatures *getServerFeaturesWhere(const char *key,
+			const char *where, LayerAllRecords **records = 0) const;
 
+	// web mercator tiles of zoom minZoom to maxZoom, stored under
+	// "key:z:x:y" by one writer per cpu. a tile holds a LayerAllFeatures and
+	// a LayerAllRecords of the features touching it, clipped to the tile and
+	// its buffer and simplified for the zoom. the pyramid is walked down
+	// from the world tile, and only the children of tiles touched by a
+	// feature extent are visited. tiles without features are not stored,
+	// nor are tiles of an earlier pyramid removed. TILE_MVT stores mapbox
+	// vector tiles instead. false, with the reason or the count of failed
+	// tiles on stderr, if the layer could not be tiled or a tile not stored.
+	bool putLayerTiles(const char *key, OGRLayer *layer, int minZoom,
+			int maxZoom, TileFormat format = TILE_LAYER) const;
+	char *getTile(const char *key, int z, int x, int y, int *size) const;
+
+	// each put of a part from an OGRLayer reads the layer. to put several
+	// parts of one layer, read it once into a LayerSnapshot and put its
+	// parts instead.
 	void putMetadata(const char *key, OGRLayer *layer) const;
 	void putMetadata(const char *key, LayerMetadata *metadata) const;
 	LayerMetadata * getMetadata(const char *key) const;
@@ -47,12 +167,46 @@ public:
 	void putAllRecords(const char *key, OGRLayer *layer) const;
 	void putAllRecords(const char *key, LayerAllRecords * allrecords) const;
 	LayerAllRecords * getAllRecords(const char *key) const;
+
+#if __cplusplus >= 201103L
+	// the getters above that return a new object, with the object owned by
+	// the unique_ptr; NULL where they give NULL.
+	std::unique_ptr<LayerMetadata> getUniqueMetadata(const char *key) const;
+	std::unique_ptr<LayerAttrDef> getUniqueAttributeDef(const char *key) const;
+	std::unique_ptr<LayerAllFeatures> getUniqueAllFeatures(
+			const char *key) const;
+	std::unique_ptr<LayerAllRecords> getUniqueAllRecords(
+			const char *key) const;
+	std::unique_ptr<LayerAllFeatures> getUniqueFeaturesInBBox(
+			const char *key, double minx, double miny, double maxx,
+			double maxy) const;
+	std::unique_ptr<LayerAllFeatures> getUniqueFeaturesByFid(
+			const char *key, const long long *fids, int fidcount) const;
+	std::unique_ptr<LayerAllFeatures> getUniqueFeaturesWhere(
+			const char *key, const char *where,
+			std::unique_ptr<LayerAllRecords> *records = 0) const;
+#endif
 private:
 	SpatialClient(const SpatialClient &);
 	void operator=(const SpatialClient &);
-	char *serialize(OGRLayer *poLayer) const;
-	OGRLayer *deserialize(const char *bytes) const;
+	char *serialize(OGRLayer *poLayer, LayerSpatialIndex *index = 0,
+			SpatialCurveType curve = CURVE_NONE, int **order = 0,
+			LayerFidIndex *fidindex = 0) const;
+	// into a new Memory datasource when pds is NULL. with fids, the features
+	// get their stored fids, and the changes of a log are merged.
+	OGRLayer *deserialize(const char *bytes, OGRDataSource *pds = 0,
+			const LayerFidIndex *fids = 0, const LayerChangeLog *log = 0) const;
+	// NULL, quietly, when the layer has none.
+	LayerFidIndex *getFidIndex(const char *key) const;
+	LayerChangeLog *getChangeLog(const char *key) const;
+	redisContext *openConnection() const;
+	static void *putTilesWorker(void *job);
+	static void *putStreamWriter(void *job);
+
 	redisContext *con_;
+	char *ip_;
+	int port_;
+	int dbno_;
 };
 
 #endif /* SPATIALCLIENT_H_ */
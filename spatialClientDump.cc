@@ -0,0 +1,541 @@
+/// @file spatialClientDump.cc
+/// @author luliang@ict.ac.cn
+/// @copybrief Copyright 2013 ICT, CAS. All rights reserved.
+/// @version 0.1
+/// @date 2026-10-19
+
+// spatialclient-dump: writes the layers in redis back to files.
+//
+//   spatialclient-dump [-h host] [-p port] [-n db] [-j jobs] [-o dir]
+//                      [-f gpkg|shp|raw] [pattern ...]
+//   spatialclient-dump [-h host] [-p port] [-n db] [-j jobs] [-o dir] -R
+//
+// the keys matching the patterns, "*" by default, are found with SCAN and
+// shared by the jobs, each fetching on a connection of its own. gpkg and shp
+// write every layer to a file of that OGR driver, named after its key; the
+// rtree, order, fid, stream and tile keys beside the layers are left out. a
+// layer put in parts is found by its "key:parts" and written as one layer,
+// its "key:part:n" values are left out. raw
+// writes the value of every matching key as it is, with a manifest of
+// "file<TAB>size<TAB>key" lines, and -R puts such a dump back.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include "ogrsf_frmts.h"
+
+#include "spatialClient.h"
+
+static const char *MANIFEST_NAME = "manifest.txt";
+static const int PROGRESS_STEP = 1000;
+
+typedef enum {
+	DUMP_GPKG, DUMP_SHP, DUMP_RAW, DUMP_RESTORE
+} DumpMode;
+
+typedef struct {
+	const char *host_;
+	int port_;
+	int dbno_;
+	const char *dir_;
+	DumpMode mode_;
+
+	char **keys_;
+	int count_;
+	// raw dumps and restores: the value size of every key, -1 if not done.
+	long long *sizes_;
+	int next_;
+
+	// progress, all under the mutex.
+	pthread_mutex_t mutex_;
+	int done_;
+	int failed_;
+	long long bytes_;
+} DumpJob;
+
+static double now() {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void freeKeys(char **keys, int count) {
+	for (int i = 0; i < count; ++i)
+		free(keys[i]);
+	if (keys)
+		free(keys);
+}
+
+static bool endsWith(const char *key, const char *suffix) {
+	int keylength = strlen(key), suffixlength = strlen(suffix);
+	return keylength >= suffixlength
+			&& strcmp(key + keylength - suffixlength, suffix) == 0;
+}
+
+static bool isNumber(const char *begin, const char *end) {
+	if (begin == end)
+		return false;
+	for (const char *c = begin; c < end; ++c) {
+		if (!isdigit((unsigned char) *c))
+			return false;
+	}
+	return true;
+}
+
+// "key:part:n", a part of a layer put in parts.
+static bool isPartKey(const char *key) {
+	static const char PART[] = ":part";
+	int partlength = sizeof(PART) - 1;
+	const char *colon = strrchr(key, ':');
+	return colon && isNumber(colon + 1, key + strlen(key))
+			&& colon - key >= partlength
+			&& strncmp(colon - partlength, PART, partlength) == 0;
+}
+
+// the keys SpatialClient puts beside a layer: "key:rtree", "key:order",
+// "key:fid", "key:log", "key:stream", "key:stream:n[:records]", parts
+// "key:part:n" and tiles "key:z:x:y". "key:parts" stands for the layer of
+// the parts.
+static bool isLayerKey(const char *key) {
+	if (endsWith(key, ":rtree") || endsWith(key, ":order")
+			|| endsWith(key, ":fid") || endsWith(key, ":log")
+			|| endsWith(key, ":stream") || strstr(key, ":stream:")
+			|| isPartKey(key))
+		return false;
+	const char *end = key + strlen(key);
+	for (int i = 0; i < 3; ++i) {
+		const char *colon = end - 1;
+		while (colon >= key && *colon != ':')
+			--colon;
+		if (colon < key || !isNumber(colon + 1, end))
+			return true;
+		end = colon;
+	}
+	return false;
+}
+
+static char *joinPath(const char *dir, const char *name) {
+	int length = strlen(dir) + strlen(name) + 2;
+	char *path = (char *) malloc(length);
+	if (path == NULL) {
+		fprintf(stderr, "Fail to alloc memory for path.\n");
+		return NULL;
+	}
+	snprintf(path, length, "%s/%s", dir, name);
+	return path;
+}
+
+// the file of a layer: its key, with what a file name may not hold as '_'.
+static char *layerPath(const char *dir, const char *key, const char *extension) {
+	int keylength = strlen(key);
+	char *name = (char *) malloc(keylength + strlen(extension) + 1);
+	if (name == NULL) {
+		fprintf(stderr, "Fail to alloc memory for path.\n");
+		return NULL;
+	}
+	for (int i = 0; i < keylength; ++i) {
+		char c = key[i];
+		name[i] = isalnum((unsigned char) c) || c == '-' || c == '_'
+				|| (c == '.' && i > 0) ? c : '_';
+	}
+	strcpy(name + keylength, extension);
+	char *path = joinPath(dir, name);
+	free(name);
+	return path;
+}
+
+static char *rawName(int index) {
+	char name[32];
+	snprintf(name, sizeof(name), "%08d.bin", index);
+	return strdup(name);
+}
+
+static bool dumpLayer(SpatialClient *client, DumpJob *job, const char *key) {
+	// a layer put in parts, by its "key:parts".
+	bool parts = endsWith(key, ":parts");
+	char *layerkey = strdup(key);
+	if (layerkey == NULL) {
+		fprintf(stderr, "Fail to alloc memory for key.\n");
+		return false;
+	}
+	if (parts)
+		layerkey[strlen(layerkey) - strlen(":parts")] = '\0';
+	const char *drivername = job->mode_ == DUMP_GPKG ? "GPKG" : "ESRI Shapefile";
+	char *path = layerPath(job->dir_, layerkey,
+			job->mode_ == DUMP_GPKG ? ".gpkg" : ".shp");
+	if (path == NULL) {
+		free(layerkey);
+		return false;
+	}
+	OGRSFDriver *driver =
+			OGRSFDriverRegistrar::GetRegistrar()->GetDriverByName(drivername);
+	OGRDataSource *datasource = driver ? driver->CreateDataSource(path) : NULL;
+	if (datasource == NULL) {
+		fprintf(stderr, "Can not create %s with driver %s.\n", path, drivername);
+		free(path);
+		free(layerkey);
+		return false;
+	}
+	OGRLayer *layer = parts ? client->getLayerParts(layerkey, datasource) :
+			client->getLayer(layerkey, datasource);
+	OGRDataSource::DestroyDataSource(datasource);
+	if (layer == NULL)
+		unlink(path);
+	free(path);
+	free(layerkey);
+	return layer != NULL;
+}
+
+static long long dumpRaw(SpatialClient *client, DumpJob *job, int index) {
+	int size = 0;
+	char *bytes = client->get(job->keys_[index], &size);
+	if (bytes == NULL)
+		return -1;
+	char *name = rawName(index);
+	char *path = name ? joinPath(job->dir_, name) : NULL;
+	FILE *file = path ? fopen(path, "wb") : NULL;
+	bool succeeded = file != NULL
+			&& fwrite(bytes, 1, size, file) == (size_t) size;
+	if (file && fclose(file) != 0)
+		succeeded = false;
+	if (!succeeded)
+		fprintf(stderr, "Can not write %s.\n", path ? path : job->keys_[index]);
+	free(bytes);
+	if (name)
+		free(name);
+	if (path)
+		free(path);
+	return succeeded ? size : -1;
+}
+
+static long long restoreRaw(SpatialClient *client, DumpJob *job, int index) {
+	char *name = rawName(index);
+	char *path = name ? joinPath(job->dir_, name) : NULL;
+	long long size = job->sizes_[index];
+	char *bytes = size >= 0 ? (char *) malloc(size + 1) : NULL;
+	FILE *file = path && bytes ? fopen(path, "rb") : NULL;
+	if (bytes)
+		bytes[size] = '\0'; // put takes an empty value as a string.
+	bool succeeded = file != NULL && fread(bytes, 1, size, file) == (size_t) size
+			&& client->put(job->keys_[index], bytes, (int) size);
+	if (!succeeded)
+		fprintf(stderr, "Can not restore %s from %s.\n", job->keys_[index],
+				path ? path : "its file");
+	if (file)
+		fclose(file);
+	if (bytes)
+		free(bytes);
+	if (name)
+		free(name);
+	if (path)
+		free(path);
+	return succeeded ? size : -1;
+}
+
+static void *dumpWorker(void *arg) {
+	DumpJob *job = (DumpJob *) arg;
+	SpatialClient client;
+	if (!client.connect(job->host_, job->port_, job->dbno_))
+		return NULL;
+
+	for (;;) {
+		pthread_mutex_lock(&job->mutex_);
+		int index = job->next_++;
+		pthread_mutex_unlock(&job->mutex_);
+		if (index >= job->count_)
+			break;
+
+		long long size = -1;
+		if (job->mode_ == DUMP_RAW)
+			size = dumpRaw(&client, job, index);
+		else if (job->mode_ == DUMP_RESTORE)
+			size = restoreRaw(&client, job, index);
+		else
+			size = dumpLayer(&client, job, job->keys_[index]) ? 0 : -1;
+		if (job->mode_ == DUMP_RAW)
+			job->sizes_[index] = size;
+
+		pthread_mutex_lock(&job->mutex_);
+		++job->done_;
+		if (size < 0)
+			++job->failed_;
+		else
+			job->bytes_ += size;
+		if (job->done_ % PROGRESS_STEP == 0 || job->done_ == job->count_)
+			fprintf(stderr, "[%d/%d] %d failed\n", job->done_, job->count_,
+					job->failed_);
+		pthread_mutex_unlock(&job->mutex_);
+	}
+	return NULL;
+}
+
+static bool writeManifest(DumpJob *job) {
+	char *path = joinPath(job->dir_, MANIFEST_NAME);
+	FILE *file = path ? fopen(path, "w") : NULL;
+	if (file == NULL) {
+		fprintf(stderr, "Can not write the manifest %s.\n",
+				path ? path : MANIFEST_NAME);
+		if (path)
+			free(path);
+		return false;
+	}
+	for (int i = 0; i < job->count_; ++i) {
+		if (job->sizes_[i] < 0)
+			continue;
+		fprintf(file, "%08d.bin\t%lld\t%s\n", i, job->sizes_[i], job->keys_[i]);
+	}
+	bool succeeded = fclose(file) == 0;
+	if (!succeeded)
+		fprintf(stderr, "Can not write the manifest %s.\n", path);
+	free(path);
+	return succeeded;
+}
+
+// the keys and sizes of a raw dump, by the index in their file names.
+static bool readManifest(DumpJob *job) {
+	char *path = joinPath(job->dir_, MANIFEST_NAME);
+	FILE *file = path ? fopen(path, "r") : NULL;
+	if (file == NULL) {
+		fprintf(stderr, "Can not read the manifest %s.\n",
+				path ? path : MANIFEST_NAME);
+		if (path)
+			free(path);
+		return false;
+	}
+	free(path);
+	bool succeeded = true;
+	int capacity = 0;
+	char line[65536];
+	while (succeeded && fgets(line, sizeof(line), file)) {
+		int length = strlen(line);
+		if (length > 0 && line[length - 1] == '\n')
+			line[--length] = '\0';
+		int index = -1;
+		long long size = -1;
+		int keyoffset = 0;
+		if (sscanf(line, "%d.bin\t%lld\t%n", &index, &size, &keyoffset) < 2
+				|| keyoffset == 0 || index < 0 || size < 0
+				|| size > 0x7fffffff) {
+			fprintf(stderr, "Bad manifest line: %s\n", line);
+			succeeded = false;
+			break;
+		}
+		if (index >= capacity) {
+			int grown = capacity ? capacity : 1024;
+			while (grown <= index)
+				grown *= 2;
+			char **keys = (char **) realloc(job->keys_, sizeof(char *) * grown);
+			if (keys)
+				job->keys_ = keys;
+			long long *sizes = (long long *) realloc(job->sizes_,
+					sizeof(long long) * grown);
+			if (sizes)
+				job->sizes_ = sizes;
+			if (keys == NULL || sizes == NULL) {
+				fprintf(stderr, "Fail to alloc memory for the manifest.\n");
+				succeeded = false;
+				break;
+			}
+			for (int i = capacity; i < grown; ++i) {
+				job->keys_[i] = NULL;
+				job->sizes_[i] = -1;
+			}
+			capacity = grown;
+		}
+		if (job->keys_[index]) {
+			fprintf(stderr, "Bad manifest line: %s\n", line);
+			succeeded = false;
+			break;
+		}
+		job->keys_[index] = strdup(line + keyoffset);
+		job->sizes_[index] = size;
+		if (job->keys_[index] == NULL) {
+			fprintf(stderr, "Fail to alloc memory for the manifest.\n");
+			succeeded = false;
+		}
+		if (index >= job->count_)
+			job->count_ = index + 1;
+	}
+	fclose(file);
+	// a manifest leaves out the keys that failed to dump.
+	int count = 0;
+	for (int i = 0; i < job->count_; ++i) {
+		if (job->keys_[i]) {
+			job->keys_[count] = job->keys_[i];
+			job->sizes_[count] = job->sizes_[i];
+			++count;
+		}
+	}
+	job->count_ = count;
+	return succeeded;
+}
+
+static void usage(const char *program) {
+	fprintf(stderr,
+			"usage: %s [-h host] [-p port] [-n db] [-j jobs] [-o dir]"
+					" [-f gpkg|shp|raw] [pattern ...]\n"
+					"       %s [-h host] [-p port] [-n db] [-j jobs] [-o dir] -R\n",
+			program, program);
+}
+
+int main(int argc, char *argv[]) {
+	DumpJob job;
+	memset(&job, 0, sizeof(job));
+	job.host_ = "127.0.0.1";
+	job.port_ = 6379;
+	job.dir_ = ".";
+	job.mode_ = DUMP_GPKG;
+	int jobs = 4;
+
+	int option;
+	while ((option = getopt(argc, argv, "h:p:n:j:o:f:R")) != -1) {
+		switch (option) {
+		case 'h':
+			job.host_ = optarg;
+			break;
+		case 'p':
+			job.port_ = atoi(optarg);
+			break;
+		case 'n':
+			job.dbno_ = atoi(optarg);
+			break;
+		case 'j':
+			jobs = atoi(optarg);
+			break;
+		case 'o':
+			job.dir_ = optarg;
+			break;
+		case 'f':
+			if (strcmp(optarg, "gpkg") == 0)
+				job.mode_ = DUMP_GPKG;
+			else if (strcmp(optarg, "shp") == 0)
+				job.mode_ = DUMP_SHP;
+			else if (strcmp(optarg, "raw") == 0)
+				job.mode_ = DUMP_RAW;
+			else {
+				usage(argv[0]);
+				return 2;
+			}
+			break;
+		case 'R':
+			job.mode_ = DUMP_RESTORE;
+			break;
+		default:
+			usage(argv[0]);
+			return 2;
+		}
+	}
+	if (jobs < 1 || (job.mode_ == DUMP_RESTORE && optind < argc)) {
+		usage(argv[0]);
+		return 2;
+	}
+	if (job.mode_ != DUMP_RESTORE && mkdir(job.dir_, 0755) != 0) {
+		struct stat st;
+		if (stat(job.dir_, &st) != 0 || !S_ISDIR(st.st_mode)) {
+			fprintf(stderr, "Can not create directory %s.\n", job.dir_);
+			return 1;
+		}
+	}
+
+	double start = now();
+	bool succeeded = true;
+	if (job.mode_ == DUMP_RESTORE) {
+		succeeded = readManifest(&job);
+	} else {
+		// the keys of all patterns; one scanning connection is enough, the
+		// keys come back a thousand at a time.
+		SpatialClient client;
+		succeeded = client.connect(job.host_, job.port_, job.dbno_);
+		const char *all = "*";
+		const char **patterns = optind < argc ? (const char **) argv + optind : &all;
+		int patterncount = optind < argc ? argc - optind : 1;
+		int capacity = 0;
+		for (int i = 0; succeeded && i < patterncount; ++i) {
+			int count = 0;
+			char **keys = client.scanKeys(patterns[i], &count);
+			if (keys == NULL) {
+				succeeded = false;
+				break;
+			}
+			for (int j = 0; j < count; ++j) {
+				bool wanted = job.mode_ == DUMP_RAW ? strchr(keys[j], '\n') == NULL
+						: isLayerKey(keys[j]);
+				if (!wanted || !succeeded) {
+					free(keys[j]);
+					continue;
+				}
+				if (job.count_ == capacity) {
+					capacity = capacity ? capacity * 2 : 1024;
+					char **grown = (char **) realloc(job.keys_,
+							sizeof(char *) * capacity);
+					if (grown == NULL) {
+						fprintf(stderr, "Fail to alloc memory for keys.\n");
+						free(keys[j]);
+						succeeded = false;
+						continue;
+					}
+					job.keys_ = grown;
+				}
+				job.keys_[job.count_++] = keys[j];
+			}
+			free(keys);
+		}
+		if (succeeded && job.mode_ == DUMP_RAW) {
+			job.sizes_ = (long long *) malloc(sizeof(long long) * (job.count_ + 1));
+			if (job.sizes_ == NULL) {
+				fprintf(stderr, "Fail to alloc memory for sizes.\n");
+				succeeded = false;
+			}
+			for (int i = 0; succeeded && i < job.count_; ++i)
+				job.sizes_[i] = -1;
+		}
+	}
+	if (!succeeded) {
+		freeKeys(job.keys_, job.count_);
+		if (job.sizes_)
+			free(job.sizes_);
+		return 1;
+	}
+	fprintf(stderr, "%d keys found in %.2fs.\n", job.count_, now() - start);
+
+	OGRRegisterAll();
+	pthread_mutex_init(&job.mutex_, NULL);
+	if (jobs > job.count_)
+		jobs = job.count_ > 0 ? job.count_ : 1;
+	pthread_t *threads = (pthread_t *) malloc(sizeof(pthread_t) * jobs);
+	int started = 0;
+	if (threads) {
+		while (started < jobs
+				&& pthread_create(&threads[started], NULL, dumpWorker, &job) == 0)
+			++started;
+	}
+	if (started == 0)
+		dumpWorker(&job);
+	for (int i = 0; i < started; ++i)
+		pthread_join(threads[i], NULL);
+	if (job.mode_ == DUMP_RAW && !writeManifest(&job))
+		succeeded = false;
+	double elapsed = now() - start;
+	if (elapsed <= 0)
+		elapsed = 1e-6;
+
+	// keys a worker never reached, e.g. when it could not connect.
+	int missed = job.count_ - job.done_;
+	fprintf(stderr, "%d keys, %d failed, %d not reached in %.2fs:"
+			" %.0f keys/s, %.2f MB/s\n", job.done_, job.failed_, missed,
+			elapsed, job.done_ / elapsed, job.bytes_ / elapsed / (1024 * 1024));
+
+	pthread_mutex_destroy(&job.mutex_);
+	if (threads)
+		free(threads);
+	freeKeys(job.keys_, job.count_);
+	if (job.sizes_)
+		free(job.sizes_);
+	return succeeded && job.failed_ == 0 && missed == 0 ? 0 : 1;
+}
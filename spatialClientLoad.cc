@@ -0,0 +1,502 @@
+/// @file spatialClientLoad.cc
+/// @author luliang@ict.ac.cn
+/// @copybrief Copyright 2013 ICT, CAS. All rights reserved.
+/// @version 0.1
+/// @date 2026-10-19
+
+// spatialclient-load: puts every layer of many vector datasets into redis.
+//
+//   spatialclient-load [-h host] [-p port] [-n db] [-j jobs] [-k prefix]
+//                      [-c checkpoint] [-i] [-f] path|glob ...
+//
+// a directory stands for the datasets under it. each of the jobs opens the
+// next dataset and streams its layers with putLayerStream on a connection
+// of its own; the layers are encoded on all cpus while being sent. the key
+// of a layer is prefix + the dataset name without extension, followed by
+// "/" + the layer name when the dataset has several layers. the name of a
+// dataset under a directory given is its path from that directory, e.g.
+// "a/roads", of another its file name. datasets of the same name, such as
+// roads.shp and roads.gpkg, are refused before anything is loaded. -i puts
+// the spatial index too, -f the fid index. datasets done are appended to the
+// checkpoint file, and skipped when the load is run again with the same file.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <glob.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include "ogrsf_frmts.h"
+
+#include "spatialClient.h"
+
+static const char *DATASET_EXTENSIONS[] = { "shp", "gpkg", "geojson", "json",
+		"kml", "gml", "tab", "mif", "sqlite", "csv", NULL };
+
+typedef struct {
+	char *path_;
+	const char *name_; // within path_, from the directory given
+} DatasetPath;
+
+typedef struct {
+	DatasetPath *paths_;
+	int count_;
+	int capacity_;
+} PathList;
+
+typedef struct {
+	const char *host_;
+	int port_;
+	int dbno_;
+	const char *prefix_;
+	int options_;
+
+	PathList *datasets_;
+	int next_;
+	FILE *checkpoint_;
+
+	// progress, all under the mutex.
+	pthread_mutex_t mutex_;
+	int done_;
+	int failed_;
+	int layers_;
+	long long features_;
+	long long bytes_;
+} LoadJob;
+
+static double now() {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+// nameoffset: where the name of the dataset starts in path.
+static bool addPath(PathList *list, const char *path, int nameoffset) {
+	if (list->count_ == list->capacity_) {
+		int capacity = list->capacity_ ? list->capacity_ * 2 : 64;
+		DatasetPath *paths = (DatasetPath *) realloc(list->paths_,
+				sizeof(DatasetPath) * capacity);
+		if (paths == NULL) {
+			fprintf(stderr, "Fail to alloc memory for paths.\n");
+			return false;
+		}
+		list->paths_ = paths;
+		list->capacity_ = capacity;
+	}
+	char *copy = strdup(path);
+	if (copy == NULL) {
+		fprintf(stderr, "Fail to alloc memory for paths.\n");
+		return false;
+	}
+	list->paths_[list->count_].path_ = copy;
+	list->paths_[list->count_].name_ = copy + nameoffset;
+	++list->count_;
+	return true;
+}
+
+static void freePaths(PathList *list) {
+	for (int i = 0; i < list->count_; ++i)
+		free(list->paths_[i].path_);
+	if (list->paths_)
+		free(list->paths_);
+	list->paths_ = NULL;
+	list->count_ = list->capacity_ = 0;
+}
+
+static int comparePaths(const void *a, const void *b) {
+	return strcmp(((const DatasetPath *) a)->path_,
+			((const DatasetPath *) b)->path_);
+}
+
+// a path found twice first by the name from the outer directory.
+static int compareFound(const void *a, const void *b) {
+	const DatasetPath *patha = (const DatasetPath *) a;
+	const DatasetPath *pathb = (const DatasetPath *) b;
+	int result = strcmp(patha->path_, pathb->path_);
+	if (result)
+		return result;
+	return (patha->name_ - patha->path_) - (pathb->name_ - pathb->path_);
+}
+
+// the length of the name of a dataset without its extension.
+static int datasetNameLength(const char *name) {
+	const char *base = strrchr(name, '/');
+	base = base ? base + 1 : name;
+	const char *dot = strrchr(base, '.');
+	return dot && dot != base ? dot - name : strlen(name);
+}
+
+static int compareNames(const void *a, const void *b) {
+	const char *namea = (*(const DatasetPath * const *) a)->name_;
+	const char *nameb = (*(const DatasetPath * const *) b)->name_;
+	int lengtha = datasetNameLength(namea);
+	int lengthb = datasetNameLength(nameb);
+	int result = strncmp(namea, nameb,
+			lengtha < lengthb ? lengtha : lengthb);
+	return result ? result : lengtha - lengthb;
+}
+
+static bool isDataset(const char *name) {
+	const char *dot = strrchr(name, '.');
+	if (dot == NULL)
+		return false;
+	for (int i = 0; DATASET_EXTENSIONS[i]; ++i) {
+		if (strcasecmp(dot + 1, DATASET_EXTENSIONS[i]) == 0)
+			return true;
+	}
+	return false;
+}
+
+// the datasets under a directory, at any depth, named from the directory
+// rootlength chars into their paths.
+static bool addDirectory(PathList *list, const char *dirpath, int rootlength) {
+	DIR *dir = opendir(dirpath);
+	if (dir == NULL) {
+		fprintf(stderr, "Can not open directory %s.\n", dirpath);
+		return false;
+	}
+	bool succeeded = true;
+	struct dirent *entry;
+	while (succeeded && (entry = readdir(dir)) != NULL) {
+		if (entry->d_name[0] == '.')
+			continue;
+		int length = strlen(dirpath) + strlen(entry->d_name) + 2;
+		char *path = (char *) malloc(length);
+		if (path == NULL) {
+			fprintf(stderr, "Fail to alloc memory for paths.\n");
+			succeeded = false;
+			break;
+		}
+		snprintf(path, length, "%s/%s", dirpath, entry->d_name);
+		struct stat st;
+		if (stat(path, &st) == 0) {
+			if (S_ISDIR(st.st_mode))
+				succeeded = addDirectory(list, path, rootlength);
+			else if (isDataset(entry->d_name))
+				succeeded = addPath(list, path, rootlength);
+		}
+		free(path);
+	}
+	closedir(dir);
+	return succeeded;
+}
+
+static bool addArgument(PathList *list, const char *pattern) {
+	glob_t matches;
+	int status = glob(pattern, 0, NULL, &matches);
+	if (status == GLOB_NOMATCH) {
+		fprintf(stderr, "No dataset matches %s.\n", pattern);
+		return true;
+	}
+	if (status != 0) {
+		fprintf(stderr, "Can not expand %s.\n", pattern);
+		return false;
+	}
+	bool succeeded = true;
+	for (size_t i = 0; succeeded && i < matches.gl_pathc; ++i) {
+		struct stat st;
+		const char *path = matches.gl_pathv[i];
+		const char *base = strrchr(path, '/');
+		if (stat(path, &st) == 0 && S_ISDIR(st.st_mode)) {
+			// "dir/" finds the same paths as "dir".
+			int length = strlen(path);
+			while (length > 1 && path[length - 1] == '/')
+				--length;
+			char *dirpath = strndup(path, length);
+			if (dirpath == NULL) {
+				fprintf(stderr, "Fail to alloc memory for paths.\n");
+				succeeded = false;
+				break;
+			}
+			succeeded = addDirectory(list, dirpath, length + 1);
+			free(dirpath);
+		} else
+			succeeded = addPath(list, path, base ? base + 1 - path : 0);
+	}
+	globfree(&matches);
+	return succeeded;
+}
+
+// the checkpoint holds one finished dataset path per line.
+static bool readCheckpoint(const char *filename, PathList *done) {
+	FILE *file = fopen(filename, "r");
+	if (file == NULL)
+		return true; // a first run.
+	char line[4096];
+	bool succeeded = true;
+	while (succeeded && fgets(line, sizeof(line), file)) {
+		int length = strlen(line);
+		while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r'))
+			line[--length] = '\0';
+		if (length > 0)
+			succeeded = addPath(done, line, 0);
+	}
+	fclose(file);
+	qsort(done->paths_, done->count_, sizeof(DatasetPath), comparePaths);
+	return succeeded;
+}
+
+// false, naming them, when two datasets would be put under the same keys.
+static bool checkNames(const PathList *datasets) {
+	if (datasets->count_ < 2)
+		return true;
+	const DatasetPath **sorted = (const DatasetPath **) malloc(
+			sizeof(DatasetPath *) * datasets->count_);
+	if (sorted == NULL) {
+		fprintf(stderr, "Fail to alloc memory for dataset names.\n");
+		return false;
+	}
+	for (int i = 0; i < datasets->count_; ++i)
+		sorted[i] = &datasets->paths_[i];
+	qsort(sorted, datasets->count_, sizeof(DatasetPath *), compareNames);
+	bool succeeded = true;
+	for (int i = 1; i < datasets->count_; ++i) {
+		// the same path given twice is loaded once.
+		if (compareNames(&sorted[i - 1], &sorted[i]) == 0
+				&& strcmp(sorted[i - 1]->path_, sorted[i]->path_) != 0) {
+			fprintf(stderr, "Datasets %s and %s have the same key %.*s.\n",
+					sorted[i - 1]->path_, sorted[i]->path_,
+					datasetNameLength(sorted[i]->name_), sorted[i]->name_);
+			succeeded = false;
+		}
+	}
+	free(sorted);
+	return succeeded;
+}
+
+static char *layerKey(const char *prefix, const DatasetPath &dataset,
+		OGRLayer *layer, int layercount) {
+	const char *name = dataset.name_;
+	int namelength = datasetNameLength(name);
+	const char *layername = layercount > 1 ? layer->GetName() : "";
+	int length = strlen(prefix) + namelength + strlen(layername) + 2;
+	char *key = (char *) malloc(length);
+	if (key == NULL) {
+		fprintf(stderr, "Fail to alloc memory for key.\n");
+		return NULL;
+	}
+	snprintf(key, length, "%s%.*s%s%s", prefix, namelength, name,
+			layercount > 1 ? "/" : "", layername);
+	return key;
+}
+
+static bool loadDataset(SpatialClient *client, LoadJob *job,
+		const DatasetPath &dataset, int *layers, long long *features) {
+	const char *path = dataset.path_;
+	OGRDataSource *datasource = OGRSFDriverRegistrar::Open(path, FALSE);
+	if (datasource == NULL) {
+		fprintf(stderr, "Can not open dataset %s.\n", path);
+		return false;
+	}
+	bool succeeded = true;
+	int layercount = datasource->GetLayerCount();
+	for (int i = 0; succeeded && i < layercount; ++i) {
+		OGRLayer *layer = datasource->GetLayer(i);
+		char *key = layer ? layerKey(job->prefix_, dataset, layer, layercount) : NULL;
+		if (key == NULL) {
+			succeeded = false;
+			break;
+		}
+		succeeded = client->putLayerStream(key, layer, job->options_);
+		if (succeeded) {
+			++*layers;
+			// only a count the driver knows without a scan.
+			int count = layer->GetFeatureCount(FALSE);
+			if (count > 0)
+				*features += count;
+		} else {
+			fprintf(stderr, "Fail to put layer %s of %s.\n", key, path);
+		}
+		free(key);
+	}
+	OGRDataSource::DestroyDataSource(datasource);
+	return succeeded;
+}
+
+static void *loadWorker(void *arg) {
+	LoadJob *job = (LoadJob *) arg;
+	SpatialClient client;
+	if (!client.connect(job->host_, job->port_, job->dbno_))
+		return NULL;
+
+	for (;;) {
+		pthread_mutex_lock(&job->mutex_);
+		int index = job->next_++;
+		pthread_mutex_unlock(&job->mutex_);
+		if (index >= job->datasets_->count_)
+			break;
+		const DatasetPath &dataset = job->datasets_->paths_[index];
+		const char *path = dataset.path_;
+
+		double start = now();
+		int layers = 0;
+		long long features = 0;
+		bool succeeded = loadDataset(&client, job, dataset, &layers,
+				&features);
+		struct stat st;
+		long long bytes = stat(path, &st) == 0 ? st.st_size : 0;
+
+		pthread_mutex_lock(&job->mutex_);
+		++job->done_;
+		job->layers_ += layers;
+		job->features_ += features;
+		if (succeeded) {
+			job->bytes_ += bytes;
+			if (job->checkpoint_) {
+				fprintf(job->checkpoint_, "%s\n", path);
+				fflush(job->checkpoint_);
+			}
+		} else {
+			++job->failed_;
+		}
+		fprintf(stderr, "[%d/%d] %s %s: %d layers, %lld features, %.2fs\n",
+				job->done_, job->datasets_->count_, succeeded ? "ok" : "FAILED",
+				path, layers, features, now() - start);
+		pthread_mutex_unlock(&job->mutex_);
+	}
+	return NULL;
+}
+
+static void usage(const char *program) {
+	fprintf(stderr,
+			"usage: %s [-h host] [-p port] [-n db] [-j jobs] [-k prefix]"
+					" [-c checkpoint] [-i] [-f] path|glob ...\n", program);
+}
+
+int main(int argc, char *argv[]) {
+	LoadJob job;
+	memset(&job, 0, sizeof(job));
+	job.host_ = "127.0.0.1";
+	job.port_ = 6379;
+	job.prefix_ = "";
+	job.options_ = PUT_DEFAULT;
+	int jobs = 4;
+	const char *checkpoint = NULL;
+
+	int option;
+	while ((option = getopt(argc, argv, "h:p:n:j:k:c:if")) != -1) {
+		switch (option) {
+		case 'h':
+			job.host_ = optarg;
+			break;
+		case 'p':
+			job.port_ = atoi(optarg);
+			break;
+		case 'n':
+			job.dbno_ = atoi(optarg);
+			break;
+		case 'j':
+			jobs = atoi(optarg);
+			break;
+		case 'k':
+			job.prefix_ = optarg;
+			break;
+		case 'c':
+			checkpoint = optarg;
+			break;
+		case 'i':
+			job.options_ |= PUT_SPATIAL_INDEX;
+			break;
+		case 'f':
+			job.options_ |= PUT_FID_INDEX;
+			break;
+		default:
+			usage(argv[0]);
+			return 2;
+		}
+	}
+	if (optind >= argc || jobs < 1) {
+		usage(argv[0]);
+		return 2;
+	}
+
+	PathList found;
+	memset(&found, 0, sizeof(found));
+	for (int i = optind; i < argc; ++i) {
+		if (!addArgument(&found, argv[i])) {
+			freePaths(&found);
+			return 1;
+		}
+	}
+	qsort(found.paths_, found.count_, sizeof(DatasetPath), compareFound);
+
+	PathList done, datasets;
+	memset(&done, 0, sizeof(done));
+	memset(&datasets, 0, sizeof(datasets));
+	bool succeeded = checkpoint == NULL || readCheckpoint(checkpoint, &done);
+	int skipped = 0;
+	for (int i = 0; succeeded && i < found.count_; ++i) {
+		// the same path given twice, or by two patterns, is loaded once.
+		if (i > 0 && comparePaths(&found.paths_[i], &found.paths_[i - 1]) == 0)
+			continue;
+		if (done.count_ > 0 && bsearch(&found.paths_[i], done.paths_,
+				done.count_, sizeof(DatasetPath), comparePaths)) {
+			++skipped;
+			continue;
+		}
+		succeeded = addPath(&datasets, found.paths_[i].path_,
+				found.paths_[i].name_ - found.paths_[i].path_);
+	}
+	// checked over every dataset found, loaded before or not.
+	succeeded = succeeded && checkNames(&found);
+	if (succeeded && checkpoint) {
+		job.checkpoint_ = fopen(checkpoint, "a");
+		if (job.checkpoint_ == NULL) {
+			fprintf(stderr, "Can not open checkpoint %s.\n", checkpoint);
+			succeeded = false;
+		}
+	}
+	if (!succeeded) {
+		freePaths(&found);
+		freePaths(&done);
+		freePaths(&datasets);
+		return 1;
+	}
+	fprintf(stderr, "%d datasets to load, %d done before.\n", datasets.count_,
+			skipped);
+
+	OGRRegisterAll();
+	job.datasets_ = &datasets;
+	pthread_mutex_init(&job.mutex_, NULL);
+	if (jobs > datasets.count_)
+		jobs = datasets.count_ > 0 ? datasets.count_ : 1;
+	pthread_t *threads = (pthread_t *) malloc(sizeof(pthread_t) * jobs);
+	int started = 0;
+	double start = now();
+	if (threads) {
+		while (started < jobs
+				&& pthread_create(&threads[started], NULL, loadWorker, &job) == 0)
+			++started;
+	}
+	if (started == 0)
+		loadWorker(&job);
+	for (int i = 0; i < started; ++i)
+		pthread_join(threads[i], NULL);
+	double elapsed = now() - start;
+	if (elapsed <= 0)
+		elapsed = 1e-6;
+
+	// datasets a worker never reached, e.g. when it could not connect.
+	int missed = datasets.count_ - job.done_;
+	fprintf(stderr,
+			"%d datasets, %d failed, %d not loaded, %d layers, %lld features in %.2fs:"
+					" %.1f datasets/s, %.0f features/s, %.2f MB/s\n",
+			job.done_, job.failed_, missed, job.layers_, job.features_,
+			elapsed, job.done_ / elapsed, job.features_ / elapsed,
+			job.bytes_ / elapsed / (1024 * 1024));
+
+	if (job.checkpoint_)
+		fclose(job.checkpoint_);
+	pthread_mutex_destroy(&job.mutex_);
+	if (threads)
+		free(threads);
+	freePaths(&found);
+	freePaths(&done);
+	freePaths(&datasets);
+	return job.failed_ > 0 || missed > 0 ? 1 : 0;
+}
@@ -0,0 +1,129 @@
+/// @file spatialCurve.cc
+/// @author luliang@ict.ac.cn
+/// @copybrief Copyright 2013 ICT, CAS. All rights reserved.
+/// @version 0.1
+/// @date 2026-10-19
+
+#include "spatialCurve.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef struct {
+	unsigned int code_;
+	int index_;
+} CurveItem;
+
+static int compareCurveItem(const void *a, const void *b) {
+	const CurveItem *ia = (const CurveItem *) a;
+	const CurveItem *ib = (const CurveItem *) b;
+	if (ia->code_ != ib->code_)
+		return ia->code_ < ib->code_ ? -1 : 1;
+	return ia->index_ - ib->index_;
+}
+
+static unsigned int interleave(unsigned int x) {
+	x &= 0xFFFF;
+	x = (x | (x << 8)) & 0x00FF00FF;
+	x = (x | (x << 4)) & 0x0F0F0F0F;
+	x = (x | (x << 2)) & 0x33333333;
+	x = (x | (x << 1)) & 0x55555555;
+	return x;
+}
+
+// branch free hilbert index of a 16 bit grid cell, see
+// http://threadlocalmutex.com/?p=126
+unsigned int hilbertCode(unsigned int x, unsigned int y) {
+	unsigned int a = x ^ y;
+	unsigned int b = 0xFFFF ^ a;
+	unsigned int c = 0xFFFF ^ (x | y);
+	unsigned int d = x & (y ^ 0xFFFF);
+
+	unsigned int A = a | (b >> 1);
+	unsigned int B = (a >> 1) ^ a;
+	unsigned int C = ((c >> 1) ^ (b & (d >> 1))) ^ c;
+	unsigned int D = ((a & (c >> 1)) ^ (d >> 1)) ^ d;
+
+	a = A;
+	b = B;
+	c = C;
+	d = D;
+	A = ((a & (a >> 2)) ^ (b & (b >> 2)));
+	B = ((a & (b >> 2)) ^ (b & ((a ^ b) >> 2)));
+	C ^= ((a & (c >> 2)) ^ (b & (d >> 2)));
+	D ^= ((b & (c >> 2)) ^ ((a ^ b) & (d >> 2)));
+
+	a = A;
+	b = B;
+	c = C;
+	d = D;
+	A = ((a & (a >> 4)) ^ (b & (b >> 4)));
+	B = ((a & (b >> 4)) ^ (b & ((a ^ b) >> 4)));
+	C ^= ((a & (c >> 4)) ^ (b & (d >> 4)));
+	D ^= ((b & (c >> 4)) ^ ((a ^ b) & (d >> 4)));
+
+	a = A;
+	b = B;
+	c = C;
+	d = D;
+	C ^= ((a & (c >> 8)) ^ (b & (d >> 8)));
+	D ^= ((b & (c >> 8)) ^ ((a ^ b) & (d >> 8)));
+
+	a = C ^ (C >> 1);
+	b = D ^ (D >> 1);
+
+	unsigned int i0 = x ^ y;
+	unsigned int i1 = b | (0xFFFF ^ (i0 | a));
+
+	return (interleave(i1) << 1) | interleave(i0);
+}
+
+unsigned int mortonCode(unsigned int x, unsigned int y) {
+	return (interleave(y) << 1) | interleave(x);
+}
+
+int *spatialOrder(const double *xs, const double *ys, int count,
+		SpatialCurveType curve) {
+	int *order = (int *) malloc(sizeof(int) * (count + 1));
+	CurveItem *items = (CurveItem *) malloc(sizeof(CurveItem) * (count + 1));
+	if (order == NULL || items == NULL) {
+		fprintf(stderr, "Fail to alloc memory for spatial order.\n");
+		if (order)
+			free(order);
+		if (items)
+			free(items);
+		return NULL;
+	}
+
+	double minx = 0, miny = 0, maxx = 0, maxy = 0;
+	for (int i = 0; i < count; ++i) {
+		if (i == 0 || xs[i] < minx)
+			minx = xs[i];
+		if (i == 0 || ys[i] < miny)
+			miny = ys[i];
+		if (i == 0 || xs[i] > maxx)
+			maxx = xs[i];
+		if (i == 0 || ys[i] > maxy)
+			maxy = ys[i];
+	}
+	double width = maxx - minx;
+	double height = maxy - miny;
+
+	for (int i = 0; i < count; ++i) {
+		unsigned int x = 0, y = 0;
+		if (width > 0)
+			x = (unsigned int) (65535.0 * (xs[i] - minx) / width);
+		if (height > 0)
+			y = (unsigned int) (65535.0 * (ys[i] - miny) / height);
+		items[i].code_ =
+				curve == CURVE_MORTON ? mortonCode(x, y) : hilbertCode(x, y);
+		items[i].index_ = i;
+	}
+	if (curve != CURVE_NONE)
+		qsort(items, count, sizeof(CurveItem), compareCurveItem);
+	for (int i = 0; i < count; ++i)
+		order[i] = items[i].index_;
+
+	free(items);
+	return order;
+}
@@ -0,0 +1,23 @@
+/// @file spatialCurve.h
+/// @author luliang@ict.ac.cn
+/// @copybrief Copyright 2013 ICT, CAS. All rights reserved.
+/// @version 0.1
+/// @date 2026-10-19
+
+#ifndef SPATIALCURVE_H_
+#define SPATIALCURVE_H_
+
+typedef enum {
+	CURVE_NONE = 0, CURVE_HILBERT = 1, CURVE_MORTON = 2
+} SpatialCurveType;
+
+// x and y are grid coordinates in [0, 65535].
+unsigned int hilbertCode(unsigned int x, unsigned int y);
+unsigned int mortonCode(unsigned int x, unsigned int y);
+
+// order of the points along the curve: order[i] is the index of the i-th
+// point. the result is malloc'ed, free() by caller.
+int *spatialOrder(const double *xs, const double *ys, int count,
+		SpatialCurveType curve);
+
+#endif /* SPATIALCURVE_H_ */
@@ -0,0 +1,333 @@
+/// @file spatialModule.cc
+/// @author luliang@ict.ac.cn
+/// @copybrief Copyright 2013 ICT, CAS. All rights reserved.
+/// @version 0.1
+/// @date 2026-10-19
+///
+/// Redis module answering layer queries inside the server, so that only
+/// the matching features leave it:
+///   SC.BBOX key indexkey logkey minx miny maxx maxy
+///   SC.FILTER key logkey where
+/// key holds a layer stored by SpatialClient::putLayer, indexkey and logkey
+/// its "key:rtree" and "key:log", named so that cluster routing and ACLs
+/// see every key read. SC.BBOX uses the index when there is one; both fail
+/// while the log holds changes. Both reply with an array of the
+/// LayerAllFeatures bytes and the LayerAllRecords bytes of the matches.
+/// Built as a shared object against redismodule.h of the redis sources and
+/// the sources of this project, and loaded with redis-server --loadmodule.
+
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <limits.h>
+
+extern "C" {
+#include "redismodule.h"
+}
+
+#include "layerDecoder.h"
+#include "layerSpatialIndex.h"
+#include "recordFilter.h"
+#include "wkbReader.h"
+
+// where the sections of a layer value start.
+typedef struct {
+	int attrdefoffset_;
+	int fieldcount_;
+	int featureoffset_; // first feature
+	int featurecount_;
+	int recordoffset_; // records header
+	int *offsets_; // of every feature, and the end of the last, free() by
+			// the user
+} LayerSections;
+
+static bool readInt(const char *bytes, size_t size, int offset, int *value) {
+	if (offset < 0 || (size_t) offset + sizeof(int) > size)
+		return false;
+	memcpy(value, bytes + offset, sizeof(int));
+	return true;
+}
+
+// checks the layout of a layer value and finds its features. every length
+// is checked against what is left of the value before it is used.
+static bool readSections(const char *bytes, size_t size,
+		LayerSections *sections) {
+	sections->offsets_ = NULL;
+	int metadatalength = 0, attrdeflength = 0, featurelength = 0;
+	if (size > INT_MAX || !checkLayerHead(bytes, (int) size, true))
+		return false;
+	int end = (int) size;
+	if (!readInt(bytes, size, LAYER_HEAD_SIZE, &metadatalength)
+			|| metadatalength < 0
+			|| metadatalength > end - LAYER_HEAD_SIZE - (int) (2 * sizeof(int)))
+		return false;
+	sections->attrdefoffset_ = LAYER_HEAD_SIZE + sizeof(int) + metadatalength;
+	if (!readInt(bytes, size, sections->attrdefoffset_, &attrdeflength)
+			|| attrdeflength < (int) sizeof(int)
+			|| attrdeflength
+					> end - sections->attrdefoffset_ - (int) sizeof(int)
+			|| !readInt(bytes, size, sections->attrdefoffset_ + sizeof(int),
+					&sections->fieldcount_) || sections->fieldcount_ < 0)
+		return false;
+	// a field takes its title length, a title of one char at least, its
+	// width, precision and type.
+	if (sections->fieldcount_
+			> (attrdeflength - (int) sizeof(int))
+					/ (int) (3 * sizeof(int) + 2 * sizeof(char)))
+		return false;
+	int offset = sections->attrdefoffset_ + sizeof(int) + attrdeflength;
+	if (!readInt(bytes, size, offset, &featurelength)
+			|| featurelength < (int) sizeof(int)
+			|| !readInt(bytes, size, offset + sizeof(int),
+					&sections->featurecount_) || sections->featurecount_ < 0)
+		return false;
+	sections->featureoffset_ = offset + 2 * sizeof(int);
+	// the records header follows the features.
+	if (featurelength > end - sections->featureoffset_ - (int) (3 * sizeof(int)))
+		return false;
+	sections->recordoffset_ = sections->featureoffset_ + featurelength;
+	// a record for every feature.
+	int recordcount = 0;
+	if (!readInt(bytes, size, sections->recordoffset_ + sizeof(int),
+			&recordcount) || recordcount != sections->featurecount_)
+		return false;
+
+	// the feature entries end sizeof(int) before the records.
+	sections->offsets_ = scanFeatureOffsets(bytes + sections->featureoffset_,
+			sections->featurecount_, featurelength - sizeof(int));
+	if (sections->offsets_ == NULL)
+		return false;
+	for (int i = 0; i <= sections->featurecount_; ++i)
+		sections->offsets_[i] += sections->featureoffset_;
+	return true;
+}
+
+// field titles and types, pointing into the value.
+static bool readFields(const char *bytes, size_t size,
+		const LayerSections &sections, const char **titles, char *types) {
+	int offset = sections.attrdefoffset_ + 2 * sizeof(int);
+	for (int i = 0; i < sections.fieldcount_; ++i) {
+		int titlelength = 0;
+		if (!readInt(bytes, size, offset, &titlelength) || titlelength <= 0)
+			return false;
+		offset += sizeof(titlelength);
+		if ((size_t) offset + titlelength + 2 * sizeof(int) + 1 > size
+				|| bytes[offset + titlelength - 1] != '\0')
+			return false;
+		titles[i] = bytes + offset;
+		offset += titlelength + 2 * sizeof(int);
+		types[i] = bytes[offset];
+		offset += sizeof(char);
+	}
+	return true;
+}
+
+static bool featureIntersects(const char *feature, int size,
+		const LayerEnvelope &box) {
+	if (size <= (int) (2 * sizeof(int)))
+		return false;
+	WkbReader reader(feature + 2 * sizeof(int), size - 2 * sizeof(int));
+	int type = reader.readHeader();
+	if (type < 0)
+		return false;
+	LayerEnvelope envelope = { DBL_MAX, DBL_MAX, -DBL_MAX, -DBL_MAX };
+	reader.readEnvelope(type, &envelope);
+	return !reader.failed() && envelope.minx_ <= box.maxx_
+			&& envelope.maxx_ >= box.minx_ && envelope.miny_ <= box.maxy_
+			&& envelope.maxy_ >= box.miny_;
+}
+
+static int compareInt(const void *a, const void *b) {
+	return *(const int *) a - *(const int *) b;
+}
+
+// replies with the features and records of rows.
+static int replySelection(RedisModuleCtx *ctx, const char *bytes,
+		size_t size, const LayerSections &sections, const int *rows,
+		int rowcount) {
+	int featurelength = 2 * sizeof(int);
+	for (int i = 0; i < rowcount; ++i)
+		featurelength += sections.offsets_[rows[i] + 1]
+				- sections.offsets_[rows[i]];
+	char *features = (char *) RedisModule_Alloc(featurelength);
+	int offset = 0;
+	memcpy(features + offset, &featurelength, sizeof(featurelength));
+	offset += sizeof(featurelength);
+	memcpy(features + offset, &rowcount, sizeof(rowcount));
+	offset += sizeof(rowcount);
+	for (int i = 0; i < rowcount; ++i) {
+		int start = sections.offsets_[rows[i]];
+		int size = sections.offsets_[rows[i] + 1] - start;
+		memcpy(features + offset, bytes + start, size);
+		offset += size;
+	}
+
+	// a layer value keeps its record length without the header.
+	int recordlength = 0;
+	char *records = RecordFilter::copyRows(bytes + sections.recordoffset_,
+			(int) size - sections.recordoffset_, rows, rowcount, &recordlength);
+	if (records == NULL) {
+		RedisModule_Free(features);
+		return RedisModule_ReplyWithError(ctx, "ERR malformed layer records");
+	}
+	RedisModule_ReplyWithArray(ctx, 2);
+	RedisModule_ReplyWithStringBuffer(ctx, features, featurelength);
+	RedisModule_ReplyWithStringBuffer(ctx, records, recordlength);
+	RedisModule_Free(features);
+	free(records);
+	return REDISMODULE_OK;
+}
+
+static const char *openLayer(RedisModuleCtx *ctx, RedisModuleString *name,
+		size_t *size) {
+	RedisModuleKey *key = (RedisModuleKey *) RedisModule_OpenKey(ctx, name,
+			REDISMODULE_READ);
+	if (RedisModule_KeyType(key) != REDISMODULE_KEYTYPE_STRING)
+		return NULL;
+	return RedisModule_StringDMA(key, size, REDISMODULE_READ);
+}
+
+// true while the log "key:log" holds changes of updateFeatureGeometry or
+// updateRecordField, which the value gets at compactLayer only.
+static bool hasChangeLog(RedisModuleCtx *ctx, RedisModuleString *logname) {
+	size_t size = 0;
+	return openLayer(ctx, logname, &size) != NULL && size > 0;
+}
+
+// SC.BBOX key indexkey logkey minx miny maxx maxy
+static int bboxCommand(RedisModuleCtx *ctx, RedisModuleString **argv,
+		int argc) {
+	if (argc != 8)
+		return RedisModule_WrongArity(ctx);
+	RedisModule_AutoMemory(ctx);
+	LayerEnvelope box;
+	if (RedisModule_StringToDouble(argv[4], &box.minx_) != REDISMODULE_OK
+			|| RedisModule_StringToDouble(argv[5], &box.miny_) != REDISMODULE_OK
+			|| RedisModule_StringToDouble(argv[6], &box.maxx_) != REDISMODULE_OK
+			|| RedisModule_StringToDouble(argv[7], &box.maxy_) != REDISMODULE_OK)
+		return RedisModule_ReplyWithError(ctx, "ERR invalid bbox");
+	if (hasChangeLog(ctx, argv[3]))
+		return RedisModule_ReplyWithError(ctx,
+				"ERR layer has logged changes, compact it first");
+
+	size_t size = 0;
+	const char *bytes = openLayer(ctx, argv[1], &size);
+	LayerSections sections;
+	if (bytes == NULL || !readSections(bytes, size, &sections))
+		return RedisModule_ReplyWithError(ctx, "ERR not a layer value");
+
+	int *rows = NULL;
+	int rowcount = 0;
+	size_t indexsize = 0;
+	const char *indexbytes = openLayer(ctx, argv[2], &indexsize);
+	LayerSpatialIndex *index = NULL;
+	if (indexbytes && indexsize <= INT_MAX) {
+		index = new LayerSpatialIndex(indexbytes, (int) indexsize);
+		// an index of another value, or a bad one, is read as none.
+		if (index->getIndexLength() != (int) indexsize
+				|| index->getItemCount() != sections.featurecount_) {
+			delete index;
+			index = NULL;
+		}
+	}
+	if (index) {
+		// item offsets back to rows.
+		int *items = NULL;
+		rowcount = index->search(box.minx_, box.miny_, box.maxx_, box.maxy_,
+				&items);
+		rows = (int *) malloc(sizeof(int) * (rowcount + 1));
+		if (rows == NULL)
+			rowcount = 0;
+		for (int i = 0; i < rowcount; ++i)
+			rows[i] = index->getItemOffset(items[i]);
+		free(items);
+		delete index;
+		qsort(rows, rowcount, sizeof(int), compareInt);
+		// items at no feature are dropped.
+		int row = 0, count = 0;
+		for (int i = 0; i < rowcount; ++i) {
+			while (row < sections.featurecount_
+					&& sections.offsets_[row] < rows[i])
+				++row;
+			if (row < sections.featurecount_
+					&& sections.offsets_[row] == rows[i])
+				rows[count++] = row;
+		}
+		rowcount = count;
+	} else {
+		rows = (int *) malloc(sizeof(int) * (sections.featurecount_ + 1));
+		for (int i = 0; rows && i < sections.featurecount_; ++i) {
+			if (featureIntersects(bytes + sections.offsets_[i],
+					sections.offsets_[i + 1] - sections.offsets_[i], box))
+				rows[rowcount++] = i;
+		}
+	}
+
+	int status = rows ?
+			replySelection(ctx, bytes, size, sections, rows, rowcount) :
+			RedisModule_ReplyWithError(ctx, "ERR out of memory");
+	free(rows);
+	free(sections.offsets_);
+	return status;
+}
+
+// SC.FILTER key logkey where
+static int filterCommand(RedisModuleCtx *ctx, RedisModuleString **argv,
+		int argc) {
+	if (argc != 4)
+		return RedisModule_WrongArity(ctx);
+	RedisModule_AutoMemory(ctx);
+	if (hasChangeLog(ctx, argv[2]))
+		return RedisModule_ReplyWithError(ctx,
+				"ERR layer has logged changes, compact it first");
+	size_t size = 0;
+	const char *bytes = openLayer(ctx, argv[1], &size);
+	LayerSections sections;
+	if (bytes == NULL || !readSections(bytes, size, &sections))
+		return RedisModule_ReplyWithError(ctx, "ERR not a layer value");
+
+	const char **titles = (const char **) RedisModule_Alloc(
+			sizeof(char *) * (sections.fieldcount_ + 1));
+	char *types = (char *) RedisModule_Alloc(sections.fieldcount_ + 1);
+	int status;
+	RecordFilter filter;
+	if (!readFields(bytes, size, sections, titles, types)) {
+		status = RedisModule_ReplyWithError(ctx, "ERR not a layer value");
+	} else if (!filter.compile(RedisModule_StringPtrLen(argv[3], NULL), titles,
+			types, sections.fieldcount_)) {
+		status = RedisModule_ReplyWithError(ctx, "ERR invalid filter");
+	} else {
+		int *rows = NULL;
+		int rowcount = filter.select(bytes + sections.recordoffset_,
+				(int) size - sections.recordoffset_, &rows);
+		if (rowcount < 0) {
+			status = RedisModule_ReplyWithError(ctx,
+					"ERR malformed layer records");
+		} else {
+			status = replySelection(ctx, bytes, size, sections, rows,
+					rowcount);
+			free(rows);
+		}
+	}
+	RedisModule_Free(titles);
+	RedisModule_Free(types);
+	free(sections.offsets_);
+	return status;
+}
+
+extern "C" int RedisModule_OnLoad(RedisModuleCtx *ctx, RedisModuleString **argv,
+		int argc) {
+	(void) argv;
+	(void) argc;
+	if (RedisModule_Init(ctx, "spatialclient", 1, REDISMODULE_APIVER_1)
+			== REDISMODULE_ERR)
+		return REDISMODULE_ERR;
+	// every key read is an argument: the value, its index and its log.
+	if (RedisModule_CreateCommand(ctx, "sc.bbox", bboxCommand, "readonly", 1,
+			3, 1) == REDISMODULE_ERR)
+		return REDISMODULE_ERR;
+	if (RedisModule_CreateCommand(ctx, "sc.filter", filterCommand, "readonly",
+			1, 2, 1) == REDISMODULE_ERR)
+		return REDISMODULE_ERR;
+	return REDISMODULE_OK;
+}
@@ -0,0 +1,145 @@
+/// @file wkbReader.cc
+/// @author luliang@ict.ac.cn
+/// @copybrief Copyright 2013 ICT, CAS. All rights reserved.
+/// @version 0.1
+/// @date 2026-10-19
+
+#include "wkbReader.h"
+
+#include <string.h>
+
+static bool littleEndian() {
+	unsigned int one = 1;
+	return *(const unsigned char *) &one == 1;
+}
+
+WkbReader::WkbReader(const char *wkb, int size) :
+		wkb_((const unsigned char *) wkb), size_(size), offset_(0), swap_(
+				false), dimension_(2), failed_(wkb == 0 || size < 0) {
+}
+
+int WkbReader::readHeader() {
+	if (failed_ || offset_ + 5 > size_) {
+		failed_ = true;
+		return -1;
+	}
+	// 1 is NDR (little endian), 0 is XDR.
+	bool ndr = wkb_[offset_] == 1;
+	swap_ = ndr != littleEndian();
+	++offset_;
+
+	unsigned int type = readUInt32();
+	dimension_ = 2;
+	if (type & 0x80000000) {
+		// 25D
+		dimension_ = 3;
+		type &= ~0x80000000;
+	}
+	if (type >= 3000) {
+		dimension_ = 4;
+		type -= 3000;
+	} else if (type >= 2000) {
+		dimension_ = 3;
+		type -= 2000;
+	} else if (type >= 1000) {
+		dimension_ = 3;
+		type -= 1000;
+	}
+	if (type < 1 || type > 7) {
+		failed_ = true;
+		return -1;
+	}
+	return (int) type;
+}
+
+unsigned int WkbReader::readCount() {
+	unsigned int count = readUInt32();
+	// every counted item takes at least 4 bytes.
+	if (count > (unsigned int) (size_ - offset_) / 4 + 1)
+		failed_ = true;
+	return failed_ ? 0 : count;
+}
+
+void WkbReader::readPoint(double *x, double *y) {
+	*x = readDouble();
+	*y = readDouble();
+	for (int i = 2; i < dimension_; ++i)
+		readDouble();
+}
+
+void WkbReader::readEnvelope(int type, LayerEnvelope *envelope) {
+	unsigned int count = type == 1 ? 1 : readCount();
+	for (unsigned int i = 0; i < count && !failed_; ++i) {
+		if (type == 1 || type == 2) {
+			double x, y;
+			readPoint(&x, &y);
+			if (x != x || y != y)
+				continue;
+			if (x < envelope->minx_)
+				envelope->minx_ = x;
+			if (y < envelope->miny_)
+				envelope->miny_ = y;
+			if (x > envelope->maxx_)
+				envelope->maxx_ = x;
+			if (y > envelope->maxy_)
+				envelope->maxy_ = y;
+		} else if (type == 3) {
+			// a ring is read as a linestring.
+			readEnvelope(2, envelope);
+		} else {
+			int parttype = readHeader();
+			if (parttype < 0)
+				return;
+			readEnvelope(parttype, envelope);
+		}
+	}
+}
+
+bool WkbReader::failed() const {
+	return failed_;
+}
+
+int WkbReader::getOffset() const {
+	return offset_;
+}
+
+unsigned int WkbReader::readUInt32() {
+	if (failed_ || offset_ + 4 > size_) {
+		failed_ = true;
+		return 0;
+	}
+	unsigned char bytes[4];
+	memcpy(bytes, wkb_ + offset_, 4);
+	offset_ += 4;
+	if (swap_) {
+		unsigned char temp = bytes[0];
+		bytes[0] = bytes[3];
+		bytes[3] = temp;
+		temp = bytes[1];
+		bytes[1] = bytes[2];
+		bytes[2] = temp;
+	}
+	unsigned int value;
+	memcpy(&value, bytes, 4);
+	return value;
+}
+
+double WkbReader::readDouble() {
+	if (failed_ || offset_ + 8 > size_) {
+		failed_ = true;
+		return 0;
+	}
+	unsigned char bytes[8];
+	memcpy(bytes, wkb_ + offset_, 8);
+	offset_ += 8;
+	if (swap_) {
+		for (int i = 0; i < 4; ++i) {
+			unsigned char temp = bytes[i];
+			bytes[i] = bytes[7 - i];
+			bytes[7 - i] = temp;
+		}
+	}
+	double value;
+	memcpy(&value, bytes, 8);
+	return value;
+}
@@ -0,0 +1,43 @@
+/// @file wkbReader.h
+/// @author luliang@ict.ac.cn
+/// @copybrief Copyright 2013 ICT, CAS. All rights reserved.
+/// @version 0.1
+/// @date 2026-10-19
+
+#ifndef WKBREADER_H_
+#define WKBREADER_H_
+
+#include "layerSpatialIndex.h"
+
+// Cursor over the WKB of a LayerFeature, for walking geometries without
+// building OGRGeometry objects. Both byte orders and the 25D and ISO Z/M
+// type codes are understood; only x and y are returned.
+class WkbReader {
+public:
+	WkbReader(const char *wkb, int size);
+
+	// byte order and type of the next (sub)geometry: returns the flat type
+	// (1 point ... 7 geometry collection) or -1 on malformed input.
+	int readHeader();
+	unsigned int readCount();
+	void readPoint(double *x, double *y);
+	// grows envelope by the points of a geometry of type, whose header is
+	// read. the NaN of empty points are left out.
+	void readEnvelope(int type, LayerEnvelope *envelope);
+
+	bool failed() const;
+	int getOffset() const;
+
+private:
+	unsigned int readUInt32();
+	double readDouble();
+
+	const unsigned char *wkb_;
+	int size_;
+	int offset_;
+	bool swap_;
+	int dimension_;
+	bool failed_;
+};
+
+#endif /* WKBREADER_H_ */